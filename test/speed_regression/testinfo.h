@@ -64,8 +64,10 @@ struct testinfo {
 			"Writing",
 			"Compressing",
 			"Uncompressing",
-			"Snappy-blocks",
+			"Compressed-blocks",
 			"None-blocks",
+			"Skipped-blocks",
+			"Probe-blocks",
 			NULL};
 		for (size_t i = 0; labels[i]; ++i) {
 			m_sysinfo.printinfo(labels[i], get_user(i));
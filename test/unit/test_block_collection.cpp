@@ -28,6 +28,8 @@
 #include <algorithm>
 #include <tpie/file_accessor/file_accessor.h>
 #include <list>
+#include <thread>
+#include <atomic>
 
 using namespace tpie;
 using namespace tpie::blocks;
@@ -195,9 +197,44 @@ bool overwrite() {
 	return true;
 }
 
+bool concurrent_read() {
+	temp_file file;
+	block_collection collection(file.path(), BLOCK_SIZE, true);
+	std::vector<block_handle> blocks;
+
+	for(char i = 0; i < 64; ++i) {
+		block_handle handle = collection.get_free_block();
+		block b(handle.size);
+		for(block::iterator j = b.begin(); j != b.end(); ++j)
+			*j = i;
+		collection.write_block(handle, b);
+		blocks.push_back(handle);
+	}
+
+	// Reads use positional I/O, so several threads may share the file.
+	std::atomic<size_t> errors(0);
+	std::vector<std::thread> threads;
+	for(size_t t = 0; t < 4; ++t) {
+		threads.push_back(std::thread([&, t]() {
+			for(size_t k = 0; k < 10 * blocks.size(); ++k) {
+				size_t i = random(k + t) % blocks.size();
+				block b;
+				collection.read_block(blocks[i], b);
+				for(block::iterator j = b.begin(); j != b.end(); ++j)
+					if(*j != (char) i) { ++errors; break; }
+			}
+		}));
+	}
+	for(size_t t = 0; t < threads.size(); ++t) threads[t].join();
+
+	TEST_ENSURE_EQUALITY(0, (size_t) errors, "concurrent reads returned wrong contents");
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(basic, "basic")
 		.test(erase, "erase")
-		.test(overwrite, "overwrite");
+		.test(overwrite, "overwrite")
+		.test(concurrent_read, "concurrent_read");
 }
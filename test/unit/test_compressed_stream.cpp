@@ -19,7 +19,10 @@
 
 #include "common.h"
 #include <tpie/compressed/stream.h>
+#include <tpie/compressed/controller.h>
 #include <tpie/file_stream.h>
+#include <algorithm>
+#include <cmath>
 
 template <tpie::compression_flags flags>
 class tests {
@@ -293,6 +296,34 @@ static bool position_seek_test() {
 	return true;
 }
 
+static bool position_forward_test() {
+	tpie::temp_file tf;
+	tpie::file_stream<size_t> s;
+	s.open(tf, tpie::access_read_write, 0, tpie::access_sequential, flags);
+	tpie::stream_position p2;
+	tpie::stream_position p5;
+	for (size_t i = 0; i < 10; ++i) {
+		if (i == 2) p2 = s.get_position();
+		if (i == 5) p5 = s.get_position();
+		s.write(i);
+	}
+	s.set_position(p2);
+	s.read();
+	// Skip ahead within the block after reads have been cached
+	s.set_position(p5);
+	for (size_t i = 5; i < 10; ++i) {
+		if (s.read() != i) {
+			tpie::log_error() << "Bad read in position " << i << std::endl;
+			return false;
+		}
+	}
+	if (s.can_read()) {
+		tpie::log_error() << "can_read() after reading the last item" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 #define TEST_ASSERT(cond) \
 	do { \
 		if (!(cond)) { \
@@ -992,6 +1023,212 @@ bool stack_test() {
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Get the compression scheme recorded in each block of a compressed stream.
+/// Each block is framed by a 32-bit header and an identical trailer holding
+/// the compressed size in the low 24 bits and the scheme in the high 8 bits.
+///////////////////////////////////////////////////////////////////////////////
+std::vector<tpie::compression_scheme::type> block_schemes(const std::string & path, double blockFactor) {
+	tpie::file_accessor::byte_stream_accessor<tpie::default_raw_file_accessor> accessor;
+	accessor.open(path, true, false, sizeof(size_t),
+				  tpie::file_stream<size_t>::block_size(blockFactor), 0,
+				  tpie::access_sequential, tpie::compression_normal);
+	std::vector<tpie::compression_scheme::type> result;
+	tpie::stream_size_type offset = 0;
+	while (offset < accessor.file_size()) {
+		tpie::uint32_t header;
+		accessor.read(offset, &header, sizeof(header));
+		result.push_back(static_cast<tpie::compression_scheme::type>(header >> 24));
+		offset += sizeof(header) + (header & ((1 << 24) - 1)) + sizeof(header);
+	}
+	return result;
+}
+
+bool mixed_scheme_test(size_t n) {
+	struct scheme_t {
+		tpie::open::type flags;
+		tpie::compression_scheme::type scheme;
+		const char * name;
+	};
+	const scheme_t schemes[] = {
+		{tpie::open::defaults, tpie::compression_scheme::snappy, "preferred (snappy)"},
+		{tpie::open::scheme_snappy, tpie::compression_scheme::snappy, "snappy"},
+		{tpie::open::scheme_lz4, tpie::compression_scheme::lz4, "lz4"},
+		{tpie::open::scheme_zstd | tpie::open::compression_level(1), tpie::compression_scheme::zstd, "zstd level 1"},
+		{tpie::open::scheme_zstd | tpie::open::compression_level(19), tpie::compression_scheme::zstd, "zstd level 19"}
+	};
+	const size_t schemeCount = sizeof(schemes) / sizeof(schemes[0]);
+	auto bof = tpie::file_stream<size_t>::calculate_block_factor(1024);
+	tpie::temp_file tf;
+	std::vector<tpie::compression_scheme::type> expected;
+	for (size_t i = 0; i < schemeCount; ++i) {
+		// Blocks written with a scheme that is not built in are stored
+		// uncompressed.
+		tpie::compression_scheme::type scheme = schemes[i].scheme;
+		if (!tpie::compression_scheme_available(scheme)) {
+			tpie::log_warning() << "Not testing " << schemes[i].name
+								<< ": the library was not found when TPIE was built" << std::endl;
+			scheme = tpie::compression_scheme::none;
+		}
+		if (expected.empty() || expected.back() != scheme) expected.push_back(scheme);
+
+		tpie::file_stream<size_t> s(bof);
+		s.open(tf, tpie::open::compression_all | schemes[i].flags);
+		s.seek(0, tpie::file_stream_base::end);
+		for (size_t j = 0; j < n; ++j) s.write(i * n + j);
+	}
+
+	// The last block of each part is rewritten by the next part, so the
+	// runs of blocks with the same scheme must follow the expected order.
+	std::vector<tpie::compression_scheme::type> actual = block_schemes(tf.path(), bof);
+	actual.erase(std::unique(actual.begin(), actual.end()), actual.end());
+	if (actual != expected) {
+		tpie::log_error() << "Block schemes were";
+		for (size_t i = 0; i < actual.size(); ++i) tpie::log_error() << ' ' << actual[i];
+		tpie::log_error() << ", expected";
+		for (size_t i = 0; i < expected.size(); ++i) tpie::log_error() << ' ' << expected[i];
+		tpie::log_error() << std::endl;
+		return false;
+	}
+
+	tpie::file_stream<size_t> s(bof);
+	s.open(tf, tpie::open::read_only);
+	TEST_ASSERT(s.size() == schemeCount * n);
+	for (size_t i = 0; i < schemeCount * n; ++i) {
+		size_t x = s.read();
+		if (x != i) {
+			tpie::log_error() << "Read " << x << " at " << i << std::endl;
+			return false;
+		}
+	}
+	for (size_t i = schemeCount * n; i--;) {
+		size_t x = s.read_back();
+		if (x != i) {
+			tpie::log_error() << "Read back " << x << " at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool adaptive_controller_test() {
+	const tpie::compression_scheme::type snappy = tpie::compression_scheme::snappy;
+	const tpie::compression_scheme::type none = tpie::compression_scheme::none;
+	const tpie::memory_size_type mb = 1024*1024;
+	{
+		// Fast disk and incompressible data: skip compression,
+		// but probe periodically.
+		tpie::compression_controller c;
+		tpie::compression_stream_statistics s;
+		TEST_ASSERT(c.choose(s, snappy) == snappy);
+		c.record_compression(s, snappy, mb, mb, 1.0 / 200);
+		TEST_ASSERT(!c.record_write(&s, mb, 1.0 / 4000));
+		c.record_sync(&s, 1.0 / 4000);
+		size_t compressed = 0;
+		for (size_t i = 0; i < 10 * c.probe_interval(); ++i)
+			if (c.choose(s, snappy) == snappy) ++compressed;
+		TEST_ASSERT(compressed == 10);
+	}
+	{
+		// Slow disk and compressible data: always compress.
+		tpie::compression_controller c;
+		tpie::compression_stream_statistics s;
+		c.record_compression(s, snappy, mb, mb / 4, 1.0 / 200);
+		TEST_ASSERT(!c.record_write(&s, mb, 1.0 / 10000));
+		c.record_sync(&s, 1.0 / 100);
+		for (size_t i = 0; i < 10 * c.probe_interval(); ++i)
+			TEST_ASSERT(c.choose(s, snappy) == snappy);
+	}
+	{
+		// Writes are measured in windows ended by a sync, and only one
+		// file is measured at a time.
+		tpie::compression_controller c;
+		int a, b;
+		const tpie::memory_size_type window = c.window_bytes();
+		TEST_ASSERT(!c.record_write(&a, window / 2, 1.0 / 1000));
+		TEST_ASSERT(!c.record_write(&b, window, 1.0 / 1000));
+		TEST_ASSERT(c.record_write(&a, window / 2, 1.0 / 1000));
+		TEST_ASSERT(c.disk_speed() == 0.0);
+		c.record_sync(&a, 1.0 - 2.0 / 1000);
+		TEST_ASSERT(std::abs(c.disk_speed() - window) < 1.0);
+		// The next window starts after window_interval seconds.
+		TEST_ASSERT(!c.record_write(&b, window, 1.0 / 1000));
+	}
+	{
+		// Streams opened without compression are never compressed.
+		tpie::compression_controller c;
+		tpie::compression_stream_statistics s;
+		TEST_ASSERT(c.choose(s, none) == none);
+	}
+	return true;
+}
+
+bool thread_pool_test(size_t threads, size_t n) {
+	tpie::set_compressor_thread_count(threads);
+	if (tpie::the_compressor_thread().thread_count() != threads) {
+		tpie::log_error() << "Compressor pool has "
+			<< tpie::the_compressor_thread().thread_count()
+			<< " threads, expected " << threads << std::endl;
+		return false;
+	}
+	const size_t streams = 8;
+	auto bof = tpie::file_stream<size_t>::calculate_block_factor(1024);
+	tpie::array<tpie::unique_ptr<tpie::file_stream<size_t> > > fs(streams);
+	for (size_t j = 0; j < streams; ++j) {
+		fs[j].reset(tpie::tpie_new<tpie::file_stream<size_t> >(bof));
+		fs[j]->open(tpie::compression_all);
+	}
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < streams; ++j)
+			fs[j]->write(i * streams + j);
+	for (size_t j = 0; j < streams; ++j) fs[j]->seek(0);
+	bool result = true;
+	for (size_t i = 0; i < n && result; ++i) {
+		for (size_t j = 0; j < streams; ++j) {
+			size_t x = fs[j]->read();
+			if (x != i * streams + j) {
+				tpie::log_error() << "Stream " << j << " read " << x
+					<< " at " << i << ", expected " << i * streams + j << std::endl;
+				result = false;
+				break;
+			}
+		}
+	}
+	for (size_t j = 0; j < streams; ++j) fs[j].reset();
+	tpie::set_compressor_thread_count(tpie::default_compressor_thread_count());
+	return result;
+}
+
+bool thread_pool_single_stream_test(size_t threads, size_t n) {
+	// Many small blocks of one stream, so that several blocks of the stream
+	// are compressed by different workers at the same time.
+	tpie::set_compressor_thread_count(threads);
+	bool result = true;
+	{
+		auto bof = tpie::file_stream<size_t>::calculate_block_factor(4096);
+		tpie::file_stream<size_t> fs(bof);
+		fs.open(tpie::compression_all);
+		for (size_t i = 0; i < n; ++i) fs.write(i);
+		fs.seek(0);
+		for (size_t i = 0; i < n && result; ++i) {
+			size_t x = fs.read();
+			if (x != i) {
+				tpie::log_error() << "Read " << x << " at " << i << std::endl;
+				result = false;
+			}
+		}
+		for (size_t i = n; i-- > 0 && result;) {
+			size_t x = fs.read_back();
+			if (x != i) {
+				tpie::log_error() << "Read back " << x << " at " << i << std::endl;
+				result = false;
+			}
+		}
+	}
+	tpie::set_compressor_thread_count(tpie::default_compressor_thread_count());
+	return result;
+}
+
 template <tpie::compression_flags flags>
 tpie::tests & add_tests(tpie::tests & t, std::string suffix) {
 	typedef tests<flags> T;
@@ -1018,6 +1255,7 @@ tpie::tests & add_tests(tpie::tests & t, std::string suffix) {
 		.test(T::position_test_8, "position_8" + suffix)
 		.test(T::position_test_9, "position_9" + suffix)
 		.test(T::position_seek_test, "position_seek" + suffix)
+		.test(T::position_forward_test, "position_forward" + suffix)
 		.test(T::uncompressed_test, "uncompressed" + suffix, "n", static_cast<size_t>(1000000))
 		.test(T::uncompressed_new_test, "uncompressed_new" + suffix, "n", static_cast<size_t>(1000000))
 		.test(T::backwards_test, "backwards" + suffix, "n", static_cast<size_t>(1 << 23))
@@ -1034,5 +1272,9 @@ int main(int argc, char ** argv) {
 		.test(write_peek_test, "write_peek", "n", static_cast<size_t>(1 << 23))
 		/* .test(read_only_test, "read_only") */
 		.test(write_only_test, "write_only")
-		.test(stack_test, "lockstep_reverse");
+		.test(stack_test, "lockstep_reverse")
+		.test(adaptive_controller_test, "adaptive_controller")
+		.test(mixed_scheme_test, "mixed_scheme", "n", static_cast<size_t>(10000))
+		.test(thread_pool_test, "thread_pool", "t", static_cast<size_t>(4), "n", static_cast<size_t>(100000))
+		.test(thread_pool_single_stream_test, "thread_pool_single", "t", static_cast<size_t>(4), "n", static_cast<size_t>(1000000));
 }
@@ -289,6 +289,98 @@ bool remove_group_buffer_test(memory_size_type mmAvail, memory_size_type blockSi
 	return cyclic_pq_test(pq, items, iterations);
 }
 
+template <typename T>
+bool block_reuse_test(memory_size_type mmAvail, memory_size_type blockSize, stream_size_type items, stream_size_type rounds) {
+	const float blockFact = (float) blockSize / (1<<21);
+	ami::priority_queue<T, std::greater<T> > pq(mmAvail, blockFact);
+	stream_size_type usage = 0;
+	for(stream_size_type round = 0; round < rounds; ++round) {
+		for(stream_size_type i = 0; i < items; ++i) pq.push(static_cast<T>((i * 7919) % items));
+		for(stream_size_type i = 0; i < items; ++i) {
+			if(pq.top() != static_cast<T>(items - 1 - i)) {
+				log_error() << "Wrong item " << pq.top() << " in round " << round << endl;
+				return false;
+			}
+			pq.pop();
+		}
+		// Blocks freed in the first round must be reused by the later rounds.
+		if(round == 0) usage = get_temp_file_usage();
+		else if(get_temp_file_usage() > 2*usage) {
+			log_error() << "Temporary file grew from " << usage << " to "
+						<< get_temp_file_usage() << " bytes" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// With direct I/O enabled for temporary files, the blocks of the slots and
+// group buffers must bypass the page cache, and freed blocks must still be
+// reused.
+bool direct_io_test() {
+	bool supported;
+	{
+		temp_file tmp;
+		file_accessor::raw_file_accessor f;
+		f.set_direct_io(true);
+		f.open_rw_new(tmp.path());
+		supported = f.direct_io_active();
+		f.close_i();
+	}
+	if (!supported) {
+		log_info() << "The temporary directory does not support direct I/O" << endl;
+		return true;
+	}
+	const stream_size_type directBefore = get_bytes_direct_io();
+	tempname::set_direct_io(true);
+	bool result = block_reuse_test<uint64_t>(1<<20, 1<<12, 200000, 2);
+	tempname::set_direct_io(false);
+	TEST_ENSURE(result, "Wrong output with direct I/O");
+	TEST_ENSURE(get_bytes_direct_io() > directBefore, "The blocks did not use direct I/O");
+	return true;
+}
+
+bool batch_test(memory_size_type mmAvail, memory_size_type blockSize, stream_size_type iterations) {
+	const float blockFact = (float) blockSize / (1<<21);
+	ami::priority_queue<uint64_t, bit_pertume_compare< std::greater<uint64_t> > > pq(mmAvail, blockFact);
+	std::priority_queue<uint64_t, std::vector<uint64_t>, bit_pertume_compare<std::less<uint64_t> > > pq2;
+	std::default_random_engine rnd;
+	std::vector<uint64_t> items;
+	pq.push_batch(items);
+	if(!pq.empty()) {
+		log_error() << "Empty batch changed the size" << endl;
+		return false;
+	}
+	for(stream_size_type i = 0; i < iterations; ++i) {
+		items.resize(rnd() % 5000);
+		// push more than we pop in the first half and the opposite in the second half
+		memory_size_type popCount = rnd() % (i < iterations / 2 ? 3000 : 8000);
+		for(size_t j = 0; j < items.size(); ++j) {
+			items[j] = rnd();
+			pq2.push(items[j]);
+		}
+		pq.push_batch(items);
+		items.clear();
+		memory_size_type popped = pq.pop_batch(popCount, std::back_inserter(items));
+		if(popped != items.size() || popped != std::min<stream_size_type>(popCount, pq2.size())) {
+			log_error() << "Popped " << popped << " of " << popCount << " items" << endl;
+			return false;
+		}
+		for(size_t j = 0; j < items.size(); ++j) {
+			if(items[j] != pq2.top()) {
+				log_error() << "Wrong item " << items[j] << ", expected " << pq2.top() << endl;
+				return false;
+			}
+			pq2.pop();
+		}
+		if(pq.size() != pq2.size()) {
+			log_error() << "Size differs " << pq.size() << " " << pq2.size() << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv, 128)
 		.test(basic_test, "basic")
@@ -304,5 +396,15 @@ int main(int argc, char **argv) {
 			  "blocksize", static_cast<memory_size_type>(1<<9),
 			  "items", static_cast<stream_size_type>(5000),
 			  "iterations", static_cast<stream_size_type>(100000))
+		.test(block_reuse_test<uint64_t>, "block_reuse",
+			  "mmavail", static_cast<memory_size_type>((1<<14) + (1<<13) + (1<<10) + (1<<7)),
+			  "blocksize", static_cast<memory_size_type>(1<<9),
+			  "items", static_cast<stream_size_type>(50000),
+			  "rounds", static_cast<stream_size_type>(4))
+		.test(direct_io_test, "direct_io")
+		.test(batch_test, "batch",
+			  "mmavail", static_cast<memory_size_type>(1<<20),
+			  "blocksize", static_cast<memory_size_type>(1<<12),
+			  "iterations", static_cast<stream_size_type>(200))
 		;
 }
@@ -18,6 +18,9 @@
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 #include "common.h"
 #include <tpie/internal_priority_queue.h>
+#include <tpie/radix_heap.h>
+#include <queue>
+#include <random>
 #include <vector>
 #include "priority_queue.h"
 
@@ -53,6 +56,60 @@ bool large_cycle(){
 	return cyclic_pq_test(pq, x, 20000000);
 }
 
+template <memory_size_type D>
+bool dary_test() {
+	size_t z = 104729;
+	internal_priority_queue<uint64_t, bit_pertume_compare<std::greater<uint64_t> >, dary_heap<D> > pq(z);
+	// The children of the root start a cache line.
+	if (reinterpret_cast<size_t>(&pq.top() + 1) % 64 != 0) {
+		tpie::log_error() << "Children of the root are not aligned" << std::endl;
+		return false;
+	}
+	return basic_pq_test(pq, z);
+}
+
+bool radix_heap_test() {
+	const size_t z = 100000;
+	radix_heap<uint32_t> pq(z);
+	std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t> > pq2;
+	std::default_random_engine rnd;
+	uint32_t last = 0;
+	for (size_t round = 0; round < 4; ++round) {
+		for (size_t i = 0; i < 10*z; ++i) {
+			// Only push keys that are not less than the last top
+			if (pq.size() < z && (pq.empty() || rnd() % 3 != 0)) {
+				uint32_t x = last + rnd() % (1u << (rnd() % 24));
+				pq.push(x);
+				pq2.push(x);
+				continue;
+			}
+			if (pq.top() != pq2.top()) {
+				tpie::log_error() << "Got " << pq.top() << " expected " << pq2.top() << std::endl;
+				return false;
+			}
+			last = pq.top();
+			pq.pop();
+			pq2.pop();
+		}
+		while (!pq.empty()) {
+			if (pq.top() != pq2.top() || pq.size() != pq2.size()) return false;
+			pq.pop();
+			pq2.pop();
+		}
+		pq.clear();
+		last = 0;
+	}
+	radix_heap<int, std::greater<int> > signedHeap(16);
+	const int items[] = {5, -3, 17, 5, -100, 0};
+	for (int x : items) signedHeap.push(x);
+	const int expected[] = {17, 5, 5, 0, -3, -100};
+	for (int x : expected) {
+		if (signedHeap.top() != x) return false;
+		signedHeap.pop();
+	}
+	return signedHeap.empty();
+}
+
 class my_memory_test: public memory_test {
 public:
 	internal_priority_queue<int> * a;
@@ -65,5 +122,8 @@ int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(basic_test, "basic")
 		.test(large_cycle, "large_cycle")
-		.test(my_memory_test(), "memory");
+		.test(my_memory_test(), "memory")
+		.test(dary_test<4>, "dary4")
+		.test(dary_test<8>, "dary8")
+		.test(radix_heap_test, "radix_heap");
 }
@@ -20,6 +20,7 @@
 #include "common.h"
 #include <tpie/job.h>
 #include <tpie/array.h>
+#include <atomic>
 
 class test_job : public tpie::job {
 	size_t * ctr;
@@ -60,8 +61,48 @@ bool repeat_test() {
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Job that splits itself into two subjobs and waits for them inside
+/// operator(). With more nested joins than workers, this only finishes if
+/// joining threads run pending jobs.
+///////////////////////////////////////////////////////////////////////////////
+class split_job : public tpie::job {
+	size_t depth;
+	std::atomic<size_t> * leaves;
+public:
+	split_job(size_t depth, std::atomic<size_t> * leaves)
+		: depth(depth)
+		, leaves(leaves)
+	{
+	}
+
+	void operator()() {
+		if (depth == 0) {
+			++*leaves;
+			return;
+		}
+		split_job left(depth-1, leaves);
+		split_job right(depth-1, leaves);
+		left.enqueue();
+		right.enqueue();
+		left.join();
+		right.join();
+	}
+};
+
+bool nested_join_test(size_t depth) {
+	std::atomic<size_t> leaves(0);
+	split_job root(depth, &leaves);
+	root.enqueue();
+	root.join();
+	TEST_ENSURE(root.is_done(), "root not done after join");
+	TEST_ENSURE_EQUALITY(static_cast<size_t>(1) << depth, leaves.load(), "leaves");
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(repeat_test, "repeat")
+		.test(nested_join_test, "nested_join", "depth", static_cast<size_t>(12))
 		;
 }
@@ -0,0 +1,118 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include "common.h"
+#include <tpie/loser_tree.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace tpie;
+
+// Merge the given sorted runs with a loser tree and compare the result
+// against std::sort.
+bool merge_runs(std::vector<std::vector<int> > & runs) {
+	std::vector<int> expected;
+	for (size_t i = 0; i < runs.size(); ++i) {
+		std::sort(runs[i].begin(), runs[i].end());
+		expected.insert(expected.end(), runs[i].begin(), runs[i].end());
+	}
+	std::sort(expected.begin(), expected.end());
+
+	loser_tree<int> t;
+	t.resize(runs.size());
+	std::vector<size_t> next(runs.size(), 0);
+	for (size_t i = 0; i < runs.size(); ++i) {
+		if (runs[i].empty()) continue;
+		t.unsafe_set(i, runs[i][0]);
+		next[i] = 1;
+	}
+	t.make_safe();
+
+	std::vector<int> actual;
+	while (!t.empty()) {
+		size_t run = t.top_run();
+		TEST_ENSURE(next[run] > 0 && runs[run][next[run]-1] == t.top(), "top_run does not match top");
+		actual.push_back(t.top());
+		if (next[run] < runs[run].size()) {
+			t.pop_and_push(runs[run][next[run]++]);
+		} else {
+			t.pop();
+		}
+	}
+	TEST_ENSURE(actual == expected, "Merged output differs");
+	return true;
+}
+
+bool random_test() {
+	std::mt19937 rng(42);
+	const size_t fanouts[] = {1, 2, 3, 7, 64, 250};
+	for (size_t f = 0; f < sizeof(fanouts)/sizeof(fanouts[0]); ++f) {
+		std::vector<std::vector<int> > runs(fanouts[f]);
+		for (size_t i = 0; i < runs.size(); ++i) {
+			runs[i].resize(rng() % 200);
+			for (size_t j = 0; j < runs[i].size(); ++j) runs[i][j] = rng() % 1000;
+		}
+		if (!merge_runs(runs)) return false;
+	}
+	return true;
+}
+
+// Runs that cover disjoint or interleaved key ranges exercise the runner-up
+// shortcut and its invalidation.
+bool streak_test() {
+	std::vector<std::vector<int> > runs(9);
+	for (size_t i = 0; i < runs.size(); ++i) {
+		for (int j = 0; j < 100; ++j) {
+			if (i % 3 == 0) runs[i].push_back(static_cast<int>(i) * 100 + j);
+			else if (i % 3 == 1) runs[i].push_back(j * 9 + static_cast<int>(i));
+			else runs[i].push_back(j / 10 * 100);
+		}
+	}
+	return merge_runs(runs);
+}
+
+bool empty_test() {
+	loser_tree<int> t;
+	TEST_ENSURE(t.empty(), "Tree without runs is not empty");
+	t.resize(5);
+	t.make_safe();
+	TEST_ENSURE(t.empty(), "Tree with only exhausted runs is not empty");
+	std::vector<std::vector<int> > runs(4);
+	runs[2].push_back(3);
+	return merge_runs(runs);
+}
+
+class my_memory_test: public memory_test {
+public:
+	loser_tree<int> * a;
+	virtual void alloc() {
+		a = tpie_new<loser_tree<int> >();
+		a->resize(123456);
+	}
+	virtual void free() {tpie_delete(a);}
+	virtual size_type claimed_size() {return static_cast<size_type>(loser_tree<int>::memory_usage(123456));}
+};
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(random_test, "random")
+		.test(streak_test, "streak")
+		.test(empty_test, "empty")
+		.test(my_memory_test(), "memory");
+}
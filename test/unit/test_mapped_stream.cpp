@@ -0,0 +1,191 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/mapped_stream.h>
+#include <tpie/file_stream.h>
+#include <tpie/uncompressed_stream.h>
+#include <tpie/tempname.h>
+#include <random>
+
+using tpie::uint64_t;
+
+namespace {
+
+const uint64_t ITEMS = 1024*1024;
+
+uint64_t item(uint64_t i) {return i * 7919 + 13;}
+
+// An item whose size does not divide the block size.
+struct triple {
+	tpie::uint32_t a, b, c;
+};
+
+void write_items(tpie::temp_file & tmp, uint64_t items) {
+	tpie::file_stream<uint64_t> s;
+	s.open(tmp);
+	for (uint64_t i = 0; i < items; ++i) s.write(item(i));
+}
+
+} // unnamed namespace
+
+bool basic_test() {
+	tpie::temp_file tmp;
+	write_items(tmp, ITEMS);
+
+	tpie::mapped_stream<uint64_t> s;
+	s.open(tmp);
+	TEST_ENSURE_EQUALITY(ITEMS, s.size(), "size");
+	TEST_ENSURE(s.contiguous(), "uint64_t items should be contiguous");
+	for (uint64_t i = 0; i < ITEMS; ++i)
+		TEST_ENSURE_EQUALITY(item(i), s.read(), "sequential read");
+	TEST_ENSURE(!s.can_read(), "can_read at end");
+	for (uint64_t i = ITEMS; i--;)
+		TEST_ENSURE_EQUALITY(item(i), s.read_back(), "backwards read");
+	TEST_ENSURE(!s.can_read_back(), "can_read_back at beginning");
+
+	bool threw = false;
+	try {
+		s.read_back();
+	} catch (tpie::end_of_stream_exception &) {
+		threw = true;
+	}
+	TEST_ENSURE(threw, "read_back at beginning should throw");
+
+	s.set_cache_hint(tpie::access_random);
+	std::mt19937 rng(42);
+	for (size_t i = 0; i < 10000; ++i) {
+		uint64_t offset = rng() % ITEMS;
+		s.seek(offset);
+		TEST_ENSURE_EQUALITY(item(offset), s.peek(), "peek after seek");
+		TEST_ENSURE_EQUALITY(item(offset), s.read(), "read after seek");
+		TEST_ENSURE_EQUALITY(offset + 1, s.offset(), "offset after read");
+	}
+	s.seek(-1, tpie::mapped_stream<uint64_t>::end);
+	TEST_ENSURE_EQUALITY(item(ITEMS-1), s.read(), "seek from end");
+	s.seek(-2, tpie::mapped_stream<uint64_t>::current);
+	TEST_ENSURE_EQUALITY(item(ITEMS-2), s.read(), "seek from current");
+
+	threw = false;
+	try {
+		s.seek(ITEMS+1);
+	} catch (tpie::io_exception &) {
+		threw = true;
+	}
+	TEST_ENSURE(threw, "seek beyond the end should throw");
+	return true;
+}
+
+bool view_test() {
+	tpie::temp_file tmp;
+	write_items(tmp, ITEMS);
+
+	tpie::mapped_stream<uint64_t> s;
+	s.open(tmp, tpie::access_random);
+	tpie::array_view<const uint64_t> v = s.view(ITEMS/3, ITEMS/2);
+	TEST_ENSURE_EQUALITY(ITEMS/2, v.size(), "view size");
+	for (size_t i = 0; i < v.size(); ++i)
+		TEST_ENSURE_EQUALITY(item(ITEMS/3 + i), v[i], "view item");
+	TEST_ENSURE_EQUALITY(0u, s.view(ITEMS, 0).size(), "empty view at end");
+
+	bool threw = false;
+	try {
+		s.view(ITEMS/2, ITEMS);
+	} catch (tpie::stream_exception &) {
+		threw = true;
+	}
+	TEST_ENSURE(threw, "view beyond the end should throw");
+	return true;
+}
+
+bool odd_test() {
+	tpie::temp_file tmp;
+	const uint64_t items = 400000;
+	{
+		tpie::uncompressed_stream<triple> s;
+		s.open(tmp);
+		for (uint64_t i = 0; i < items; ++i) {
+			triple t = {static_cast<tpie::uint32_t>(i), static_cast<tpie::uint32_t>(2*i), 7};
+			s.write(t);
+		}
+	}
+	tpie::mapped_stream<triple> s;
+	s.open(tmp);
+	TEST_ENSURE_EQUALITY(items, s.size(), "size");
+	for (uint64_t i = 0; i < items; ++i) {
+		const triple & t = s.read();
+		TEST_ENSURE_EQUALITY(i, t.a, "a");
+		TEST_ENSURE_EQUALITY(2*i, t.b, "b");
+	}
+	if (!s.contiguous()) {
+		bool threw = false;
+		try {
+			s.view(s.block_items() - 1, 2);
+		} catch (tpie::stream_exception &) {
+			threw = true;
+		}
+		TEST_ENSURE(threw, "view across a block gap should throw");
+	}
+	return true;
+}
+
+bool user_data_test() {
+	tpie::temp_file tmp;
+	{
+		tpie::file_stream<uint64_t> s;
+		s.open(tmp, tpie::open::defaults, sizeof(uint64_t));
+		s.write_user_data(item(42));
+		s.write(item(0));
+	}
+	tpie::mapped_stream<uint64_t> s;
+	s.open(tmp);
+	uint64_t userData = 0;
+	s.read_user_data(userData);
+	TEST_ENSURE_EQUALITY(item(42), userData, "user data");
+	TEST_ENSURE_EQUALITY(item(0), s.read(), "item after user data");
+	return true;
+}
+
+bool compressed_test() {
+	tpie::temp_file tmp;
+	{
+		tpie::file_stream<uint64_t> s;
+		s.open(tmp, tpie::open::compression_all);
+		for (uint64_t i = 0; i < 1000; ++i) s.write(item(i));
+	}
+	tpie::mapped_stream<uint64_t> s;
+	bool threw = false;
+	try {
+		s.open(tmp);
+	} catch (tpie::stream_exception &) {
+		threw = true;
+	}
+	TEST_ENSURE(threw, "mapping a compressed stream should throw");
+	TEST_ENSURE(!s.is_open(), "stream open after failure");
+	return true;
+}
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(basic_test, "basic")
+		.test(view_test, "view")
+		.test(odd_test, "odd")
+		.test(user_data_test, "user_data")
+		.test(compressed_test, "compressed");
+}
@@ -22,6 +22,7 @@
 #include <tpie/parallel_sort.h>
 #include <tpie/sysinfo.h>
 #include <random>
+#include <vector>
 
 using namespace tpie;
 
@@ -158,6 +159,243 @@ bool tall_tree_test(size_t fanout, size_t height) {
 	return true;
 }
 
+// Enough runs for two intermediate merge levels, whose groups are merged
+// concurrently.
+bool parallel_merge_test(size_t fanout, size_t runs) {
+	const memory_size_type runLength = 64;
+	const size_t items = runs * runLength;
+	merge_sorter<size_t, false> s;
+	s.set_parameters(runLength, fanout);
+	s.begin();
+	for (size_t i = 0; i < items; ++i) s.push(i * 7919 % items);
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	for (size_t i = 0; i < items; ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		TEST_ENSURE_EQUALITY(i, s.pull(), "pull");
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	return true;
+}
+
+struct keyed_item {
+	uint32_t key;
+	uint32_t payload;
+};
+
+struct item_key {
+	uint32_t operator()(const keyed_item & item) const { return item.key; }
+};
+
+// Runs formed by radix sort on an extracted key, over several runs. Full
+// runs take their scratch from the spare phase 1 memory, and the last
+// partial run from the unused end of the run buffer.
+bool key_extractor_test(size_t runs) {
+	const memory_size_type runLength = 100000;
+	const size_t items = runs * runLength + runLength / 3;
+	merge_sorter<keyed_item, false, key_less<item_key> > s;
+	s.set_phase_1_memory(2 * runLength * sizeof(keyed_item) + 16*1024*1024);
+	s.set_parameters(runLength, 4);
+	s.begin();
+	std::mt19937 rng;
+	uint64_t payloadSum = 0;
+	for (size_t i = 0; i < items; ++i) {
+		keyed_item item = {static_cast<uint32_t>(rng()), static_cast<uint32_t>(i)};
+		payloadSum += item.payload;
+		s.push(item);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	uint32_t prev = 0;
+	for (size_t i = 0; i < items; ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		keyed_item item = s.pull();
+		TEST_ENSURE(prev <= item.key, "Out of order");
+		prev = item.key;
+		payloadSum -= item.payload;
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	TEST_ENSURE_EQUALITY(0, payloadSum, "Items lost");
+	return true;
+}
+
+// Items i + d for a random displacement 0 <= d < maxDisplacement, or random
+// items if maxDisplacement is 0, sorted with replacement selection.
+bool replacement_selection_run(size_t items, size_t runLength, size_t fanout,
+							   size_t maxDisplacement, bool & calcFree) {
+	merge_sorter<uint64_t, false> s;
+	s.set_parameters(runLength, fanout);
+	s.set_replacement_selection(true);
+	s.begin();
+	std::mt19937 rng;
+	std::vector<uint64_t> expected;
+	for (size_t i = 0; i < items; ++i) {
+		uint64_t item = maxDisplacement ? i + rng() % maxDisplacement : rng();
+		expected.push_back(item);
+		s.push(item);
+	}
+	s.end();
+	calcFree = s.is_calc_free();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < items; ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		TEST_ENSURE_EQUALITY(expected[i], s.pull(), "pull");
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	return true;
+}
+
+bool replacement_selection_test() {
+	const size_t runLength = 1000;
+	bool calcFree;
+	// Random input gives runs of about twice the buffer, so the eight
+	// buffers of items fit in six runs.
+	if (!replacement_selection_run(8*runLength, runLength, 6, 0, calcFree)) return false;
+	TEST_ENSURE(calcFree, "Random input gave too many runs");
+	// Nearly sorted input gives a single run.
+	if (!replacement_selection_run(100*runLength, runLength, 2, runLength/2, calcFree)) return false;
+	TEST_ENSURE(calcFree, "Nearly sorted input gave more than one run");
+	// Several merge levels with runs of varying length.
+	return replacement_selection_run(50*runLength, runLength, 3, 0, calcFree)
+		&& replacement_selection_run(50*runLength, runLength, 3, 5*runLength, calcFree);
+}
+
+// A final fanout below the fanout, so the final merge first merges some
+// runs into a run of the next level, and evacuation in between.
+bool replacement_selection_final_fanout_test() {
+	const memory_size_type mb = 1024*1024;
+	merge_sorter<uint64_t, false> s;
+	s.set_available_memory(3*mb, 30*mb, 12*mb);
+	s.set_replacement_selection(true);
+	s.begin();
+	std::mt19937 rng;
+	const size_t items = 8*mb / sizeof(uint64_t);
+	std::vector<uint64_t> expected;
+	for (size_t i = 0; i < items; ++i) {
+		expected.push_back(rng());
+		s.push(expected.back());
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	s.evacuate();
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < items; ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		TEST_ENSURE_EQUALITY(expected[i], s.pull(), "pull");
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	return true;
+}
+
+// Input made of the given number of sorted chunks. Runs that continue the
+// previous run are appended to it, so there is about one run per chunk.
+bool presorted_test(size_t chunks) {
+	const memory_size_type runLength = 1000;
+	const size_t items = 20*runLength;
+	merge_sorter<uint64_t, false> s;
+	s.set_parameters(runLength, chunks + 2);
+	s.begin();
+	std::mt19937 rng;
+	std::vector<uint64_t> expected;
+	for (size_t c = 0; c < chunks; ++c) {
+		std::vector<uint64_t> chunk(items / chunks);
+		for (size_t i = 0; i < chunk.size(); ++i) chunk[i] = rng();
+		std::sort(chunk.begin(), chunk.end());
+		for (size_t i = 0; i < chunk.size(); ++i) s.push(chunk[i]);
+		expected.insert(expected.end(), chunk.begin(), chunk.end());
+	}
+	s.end();
+	TEST_ENSURE(s.is_calc_free(), "Too many runs");
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		TEST_ENSURE_EQUALITY(expected[i], s.pull(), "pull");
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	return true;
+}
+
+// Items pushed in batches that do not line up with the runs.
+bool push_batch_test(bool replacementSelection) {
+	const memory_size_type runLength = 1000;
+	const size_t batch = 700;
+	const size_t items = 20*runLength;
+	merge_sorter<uint64_t, false> s;
+	s.set_parameters(runLength, 4);
+	s.set_replacement_selection(replacementSelection);
+	s.begin();
+	std::mt19937 rng;
+	std::vector<uint64_t> expected(items);
+	for (size_t i = 0; i < items; ++i) expected[i] = rng();
+	for (size_t i = 0; i < items; i += batch)
+		s.push_batch(array_view<const uint64_t>(expected.data() + i, std::min(batch, items - i)));
+	s.end();
+	TEST_ENSURE_EQUALITY(items, s.item_count(), "item_count");
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < items; ++i) {
+		TEST_ENSURE(s.can_pull(), "can_pull");
+		TEST_ENSURE_EQUALITY(expected[i], s.pull(), "pull");
+	}
+	TEST_ENSURE(!s.can_pull(), "too many items");
+	return true;
+}
+
+// With direct I/O enabled for temporary files, the blocks of the run files
+// must actually bypass the page cache.
+bool direct_io_test() {
+	bool supported;
+	{
+		temp_file tmp;
+		file_accessor::raw_file_accessor f;
+		f.set_direct_io(true);
+		f.open_rw_new(tmp.path());
+		supported = f.direct_io_active();
+		f.close_i();
+	}
+	if (!supported) {
+		log_info() << "The temporary directory does not support direct I/O" << std::endl;
+		return true;
+	}
+	const memory_size_type runLength = get_block_size() / sizeof(uint64_t);
+	const size_t runs = 12;
+	const stream_size_type directBefore = get_bytes_direct_io();
+	tempname::set_direct_io(true);
+	bool result = true;
+	{
+		merge_sorter<uint64_t, false> s;
+		// More runs than the fanout, so that runs are also merged into runs.
+		s.set_parameters(runLength, 4);
+		s.begin();
+		std::mt19937 rng;
+		for (size_t i = 0; i < runs * runLength; ++i) s.push(rng());
+		s.end();
+		dummy_progress_indicator pi;
+		s.calc(pi);
+		uint64_t prev = 0;
+		size_t items = 0;
+		while (s.can_pull()) {
+			uint64_t x = s.pull();
+			if (x < prev) result = false;
+			prev = x;
+			++items;
+		}
+		if (items != runs * runLength) result = false;
+	}
+	tempname::set_direct_io(false);
+	TEST_ENSURE(result, "Wrong output with direct I/O");
+	TEST_ENSURE(get_bytes_direct_io() > directBefore, "The run files did not use direct I/O");
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	tests t(argc, argv);
 	return
@@ -166,5 +404,14 @@ int main(int argc, char ** argv) {
 		.test(sort_faulty_upper_bound_test, "sort_faulty_upper_bound")
 		.test(temp_file_usage_test, "temp_file_usage")
 		.test(tall_tree_test, "tall_tree", "fanout", static_cast<size_t>(6), "height", static_cast<size_t>(1))
+		.test(parallel_merge_test, "parallel_merge", "fanout", static_cast<size_t>(16), "runs", static_cast<size_t>(300))
+		.test(key_extractor_test, "key_extractor", "runs", static_cast<size_t>(5))
+		.test(replacement_selection_test, "replacement_selection")
+		.test(replacement_selection_final_fanout_test, "replacement_selection_final_fanout")
+		.test(presorted_test, "presorted", "chunks", static_cast<size_t>(1))
+		.test(presorted_test, "presorted_chunks", "chunks", static_cast<size_t>(3))
+		.test(direct_io_test, "direct_io")
+		.test(push_batch_test, "push_batch", "replacement_selection", false)
+		.test(push_batch_test, "push_batch_selection", "replacement_selection", true)
 		;
 }
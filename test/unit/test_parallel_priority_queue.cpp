@@ -0,0 +1,178 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#include "common.h"
+#include <tpie/parallel_priority_queue.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace tpie;
+
+typedef parallel_priority_queue<uint64_t> queue_type;
+
+// Random pushes and pops, small buffers so the heap and insertion buffer
+// overflow often.
+bool basic_test(memory_size_type memory, memory_size_type bufferItems, stream_size_type iterations) {
+	queue_type pq(memory, bufferItems, 0.0078125f);
+	std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t> > pq2;
+	std::mt19937 rnd(42);
+	std::vector<uint64_t> items;
+	for (stream_size_type i = 0; i < iterations; ++i) {
+		memory_size_type pushes = rnd() % 300;
+		// Pushes are close to the current top half of the time, as in time
+		// forward processing.
+		uint64_t base = pq2.empty() ? 0 : pq2.top();
+		for (memory_size_type j = 0; j < pushes; ++j) {
+			uint64_t x = (rnd() % 2) ? base + rnd() % 1000 : rnd() % 1000000000;
+			pq.push(x);
+			pq2.push(x);
+		}
+		memory_size_type pops = rnd() % (i < iterations / 2 ? 250 : 400);
+		for (memory_size_type j = 0; j < pops && !pq2.empty(); ++j) {
+			if (pq.top() != pq2.top()) {
+				log_error() << "Top differs " << pq.top() << " " << pq2.top() << std::endl;
+				return false;
+			}
+			pq.pop();
+			pq2.pop();
+		}
+		if (pq.size() != pq2.size()) {
+			log_error() << "Size differs " << pq.size() << " " << pq2.size() << std::endl;
+			return false;
+		}
+	}
+	items.clear();
+	pq.pop_batch(pq.size(), std::back_inserter(items));
+	for (size_t i = 0; i < items.size(); ++i) {
+		if (items[i] != pq2.top()) {
+			log_error() << "pop_batch differs " << items[i] << " " << pq2.top() << std::endl;
+			return false;
+		}
+		pq2.pop();
+	}
+	return pq.empty() && pq2.empty();
+}
+
+// Several producer threads push while the main thread pops.
+bool producers_test(memory_size_type memory, memory_size_type threads, stream_size_type items) {
+	queue_type pq(memory, 1024, 0.0078125f);
+	std::vector<std::thread> producers;
+	for (memory_size_type t = 0; t < threads; ++t) {
+		producers.push_back(std::thread([&pq, t, threads, items]() {
+			queue_type::producer p(pq, 100);
+			for (stream_size_type i = t; i < items; i += threads)
+				p.push((i * 2654435761u) % items);
+		}));
+	}
+	std::vector<uint64_t> popped;
+	std::vector<uint64_t> batch;
+	while (popped.size() < items / 2) {
+		batch.clear();
+		pq.pop_batch(64, std::back_inserter(batch));
+		popped.insert(popped.end(), batch.begin(), batch.end());
+	}
+	for (auto & t : producers) t.join();
+
+	// Once all producers are done, the rest comes out sorted.
+	stream_size_type rest = pq.size();
+	batch.clear();
+	pq.pop_batch(rest, std::back_inserter(batch));
+	if (batch.size() != rest || !pq.empty()) {
+		log_error() << "Popped " << batch.size() << " of " << rest << " items" << std::endl;
+		return false;
+	}
+	if (!std::is_sorted(batch.begin(), batch.end())) {
+		log_error() << "Items not sorted" << std::endl;
+		return false;
+	}
+	popped.insert(popped.end(), batch.begin(), batch.end());
+	std::sort(popped.begin(), popped.end());
+	for (stream_size_type i = 0; i < items; ++i) {
+		if (popped[i] != i) {
+			log_error() << "Item " << i << " missing" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Two queues share the job pool. Each producer pushes to both queues, and
+// each queue has its own consumer thread.
+bool shared_pool_test(memory_size_type memory, memory_size_type threads, stream_size_type items) {
+	queue_type pq1(memory, 256, 0.0078125f);
+	queue_type pq2(memory, 256, 0.0078125f);
+	std::vector<std::thread> producers;
+	for (memory_size_type t = 0; t < threads; ++t) {
+		producers.push_back(std::thread([&pq1, &pq2, t, threads, items]() {
+			queue_type::producer p1(pq1, 100);
+			queue_type::producer p2(pq2, 100);
+			for (stream_size_type i = t; i < items; i += threads) {
+				p1.push((i * 2654435761u) % items);
+				p2.push(items - 1 - (i * 2654435761u) % items);
+			}
+		}));
+	}
+	std::vector<uint64_t> popped1;
+	std::vector<uint64_t> popped2;
+	auto consume = [items] (queue_type & pq, std::vector<uint64_t> & popped) {
+		while (popped.size() < items) {
+			if (pq.pop_batch(64, std::back_inserter(popped)) == 0)
+				std::this_thread::yield();
+		}
+	};
+	std::thread consumer(consume, std::ref(pq2), std::ref(popped2));
+	consume(pq1, popped1);
+	consumer.join();
+	for (auto & t : producers) t.join();
+
+	if (!pq1.empty() || !pq2.empty()) {
+		log_error() << "Queues not empty" << std::endl;
+		return false;
+	}
+	std::sort(popped1.begin(), popped1.end());
+	std::sort(popped2.begin(), popped2.end());
+	for (stream_size_type i = 0; i < items; ++i) {
+		if (popped1[i] != i || popped2[i] != i) {
+			log_error() << "Item " << i << " missing" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char ** argv) {
+	return tests(argc, argv)
+		.test(basic_test, "basic",
+			  "memory", static_cast<memory_size_type>(1024*1024),
+			  "buffer", static_cast<memory_size_type>(256),
+			  "iterations", static_cast<stream_size_type>(2000))
+		.test(producers_test, "producers",
+			  "memory", static_cast<memory_size_type>(2*1024*1024),
+			  "threads", static_cast<memory_size_type>(4),
+			  "items", static_cast<stream_size_type>(400000))
+		.test(shared_pool_test, "shared_pool",
+			  "memory", static_cast<memory_size_type>(1024*1024),
+			  "threads", static_cast<memory_size_type>(4),
+			  "items", static_cast<stream_size_type>(200000));
+}
@@ -30,6 +30,7 @@
 #include <tpie/pipelining/serialization.h>
 #include <tpie/progress_indicator_arrow.h>
 #include <tpie/pipelining/helpers.h>
+#include <tpie/pipelining/filter.h>
 #include <tpie/pipelining/split.h>
 #include <tpie/resource_manager.h>
 
@@ -1560,6 +1561,68 @@ bool parallel_push_in_end_test() {
 	return true;
 }
 
+bool parallel_input_test(size_t modulo) {
+	temp_file tmp;
+	{
+		file_stream<size_t> fs;
+		fs.open(tmp.path(), access_write);
+		for (size_t i = 1; i < modulo; ++i) fs.write(i);
+	}
+	bool result = false;
+	pipeline p = parallel_input<size_t>(tmp.path(),
+										multiplicative_inverter(modulo) | multiplicative_inverter(modulo),
+										maintain_order, 4, 100)
+		| sequence_verifier(modulo-1, &result);
+	p.plot(log_info());
+	p();
+	return result;
+}
+
+bool parallel_input_compressed_test() {
+	// Enough items to span several compressed blocks
+	const test_t items = 1000000;
+	temp_file tmp;
+	std::vector<stream_position> boundaries;
+	{
+		file_stream<test_t> fs;
+		fs.open(tmp.path(), access_write, 0, access_sequential, compression_normal);
+		for (test_t i = 0; i < items; ++i) {
+			if (i % 70001 == 0) boundaries.push_back(fs.get_position());
+			fs.write(i);
+		}
+	}
+	test_t sumOutput = 0;
+	pipeline p = parallel_input<test_t>(tmp.path(), boundaries, item_type<test_t>(), arbitrary_order, 3)
+		| summer(sumOutput);
+	p.plot(log_info());
+	p();
+	const test_t expect = items * (items - 1) / 2;
+	if (sumOutput != expect) {
+		log_error() << "Expected sum " << expect << ", got " << sumOutput << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parallel_input_reject_compressed_test() {
+	temp_file tmp;
+	{
+		file_stream<test_t> fs;
+		fs.open(tmp.path(), access_write, 0, access_sequential, compression_normal);
+		for (test_t i = 0; i < 1000; ++i) fs.write(i);
+	}
+	test_t sumOutput = 0;
+	pipeline p = parallel_input<test_t>(tmp.path(), item_type<test_t>(), arbitrary_order, 3)
+		| summer(sumOutput);
+	try {
+		p();
+	} catch (const tpie::exception &) {
+		return true;
+	}
+	log_error() << "Reading a compressed stream without boundaries did not throw" << std::endl;
+	return false;
+}
+
 template <typename dest_t>
 class step_begin_type : public node {
 	dest_t dest;
@@ -2093,6 +2156,147 @@ bool file_limit_sort_test() {
 	return true;
 }
 
+bool concurrent_phases_test() {
+	const size_t elements = 300*1024;
+	bool result1 = false;
+	bool result2 = false;
+	// The merge and output phases of the two sorts run at the same time.
+	pipeline p = sequence_generator(elements, true)
+		| fork(sort().name("First") | sequence_verifier(elements, &result1))
+		| sort().name("Second")
+		| sequence_verifier(elements, &result2);
+	p.set_concurrent_phases(true);
+	p();
+	return result1 && result2;
+}
+
+bool profile_test() {
+	const size_t elements = 100000;
+	std::vector<test_t> input(elements);
+	for (size_t i = 0; i < elements; ++i) input[i] = elements - i;
+	std::vector<test_t> output;
+
+	pipeline p = input_vector(input).name("Input")
+		| map([](test_t x) { return 2*x; }).name("Double")
+		| sort().name("Sort")
+		| output_vector(output).name("Output");
+	p.set_profiling(true);
+	p();
+	TEST_ENSURE_EQUALITY(elements, output.size(), "Wrong output size");
+
+	const pipeline_profile & profile = p.get_profile();
+	std::stringstream json;
+	profile.write_json(json);
+	log_info() << json.str() << std::endl;
+	TEST_ENSURE(json.str().find("\"exclusive_time\"") != std::string::npos, "Bad JSON");
+
+	TEST_ENSURE(profile.phaseTimes.size() >= 2, "Too few phases");
+	std::map<std::string, const node_profile *> nodes;
+	for (const node_profile & n: profile.nodes) {
+		TEST_ENSURE(n.exclusiveTime <= n.inclusiveTime + 1e-9, "Exclusive time exceeds inclusive time");
+		nodes[n.name] = &n;
+	}
+	for (std::string name: {"Input", "Double", "Output"}) {
+		TEST_ENSURE(nodes.count(name), "Missing node profile");
+		TEST_ENSURE_EQUALITY(elements, nodes[name]->items, "Wrong item count");
+		TEST_ENSURE_EQUALITY(elements * sizeof(test_t), nodes[name]->bytes, "Wrong byte count");
+	}
+	// The input node calls map, which calls the sort input
+	TEST_ENSURE(nodes["Input"]->inclusiveTime >= nodes["Double"]->inclusiveTime, "Input time does not include map");
+	memory_size_type assigned = 0;
+	for (const node_profile & n: profile.nodes) assigned += n.memoryAssigned;
+	TEST_ENSURE(assigned > 0, "No memory assigned");
+
+	std::stringstream plot;
+	p.plot_profile(plot);
+	log_info() << plot.str() << std::endl;
+	TEST_ENSURE(plot.str().find("fillcolor") != std::string::npos, "Plot not annotated");
+	return true;
+}
+
+template <typename T>
+class batch_counter_type : public node {
+public:
+	typedef T item_type;
+
+	batch_counter_type(std::vector<T> & output, size_t & batches)
+		: output(output)
+		, batches(batches)
+	{
+	}
+
+	void push(const T & item) {
+		output.push_back(item);
+	}
+
+	void push_batch(array_view<const T> items) {
+		++batches;
+		output.insert(output.end(), items.begin(), items.end());
+	}
+
+private:
+	std::vector<T> & output;
+	size_t & batches;
+};
+
+typedef pipe_end<termfactory<batch_counter_type<test_t>, std::vector<test_t> &, size_t &> > batch_counter;
+
+bool push_batch_test() {
+	const size_t elements = 10000;
+	const size_t inputBatches = (elements + pipelining::bits::batch_size - 1) / pipelining::bits::batch_size;
+	std::vector<test_t> items(elements);
+	for (size_t i = 0; i < elements; ++i) items[i] = i;
+
+	// Batches pass through pure_map, pure_filter and a virtual chunk
+	std::vector<test_t> result;
+	size_t batches = 0;
+	pipeline p = virtual_chunk_begin<test_t>(input_vector(items)
+			| pure_map([](test_t x) { return x + 1; })
+			| pure_filter([](test_t x) { return x % 2 == 0; }))
+		| virtual_chunk<test_t, test_t>(pure_map([](test_t x) { return x / 2; }))
+		| virtual_chunk_end<test_t>(batch_counter(result, batches));
+	p();
+	TEST_ENSURE_EQUALITY(elements / 2, result.size(), "Wrong output size");
+	for (size_t i = 0; i < result.size(); ++i)
+		TEST_ENSURE_EQUALITY(i + 1, result[i], "Wrong output");
+	TEST_ENSURE_EQUALITY(inputBatches, batches, "Items were not pushed in batches");
+
+	// map and filter call their functors item by item, each followed by the
+	// push of its result
+	result.clear();
+	batches = 0;
+	size_t calls = 0;
+	bool interleaved = true;
+	pipeline p1 = input_vector(items)
+		| filter([&](test_t) { interleaved = interleaved && calls == result.size(); return true; })
+		| map([&](test_t x) { ++calls; return x; })
+		| batch_counter(result, batches);
+	p1();
+	TEST_ENSURE(result == items, "Wrong output from map and filter");
+	TEST_ENSURE(interleaved, "Functors ran ahead of the pushes");
+	TEST_ENSURE_EQUALITY(0, batches, "map pushed a batch");
+
+	// Batches are written to and read from file streams
+	tpie::temp_file file;
+	{
+		file_stream<test_t> out;
+		out.open(file.path());
+		pipeline p2 = input_vector(items) | output(out);
+		p2();
+	}
+	result.clear();
+	batches = 0;
+	{
+		file_stream<test_t> in;
+		in.open(file.path());
+		pipeline p3 = input(in) | batch_counter(result, batches);
+		p3();
+	}
+	TEST_ENSURE(result == items, "Wrong output from file stream");
+	TEST_ENSURE_EQUALITY(inputBatches, batches, "File stream was not read in batches");
+	return true;
+}
+
 template<typename T>
 virtual_chunk<int, int> passive_virtual_chunk() {
     T passive;
@@ -2263,6 +2467,9 @@ int main(int argc, char ** argv) {
 	.test(parallel_multiple_test, "parallel_multiple")
 	.test(parallel_own_buffer_test, "parallel_own_buffer")
 	.test(parallel_push_in_end_test, "parallel_push_in_end")
+	.test(parallel_input_test, "parallel_input", "modulo", static_cast<size_t>(2003))
+	.test(parallel_input_compressed_test, "parallel_input_compressed")
+	.test(parallel_input_reject_compressed_test, "parallel_input_reject_compressed")
 	.test(join_test, "join")
 	.test(split_test, "split")
 	.test(subpipeline_test, "subpipeline")
@@ -2270,6 +2477,9 @@ int main(int argc, char ** argv) {
 	.test(copy_ctor_test, "copy_ctor")
 	.multi_test(datastructure_test_multi, "datastructures")
 	.test(file_limit_sort_test, "file_limit_sort")
+	.test(concurrent_phases_test, "concurrent_phases")
+	.test(profile_test, "profile")
+	.test(push_batch_test, "push_batch")
 	.multi_test(passive_virtual_test_multi, "passive_virtual_management")
 	.test(join_split_dealloc_test, "join_split_dealloc")
 	.test(nodeset_dealloc_test, "nodeset_dealloc")
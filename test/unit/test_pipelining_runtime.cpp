@@ -570,11 +570,70 @@ void evacuate_phase_graph_multi(teststream & ts) {
 	});
 }
 
+bool concurrent_phases_test() {
+	const size_t N = 5;
+	evac_node nodes[N];
+
+	node_map::ptr nodeMap = nodes[0].get_node_map();
+	for (size_t i = 1; i < N; ++i) nodes[i].get_node_map()->union_set(nodeMap);
+	nodeMap = nodeMap->find_authority();
+
+	// A fork into two sorts: phase 0 is the input phase, 1 and 3 are the
+	// merge phases and 2 and 4 the output phases.
+	//
+	//    ,-- 1 -- 2
+	//   0
+	//    `-- 3 -- 4
+	//
+	std::vector<std::pair<size_t, size_t> > edges{{0,1}, {0,3}, {1,2}, {3,4}};
+	for (auto e: edges) nodes[e.second].add_memory_share_dependency(nodes[e.first]);
+
+	std::vector<std::vector<node *> > phases;
+	for (size_t i = 0; i < N; ++i) phases.push_back({&nodes[i]});
+
+	runtime rt(nodeMap);
+	std::vector<size_t> order;
+	std::vector<size_t> groups;
+
+	rt.get_concurrent_phases(phases, 1000, 1000, order, groups);
+	TEST_ENSURE((order == std::vector<size_t>{0, 1, 2, 3, 4}), "Bad order when disabled");
+	TEST_ENSURE((groups == std::vector<size_t>{0, 1, 2, 3, 4}), "Bad groups when disabled");
+
+	rt.set_concurrent_phases(true);
+	rt.get_concurrent_phases(phases, 1000, 1000, order, groups);
+	TEST_ENSURE((order == std::vector<size_t>{0, 1, 3, 2, 4}), "Bad order");
+	TEST_ENSURE((groups == std::vector<size_t>{0, 1, 1, 3, 3}), "Bad groups");
+
+	// Every memory share is on a phase of the previous group.
+	std::vector<std::vector<node *> > ordered = phases;
+	apply_order(ordered, order);
+	std::unordered_set<node_map::id_t> evacuateWhenDone;
+	rt.get_evacuations(ordered, groups, evacuateWhenDone);
+	TEST_ENSURE(evacuateWhenDone.empty(), "Nothing should be evacuated");
+
+	// The two merge phases do not fit in memory together, so the second
+	// merge phase is run with the first output phase instead.
+	nodes[1].set_minimum_memory(600);
+	nodes[3].set_minimum_memory(600);
+	rt.get_concurrent_phases(phases, 1000, 1000, order, groups);
+	TEST_ENSURE((order == std::vector<size_t>{0, 1, 2, 3, 4}), "Bad order with memory limit");
+	TEST_ENSURE((groups == std::vector<size_t>{0, 1, 2, 2, 4}), "Bad groups with memory limit");
+
+	ordered = phases;
+	apply_order(ordered, order);
+	evacuateWhenDone.clear();
+	rt.get_evacuations(ordered, groups, evacuateWhenDone);
+	TEST_ENSURE((evacuateWhenDone == std::unordered_set<node_map::id_t>{nodes[0].get_id()}),
+				"Only the input phase should be evacuated");
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	return tpie::tests(argc, argv)
 	.test(evacuate_test, "evacuate")
 	.test(get_phase_graph_test, "get_phase_graph")
 	.multi_test(optimal_satisfiable_ordering_test, "optimal_satisfiable_ordering")
 	.multi_test(evacuate_phase_graph_multi, "evacuate_phase_graph")
+	.test(concurrent_phases_test, "concurrent_phases")
 	;
 }
@@ -0,0 +1,124 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/radix_sort.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace tpie;
+
+struct keyed_item {
+	uint64_t key;
+	size_t position;
+};
+
+struct item_key {
+	uint64_t operator()(const keyed_item & item) const { return item.key; }
+};
+
+// Sort items whose keys only use the given number of low bits and check
+// that the result is ordered by key and stable.
+template <typename sort_fn_t>
+bool check_sort(sort_fn_t sort_fn, size_t n, size_t bits) {
+	std::mt19937_64 rng(n + bits);
+	const uint64_t mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+	std::vector<keyed_item> items(n), scratch(n);
+	for (size_t i = 0; i < n; ++i) {
+		items[i].key = rng() & mask;
+		items[i].position = i;
+	}
+	sort_fn(items.data(), items.data() + n, scratch.data(), item_key());
+	for (size_t i = 1; i < n; ++i) {
+		TEST_ENSURE(items[i-1].key <= items[i].key, "Out of order");
+		if (items[i-1].key == items[i].key)
+			TEST_ENSURE(items[i-1].position < items[i].position, "Not stable");
+	}
+	return true;
+}
+
+struct sequential {
+	template <typename T, typename key_t>
+	void operator()(T * begin, T * end, T * scratch, key_t key) {
+		radix_sort(begin, end, scratch, key);
+	}
+};
+
+struct parallel {
+	template <typename T, typename key_t>
+	void operator()(T * begin, T * end, T * scratch, key_t key) {
+		parallel_radix_sort(begin, end, scratch, key);
+	}
+};
+
+bool basic_test() {
+	const size_t bits[] = {0, 3, 8, 20, 64};
+	const size_t sizes[] = {0, 1, 2, 1000, 100000};
+	for (size_t b : bits)
+		for (size_t n : sizes)
+			if (!check_sort(sequential(), n, b)) return false;
+	return true;
+}
+
+// Large enough for the bucket jobs, with the most significant differing
+// byte both at the top and in the middle of the key.
+bool parallel_test(size_t n) {
+	const size_t bits[] = {0, 5, 12, 40, 64};
+	for (size_t b : bits)
+		if (!check_sort(parallel(), n, b)) return false;
+	return true;
+}
+
+// radix_key_traits must order integers as std::less and std::greater do.
+template <typename T, typename pred_t>
+bool check_traits() {
+	typedef radix_key_traits<pred_t, T> traits;
+	TEST_ENSURE(traits::enabled, "Traits not enabled");
+	std::mt19937_64 rng;
+	std::vector<T> items(10000), scratch(items.size());
+	for (size_t i = 0; i < items.size(); ++i) items[i] = static_cast<T>(rng());
+	items[0] = std::numeric_limits<T>::min();
+	items[1] = std::numeric_limits<T>::max();
+	std::vector<T> expected = items;
+	std::sort(expected.begin(), expected.end(), pred_t());
+	pred_t pred;
+	radix_sort(items.data(), items.data() + items.size(), scratch.data(),
+			   [&pred](const T & x) { return traits::key(pred, x); });
+	TEST_ENSURE(items == expected, "Radix key order differs from predicate");
+	return true;
+}
+
+bool traits_test() {
+	TEST_ENSURE(!(radix_key_traits<std::less<double>, double>::enabled), "double enabled");
+	TEST_ENSURE(!(radix_key_traits<std::less<bool>, bool>::enabled), "bool enabled");
+	return check_traits<uint64_t, std::less<uint64_t> >()
+		&& check_traits<int64_t, std::less<int64_t> >()
+		&& check_traits<int8_t, std::less<int8_t> >()
+		&& check_traits<int32_t, std::greater<int32_t> >()
+		&& check_traits<uint16_t, std::greater<uint16_t> >();
+}
+
+int main(int argc, char ** argv) {
+	return tests(argc, argv)
+		.test(basic_test, "basic")
+		.test(parallel_test, "parallel", "n", static_cast<size_t>(1000000))
+		.test(traits_test, "traits")
+		;
+}
@@ -67,9 +67,66 @@ public:
 	};
 };
 
+// Enough memory in phase 2 and 3 to merge several groups at a time and to
+// merge the next key range of the final merge ahead.
+bool parallel_merge_test(memory_size_type partitions) {
+	typedef use_serialization_sorter::test_t test_t;
+	const memory_size_type mb = 1024*1024;
+	use_serialization_sorter::item_generator gen(30*mb);
+	use_serialization_sorter::sorter s;
+	s.set_available_memory(6*mb, 40*mb, 100*mb);
+	s.set_final_merge_partitions(partitions);
+	s.begin();
+	for (stream_size_type i = 0; i < gen.items(); ++i) s.push(gen());
+	s.end();
+	s.merge_runs();
+	// The key ranges are merged ahead in memory, not into new files.
+	const stream_size_type runFiles = get_temp_file_usage();
+	test_t prev;
+	stream_size_type itemsRead = 0;
+	while (s.can_pull()) {
+		test_t item = s.pull();
+		TEST_ENSURE(!(item < prev), "Out of order");
+		TEST_ENSURE(get_temp_file_usage() <= runFiles, "Temporary files written in the final merge");
+		prev = item;
+		++itemsRead;
+	}
+	TEST_ENSURE_EQUALITY(gen.items(), itemsRead, "Wrong number of items");
+	return true;
+}
+
+// Strings over a small alphabet, so that many items share their key prefix,
+// plus bytes above 127 to check that the prefix compares them unsigned.
+bool key_prefix_test(memory_size_type memory, stream_size_type items) {
+	const char alphabet[] = {'a', 'b', '\xe6', '\xf8'};
+	std::mt19937 rng;
+	std::vector<std::string> expected;
+	serialization_sorter<std::string, std::less<std::string> > s;
+	s.set_available_memory(memory);
+	s.set_key_prefix(string_key_prefix());
+	s.begin();
+	for (stream_size_type i = 0; i < items; ++i) {
+		std::string item(rng() % 16, ' ');
+		for (size_t j = 0; j < item.size(); ++j) item[j] = alphabet[rng() % 4];
+		expected.push_back(item);
+		s.push(item);
+	}
+	s.end();
+	s.merge_runs();
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		TEST_ENSURE(s.can_pull(), "Too few items");
+		TEST_ENSURE(s.pull() == expected[i], "Wrong item");
+	}
+	TEST_ENSURE(!s.can_pull(), "Too many items");
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	tests t(argc, argv);
 	sort_tester<use_serialization_sorter>::add_all(t);
 	sort_tester<use_serialization_sorter>::add_file_limit_test(t, 3);
+	t.test(parallel_merge_test, "parallel_merge", "partitions", static_cast<memory_size_type>(4));
+	t.test(key_prefix_test, "key_prefix", "memory", static_cast<memory_size_type>(8*1024*1024), "items", static_cast<stream_size_type>(200000));
 	return t;
 }
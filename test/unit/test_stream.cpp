@@ -789,6 +789,97 @@ bool reopen() {
 	return true;
 }
 
+bool read_ahead_test(size_t depth) {
+	tpie::temp_file tmp;
+	tpie::memory_size_type before = tpie::get_memory_manager().used();
+	tpie::uncompressed_stream<uint64_t> s;
+	s.set_read_ahead(depth);
+	s.open(tmp);
+	TEST_ENSURE(tpie::get_memory_manager().used() - before
+				>= depth * s.block_size() + s.block_size(), "read-ahead buffers not charged");
+
+	for (size_t i = 0; i < ITEMS; ++i) s.write(ITEM(i));
+	s.seek(0);
+	for (size_t i = 0; i < ITEMS; ++i)
+		TEST_ENSURE_EQUALITY(ITEM(i), s.read(), "sequential read");
+	for (size_t i = ITEMS; i--;)
+		TEST_ENSURE_EQUALITY(ITEM(i), s.read_back(), "backwards read");
+
+	// Overwrite every other block while reading ahead
+	const size_t blockItems = s.block_items();
+	for (size_t i = 0; i < ITEMS; ++i) {
+		if ((i / blockItems) % 2) s.write(ITEM(ITEMS+i));
+		else TEST_ENSURE_EQUALITY(ITEM(i), s.read(), "interleaved read");
+	}
+	s.seek(0);
+	for (size_t i = 0; i < ITEMS; ++i) {
+		uint64_t expect = (i / blockItems) % 2 ? ITEM(ITEMS+i) : ITEM(i);
+		TEST_ENSURE_EQUALITY(expect, s.read(), "read after overwrite");
+	}
+
+	s.truncate(ITEMS/2 + 1);
+	TEST_ENSURE_EQUALITY(ITEMS/2 + 1, s.size(), "size after truncate");
+	s.seek(ITEMS/2);
+	s.write(ITEM(0));
+	s.write(ITEM(1));
+	s.close();
+
+	TEST_ENSURE(tpie::get_memory_manager().used() <= before, "read-ahead buffers not released");
+
+	s.open(tmp, tpie::access_read);
+	TEST_ENSURE_EQUALITY(ITEMS/2 + 2, s.size(), "size after reopen");
+	s.seek(ITEMS/2);
+	TEST_ENSURE_EQUALITY(ITEM(0), s.read(), "read after reopen");
+	TEST_ENSURE_EQUALITY(ITEM(1), s.read(), "read after reopen");
+	return true;
+}
+
+bool read_ahead_file_test(size_t depth) {
+	tpie::temp_file tmp;
+	tpie::file<uint64_t> f;
+	f.set_read_ahead(depth);
+	f.open(tmp);
+	{
+		tpie::file<uint64_t>::stream s(f);
+		for (size_t i = 0; i < ITEMS; ++i) s.write(ITEM(i));
+	}
+	{
+		tpie::file<uint64_t>::stream s(f);
+		tpie::file<uint64_t>::stream t(f);
+		t.seek(ITEMS/2);
+		for (size_t i = 0; i < ITEMS/2; ++i) {
+			TEST_ENSURE_EQUALITY(ITEM(i), s.read(), "first stream");
+			TEST_ENSURE_EQUALITY(ITEM(ITEMS/2+i), t.read(), "second stream");
+		}
+	}
+	return true;
+}
+
+bool direct_io_test() {
+	tpie::tempname::set_direct_io(true);
+	bool result = true;
+	{
+		tpie::uncompressed_stream<uint64_t> s;
+		s.set_read_ahead(2);
+		s.open();
+		for (size_t i = 0; i < ITEMS; ++i) s.write(ITEM(i));
+		s.seek(0);
+		for (size_t i = 0; result && i < ITEMS; ++i)
+			if (s.read() != ITEM(i)) result = false;
+	}
+	{
+		tpie::file_stream<uint64_t> s;
+		s.open();
+		for (size_t i = 0; i < ITEMS; ++i) s.write(ITEM(i));
+		s.seek(0);
+		for (size_t i = 0; result && i < ITEMS; ++i)
+			if (s.read() != ITEM(i)) result = false;
+	}
+	tpie::tempname::set_direct_io(false);
+	TEST_ENSURE(result, "wrong item read with direct I/O");
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(stream_tester<file_stream>::array_test, "array")
@@ -818,5 +909,8 @@ int main(int argc, char **argv) {
 		.test(stream_tester<file_colon_colon_stream>::user_data_test, "user_data_file")
 		.test(peek_skip_test_1, "peek_skip_1")
 		.test(peek_skip_test_2, "peek_skip_2")
+		.test(read_ahead_test, "read_ahead", "depth", static_cast<size_t>(4))
+		.test(read_ahead_file_test, "read_ahead_file", "depth", static_cast<size_t>(4))
+		.test(direct_io_test, "direct_io")
 		;
 }
@@ -0,0 +1,130 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2017, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/tempname.h>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+#include <tpie/file_accessor/uring.h>
+
+using tpie::file_accessor::uring;
+
+namespace {
+
+const size_t chunk = 4096;
+const size_t chunks = 64;
+
+char pattern(size_t i) {return static_cast<char>(i * 131 % 251);}
+
+bool sequential(const std::string & path) {
+	std::vector<char> data(chunk * chunks);
+	for (size_t i = 0; i < data.size(); ++i) data[i] = pattern(i);
+	{
+		uring f;
+		f.open_wo(path);
+		for (size_t i = 0; i < chunks; ++i) f.write_i(&data[i * chunk], chunk);
+		TEST_ENSURE_EQUALITY(data.size(), f.file_size_i(), "file size");
+		f.close_i();
+	}
+	uring f;
+	f.open_ro(path);
+	std::vector<char> read(data.size());
+	f.seek_i(chunk);
+	f.read_i(&read[chunk], data.size() - chunk);
+	f.seek_i(0);
+	f.read_i(&read[0], chunk);
+	TEST_ENSURE(read == data, "read back wrong data");
+
+	bool threw = false;
+	try {
+		f.read_i(&read[0], data.size());
+	} catch (tpie::io_exception &) {
+		threw = true;
+	}
+	TEST_ENSURE(threw, "reading past the end did not throw");
+	return true;
+}
+
+bool positional(const std::string & path) {
+	std::vector<char> data(chunk * chunks);
+	std::vector<char> read(chunk * chunks);
+	for (size_t i = 0; i < data.size(); ++i) data[i] = pattern(i);
+
+	uring f;
+	f.open_rw_new(path);
+	// Write the chunks in reverse order.
+	for (size_t i = 0; i < chunks; ++i) {
+		size_t c = chunks - 1 - i;
+		f.write_at_i(&data[c * chunk], chunk, c * chunk);
+	}
+	TEST_ENSURE_EQUALITY(chunk * chunks, f.file_size_i(), "file size");
+	for (size_t i = 0; i < chunks; ++i)
+		f.read_at_i(&read[i * chunk], chunk, i * chunk);
+	TEST_ENSURE(read == data, "read back wrong data");
+	return true;
+}
+
+} // unnamed namespace
+
+bool basic_test() {
+	tpie::log_info() << "io_uring available: " << uring::available() << std::endl;
+	tpie::temp_file tmp;
+	return sequential(tmp.path());
+}
+
+bool positional_test() {
+	tpie::temp_file tmp;
+	return positional(tmp.path());
+}
+
+bool fallback_test() {
+	// The ring of a thread is set up on first use, so a new thread sees the
+	// changed environment.
+	setenv("TPIE_IO_URING", "0", 1);
+	bool result = false;
+	bool available = true;
+	std::thread t([&]() {
+		available = uring::available();
+		tpie::temp_file tmp;
+		result = sequential(tmp.path()) && positional(tmp.path());
+	});
+	t.join();
+	unsetenv("TPIE_IO_URING");
+	TEST_ENSURE(!available, "io_uring not disabled by the environment");
+	return result;
+}
+
+#else // WIN32
+
+bool basic_test() {return true;}
+bool positional_test() {return true;}
+bool fallback_test() {return true;}
+
+#endif // WIN32
+
+int main(int argc, char ** argv) {
+	return tpie::tests(argc, argv)
+	.test(basic_test, "basic")
+	.test(positional_test, "positional")
+	.test(fallback_test, "fallback")
+	;
+}
@@ -0,0 +1,317 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/async_block_io.h>
+#include <tpie/array.h>
+#include <tpie/exception.h>
+#include <tpie/memory.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace tpie {
+
+class async_block_io::impl {
+public:
+	enum slot_state {
+		slot_free,
+		slot_reading,
+		slot_ready,
+		slot_writing
+	};
+
+	struct slot {
+		char * data;
+		stream_size_type block;
+		memory_size_type items;
+		slot_state state;
+		bool stale;
+		stream_size_type seq;
+	};
+
+	impl(file_accessor::file_accessor * accessor,
+		 memory_size_type blockSize,
+		 memory_size_type itemSize,
+		 memory_size_type depth)
+		: m_accessor(accessor)
+		, m_blockSize(blockSize)
+		, m_itemSize(itemSize)
+		, m_slots(depth)
+		, m_pending(0)
+		, m_seq(0)
+		, m_stop(false)
+	{
+		for (memory_size_type i = 0; i < m_slots.size(); ++i) {
+			m_slots[i].data = tpie_new_aligned_buffer(m_blockSize);
+			m_slots[i].state = slot_free;
+			m_slots[i].stale = false;
+		}
+		m_thread = std::thread(&impl::run, this);
+	}
+
+	~impl() {
+		for (memory_size_type i = 0; i < m_slots.size(); ++i)
+			tpie_delete_aligned_buffer(m_slots[i].data, m_blockSize);
+	}
+
+	void read(char * data, stream_size_type block, memory_size_type itemCount) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		rethrow();
+		if (itemCount == 0) return;
+		slot * s = find(block);
+		if (s != 0 && s->items >= itemCount) {
+			while (s->state == slot_reading && !m_error)
+				m_done.wait(lock);
+			rethrow();
+			std::memcpy(data, s->data, itemCount * m_itemSize);
+			if (s->state == slot_ready) {
+				// Blocks prefetched before this one were skipped by the reader.
+				for (memory_size_type i = 0; i < m_slots.size(); ++i) {
+					slot & o = m_slots[i];
+					if (o.state == slot_reading || o.state == slot_ready)
+						if (o.seq < s->seq) discard(o);
+				}
+				release(*s);
+			}
+			return;
+		}
+		drain(lock);
+		lock.unlock();
+		if (m_accessor->read_block(data, block, itemCount) != itemCount)
+			throw io_exception("Incorrect number of items read");
+	}
+
+	void prefetch(stream_size_type block, memory_size_type itemCount) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_error || itemCount == 0 || find(block) != 0) return;
+		slot * s = free_slot();
+		if (s == 0) return;
+		schedule(*s, slot_reading, block, itemCount);
+	}
+
+	void write(const char * data, stream_size_type block, memory_size_type itemCount) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		rethrow();
+		for (memory_size_type i = 0; i < m_slots.size(); ++i) {
+			slot & o = m_slots[i];
+			if ((o.state == slot_reading || o.state == slot_ready) && o.block == block)
+				discard(o);
+		}
+		slot * s;
+		while ((s = free_slot()) == 0) {
+			if (!evict()) m_done.wait(lock);
+			rethrow();
+		}
+		std::memcpy(s->data, data, itemCount * m_itemSize);
+		schedule(*s, slot_writing, block, itemCount);
+	}
+
+	void drain() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		drain(lock);
+	}
+
+	void stop() {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_newRequest.notify_all();
+		}
+		m_thread.join();
+		std::unique_lock<std::mutex> lock(m_mutex);
+		rethrow();
+	}
+
+	memory_size_type depth() const {
+		return m_slots.size();
+	}
+
+private:
+	slot * find(stream_size_type block) {
+		slot * best = 0;
+		for (memory_size_type i = 0; i < m_slots.size(); ++i) {
+			slot & s = m_slots[i];
+			if (s.state == slot_free || s.stale || s.block != block) continue;
+			if (best == 0 || best->seq < s.seq) best = &s;
+		}
+		return best;
+	}
+
+	slot * free_slot() {
+		for (memory_size_type i = 0; i < m_slots.size(); ++i)
+			if (m_slots[i].state == slot_free) return &m_slots[i];
+		return 0;
+	}
+
+	bool evict() {
+		slot * oldest = 0;
+		for (memory_size_type i = 0; i < m_slots.size(); ++i) {
+			slot & s = m_slots[i];
+			if (s.state != slot_ready) continue;
+			if (oldest == 0 || s.seq < oldest->seq) oldest = &s;
+		}
+		if (oldest == 0) return false;
+		release(*oldest);
+		return true;
+	}
+
+	void schedule(slot & s, slot_state state, stream_size_type block, memory_size_type itemCount) {
+		s.state = state;
+		s.block = block;
+		s.items = itemCount;
+		s.stale = false;
+		s.seq = m_seq++;
+		m_queue.push_back(&s);
+		++m_pending;
+		m_newRequest.notify_one();
+	}
+
+	void discard(slot & s) {
+		if (s.state == slot_ready) release(s);
+		else s.stale = true;
+	}
+
+	void release(slot & s) {
+		s.state = slot_free;
+		s.stale = false;
+		m_done.notify_all();
+	}
+
+	void drain(std::unique_lock<std::mutex> & lock) {
+		while (m_pending > 0)
+			m_done.wait(lock);
+		for (memory_size_type i = 0; i < m_slots.size(); ++i)
+			if (m_slots[i].state == slot_ready) release(m_slots[i]);
+		rethrow();
+	}
+
+	void rethrow() {
+		if (!m_error) return;
+		std::exception_ptr e = m_error;
+		m_error = std::exception_ptr();
+		std::rethrow_exception(e);
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			while (m_queue.empty() && !m_stop)
+				m_newRequest.wait(lock);
+			if (m_queue.empty()) break;
+			slot & s = *m_queue.front();
+			m_queue.pop_front();
+			bool failed = false;
+			lock.unlock();
+			try {
+				if (s.state == slot_reading) {
+					if (m_accessor->read_block(s.data, s.block, s.items) != s.items)
+						throw io_exception("Incorrect number of items read");
+				} else {
+					m_accessor->write_block(s.data, s.block, s.items);
+				}
+			} catch (...) {
+				lock.lock();
+				if (!m_error) m_error = std::current_exception();
+				failed = true;
+				lock.unlock();
+			}
+			lock.lock();
+			if (s.state == slot_reading && !s.stale && !failed)
+				s.state = slot_ready;
+			else
+				s.state = slot_free;
+			s.stale = false;
+			--m_pending;
+			m_done.notify_all();
+		}
+	}
+
+	file_accessor::file_accessor * m_accessor;
+	memory_size_type m_blockSize;
+	memory_size_type m_itemSize;
+	array<slot> m_slots;
+	std::deque<slot *> m_queue;
+	memory_size_type m_pending;
+	stream_size_type m_seq;
+	bool m_stop;
+	std::exception_ptr m_error;
+	std::mutex m_mutex;
+	std::condition_variable m_newRequest;
+	std::condition_variable m_done;
+	std::thread m_thread;
+};
+
+async_block_io::async_block_io(file_accessor::file_accessor * accessor,
+							   memory_size_type blockSize,
+							   memory_size_type itemSize,
+							   memory_size_type depth)
+	: pimpl(tpie_new<impl>(accessor, blockSize, itemSize, depth))
+{
+}
+
+async_block_io::~async_block_io() {
+	try {
+		stop();
+	} catch (...) {
+	}
+}
+
+void async_block_io::read(char * data, stream_size_type block, memory_size_type itemCount) {
+	pimpl->read(data, block, itemCount);
+}
+
+void async_block_io::prefetch(stream_size_type block, memory_size_type itemCount) {
+	pimpl->prefetch(block, itemCount);
+}
+
+void async_block_io::write(const char * data, stream_size_type block, memory_size_type itemCount) {
+	pimpl->write(data, block, itemCount);
+}
+
+void async_block_io::drain() {
+	pimpl->drain();
+}
+
+void async_block_io::stop() {
+	if (pimpl == 0) return;
+	impl * p = pimpl;
+	pimpl = 0;
+	try {
+		p->stop();
+	} catch (...) {
+		tpie_delete(p);
+		throw;
+	}
+	tpie_delete(p);
+}
+
+memory_size_type async_block_io::depth() const {
+	return pimpl->depth();
+}
+
+/*static*/ memory_size_type async_block_io::memory_usage(memory_size_type blockSize,
+														 memory_size_type depth) {
+	return sizeof(async_block_io) + sizeof(impl)
+		+ depth * (sizeof(impl::slot) + blockSize);
+}
+
+} // namespace tpie
@@ -0,0 +1,121 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file async_block_io.h  Background read-ahead and write-behind of blocks
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TPIE_ASYNC_BLOCK_IO_H
+#define TPIE_ASYNC_BLOCK_IO_H
+
+#include <tpie/types.h>
+#include <tpie/file_accessor/file_accessor.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Asynchronous block I/O on behalf of a single uncompressed file.
+///
+/// A worker thread owns a fixed number of block sized slots, allocated
+/// through the TPIE memory manager. Blocks are prefetched into free slots,
+/// and dirty blocks are copied into a slot and written behind while the
+/// caller continues. A later read of a block that is still waiting to be
+/// written is served from the pending slot.
+///
+/// While the worker is running, only the worker may use the file accessor.
+/// The owner must call drain() before it uses the accessor directly, e.g.
+/// to truncate the file or to access the user data.
+///
+/// Exceptions thrown by the worker are rethrown by the next call to read(),
+/// write(), drain() or stop().
+///////////////////////////////////////////////////////////////////////////////
+class async_block_io {
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Start the worker thread.
+	///
+	/// \param accessor The file accessor of the open file.
+	/// \param blockSize The size of a block in bytes.
+	/// \param itemSize The size of an item in bytes.
+	/// \param depth The number of block slots.
+	///////////////////////////////////////////////////////////////////////////
+	async_block_io(file_accessor::file_accessor * accessor,
+				   memory_size_type blockSize,
+				   memory_size_type itemSize,
+				   memory_size_type depth);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Stop the worker, ignoring any pending exception.
+	///////////////////////////////////////////////////////////////////////////
+	~async_block_io();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Read the given block into data.
+	///
+	/// If the block is prefetched or waiting to be written, it is copied from
+	/// its slot. Otherwise, the worker is drained and the block is read
+	/// synchronously.
+	///////////////////////////////////////////////////////////////////////////
+	void read(char * data, stream_size_type block, memory_size_type itemCount);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Schedule a read of the given block if a slot is free.
+	///////////////////////////////////////////////////////////////////////////
+	void prefetch(stream_size_type block, memory_size_type itemCount);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Copy the given block into a slot and schedule it for writing.
+	///
+	/// Blocks until a slot is available.
+	///////////////////////////////////////////////////////////////////////////
+	void write(const char * data, stream_size_type block, memory_size_type itemCount);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for all scheduled I/O and discard prefetched blocks.
+	///
+	/// When drain() returns, the caller may use the file accessor directly
+	/// until the next call to read(), prefetch() or write().
+	///////////////////////////////////////////////////////////////////////////
+	void drain();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for all scheduled I/O and stop the worker thread.
+	///////////////////////////////////////////////////////////////////////////
+	void stop();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of block slots.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type depth() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Amount of memory used by an instance with the given number of
+	/// slots of the given block size.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type memory_usage(memory_size_type blockSize,
+										 memory_size_type depth);
+
+private:
+	class impl;
+	impl * pimpl;
+};
+
+} // namespace tpie
+
+#endif // TPIE_ASYNC_BLOCK_IO_H
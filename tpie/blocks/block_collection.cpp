@@ -61,16 +61,14 @@ void block_collection::read_block(block_handle handle, block & b) {
 
 	b.resize(handle.size);
 
-	m_accessor.seek_i(handle.position);
-	m_accessor.read_i(static_cast<void*>(b.get()), handle.size);
+	m_accessor.read_at_i(static_cast<void*>(b.get()), handle.size, handle.position);
 }
 
 void block_collection::write_block(block_handle handle, const block & b) {
 	tp_assert(m_writeable, "write_block(): the block collection is read only.");
 	tp_assert(handle.size >= b.size(), "the given block is not large enough.");
 
-	m_accessor.seek_i(handle.position);
-	m_accessor.write_i(static_cast<const void*>(b.get()), b.size());
+	m_accessor.write_at_i(static_cast<const void*>(b.get()), b.size(), handle.position);
 }
 
 } // namespace blocks
@@ -35,12 +35,9 @@ external_store_base::external_store_base(const std::string & path)
 			stream_size_type size = sizeof(size_t) * 2 + sizeof(blocks::block_handle);
 			tp_assert(m_accessor.file_size_i() >= size, "file is not empty but does not contain size btree_external_store information");
 			stream_size_type pos = m_accessor.file_size_i() - size;
-			m_accessor.seek_i(pos);
-			m_accessor.read_i((void*) &m_height, sizeof(size_t));
-			m_accessor.seek_i(pos + sizeof(size_t));
-			m_accessor.read_i((void*) &m_size, sizeof(size_t));
-			m_accessor.seek_i(pos + 2 * sizeof(size_t));
-			m_accessor.read_i((void*) &m_root, sizeof(blocks::block_handle));
+			m_accessor.read_at_i((void*) &m_height, sizeof(size_t), pos);
+			m_accessor.read_at_i((void*) &m_size, sizeof(size_t), pos + sizeof(size_t));
+			m_accessor.read_at_i((void*) &m_root, sizeof(blocks::block_handle), pos + 2 * sizeof(size_t));
 			m_accessor.truncate_i(pos);
 		}
 	}
@@ -52,12 +49,9 @@ external_store_base::~external_store_base() {
 	stream_size_type size = sizeof(size_t) * 2 + sizeof(blocks::block_handle);
 	stream_size_type pos = m_accessor.file_size_i();
 	m_accessor.truncate_i(pos + size);
-	m_accessor.seek_i(pos);
-	m_accessor.write_i((void*) &m_height, sizeof(size_t));
-	m_accessor.seek_i(pos + sizeof(size_t));
-	m_accessor.write_i((void*) &m_size, sizeof(size_t));
-	m_accessor.seek_i(pos + 2 * sizeof(size_t));
-	m_accessor.write_i((void*) &m_root, sizeof(blocks::block_handle));
+	m_accessor.write_at_i((void*) &m_height, sizeof(size_t), pos);
+	m_accessor.write_at_i((void*) &m_size, sizeof(size_t), pos + sizeof(size_t));
+	m_accessor.write_at_i((void*) &m_root, sizeof(blocks::block_handle), pos + 2 * sizeof(size_t));
 }
 
 } // namespace bits
@@ -28,11 +28,19 @@ public:
 
 	const static memory_size_type EXTRA_BUFFERS = 2;
 
-	impl() {
-		m_extraBuffers.reserve(EXTRA_BUFFERS);
-		for (size_t i = 0; i < EXTRA_BUFFERS; ++i) {
+	impl()
+		: m_sharedBuffers(0)
+	{
+		set_shared_buffer_count(EXTRA_BUFFERS);
+	}
+
+	void set_shared_buffer_count(memory_size_type count) {
+		tp_assert(m_extraBuffers.size() == m_sharedBuffers,
+				  "set_shared_buffer_count: Shared buffers are in use");
+		m_extraBuffers.resize(std::min(count, m_sharedBuffers));
+		while (m_extraBuffers.size() < count)
 			m_extraBuffers.push_back(std::make_shared<compressor_buffer>(block_size()));
-		}
+		m_sharedBuffers = count;
 	}
 
 	buffer_t allocate_own_buffer() {
@@ -61,7 +69,7 @@ public:
 
 	void release_shared_buffer(buffer_t & b) {
 		tp_assert(b.unique(), "release_shared_buffer: !b.unique");
-		tp_assert(!(m_extraBuffers.size() == EXTRA_BUFFERS), "release_shared_buffer: Too many available shared buffers");
+		tp_assert(!(m_extraBuffers.size() == m_sharedBuffers), "release_shared_buffer: Too many available shared buffers");
 
 		m_extraBuffers.push_back(buffer_t());
 		m_extraBuffers.back().swap(b);
@@ -73,6 +81,7 @@ private:
 	}
 
 	std::vector<buffer_t> m_extraBuffers;
+	memory_size_type m_sharedBuffers;
 };
 
 stream_buffer_pool::stream_buffer_pool()
@@ -104,6 +113,10 @@ void stream_buffer_pool::release_shared_buffer(buffer_t & b) {
 	pimpl->release_shared_buffer(b);
 }
 
+void stream_buffer_pool::set_shared_buffer_count(memory_size_type count) {
+	pimpl->set_shared_buffer_count(count);
+}
+
 } // namespace tpie
 
 namespace {
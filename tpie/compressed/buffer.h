@@ -84,9 +84,9 @@ struct compressor_buffer_state {
 ///////////////////////////////////////////////////////////////////////////////
 class compressor_buffer {
 private:
-	typedef array<char> storage_t;
-
-	storage_t m_storage;
+	// Aligned, so that uncompressed blocks may be written with direct I/O.
+	char * m_storage;
+	memory_size_type m_capacity;
 	memory_size_type m_size;
 	compressor_buffer_state::type m_state;
 	stream_size_type m_readOffset;
@@ -94,7 +94,8 @@ private:
 
 public:
 	compressor_buffer(memory_size_type capacity)
-		: m_storage(capacity)
+		: m_storage(tpie_new_aligned_buffer(capacity))
+		, m_capacity(capacity)
 		, m_size(0)
 		, m_state(compressor_buffer_state::dirty)
 		, m_readOffset(1111111111111111111ull)
@@ -102,6 +103,13 @@ public:
 	{
 	}
 
+	~compressor_buffer() {
+		tpie_delete_aligned_buffer(m_storage, m_capacity);
+	}
+
+	compressor_buffer(const compressor_buffer &) = delete;
+	compressor_buffer & operator=(const compressor_buffer &) = delete;
+
 	compressor_buffer_state::type get_state() const {
 		return m_state;
 	}
@@ -133,14 +141,14 @@ public:
 	/// \brief  Get pointer to buffer storage.
 	///////////////////////////////////////////////////////////////////////////////
 	char * get() {
-		return m_storage.get();
+		return m_storage;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
 	/// \brief  Get pointer to buffer storage.
 	///////////////////////////////////////////////////////////////////////////////
 	const char * get() const {
-		return m_storage.get();
+		return m_storage;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -154,7 +162,7 @@ public:
 	/// \brief  Get maximal byte size of buffer.
 	///////////////////////////////////////////////////////////////////////////////
 	memory_size_type capacity() const {
-		return m_storage.size();
+		return m_capacity;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -168,7 +176,13 @@ public:
 	/// \brief  Resize internal buffer, clearing all elements.
 	///////////////////////////////////////////////////////////////////////////////
 	void set_capacity(memory_size_type capacity) {
-		m_storage.resize(capacity);
+		if (capacity != m_capacity) {
+			tpie_delete_aligned_buffer(m_storage, m_capacity);
+			m_storage = 0;
+			m_capacity = 0;
+			m_storage = tpie_new_aligned_buffer(capacity);
+			m_capacity = capacity;
+		}
 		m_size = 0;
 	}
 
@@ -200,7 +214,9 @@ public:
 ///
 /// In addition, on program startup we allocate a number of shared buffers
 /// on program startup which any stream may use for additional efficiency.
-/// Currently, we allocate two such shared buffers.
+/// The compressor pool sets the number of shared buffers to one more than
+/// its number of workers, so that a single stream can keep every worker
+/// busy.
 ///
 /// The stream_buffer_pool class is responsible for allocating and deallocating
 /// both the streams' own buffers and the shared buffers.
@@ -222,6 +238,13 @@ public:
 	buffer_t take_shared_buffer();
 	void release_shared_buffer(buffer_t &);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Change the number of shared buffers.
+	///
+	/// Must not be called while any stream holds a shared buffer.
+	///////////////////////////////////////////////////////////////////////////
+	void set_shared_buffer_count(memory_size_type count);
+
 private:
 	class impl;
 	impl * pimpl;
@@ -0,0 +1,161 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/compressed/controller.h>
+#include <tpie/stats.h>
+
+namespace {
+
+// Weight of a new measurement in the moving averages.
+const double alpha = 0.1;
+
+// A window that has not ended after this many seconds is abandoned,
+// for instance because its file was closed.
+const double window_timeout = 60.0;
+
+double updated_average(double average, double measurement) {
+	if (average <= 0.0)
+		return measurement;
+	else
+		return average + alpha * (measurement - average);
+}
+
+void update_average(std::atomic<double> & average, double measurement) {
+	double old = average.load(std::memory_order_relaxed);
+	while (!average.compare_exchange_weak(old, updated_average(old, measurement),
+										  std::memory_order_relaxed)) {}
+}
+
+void add(std::atomic<double> & sum, double x) {
+	double old = sum.load(std::memory_order_relaxed);
+	while (!sum.compare_exchange_weak(old, old + x, std::memory_order_relaxed)) {}
+}
+
+} // unnamed namespace
+
+namespace tpie {
+
+void compression_stream_statistics::set_ratio(double ratio) {
+	double scaled = ratio * ratio_scale + 0.5;
+	if (scaled < 1.0) scaled = 1.0;
+	if (scaled > 65535.0) scaled = 65535.0;
+	m_ratio.store(static_cast<uint16_t>(scaled), std::memory_order_relaxed);
+}
+
+compression_controller::compression_controller()
+	: m_diskSpeed(0.0)
+	, m_windowFile(nullptr)
+	, m_windowBytes(0)
+	, m_windowSeconds(0.0)
+	, m_windowStart(0.0)
+	, m_windowEnd(-window_interval())
+	, m_epoch(ptime::now())
+{
+	for (size_t i = 0; i < SCHEMES; ++i) m_compressionSpeed[i] = 0.0;
+}
+
+double compression_controller::now() const {
+	return ptime::seconds(m_epoch, ptime::now());
+}
+
+compression_scheme::type compression_controller::choose(compression_stream_statistics & stream,
+														compression_scheme::type scheme)
+{
+	if (scheme == compression_scheme::none) return scheme;
+
+	double compressionSpeed = compression_speed(scheme);
+	double diskSpeed = disk_speed();
+	// Compress until we know enough to estimate the benefit.
+	if (!stream.has_ratio() || compressionSpeed <= 0.0 || diskSpeed <= 0.0)
+		return scheme;
+
+	const double compressedCost = 1.0 / compressionSpeed + stream.ratio() / diskSpeed;
+	const double uncompressedCost = 1.0 / diskSpeed;
+	if (compressedCost < uncompressedCost) {
+		stream.m_blocksSinceProbe.store(0, std::memory_order_relaxed);
+		return scheme;
+	}
+	if (stream.m_blocksSinceProbe.fetch_add(1, std::memory_order_relaxed) + 1u >= probe_interval()) {
+		stream.m_blocksSinceProbe.store(0, std::memory_order_relaxed);
+		increment_user(10, 1);
+		return scheme;
+	}
+	increment_user(9, 1);
+	return compression_scheme::none;
+}
+
+void compression_controller::record_compression(compression_stream_statistics & stream,
+												compression_scheme::type scheme,
+												memory_size_type inputBytes,
+												memory_size_type outputBytes,
+												double seconds)
+{
+	if (inputBytes == 0) return;
+	double ratio = stream.has_ratio() ? stream.ratio() : 0.0;
+	stream.set_ratio(updated_average(ratio, (double) outputBytes / (double) inputBytes));
+	if (seconds <= 0.0 || (size_t) scheme >= SCHEMES) return;
+	update_average(m_compressionSpeed[scheme], inputBytes / seconds);
+}
+
+bool compression_controller::record_write(const void * file, memory_size_type bytes, double seconds) {
+	if (bytes == 0) return false;
+	const void * windowFile = m_windowFile.load(std::memory_order_acquire);
+	if (windowFile != file) {
+		// Start measuring this file if no window is open and the last one
+		// ended long enough ago, or if the open window was abandoned.
+		const double t = now();
+		const bool start = windowFile == nullptr
+			? t - m_windowEnd.load(std::memory_order_relaxed) >= window_interval()
+			: t - m_windowStart.load(std::memory_order_relaxed) >= window_timeout;
+		if (!start || !m_windowFile.compare_exchange_strong(windowFile, file,
+															 std::memory_order_acq_rel))
+			return false;
+		m_windowBytes.store(0, std::memory_order_relaxed);
+		m_windowSeconds.store(0.0, std::memory_order_relaxed);
+		m_windowStart.store(t, std::memory_order_relaxed);
+	}
+	add(m_windowSeconds, seconds);
+	return m_windowBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes >= window_bytes();
+}
+
+void compression_controller::record_sync(const void * file, double seconds) {
+	if (m_windowFile.load(std::memory_order_acquire) != file) return;
+	const double totalSeconds = m_windowSeconds.load(std::memory_order_relaxed) + seconds;
+	const stream_size_type bytes = m_windowBytes.load(std::memory_order_relaxed);
+	if (totalSeconds > 0.0 && bytes > 0)
+		update_average(m_diskSpeed, bytes / totalSeconds);
+	m_windowEnd.store(now(), std::memory_order_relaxed);
+	m_windowFile.store(nullptr, std::memory_order_release);
+}
+
+double compression_controller::compression_speed(compression_scheme::type scheme) {
+	if ((size_t) scheme >= SCHEMES) return 0.0;
+	return m_compressionSpeed[scheme].load(std::memory_order_relaxed);
+}
+
+double compression_controller::disk_speed() {
+	return m_diskSpeed.load(std::memory_order_relaxed);
+}
+
+compression_controller & the_compression_controller() {
+	static compression_controller controller;
+	return controller;
+}
+
+} // namespace tpie
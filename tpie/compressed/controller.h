@@ -0,0 +1,185 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef TPIE_COMPRESSED_CONTROLLER_H
+#define TPIE_COMPRESSED_CONTROLLER_H
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file compressed/controller.h  Adaptive choice of compression scheme.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <tpie/types.h>
+#include <tpie/stats.h>
+#include <tpie/compressed/scheme.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Measurements of a single stream used by compression_controller.
+///
+/// Several compressor workers may service blocks of the same stream at
+/// once, so the measurements are relaxed atomics; a lost update only delays
+/// the moving average slightly.
+///////////////////////////////////////////////////////////////////////////////
+class compression_stream_statistics {
+public:
+	compression_stream_statistics() {
+		reset();
+	}
+
+	void reset() {
+		m_ratio.store(0, std::memory_order_relaxed);
+		m_blocksSinceProbe.store(0, std::memory_order_relaxed);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Whether a compressed block of this stream has been measured.
+	///////////////////////////////////////////////////////////////////////////
+	bool has_ratio() const { return m_ratio.load(std::memory_order_relaxed) != 0; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Average ratio of compressed size to uncompressed size.
+	///////////////////////////////////////////////////////////////////////////
+	double ratio() const { return m_ratio.load(std::memory_order_relaxed) / ratio_scale; }
+
+private:
+	// Kept small, since every stream accessor embeds one: the ratio is
+	// stored in fixed point, with zero meaning that it is not yet known.
+	static constexpr double ratio_scale = 16384.0;
+
+	void set_ratio(double ratio);
+
+	std::atomic<uint16_t> m_ratio;
+	std::atomic<uint8_t> m_blocksSinceProbe;
+
+	friend class compression_controller;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Feedback controller choosing whether to compress a block.
+///
+/// The controller keeps moving averages of the compression throughput of
+/// each scheme and of the disk write throughput, and each stream keeps the
+/// compression ratio of its data. Writing a block of n bytes is estimated
+/// to take n/C + r*n/D seconds when compressed and n/D seconds when not,
+/// where C is the compression throughput, D is the disk throughput and r is
+/// the compression ratio, and the cheaper alternative is chosen.
+///
+/// While compression is being skipped for a stream, every probe_interval()
+/// blocks are compressed anyway to keep the ratio of that stream current.
+///
+/// Writes usually land in the page cache and return long before the data
+/// is on disk, so timing them alone measures memory bandwidth. The disk
+/// throughput is instead measured in windows: the writes to one file are
+/// summed until window_bytes() have been written, and the writer then syncs
+/// the file, so the window ends when its data is on disk. Only one file is
+/// measured at a time, and a new window starts at most once every
+/// window_interval() seconds to bound the cost of the syncs.
+///
+/// All measurements are kept in atomics, so the compressor workers never
+/// wait for each other in the controller.
+///
+/// Decisions are reported through the stats user counters 9 (blocks left
+/// uncompressed by the controller) and 10 (blocks compressed to probe).
+///////////////////////////////////////////////////////////////////////////////
+class compression_controller {
+public:
+	compression_controller();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Choose the scheme of the next block written to a stream.
+	///
+	/// \param stream  Measurements of the stream.
+	/// \param scheme  The compression scheme the stream was opened with.
+	/// \returns \c scheme or compression_scheme::none.
+	///////////////////////////////////////////////////////////////////////////
+	compression_scheme::type choose(compression_stream_statistics & stream,
+									compression_scheme::type scheme);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Record that a block of \c inputBytes was compressed to
+	/// \c outputBytes in \c seconds.
+	///////////////////////////////////////////////////////////////////////////
+	void record_compression(compression_stream_statistics & stream,
+							compression_scheme::type scheme,
+							memory_size_type inputBytes,
+							memory_size_type outputBytes,
+							double seconds);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Record that \c bytes were written to \c file in \c seconds.
+	///
+	/// The writes to a file must be recorded one at a time.
+	///
+	/// \returns  Whether the measurement window of the file is full, in which
+	/// case the caller must sync the file and call record_sync.
+	///////////////////////////////////////////////////////////////////////////
+	bool record_write(const void * file, memory_size_type bytes, double seconds);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Record that syncing \c file took \c seconds, ending its
+	/// measurement window.
+	///////////////////////////////////////////////////////////////////////////
+	void record_sync(const void * file, double seconds);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Estimated compression throughput of the scheme in bytes per
+	/// second of uncompressed input, or 0 if not yet measured.
+	///////////////////////////////////////////////////////////////////////////
+	double compression_speed(compression_scheme::type scheme);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Estimated disk write throughput in bytes per second, or 0 if
+	/// not yet measured.
+	///////////////////////////////////////////////////////////////////////////
+	double disk_speed();
+
+	static memory_size_type probe_interval() { return 16; }
+
+	static memory_size_type window_bytes() { return 32*1024*1024; }
+
+	static double window_interval() { return 10.0; }
+
+private:
+	static const size_t SCHEMES = 4;
+
+	// Seconds since the controller was created.
+	double now() const;
+
+	std::atomic<double> m_compressionSpeed[SCHEMES];
+	std::atomic<double> m_diskSpeed;
+
+	// The file being measured, or nullptr.
+	std::atomic<const void *> m_windowFile;
+	std::atomic<stream_size_type> m_windowBytes;
+	std::atomic<double> m_windowSeconds;
+	std::atomic<double> m_windowStart;
+	std::atomic<double> m_windowEnd;
+	ptime m_epoch;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  The controller used by the compressor threads.
+///////////////////////////////////////////////////////////////////////////////
+compression_controller & the_compression_controller();
+
+} // namespace tpie
+
+#endif // TPIE_COMPRESSED_CONTROLLER_H
@@ -24,6 +24,8 @@
 /// \file compressed/predeclare.h  Useful compressed stream predeclarations.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <tpie/types.h>
+
 namespace tpie {
 
 // thread.h
@@ -31,9 +33,15 @@ class compressor_thread;
 class compressor_thread_lock;
 
 // thread.cpp
-void init_compressor();
+void init_compressor(memory_size_type threads = 0);
 void finish_compressor();
 compressor_thread & the_compressor_thread();
+/** Number of compressor workers started when none is given to tpie_init.
+ * Can be set with the TPIE_COMPRESSOR_THREADS environment variable. */
+memory_size_type default_compressor_thread_count();
+/** Restart the compressor pool with the given number of workers.
+ * Must not be called while any compressed streams are open. */
+void set_compressor_thread_count(memory_size_type threads);
 
 // buffer.h
 class compressor_buffer;
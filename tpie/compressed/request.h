@@ -225,6 +225,10 @@ public:
 		return *m_fileAccessor;
 	}
 
+	const file_accessor_t & file_accessor() const {
+		return *m_fileAccessor;
+	}
+
 	stream_size_type read_offset() {
 		return m_readOffset;
 	}
@@ -270,6 +274,10 @@ public:
 		return *m_fileAccessor;
 	}
 
+	const file_accessor_t & file_accessor() const {
+		return *m_fileAccessor;
+	}
+
 	buffer_t buffer() {
 		return m_buffer;
 	}
@@ -51,7 +51,9 @@ class compression_scheme {
 public:
 	enum type {
 		none = 0,
-		snappy = 1
+		snappy = 1,
+		lz4 = 2,
+		zstd = 3
 	};
 
 	///////////////////////////////////////////////////////////////////////////
@@ -66,8 +68,11 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Compress data from \c src into \c dest, returning its size in
 	/// \c destSize.
+	///
+	/// \param level  Scheme-specific compression level, or 0 for the default
+	/// level. Schemes without compression levels ignore this parameter.
 	///////////////////////////////////////////////////////////////////////////
-	virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize) const = 0;
+	virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int level) const = 0;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Get the uncompressed size of the compressed block at \c src.
@@ -85,6 +90,13 @@ protected:
 
 const compression_scheme & get_compression_scheme_none();
 const compression_scheme & get_compression_scheme_snappy();
+const compression_scheme & get_compression_scheme_lz4();
+const compression_scheme & get_compression_scheme_zstd();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Whether support for the given compression scheme is built in.
+///////////////////////////////////////////////////////////////////////////////
+bool compression_scheme_available(compression_scheme::type t);
 
 inline const compression_scheme & get_compression_scheme(compression_scheme::type t) {
 	switch (t) {
@@ -92,6 +104,10 @@ inline const compression_scheme & get_compression_scheme(compression_scheme::typ
 			return get_compression_scheme_none();
 		case compression_scheme::snappy:
 			return get_compression_scheme_snappy();
+		case compression_scheme::lz4:
+			return get_compression_scheme_lz4();
+		case compression_scheme::zstd:
+			return get_compression_scheme_zstd();
 	}
 	return get_compression_scheme_none();
 }
@@ -30,7 +30,7 @@ virtual size_t max_compressed_length(size_t srcSize) const override {
 	return srcSize;
 }
 
-virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize) const override {
+virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int /*level*/) const override {
 	memcpy(dest, src, srcSize);
 	*destSize = srcSize;
 }
@@ -55,4 +55,30 @@ const compression_scheme & get_compression_scheme_none() {
 	return the_compression_scheme;
 }
 
+bool compression_scheme_available(compression_scheme::type t) {
+	switch (t) {
+		case compression_scheme::none:
+			return true;
+		case compression_scheme::snappy:
+#ifdef TPIE_HAS_SNAPPY
+			return true;
+#else // TPIE_HAS_SNAPPY
+			return false;
+#endif // TPIE_HAS_SNAPPY
+		case compression_scheme::lz4:
+#ifdef TPIE_HAS_LZ4
+			return true;
+#else // TPIE_HAS_LZ4
+			return false;
+#endif // TPIE_HAS_LZ4
+		case compression_scheme::zstd:
+#ifdef TPIE_HAS_ZSTD
+			return true;
+#else // TPIE_HAS_ZSTD
+			return false;
+#endif // TPIE_HAS_ZSTD
+	}
+	return false;
+}
+
 } // namespace tpie
@@ -37,7 +37,7 @@ virtual size_t max_compressed_length(size_t srcSize) const override {
 	return snappy::MaxCompressedLength(srcSize);
 }
 
-virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize) const override {
+virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int /*level*/) const override {
 	tpie::stat_timer t(5); // Time compressing
 	snappy::RawCompress(src, srcSize, dest, destSize);
 }
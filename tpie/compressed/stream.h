@@ -58,6 +58,19 @@ struct open {
 		 * which can be set using
 		 * tpie::the_compressor_thread().set_preferred_compression(). */
 		compression_all = 00000040,
+		/** Compress blocks using snappy
+		 * rather than the preferred compression scheme. */
+		scheme_snappy = 00000100,
+		/** Compress blocks using LZ4
+		 * rather than the preferred compression scheme. */
+		scheme_lz4 = 00000200,
+		/** Compress blocks using Zstandard
+		 * rather than the preferred compression scheme. */
+		scheme_zstd = 00000300,
+		/** Mask of the scheme_* flags. */
+		scheme_mask = 00000700,
+		/** Mask of the compression level set by compression_level(). */
+		level_mask = 00037000,
 
 		defaults = 0
 	};
@@ -101,6 +114,38 @@ struct open {
 			throw tpie::stream_exception("Invalid cache flags supplied");
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Flag selecting a scheme-specific compression level between
+	/// 1 and 31.
+	///
+	/// For Zstandard the level is the compression level, and levels above
+	/// ZSTD_maxCLevel() (22) are treated as the maximum. For LZ4 it is the
+	/// acceleration factor, where higher is faster. Snappy ignores the level.
+	///////////////////////////////////////////////////////////////////////////
+	static type compression_level(int level) {
+		return (type) ((level << level_shift) & level_mask);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  The compression scheme selected by the scheme_* flags, or
+	/// \c preferred if none was given.
+	///////////////////////////////////////////////////////////////////////////
+	static compression_scheme::type translate_scheme(open::type openFlags,
+													 compression_scheme::type preferred)
+	{
+		switch (openFlags & scheme_mask) {
+			case defaults: return preferred;
+			case scheme_snappy: return compression_scheme::snappy;
+			case scheme_lz4: return compression_scheme::lz4;
+			case scheme_zstd: return compression_scheme::zstd;
+			default: throw tpie::stream_exception("Invalid compression scheme flags supplied");
+		}
+	}
+
+	static int translate_level(open::type openFlags) {
+		return (openFlags & level_mask) >> level_shift;
+	}
+
 	static compression_flags translate_compression(open::type openFlags) {
 		const open::type compressionFlags =
 			openFlags & (open::compression_normal | open::compression_all);
@@ -114,6 +159,9 @@ struct open {
 		else
 			throw tpie::stream_exception("Invalid compression flags supplied");
 	}
+
+private:
+	static const int level_shift = 9;
 };
 
 
@@ -289,6 +337,16 @@ public:
 	///     scheme, which can be set using
 	///     tpie::the_compressor_thread().set_preferred_compression().
 	///
+	/// open::scheme_snappy, open::scheme_lz4, open::scheme_zstd
+	///     Compress blocks written through this stream using the given scheme
+	///     instead of the preferred compression scheme. The scheme is recorded
+	///     in each block, so a stream may contain blocks of several schemes.
+	///
+	/// open::compression_level(n)
+	///     Pass the level n, between 1 and 31, to the compression scheme:
+	///     the Zstandard compression level, capped at ZSTD_maxCLevel(), or
+	///     the LZ4 acceleration factor. Snappy ignores the level.
+	///
 	/// \param path  The path to the file to open
 	/// \param openFlags  A bit-wise combination of the flags; see above.
 	/// \param userDataSize  Required user data capacity in stream header.
@@ -314,6 +372,12 @@ public:
 
 	void close();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Whether the open stream stores its blocks compressed, in which
+	/// case seek() only supports offset 0 and the end of the stream.
+	///////////////////////////////////////////////////////////////////////////
+	bool is_compressed() { return use_compression(); }
+
 protected:
 	void finish_requests(compressor_thread_lock & l);
 
@@ -888,6 +952,7 @@ public:
 	/// \c get_position.
 	///////////////////////////////////////////////////////////////////////////
 	void set_position(const stream_position & pos) {
+		uncache_read_writes();
 		m_updateReadOffsetFromWrite = false;
 
 		// If the code is correct, short circuiting is not necessary;
@@ -928,7 +993,6 @@ public:
 
 		m_nextPosition = pos;
 		m_seekState = seek_state::position;
-		uncache_read_writes();
 	}
 
 	///////////////////////////////////////////////////////////////////////////
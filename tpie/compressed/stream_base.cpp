@@ -80,9 +80,19 @@ void compressed_stream_base::open_inner(const std::string & path,
 	const cache_hint cacheHint = open::translate_cache(openFlags);
 	const compression_flags compressionFlags = open::translate_compression(openFlags);
 
+	compression_scheme::type preferredScheme;
+	{
+		compressor_thread_lock l(compressor());
+		preferredScheme = compressor().get_preferred_compression(l);
+	}
+
+	m_byteStreamAccessor.set_direct_io(m_tempFile != NULL && tempname::get_direct_io());
 	m_byteStreamAccessor.open(path, m_canRead, m_canWrite, m_itemSize,
 							  m_blockSize, userDataSize, cacheHint,
 							  compressionFlags);
+	m_byteStreamAccessor.set_compression_scheme(
+		open::translate_scheme(openFlags, preferredScheme),
+		open::translate_level(openFlags));
 	m_size = m_byteStreamAccessor.size();
 	m_open = true;
 	m_streamBlocks = (m_size + m_blockItems - 1) / m_blockItems;
@@ -17,11 +17,17 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 
-#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <tpie/compressed/thread.h>
 #include <tpie/compressed/request.h>
 #include <tpie/compressed/buffer.h>
 #include <tpie/compressed/scheme.h>
+#include <tpie/compressed/controller.h>
+#include <tpie/job.h>
 #include <condition_variable>
 namespace {
 
@@ -56,6 +62,17 @@ public:
 		m_payload |= scheme << BLOCK_SIZE_BITS;
 	}
 
+	// A padded block ends its payload with zeros and the length of the
+	// compressed data, so that the block fills whole direct I/O units.
+	bool get_padded() const {
+		return (m_payload & PADDED_FLAG) != 0;
+	}
+
+	void set_padded(bool padded) {
+		m_payload &= ~PADDED_FLAG;
+		if (padded) m_payload |= PADDED_FLAG;
+	}
+
 	bool operator==(const block_header & other) const {
 		return m_payload == other.m_payload;
 	}
@@ -67,12 +84,42 @@ private:
 	static const tpie::uint32_t BLOCK_SIZE_MASK = (1 << BLOCK_SIZE_BITS) - 1;
 	static const tpie::memory_size_type BLOCK_SIZE_MAX =
 		static_cast<tpie::memory_size_type>(1 << BLOCK_SIZE_BITS) - 1;
-	static const tpie::uint32_t COMPRESSION_BITS = 8;
+	static const tpie::uint32_t COMPRESSION_BITS = 7;
 	static const tpie::uint32_t COMPRESSION_MASK = ((1 << COMPRESSION_BITS) - 1) << BLOCK_SIZE_BITS;
+	static const tpie::uint32_t PADDED_FLAG = 1u << (BLOCK_SIZE_BITS + COMPRESSION_BITS);
 
 	tpie::uint32_t m_payload;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// Scratch buffer aligned for direct I/O.
+///////////////////////////////////////////////////////////////////////////////
+class aligned_scratch {
+public:
+	aligned_scratch(): m_data(0), m_size(0) {}
+
+	~aligned_scratch() {
+		resize(0);
+	}
+
+	void resize(tpie::memory_size_type size) {
+		if (m_data != 0) tpie::tpie_delete_aligned_buffer(m_data, m_size);
+		m_data = 0;
+		m_size = size;
+		if (size != 0) m_data = tpie::tpie_new_aligned_buffer(size);
+	}
+
+	char * get() const { return m_data; }
+	tpie::memory_size_type size() const { return m_size; }
+
+private:
+	aligned_scratch(const aligned_scratch &);
+	aligned_scratch & operator=(const aligned_scratch &);
+
+	char * m_data;
+	tpie::memory_size_type m_size;
+};
+
 }
 
 namespace tpie {
@@ -86,12 +133,18 @@ public:
 	impl()
 		: m_done(false)
 		, m_preferredCompression(compression_scheme::snappy)
+		, m_threadCount(0)
 	{
 	}
 
 	void stop(compressor_thread_lock & /*lock*/) {
 		m_done = true;
-		m_newRequest.notify_one();
+		m_newRequest.notify_all();
+	}
+
+	void start(compressor_thread_lock & /*lock*/, memory_size_type threadCount) {
+		m_done = false;
+		m_threadCount = threadCount;
 	}
 
 	bool request_valid(const compressor_request & r) {
@@ -108,34 +161,97 @@ public:
 	void run() {
 		while (true) {
 			compressor_thread_lock::lock_t lock(mutex());
-			m_idle = false;
-			while (!m_done && m_requests.empty()) {
-				m_idle = true;
-				m_newRequest.wait(lock);
-			}
-			if (m_done && m_requests.empty()) break;
-			{
-				compressor_request r = m_requests.front();
-				m_requests.pop();
-				lock.unlock();
-
-				switch (r.kind()) {
-					case compressor_request_kind::NONE:
-						throw exception("Invalid request");
-					case compressor_request_kind::READ:
-						process_read_request(r.get_read_request());
-						break;
-					case compressor_request_kind::WRITE:
-						process_write_request(r.get_write_request());
-						break;
-				}
+			while (m_requests.empty() && !m_done) m_newRequest.wait(lock);
+			if (m_requests.empty()) break;
+			queued_request q = m_requests.front();
+			m_requests.pop_front();
+			lock.unlock();
+
+			compressor_request & r = q.request;
+			switch (r.kind()) {
+				case compressor_request_kind::NONE:
+					throw exception("Invalid request");
+				case compressor_request_kind::READ:
+					process_read_request(r.get_read_request(), q.sequence);
+					break;
+				case compressor_request_kind::WRITE:
+					process_write_request(r.get_write_request(), q.sequence);
+					break;
 			}
+
 			lock.lock();
 			m_requestDone.notify_all();
 		}
 	}
 
 private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  A request along with its position among the requests issued
+	/// for the same stream.
+	///////////////////////////////////////////////////////////////////////////
+	struct queued_request {
+		queued_request(const compressor_request & r, stream_size_type s)
+			: request(r)
+			, sequence(s)
+		{
+		}
+
+		compressor_request request;
+		stream_size_type sequence;
+	};
+
+	typedef std::deque<queued_request> request_queue_t;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Ordering of the requests of one stream.
+	///
+	/// Several requests of a stream may be serviced at the same time, but
+	/// their file I/O must happen in the order they were issued, since a
+	/// compressed block is appended at the offset where the previous block
+	/// ended, and a read must see the blocks written before it.
+	/// Each request is given the next sequence number of its stream when it
+	/// is issued, and waits in begin_io until all requests of the stream
+	/// with smaller numbers have done their I/O.
+	///////////////////////////////////////////////////////////////////////////
+	struct stream_order {
+		stream_size_type issued = 0;
+		stream_size_type completed = 0;
+	};
+
+	typedef std::unordered_map<const void *, stream_order> stream_orders_t;
+
+	static const void * request_stream(const compressor_request & r) {
+		switch (r.kind()) {
+			case compressor_request_kind::NONE:
+				break;
+			case compressor_request_kind::READ:
+				return &r.get_read_request().file_accessor();
+			case compressor_request_kind::WRITE:
+				return &r.get_write_request().file_accessor();
+		}
+		return 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wait until it is the turn of the request to do I/O.
+	///
+	/// Since the queue is serviced in order, all earlier requests of the
+	/// stream are already being serviced, so the wait always ends.
+	///////////////////////////////////////////////////////////////////////////
+	void begin_io(compressor_thread_lock::lock_t & lock, const void * stream, stream_size_type sequence) {
+		stat_timer t(2); // Time waiting
+		while (m_streamOrders[stream].completed != sequence) m_ioDone.wait(lock);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Let the next request of the stream do I/O. Must have lock!
+	///////////////////////////////////////////////////////////////////////////
+	void end_io(const void * stream) {
+		stream_orders_t::iterator i = m_streamOrders.find(stream);
+		if (++i->second.completed == i->second.issued) m_streamOrders.erase(i);
+		m_ioDone.notify_all();
+	}
+
 	void checked_read(read_request & rr, stream_size_type readOffset, void * buf, memory_size_type count) {
 		memory_size_type nRead = rr.file_accessor().read(readOffset, buf, count);
 		if (nRead != count) {
@@ -143,12 +259,17 @@ private:
 		}
 	}
 
-	void process_read_request(read_request & rr) {
+	void process_read_request(read_request & rr, stream_size_type sequence) {
 		stat_timer t(3); // Time reading
+		const void * stream = &rr.file_accessor();
 		const bool useCompression = rr.file_accessor().get_compressed();
 		const bool backward = rr.get_read_direction() == read_direction::backward;
 		tp_assert(!(backward && !useCompression), "backward && !useCompression");
 
+		compressor_thread_lock::lock_t lock(mutex());
+		begin_io(lock, stream, sequence);
+		lock.unlock();
+
 		stream_size_type readOffset = rr.read_offset();
 		if (!useCompression) {
 			memory_size_type blockSize = rr.buffer()->size();
@@ -157,52 +278,93 @@ private:
 			}
 			rr.file_accessor().read(readOffset, rr.buffer()->get(), blockSize);
 			rr.buffer()->set_size(blockSize);
-			compressor_thread_lock::lock_t lock(mutex());
+			lock.lock();
+			end_io(stream);
 			// Notify that reading has completed.
 			rr.set_next_block_offset(1111111111111111111ull);
 			rr.buffer()->transition_state(compressor_buffer_state::reading,
 										  compressor_buffer_state::clean);
 			return;
 		}
+		// Read a first unit holding the header or trailer, and then the rest
+		// of the block. On a file with direct I/O the unit is a whole
+		// direct I/O unit, so that padded blocks are read bypassing the
+		// page cache.
+		const memory_size_type unit = rr.file_accessor().direct_io_active()
+			? direct_io_alignment : sizeof(block_header);
 		block_header blockHeader;
 		block_header blockTrailer;
-		memory_size_type blockSize;
-		array<char> scratch;
-		char * compressed;
+		aligned_scratch first;
+		aligned_scratch scratch;
+		memory_size_type blockBytes;
 		stream_size_type nextReadOffset;
 		if (backward) {
-			readOffset -= sizeof(blockTrailer);
-			checked_read(rr, readOffset, &blockTrailer, sizeof(blockTrailer));
-			blockSize = blockTrailer.get_block_size();
-			if (blockSize == 0) {
+			const memory_size_type firstSize = static_cast<memory_size_type>(
+				std::min<stream_size_type>(unit, readOffset));
+			first.resize(firstSize);
+			checked_read(rr, readOffset - firstSize, first.get(), firstSize);
+			memcpy(&blockTrailer, first.get() + firstSize - sizeof(blockTrailer), sizeof(blockTrailer));
+			blockBytes = sizeof(blockHeader) + blockTrailer.get_block_size() + sizeof(blockTrailer);
+			if (blockTrailer.get_block_size() == 0) {
 				throw exception("Block size was unexpectedly zero");
 			}
-			scratch.resize(sizeof(blockHeader) + blockSize);
-			readOffset -= scratch.size();
-			checked_read(rr, readOffset, scratch.get(), scratch.size());
-			compressed = scratch.get() + sizeof(blockHeader);
-			memcpy(&blockHeader,
-				   reinterpret_cast<block_header *>(scratch.get()),
-				   sizeof(blockHeader));
+			if (blockBytes > readOffset) {
+				throw exception("Block extends before the start of the stream");
+			}
+			scratch.resize(blockBytes);
+			if (blockBytes <= firstSize) {
+				memcpy(scratch.get(), first.get() + firstSize - blockBytes, blockBytes);
+			} else {
+				checked_read(rr, readOffset - blockBytes, scratch.get(), blockBytes - firstSize);
+				memcpy(scratch.get() + blockBytes - firstSize, first.get(), firstSize);
+			}
+			readOffset -= blockBytes;
 			nextReadOffset = readOffset;
 		} else {
-			checked_read(rr, readOffset, &blockHeader, sizeof(blockHeader));
-			blockSize = blockHeader.get_block_size();
-			if (blockSize == 0) {
+			first.resize(unit);
+			// The first unit may extend past the end of the file.
+			const memory_size_type firstSize = rr.file_accessor().read(readOffset, first.get(), unit);
+			if (firstSize < sizeof(blockHeader)) {
+				throw exception("read failed to read right amount");
+			}
+			memcpy(&blockHeader, first.get(), sizeof(blockHeader));
+			blockBytes = sizeof(blockHeader) + blockHeader.get_block_size() + sizeof(blockTrailer);
+			if (blockHeader.get_block_size() == 0) {
 				throw exception("Block size was unexpectedly zero");
 			}
-			scratch.resize(blockSize + sizeof(blockTrailer));
-			checked_read(rr, readOffset + sizeof(blockHeader), scratch.get(), scratch.size());
-			compressed = scratch.get();
-			memcpy(&blockTrailer,
-				   reinterpret_cast<block_header *>(scratch.get() + scratch.size()) - 1,
-				   sizeof(blockTrailer));
-			nextReadOffset = readOffset + sizeof(blockHeader) + scratch.size();
+			scratch.resize(blockBytes);
+			if (blockBytes <= firstSize) {
+				memcpy(scratch.get(), first.get(), blockBytes);
+			} else {
+				memcpy(scratch.get(), first.get(), firstSize);
+				checked_read(rr, readOffset + firstSize, scratch.get() + firstSize, blockBytes - firstSize);
+			}
+			nextReadOffset = readOffset + blockBytes;
+		}
+		first.resize(0);
+		memcpy(&blockHeader, scratch.get(), sizeof(blockHeader));
+		memcpy(&blockTrailer, scratch.get() + blockBytes - sizeof(blockTrailer), sizeof(blockTrailer));
+		const char * compressed = scratch.get() + sizeof(blockHeader);
+		memory_size_type blockSize = blockHeader.get_block_size();
+		if (blockHeader.get_padded()) {
+			uint32_t compressedSize = 0;
+			if (blockSize >= sizeof(compressedSize))
+				memcpy(&compressedSize, compressed + blockSize - sizeof(compressedSize), sizeof(compressedSize));
+			if (blockSize < sizeof(compressedSize) || compressedSize > blockSize - sizeof(compressedSize)) {
+				throw exception("Padded block has an invalid compressed size");
+			}
+			blockSize = compressedSize;
 		}
 		if (blockHeader != blockTrailer) {
 			throw exception("Block trailer is different from the block header");
 		}
 
+		// The block is in memory; later requests of the stream may do I/O
+		// while we decompress.
+		lock.lock();
+		end_io(stream);
+		lock.unlock();
+
 		const compression_scheme & compressionScheme =
 			get_compression_scheme(blockHeader.get_compression_scheme());
 		size_t uncompressedLength = compressionScheme.uncompressed_length(compressed, blockSize);
@@ -210,22 +372,45 @@ private:
 			throw exception("uncompressedLength exceeds the buffer capacity");
 		compressionScheme.uncompress(rr.buffer()->get(), compressed, blockSize);
 
-		compressor_thread_lock::lock_t lock(mutex());
+		lock.lock();
 		rr.buffer()->transition_state(compressor_buffer_state::reading,
 									  compressor_buffer_state::clean);
 		rr.buffer()->set_size(uncompressedLength);
-		rr.buffer()->set_block_size(sizeof(blockHeader) + blockSize + sizeof(blockTrailer));
+		rr.buffer()->set_block_size(blockBytes);
 		rr.buffer()->set_read_offset(readOffset);
 		rr.set_next_block_offset(nextReadOffset);
 	}
 
-	void process_write_request(write_request & wr) {
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Report a write to the compression controller, and sync the
+	/// file when the controller's measurement window is full. Must have the
+	/// I/O turn of the stream.
+	///////////////////////////////////////////////////////////////////////////
+	void record_write(write_request & wr, memory_size_type bytes, double seconds) {
+		compression_controller & controller = the_compression_controller();
+		const void * file = &wr.file_accessor();
+		if (controller.record_write(file, bytes, seconds)) {
+			ptime t1 = ptime::now();
+			wr.file_accessor().sync();
+			controller.record_sync(file, ptime::seconds(t1, ptime::now()));
+		}
+	}
+
+	void process_write_request(write_request & wr, stream_size_type sequence) {
 		stat_timer t(4); // Time writing
+		const void * stream = &wr.file_accessor();
+		compression_controller & controller = the_compression_controller();
 		size_t inputLength = wr.buffer()->size();
 		if (!wr.file_accessor().get_compressed()) {
 			// Uncompressed case
-			wr.file_accessor().write(wr.write_offset(), wr.buffer()->get(), wr.buffer()->size());
 			compressor_thread_lock::lock_t lock(mutex());
+			begin_io(lock, stream, sequence);
+			lock.unlock();
+			ptime t1 = ptime::now();
+			wr.file_accessor().write(wr.write_offset(), wr.buffer()->get(), wr.buffer()->size());
+			record_write(wr, wr.buffer()->size(), ptime::seconds(t1, ptime::now()));
+			lock.lock();
+			end_io(stream);
 			wr.buffer()->transition_state(compressor_buffer_state::writing,
 										  compressor_buffer_state::clean);
 			wr.update_recorded_size();
@@ -236,46 +421,85 @@ private:
 			wr.file_accessor().get_compression_flags() != compression_all;
 		block_header blockHeader;
 		block_header & blockTrailer = blockHeader;
-		compression_scheme::type schemeType = m_preferredCompression;
-		if (adaptiveCompression && !m_idle) {
+		compression_stream_statistics & streamStatistics =
+			wr.file_accessor().compression_statistics();
+		compression_scheme::type schemeType = wr.file_accessor().get_compression_scheme();
+		if (adaptiveCompression) {
+			schemeType = controller.choose(streamStatistics, schemeType);
+		}
+		if (!compression_scheme_available(schemeType)) {
+			// Record the scheme actually used in the block header.
 			schemeType = compression_scheme::none;
 		}
-		if (schemeType == compression_scheme::snappy)
-			increment_user(7, 1);
 		if (schemeType == compression_scheme::none)
 			increment_user(8, 1);
+		else
+			increment_user(7, 1);
 		const compression_scheme & compressionScheme = get_compression_scheme(schemeType);
-		const memory_size_type maxBlockSize = compressionScheme.max_compressed_length(inputLength);
+		// With direct I/O, blocks are padded to whole direct I/O units, so
+		// that they are appended at aligned offsets bypassing the page cache.
+		const bool padded = wr.file_accessor().direct_io_active();
+		const memory_size_type maxBlockSize = compressionScheme.max_compressed_length(inputLength)
+			+ (padded ? direct_io_alignment : 0);
 		if (maxBlockSize > blockHeader.max_block_size())
 			throw exception("process_write_request: MaxCompressedLength > max_block_size");
-		array<char> scratch(sizeof(blockHeader) + maxBlockSize + sizeof(blockTrailer));
+		aligned_scratch scratch;
+		scratch.resize(sizeof(blockHeader) + maxBlockSize + sizeof(blockTrailer));
 		memory_size_type blockSize;
+		ptime t1 = ptime::now();
 		compressionScheme.compress(scratch.get() + sizeof(blockHeader),
 								   reinterpret_cast<const char *>(wr.buffer()->get()),
 								   inputLength,
-								   &blockSize);
+								   &blockSize,
+								   wr.file_accessor().get_compression_level());
+		if (schemeType != compression_scheme::none) {
+			controller.record_compression(streamStatistics, schemeType, inputLength,
+										  blockSize, ptime::seconds(t1, ptime::now()));
+		}
+		if (padded) {
+			const uint32_t compressedSize = static_cast<uint32_t>(blockSize);
+			const memory_size_type paddedBytes =
+				(sizeof(blockHeader) + blockSize + sizeof(compressedSize) + sizeof(blockTrailer)
+				 + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+			const memory_size_type payload = paddedBytes - sizeof(blockHeader) - sizeof(blockTrailer);
+			char * data = scratch.get() + sizeof(blockHeader);
+			memset(data + blockSize, 0, payload - blockSize);
+			memcpy(data + payload - sizeof(compressedSize), &compressedSize, sizeof(compressedSize));
+			blockSize = payload;
+		}
 		blockHeader.set_block_size(blockSize);
 		blockHeader.set_compression_scheme(schemeType);
+		blockHeader.set_padded(padded);
 		memcpy(scratch.get(), &blockHeader, sizeof(blockHeader));
 		memcpy(scratch.get() + sizeof(blockHeader) + blockSize, &blockTrailer, sizeof(blockTrailer));
 		const memory_size_type writeSize = sizeof(blockHeader) + blockSize + sizeof(blockTrailer);
+
+		// Blocks of the stream are compressed concurrently, but appended in
+		// the order they were issued.
+		compressor_thread_lock::lock_t lock(mutex());
+		begin_io(lock, stream, sequence);
+		lock.unlock();
 		if (!wr.should_append()) {
 			//log_debug() << "Truncate to " << wr.write_offset() << std::endl;
 			wr.file_accessor().truncate_bytes(wr.write_offset());
 			//log_debug() << "File size is now " << wr.file_accessor().file_size() << std::endl;
 		}
-		{
-			compressor_thread_lock::lock_t lock(mutex());
-			wr.buffer()->transition_state(compressor_buffer_state::writing,
-										  compressor_buffer_state::clean);
-			wr.buffer()->set_block_size(writeSize);
-			wr.buffer()->set_read_offset(wr.file_accessor().file_size());
-			const stream_size_type offset = wr.file_accessor().file_size();
-			wr.set_block_info(offset, writeSize);
-			const stream_size_type newSize = offset + writeSize;
-			wr.update_recorded_size(newSize);
-		}
+		lock.lock();
+		wr.buffer()->transition_state(compressor_buffer_state::writing,
+									  compressor_buffer_state::clean);
+		wr.buffer()->set_block_size(writeSize);
+		wr.buffer()->set_read_offset(wr.file_accessor().file_size());
+		const stream_size_type offset = wr.file_accessor().file_size();
+		wr.set_block_info(offset, writeSize);
+		const stream_size_type newSize = offset + writeSize;
+		wr.update_recorded_size(newSize);
+		lock.unlock();
+
+		ptime t2 = ptime::now();
 		wr.file_accessor().append(scratch.get(), writeSize);
+		record_write(wr, writeSize, ptime::seconds(t2, ptime::now()));
+		lock.lock();
+		end_io(stream);
 	}
 
 public:
@@ -286,8 +510,8 @@ public:
 	void request(const compressor_request & r) {
 		tp_assert(request_valid(r), "Invalid request");
 
-		m_requests.push(r);
-		m_requests.back().get_request_base().initiate_request();
+		m_requests.push_back(queued_request(r, m_streamOrders[request_stream(r)].issued++));
+		m_requests.back().request.get_request_base().initiate_request();
 		m_newRequest.notify_one();
 	}
 
@@ -301,16 +525,24 @@ public:
 		m_preferredCompression = scheme;
 	}
 
+	compression_scheme::type get_preferred_compression(compressor_thread_lock &) {
+		return m_preferredCompression;
+	}
+
+	memory_size_type thread_count() {
+		return m_threadCount;
+	}
+
 private:
 	mutex_t m_mutex;
-	std::queue<compressor_request> m_requests;
+	request_queue_t m_requests;
 	std::condition_variable m_newRequest;
 	std::condition_variable m_requestDone;
+	std::condition_variable m_ioDone;
 	bool m_done;
 	compression_scheme::type m_preferredCompression;
-
-	// Whether the thread was idle prior to handling the current request.
-	bool m_idle;
+	memory_size_type m_threadCount;
+	stream_orders_t m_streamOrders;
 };
 
 } // namespace tpie
@@ -318,7 +550,7 @@ private:
 namespace {
 
 tpie::compressor_thread the_compressor_thread;
-std::thread the_compressor_thread_handle;
+std::vector<std::thread> the_compressor_thread_handles;
 bool compressor_thread_already_finished = false;
 
 void run_the_compressor_thread() {
@@ -333,18 +565,31 @@ compressor_thread & the_compressor_thread() {
 	return ::the_compressor_thread;
 }
 
-void init_compressor() {
-	if (the_compressor_thread_handle.get_id() != std::thread::id()) {
+memory_size_type default_compressor_thread_count() {
+	const char * v = getenv("TPIE_COMPRESSOR_THREADS");
+	if (v != NULL && atol(v) > 0) return atol(v);
+	return std::max<memory_size_type>(default_worker_count(), 1);
+}
+
+void init_compressor(memory_size_type threads /*= 0*/) {
+	if (!the_compressor_thread_handles.empty()) {
 		log_debug() << "Attempted to initiate compressor thread twice" << std::endl;
 		return;
 	}
-	std::thread t(run_the_compressor_thread);
-	the_compressor_thread_handle.swap(t);
+	if (threads == 0) threads = default_compressor_thread_count();
+	the_stream_buffer_pool().set_shared_buffer_count(std::max<memory_size_type>(2, threads + 1));
+	{
+		compressor_thread_lock lock(the_compressor_thread());
+		the_compressor_thread().start(lock, threads);
+	}
+	the_compressor_thread_handles.reserve(threads);
+	for (memory_size_type i = 0; i < threads; ++i)
+		the_compressor_thread_handles.push_back(std::thread(run_the_compressor_thread));
 	compressor_thread_already_finished = false;
 }
 
 void finish_compressor() {
-	if (the_compressor_thread_handle.get_id() == std::thread::id()) {
+	if (the_compressor_thread_handles.empty()) {
 		if (compressor_thread_already_finished) {
 			log_debug() << "Compressor thread already finished" << std::endl;
 		} else {
@@ -356,12 +601,17 @@ void finish_compressor() {
 		compressor_thread_lock lock(the_compressor_thread());
 		the_compressor_thread().stop(lock);
 	}
-	the_compressor_thread_handle.join();
-	std::thread t;
-	the_compressor_thread_handle.swap(t);
+	for (size_t i = 0; i < the_compressor_thread_handles.size(); ++i)
+		the_compressor_thread_handles[i].join();
+	the_compressor_thread_handles.clear();
 	compressor_thread_already_finished = true;
 }
 
+void set_compressor_thread_count(memory_size_type threads) {
+	finish_compressor();
+	init_compressor(threads);
+}
+
 compressor_thread::compressor_thread()
 	: pimpl(new impl)
 {
@@ -391,8 +641,20 @@ void compressor_thread::stop(compressor_thread_lock & lock) {
 	pimpl->stop(lock);
 }
 
+void compressor_thread::start(compressor_thread_lock & lock, memory_size_type threadCount) {
+	pimpl->start(lock, threadCount);
+}
+
+memory_size_type compressor_thread::thread_count() {
+	return pimpl->thread_count();
+}
+
 void compressor_thread::set_preferred_compression(compressor_thread_lock & lock, compression_scheme::type scheme) {
 	pimpl->set_preferred_compression(lock, scheme);
 }
 
+compression_scheme::type compressor_thread::get_preferred_compression(compressor_thread_lock & lock) {
+	return pimpl->get_preferred_compression(lock);
+}
+
 }
@@ -21,7 +21,7 @@
 #define TPIE_COMPRESSED_THREAD_H
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \file compressed/thread.h  Interface to the compressor thread.
+/// \file compressed/thread.h  Interface to the compressor thread pool.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <thread>
@@ -35,6 +35,15 @@
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Queue of compression and I/O requests serviced by a pool of
+/// worker threads.
+///
+/// Requests are processed concurrently, also when they belong to the same
+/// stream, so a single stream can keep several workers busy compressing.
+/// The file I/O of the requests of a stream is done in the order they were
+/// issued, so blocks are appended to the file in order.
+///////////////////////////////////////////////////////////////////////////////
 class compressor_thread {
 	class impl;
 	impl * pimpl;
@@ -56,11 +65,27 @@ public:
 
 	void wait_for_request_done(compressor_thread_lock & l);
 
+	// Worker thread entry point; returns when the pool is stopped.
 	void run();
 
 	void stop(compressor_thread_lock & lock);
 
+	void start(compressor_thread_lock & lock, memory_size_type threadCount);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Number of worker threads servicing requests.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type thread_count();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Set the compression scheme used by streams opened with
+	/// compression flags but without a scheme_* open flag.
+	///
+	/// Streams that are already open keep the scheme they were opened with.
+	///////////////////////////////////////////////////////////////////////////
 	void set_preferred_compression(compressor_thread_lock &, compression_scheme::type);
+
+	compression_scheme::type get_preferred_compression(compressor_thread_lock &);
 };
 
 class compressor_thread_lock {
@@ -67,6 +67,10 @@
 #endif
 
 #cmakedefine TPIE_HAS_SNAPPY
+#cmakedefine TPIE_HAS_LZ4
+#cmakedefine TPIE_HAS_ZSTD
+#cmakedefine TPIE_HAS_IO_URING
+#cmakedefine TPIE_IO_URING_DEFAULT
 
 #ifdef _WIN32
 #ifndef NOMINMAX
@@ -63,10 +63,13 @@ public:
 		this->m_fileAccessor.truncate_i(this->header_size() + size);
 	}
 
+	void sync() {
+		this->m_fileAccessor.sync_i();
+	}
+
 	void write(const stream_size_type byteOffset, const void * data, const memory_size_type size) {
 		stream_size_type position = byteOffset + this->header_size();
-		this->m_fileAccessor.seek_i(position);
-		this->m_fileAccessor.write_i(data, size);
+		this->m_fileAccessor.write_at_i(data, size, position);
 	}
 
 	void append(const void * data, memory_size_type size) {
@@ -75,8 +78,7 @@ public:
 		if (position < this->header_size())
 			position = this->header_size();
 
-		this->m_fileAccessor.seek_i(position);
-		this->m_fileAccessor.write_i(data, size);
+		this->m_fileAccessor.write_at_i(data, size, position);
 	}
 
 	memory_size_type read(const stream_size_type byteOffset, void * data, memory_size_type size) {
@@ -90,8 +92,7 @@ public:
 
 		stream_size_type position = this->header_size() + byteOffset;
 
-		this->m_fileAccessor.seek_i(position);
-		this->m_fileAccessor.read_i(data, size);
+		this->m_fileAccessor.read_at_i(data, size, position);
 		return size;
 	}
 
@@ -23,6 +23,7 @@
 /// \file file_accessor.h Declare default file accessor.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <tpie/config.h>
 #include <tpie/file_accessor/stream_accessor.h>
 
 #ifdef WIN32
@@ -35,7 +36,17 @@ typedef stream_accessor_base<win32> file_accessor;
 }
 }
 
-#else // WIN32
+#elif defined(TPIE_HAS_IO_URING) && defined(TPIE_IO_URING_DEFAULT)
+
+#include <tpie/file_accessor/uring.h>
+namespace tpie {
+namespace file_accessor {
+typedef uring raw_file_accessor;
+typedef stream_accessor_base<uring> file_accessor;
+}
+}
+
+#else // TPIE_IO_URING_DEFAULT
 
 #include <tpie/file_accessor/posix.h>
 namespace tpie {
@@ -33,9 +33,14 @@ namespace file_accessor {
 ///////////////////////////////////////////////////////////////////////////////
 
 class posix {
-private:
+protected:
 	int m_fd;
-	cache_hint m_cacheHint;
+	/** A second descriptor of the file opened with O_DIRECT, or -1. */
+	int m_directFd;
+	// Kept in bytes, so that the accessor stays small.
+	uint8_t m_cacheHint;
+	/** Whether to open m_directFd for files opened after set_direct_io. */
+	bool m_directIO;
 
 public:
 	inline posix();
@@ -49,9 +54,35 @@ public:
 	inline void read_i(void * data, memory_size_type size);
 	inline void write_i(const void * data, memory_size_type size);
 	inline void seek_i(stream_size_type offset);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Read size bytes at the given offset without using or changing
+	/// the file position, so several threads may read the file at once.
+	///////////////////////////////////////////////////////////////////////////
+	inline void read_at_i(void * data, memory_size_type size, stream_size_type offset);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Write size bytes at the given offset without using or changing
+	/// the file position.
+	///////////////////////////////////////////////////////////////////////////
+	inline void write_at_i(const void * data, memory_size_type size, stream_size_type offset);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Tell the operating system that size bytes at the given offset
+	/// will be read soon, so it may start reading them into the page cache.
+	/// Does nothing when direct I/O is active.
+	///////////////////////////////////////////////////////////////////////////
+	inline void will_read_at_i(stream_size_type offset, memory_size_type size);
+
 	inline stream_size_type file_size_i();
 	inline void close_i();
 	inline void truncate_i(stream_size_type bytes);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait until the data written to the file is on disk.
+	///////////////////////////////////////////////////////////////////////////
+	inline void sync_i();
+
 	inline bool is_open() const;
 
 	///////////////////////////////////////////////////////////////////////////
@@ -62,6 +93,49 @@ public:
 
 	inline void set_cache_hint(cache_hint cacheHint);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Bypass the operating system page cache for files opened after
+	/// this call.
+	///
+	/// The file is opened a second time with O_DIRECT. Positional requests
+	/// whose buffer address, size and file offset are multiples of
+	/// direct_io_alignment go through that descriptor; other requests, and
+	/// files on file systems without direct I/O support, use the page cache
+	/// as usual. The setting is kept for later files when a file system
+	/// rejects it. Since each descriptor keeps its flags, threads may issue
+	/// direct and buffered requests to the same file at the same time.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_direct_io(bool directIO);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check if direct I/O was requested with set_direct_io.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool direct_io() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check if aligned requests to the open file bypass the page
+	/// cache, that is, if direct I/O was requested and the file system
+	/// accepted it for this file.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool direct_io_active() const;
+
+protected:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get the descriptor to use for a positional request with the
+	/// given buffer, size and offset.
+	///////////////////////////////////////////////////////////////////////////
+	inline int io_fd(const void * data, memory_size_type size, stream_size_type offset) const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Handle a failed request on the descriptor fd.
+	///
+	/// If fd is the direct descriptor and error indicates that the file
+	/// system rejected the direct request, true is returned to indicate that
+	/// the request should be retried on m_fd. The accessor is not changed,
+	/// so this is safe while other threads issue requests.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool direct_io_failed(int fd, int error) const;
+
 private:
 	inline void _open(const std::string & path, int flags, mode_t mode);
 	inline void give_advice();
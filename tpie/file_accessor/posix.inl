@@ -20,6 +20,8 @@
 #include <string.h>
 #include <tpie/exception.h>
 #include <tpie/file_manager.h>
+#include <tpie/memory.h>
+#include <tpie/util.h>
 #include <tpie/file_accessor/posix.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -41,18 +43,44 @@ void posix::throw_errno(std::string path /*=std::string()*/) {
 
 posix::posix()
 	: m_fd(0)
+	, m_directFd(-1)
 	, m_cacheHint(access_normal)
+	, m_directIO(false)
 {
 }
 
 inline void posix::set_cache_hint(cache_hint cacheHint) {
-	m_cacheHint = cacheHint;
+	m_cacheHint = static_cast<uint8_t>(cacheHint);
+}
+
+inline void posix::set_direct_io(bool directIO) {
+	m_directIO = directIO;
+}
+
+inline bool posix::direct_io() const {
+	return m_directIO;
+}
+
+inline bool posix::direct_io_active() const {
+	return m_directFd != -1;
+}
+
+inline int posix::io_fd(const void * data, memory_size_type size, stream_size_type offset) const {
+	if (m_directFd == -1) return m_fd;
+	const bool aligned = reinterpret_cast<size_t>(data) % direct_io_alignment == 0
+		&& size % direct_io_alignment == 0
+		&& offset % direct_io_alignment == 0;
+	return aligned ? m_directFd : m_fd;
+}
+
+inline bool posix::direct_io_failed(int fd, int error) const {
+	return error == EINVAL && fd != -1 && fd == m_directFd;
 }
 
 inline void posix::give_advice() {
 #ifndef __MACH__
 	int advice;
-	switch (m_cacheHint) {
+	switch (static_cast<cache_hint>(m_cacheHint)) {
 		case access_normal:
 			advice = POSIX_FADV_NORMAL;
 			break;
@@ -98,6 +126,53 @@ inline void posix::seek_i(stream_size_type size) {
 	if (::lseek(m_fd, size, SEEK_SET) == -1) throw_errno();
 }
 
+inline void posix::read_at_i(void * data, memory_size_type size, stream_size_type offset) {
+	int fd = io_fd(data, size, offset);
+	memory_offset_type bytesRead = ::pread(fd, data, size, static_cast<off_t>(offset));
+	if (bytesRead == -1 && direct_io_failed(fd, errno)) {
+		fd = m_fd;
+		bytesRead = ::pread(fd, data, size, static_cast<off_t>(offset));
+	}
+	if (bytesRead == -1)
+		throw_errno();
+	if (bytesRead != static_cast<memory_offset_type>(size)) {
+		std::stringstream ss;
+		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
+		throw io_exception(ss.str());
+	}
+	increment_bytes_read(size);
+	if (fd == m_directFd) increment_bytes_direct_io(size);
+}
+
+inline void posix::write_at_i(const void * data, memory_size_type size, stream_size_type offset) {
+	int fd = io_fd(data, size, offset);
+	do {
+		ssize_t res = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+		if (res == -1 && direct_io_failed(fd, errno)) {
+			fd = m_fd;
+			res = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+		}
+		if(res == -1) {
+			throw_errno();
+		}
+		data = static_cast<const char*>(data) + res;
+		size -= res;
+		offset += res;
+		increment_bytes_written(res);
+		if (fd == m_directFd) increment_bytes_direct_io(res);
+	} while(size != 0);
+}
+
+inline void posix::will_read_at_i(stream_size_type offset, memory_size_type size) {
+#ifndef __MACH__
+	if (m_directFd != -1) return;
+	::posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+#else
+	unused(offset);
+	unused(size);
+#endif // __MACH__
+}
+
 inline stream_size_type posix::file_size_i() {
 	struct stat buf;
 	if (::fstat(m_fd, &buf) == -1) throw_errno();
@@ -112,6 +187,15 @@ void posix::_open(const std::string & path, int flags, mode_t mode = 0755) {
 	}
 	get_file_manager().increment_open_file_count();
 	give_advice();
+#ifdef O_DIRECT
+	if (m_directIO) {
+		// The file now exists and has been truncated if requested.
+		m_directFd = ::open(path.c_str(), (flags & ~(O_CREAT | O_TRUNC)) | O_DIRECT);
+		// EINVAL: The file system does not support direct I/O, so this file
+		// only uses the page cache.
+		if (m_directFd != -1) get_file_manager().increment_open_file_count();
+	}
+#endif // O_DIRECT
 }
 
 void posix::open_wo(const std::string & path) {
@@ -143,6 +227,12 @@ bool posix::is_open() const {
 }
 
 void posix::close_i() {
+	if (m_directFd != -1) {
+		if (::close(m_directFd) == 0) {
+			get_file_manager().decrement_open_file_count();
+		}
+	}
+	m_directFd = -1;
 	if (m_fd != 0) {
 		if (::close(m_fd) == 0) {
 			get_file_manager().decrement_open_file_count();
@@ -155,5 +245,13 @@ void posix::truncate_i(stream_size_type bytes) {
 	if (ftruncate(m_fd, bytes) == -1) throw_errno();
 }
 
+void posix::sync_i() {
+#ifdef __linux__
+	if (::fdatasync(m_fd) == -1) throw_errno();
+#else
+	if (::fsync(m_fd) == -1) throw_errno();
+#endif
+}
+
 }
 }
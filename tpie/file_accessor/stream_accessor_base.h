@@ -26,6 +26,8 @@
 
 #include <tpie/stream_header.h>
 #include <tpie/cache_hint.h>
+#include <tpie/compressed/scheme.h>
+#include <tpie/compressed/controller.h>
 
 namespace tpie {
 namespace file_accessor {
@@ -39,6 +41,18 @@ private:
 	bool m_open;
 	bool m_write;
 
+	// The compression settings below fill the padding after the flags above,
+	// so that embedding an accessor in a stream does not grow the stream.
+
+	/** Compression scheme used for blocks written through this accessor. */
+	uint8_t m_compressionScheme;
+
+	/** Scheme-specific compression level, or 0 for the default. */
+	int8_t m_compressionLevel;
+
+	/** Measurements used to choose whether to compress written blocks. */
+	compression_stream_statistics m_compressionStatistics;
+
 protected:
 	file_accessor_t m_fileAccessor;
 
@@ -112,6 +126,8 @@ public:
 	inline stream_accessor_base()
 		: m_open(false)
 		, m_write(false)
+		, m_compressionScheme(compression_scheme::none)
+		, m_compressionLevel(0)
 	{
 	}
 
@@ -213,6 +229,36 @@ public:
 	bool get_compressed() { return m_useCompression; }
 
 	int get_compression_flags() { return m_compressionFlags; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the compression scheme and level used for blocks written
+	/// to the open file. Blocks already in the file keep their scheme.
+	///////////////////////////////////////////////////////////////////////////
+	void set_compression_scheme(compression_scheme::type scheme, int level) {
+		m_compressionScheme = static_cast<uint8_t>(scheme);
+		m_compressionLevel = static_cast<int8_t>(level);
+		m_compressionStatistics.reset();
+	}
+
+	compression_scheme::type get_compression_scheme() { return static_cast<compression_scheme::type>(m_compressionScheme); }
+
+	int get_compression_level() { return m_compressionLevel; }
+
+	compression_stream_statistics & compression_statistics() { return m_compressionStatistics; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Bypass the page cache for aligned block reads and writes in
+	/// files opened after this call. See posix::set_direct_io().
+	///////////////////////////////////////////////////////////////////////////
+	void set_direct_io(bool directIO) { m_fileAccessor.set_direct_io(directIO); }
+
+	bool direct_io() const { return m_fileAccessor.direct_io(); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check if aligned reads and writes of the open file bypass the
+	/// page cache. See posix::direct_io_active().
+	///////////////////////////////////////////////////////////////////////////
+	bool direct_io_active() const { return m_fileAccessor.direct_io_active(); }
 };
 
 }
@@ -0,0 +1,334 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/config.h>
+#include <tpie/file_accessor/uring.h>
+#include <tpie/exception.h>
+#include <tpie/stats.h>
+#include <tpie/util.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef TPIE_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif // TPIE_HAS_IO_URING
+
+namespace tpie {
+namespace file_accessor {
+
+namespace {
+
+// Largest request handed to the kernel at once; the length field of a
+// submission queue entry is 32 bits.
+const memory_size_type max_request_size = memory_size_type(1) << 30;
+
+struct operation {
+	bool write;
+	int fd;
+	char * data;
+	memory_size_type size;
+	// Offset in the file, or -1 to use and advance the file position.
+	stream_size_type offset;
+};
+
+bool uring_disabled_by_environment() {
+	const char * env = std::getenv("TPIE_IO_URING");
+	return env != 0 && std::strcmp(env, "0") == 0;
+}
+
+#ifdef TPIE_HAS_IO_URING
+
+///////////////////////////////////////////////////////////////////////////////
+/// The io_uring instance of a single thread.
+///////////////////////////////////////////////////////////////////////////////
+class ring {
+public:
+	ring()
+		: m_fd(-1)
+		, m_sqRing(MAP_FAILED)
+		, m_sqes(static_cast<io_uring_sqe *>(MAP_FAILED))
+	{
+		if (uring_disabled_by_environment()) return;
+		std::memset(&m_params, 0, sizeof(m_params));
+		m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &m_params));
+		if (m_fd < 0) return;
+
+		// We rely on a single mapping of both rings and on reads and writes
+		// at the current file position (offset -1), available since 5.5/5.6.
+		const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS;
+		if ((m_params.features & needed) != needed) {
+			teardown();
+			return;
+		}
+
+		m_ringSize = std::max(
+			m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned),
+			m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe));
+		m_sqRing = ::mmap(0, m_ringSize, PROT_READ | PROT_WRITE,
+						  MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+		void * sqes = ::mmap(0, m_sqesSize, PROT_READ | PROT_WRITE,
+							 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		m_sqes = static_cast<io_uring_sqe *>(sqes);
+		if (m_sqRing == MAP_FAILED || sqes == MAP_FAILED) {
+			teardown();
+			return;
+		}
+
+		char * base = static_cast<char *>(m_sqRing);
+		m_sqTail = reinterpret_cast<unsigned *>(base + m_params.sq_off.tail);
+		m_sqMask = *reinterpret_cast<unsigned *>(base + m_params.sq_off.ring_mask);
+		m_sqArray = reinterpret_cast<unsigned *>(base + m_params.sq_off.array);
+		m_cqHead = reinterpret_cast<unsigned *>(base + m_params.cq_off.head);
+		m_cqTail = reinterpret_cast<unsigned *>(base + m_params.cq_off.tail);
+		m_cqMask = *reinterpret_cast<unsigned *>(base + m_params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe *>(base + m_params.cq_off.cqes);
+	}
+
+	~ring() {
+		teardown();
+	}
+
+	bool ok() const {
+		return m_fd >= 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Perform the operations, storing the result of each in results.
+	/// Returns false if the kernel rejected the submission, in which case
+	/// none of the remaining operations were performed.
+	///////////////////////////////////////////////////////////////////////////
+	bool run(const operation * ops, memory_size_type count, long * results) {
+		memory_size_type done = 0;
+		while (done < count) {
+			const unsigned n = static_cast<unsigned>(
+				std::min<memory_size_type>(count - done, m_params.sq_entries));
+			const unsigned tail = *m_sqTail;
+			for (unsigned i = 0; i < n; ++i) {
+				const operation & op = ops[done + i];
+				const unsigned index = (tail + i) & m_sqMask;
+				io_uring_sqe & sqe = m_sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = op.write ? IORING_OP_WRITE : IORING_OP_READ;
+				sqe.fd = op.fd;
+				sqe.addr = reinterpret_cast<__u64>(op.data);
+				sqe.len = static_cast<__u32>(op.size);
+				sqe.off = op.offset;
+				sqe.user_data = done + i;
+				m_sqArray[index] = index;
+			}
+			__atomic_store_n(m_sqTail, tail + n, __ATOMIC_RELEASE);
+
+			unsigned toSubmit = n;
+			unsigned remaining = n;
+			while (remaining > 0) {
+				long r = ::syscall(__NR_io_uring_enter, m_fd, toSubmit, 1,
+								   IORING_ENTER_GETEVENTS, 0, 0);
+				if (r < 0) {
+					if (errno == EINTR) continue;
+					if (toSubmit == n) {
+						// Nothing was consumed; retract the entries.
+						__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+						return false;
+					}
+					throw_errno_value(errno);
+				}
+				toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(r));
+				remaining -= reap(results);
+			}
+			done += n;
+		}
+		return true;
+	}
+
+private:
+	static const unsigned entries = 64;
+
+	unsigned reap(long * results) {
+		unsigned head = *m_cqHead;
+		const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+		unsigned reaped = 0;
+		for (; head != tail; ++head, ++reaped) {
+			const io_uring_cqe & cqe = m_cqes[head & m_cqMask];
+			results[cqe.user_data] = cqe.res;
+		}
+		__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		return reaped;
+	}
+
+	static void throw_errno_value(int error) {
+		errno = error;
+		posix::throw_errno();
+	}
+
+	void teardown() {
+		if (m_sqes != MAP_FAILED) ::munmap(m_sqes, m_sqesSize);
+		if (m_sqRing != MAP_FAILED) ::munmap(m_sqRing, m_ringSize);
+		if (m_fd >= 0) ::close(m_fd);
+		m_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+		m_sqRing = MAP_FAILED;
+		m_fd = -1;
+	}
+
+	int m_fd;
+	io_uring_params m_params;
+	void * m_sqRing;
+	memory_size_type m_ringSize;
+	io_uring_sqe * m_sqes;
+	memory_size_type m_sqesSize;
+	unsigned * m_sqTail;
+	unsigned m_sqMask;
+	unsigned * m_sqArray;
+	unsigned * m_cqHead;
+	unsigned * m_cqTail;
+	unsigned m_cqMask;
+	io_uring_cqe * m_cqes;
+};
+
+ring & thread_ring() {
+	static thread_local ring r;
+	return r;
+}
+
+#endif // TPIE_HAS_IO_URING
+
+///////////////////////////////////////////////////////////////////////////////
+/// Perform the operations through io_uring if possible, storing the result
+/// of each in results. Returns false if the posix fallback must be used.
+///////////////////////////////////////////////////////////////////////////////
+bool run_on_ring(const operation * ops, memory_size_type count, long * results) {
+#ifdef TPIE_HAS_IO_URING
+	ring & r = thread_ring();
+	return r.ok() && r.run(ops, count, results);
+#else // TPIE_HAS_IO_URING
+	unused(ops);
+	unused(count);
+	unused(results);
+	return false;
+#endif // TPIE_HAS_IO_URING
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Perform a single operation through the posix interface.
+///////////////////////////////////////////////////////////////////////////////
+long run_posix(const operation & op) {
+	const bool positional = op.offset != static_cast<stream_size_type>(-1);
+	if (op.write) {
+		return positional
+			? ::pwrite(op.fd, op.data, op.size, static_cast<off_t>(op.offset))
+			: ::write(op.fd, op.data, op.size);
+	}
+	return positional
+		? ::pread(op.fd, op.data, op.size, static_cast<off_t>(op.offset))
+		: ::read(op.fd, op.data, op.size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Perform a single operation until it is complete, continuing after short
+/// reads and writes. On failure, op describes the remaining part of the
+/// operation and the error number is returned.
+///////////////////////////////////////////////////////////////////////////////
+int try_to_completion(operation & op) {
+	const bool positional = op.offset != static_cast<stream_size_type>(-1);
+	while (op.size > 0) {
+		operation chunk = op;
+		chunk.size = std::min(op.size, max_request_size);
+		long result;
+		if (!run_on_ring(&chunk, 1, &result)) {
+			result = run_posix(chunk);
+			if (result < 0) result = -errno;
+		}
+		if (result < 0) return static_cast<int>(-result);
+		if (result == 0) {
+			throw io_exception(op.write
+							   ? "Wrong number of bytes written"
+							   : "Wrong number of bytes read: Unexpected end of file");
+		}
+		if (op.write)
+			increment_bytes_written(result);
+		else
+			increment_bytes_read(result);
+		op.data += result;
+		op.size -= result;
+		if (positional) op.offset += result;
+	}
+	return 0;
+}
+
+void throw_error(int error) {
+	errno = error;
+	posix::throw_errno();
+}
+
+void run_to_completion(operation op) {
+	int error = try_to_completion(op);
+	if (error != 0) throw_error(error);
+}
+
+} // unnamed namespace
+
+void uring::read_i(void * data, memory_size_type size) {
+	operation op = {false, m_fd, static_cast<char *>(data), size, static_cast<stream_size_type>(-1)};
+	run_to_completion(op);
+}
+
+void uring::write_i(const void * data, memory_size_type size) {
+	operation op = {true, m_fd, static_cast<char *>(const_cast<void *>(data)), size,
+					static_cast<stream_size_type>(-1)};
+	run_to_completion(op);
+}
+
+void uring::read_at_i(void * data, memory_size_type size, stream_size_type offset) {
+	operation op = {false, io_fd(data, size, offset), static_cast<char *>(data), size, offset};
+	int error = try_to_completion(op);
+	if (error != 0 && direct_io_failed(op.fd, error)) {
+		op.fd = m_fd;
+		error = try_to_completion(op);
+	}
+	if (error != 0) throw_error(error);
+	if (op.fd == m_directFd) increment_bytes_direct_io(size);
+}
+
+void uring::write_at_i(const void * data, memory_size_type size, stream_size_type offset) {
+	operation op = {true, io_fd(data, size, offset),
+					static_cast<char *>(const_cast<void *>(data)), size, offset};
+	int error = try_to_completion(op);
+	if (error != 0 && direct_io_failed(op.fd, error)) {
+		op.fd = m_fd;
+		error = try_to_completion(op);
+	}
+	if (error != 0) throw_error(error);
+	if (op.fd == m_directFd) increment_bytes_direct_io(size);
+}
+
+/*static*/ bool uring::available() {
+#ifdef TPIE_HAS_IO_URING
+	return thread_ring().ok();
+#else // TPIE_HAS_IO_URING
+	return false;
+#endif // TPIE_HAS_IO_URING
+}
+
+} // namespace file_accessor
+} // namespace tpie
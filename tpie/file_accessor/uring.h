@@ -0,0 +1,66 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file uring.h  io_uring file accessor
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_FILE_ACCESSOR_URING_H
+#define _TPIE_FILE_ACCESSOR_URING_H
+
+#include <tpie/file_accessor/posix.h>
+
+namespace tpie {
+namespace file_accessor {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief File accessor submitting reads and writes through io_uring.
+///
+/// Each thread lazily sets up its own submission ring, which is shared by
+/// all uring accessors used by that thread. Opening, seeking, truncating and
+/// closing are inherited from the posix accessor.
+///
+/// If the kernel does not support io_uring, or if the environment variable
+/// TPIE_IO_URING is set to 0, every operation falls back to the posix
+/// accessor.
+///
+/// This is only an accessor shim: each read or write is submitted on its
+/// own and waits for its completion, which costs more than a plain pread or
+/// pwrite. No TPIE code path submits several requests at once, so the uring
+/// accessor is only the default raw file accessor when TPIE is configured
+/// with TPIE_IO_URING_DEFAULT.
+///////////////////////////////////////////////////////////////////////////////
+class uring: public posix {
+public:
+	void read_i(void * data, memory_size_type size);
+	void write_i(const void * data, memory_size_type size);
+	void read_at_i(void * data, memory_size_type size, stream_size_type offset);
+	void write_at_i(const void * data, memory_size_type size, stream_size_type offset);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check whether I/O of the calling thread goes through io_uring
+	/// rather than the posix fallback.
+	///////////////////////////////////////////////////////////////////////////
+	static bool available();
+};
+
+}
+}
+
+#endif //_TPIE_FILE_ACCESSOR_URING_H
@@ -57,13 +57,25 @@ public:
 	inline void read_i(void * data, memory_size_type size);
 	inline void write_i(const void * data, memory_size_type size);
 	inline void seek_i(stream_size_type offset);
+	inline void read_at_i(void * data, memory_size_type size, stream_size_type offset);
+	inline void write_at_i(const void * data, memory_size_type size, stream_size_type offset);
+	inline void will_read_at_i(stream_size_type, memory_size_type) {}
 	inline stream_size_type file_size_i();
 	inline void close_i();
 	inline void truncate_i(stream_size_type bytes);
+	inline void sync_i();
 	inline bool is_open() const;
 
 	inline void set_cache_hint(cache_hint cacheHint);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Request direct I/O. FILE_FLAG_NO_BUFFERING requires every
+	/// request to be aligned, so the page cache is always used on Windows.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_direct_io(bool) {}
+	inline bool direct_io() const { return false; }
+	inline bool direct_io_active() const { return false; }
+
 private:
 	inline void _open(const std::string & path, DWORD access, DWORD create_mode);
 };
@@ -65,6 +65,29 @@ inline void win32::seek_i(stream_size_type size) {
 	if (!SetFilePointerEx(m_fd, i, NULL, 0)) throw_getlasterror();
 }
 
+inline void win32::read_at_i(void * data, memory_size_type size, stream_size_type offset) {
+	OVERLAPPED o = {0};
+	o.Offset = static_cast<DWORD>(offset);
+	o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD bytesRead = 0;
+	if (!ReadFile(m_fd, data, (DWORD)size, &bytesRead, &o)) throw_getlasterror();
+	if (bytesRead != size) {
+		std::stringstream ss;
+		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
+		throw io_exception(ss.str());
+	}
+	increment_bytes_read(size);
+}
+
+inline void win32::write_at_i(const void * data, memory_size_type size, stream_size_type offset) {
+	OVERLAPPED o = {0};
+	o.Offset = static_cast<DWORD>(offset);
+	o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD bytesWritten = 0;
+	if (!WriteFile(m_fd, data, (DWORD)size, &bytesWritten, &o) || bytesWritten != size ) throw_getlasterror();
+	increment_bytes_written(size);
+}
+
 inline stream_size_type win32::file_size_i() {
 	LARGE_INTEGER i;
 	if (!GetFileSizeEx(m_fd, &i)) throw_getlasterror();
@@ -139,5 +162,9 @@ void win32::truncate_i(stream_size_type size) {
 	if (!SetEndOfFile(m_fd)) throw_getlasterror();
 }
 
+void win32::sync_i() {
+	if (!FlushFileBuffers(m_fd)) throw_getlasterror();
+}
+
 }
 }
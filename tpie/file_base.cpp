@@ -103,7 +103,7 @@ void file_base::free_block(block_t * block) {
 
 	if (block->dirty || !m_canRead) {
 		assert(m_canWrite);
-		m_fileAccessor->write_block(block->data, block->number, block->size);
+		write_block(block->data, block->number, block->size);
 	}
 
 	boost::intrusive::list<block_t>::iterator i = m_used.iterator_to(*block);
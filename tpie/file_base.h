@@ -67,7 +67,7 @@ protected:
 
 	inline void update_size(stream_size_type size) {
 		m_size = std::max(m_size, size);
-		if (m_tempFile) 
+		if (m_tempFile && !m_asyncIO)
 			m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
 	}
 
@@ -182,6 +182,7 @@ public:
 			throw io_exception("Tried to truncate a file with one or more open streams");
 		}
 		m_size = s;
+		drain_async_io();
 		m_fileAccessor->truncate(s);
 		if (m_tempFile)
 			m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
@@ -33,6 +33,7 @@
 #include <tpie/stream_header.h>
 #include <tpie/file_accessor/file_accessor.h>
 #include <tpie/tempname.h>
+#include <tpie/async_block_io.h>
 
 namespace tpie {
 
@@ -99,6 +100,46 @@ public:
 		return block_size(blockFactor);
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Amount of memory used by the read-ahead buffers of a file with
+	/// the given block factor and read-ahead depth.
+	///
+	/// \sa set_read_ahead()
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type read_ahead_memory_usage(double blockFactor,
+														   memory_size_type depth) {
+		if (depth == 0) return 0;
+		return async_block_io::memory_usage(block_size(blockFactor), depth);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the number of blocks read ahead and written behind by a
+	/// background thread.
+	///
+	/// When the depth is positive, reading a block schedules reads of the
+	/// following depth blocks, and dirty blocks are written asynchronously.
+	/// The depth extra block buffers are allocated through the memory
+	/// manager while the file is open; see read_ahead_memory_usage().
+	/// A depth of zero, the default, performs all I/O synchronously.
+	///
+	/// The setting is kept across close() and open().
+	///////////////////////////////////////////////////////////////////////////
+	void set_read_ahead(memory_size_type depth) {
+		m_readAheadDepth = depth;
+		if (!m_open) return;
+		stop_async_io();
+		start_async_io();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get the read-ahead depth.
+	///
+	/// \sa set_read_ahead()
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type read_ahead() const {
+		return m_readAheadDepth;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Get the number of items per block.
 	///////////////////////////////////////////////////////////////////////////
@@ -125,6 +166,7 @@ public:
 	void read_user_data(TT & data) throw(stream_exception) {
 		assert(m_open);
 		if (sizeof(TT) != user_data_size()) throw io_exception("Wrong user data size");
+		drain_async_io();
 		m_fileAccessor->read_user_data(reinterpret_cast<void*>(&data), sizeof(TT));
 	}
 
@@ -137,6 +179,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	memory_size_type read_user_data(void * data, memory_size_type count) {
 		assert(m_open);
+		drain_async_io();
 		return m_fileAccessor->read_user_data(data, count);
 	}
 
@@ -152,6 +195,7 @@ public:
 	void write_user_data(const TT & data) throw(stream_exception) {
 		assert(m_open);
 		if (sizeof(TT) > max_user_data_size()) throw io_exception("Wrong user data size");
+		drain_async_io();
 		m_fileAccessor->write_user_data(reinterpret_cast<const void*>(&data), sizeof(TT));
 	}
 
@@ -166,6 +210,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void write_user_data(const void * data, memory_size_type count) {
 		assert(m_open);
+		drain_async_io();
 		m_fileAccessor->write_user_data(data, count);
 	}
 
@@ -244,6 +289,7 @@ public:
 	/// Note all streams into the file must be freed before you call close.
 	/////////////////////////////////////////////////////////////////////////
 	inline void close() throw(stream_exception) {
+		stop_async_io();
 		if (m_open) m_fileAccessor->close();
 		m_open = false;
 		m_tempFile = NULL;
@@ -277,6 +323,7 @@ protected:
 		m_canRead = accessType == access_read || accessType == access_read_write;
 		m_canWrite = accessType == access_write || accessType == access_read_write;
 		const bool preferCompression = false;
+		m_fileAccessor->set_direct_io(m_tempFile != NULL && tempname::get_direct_io());
 		m_fileAccessor->open(path, m_canRead, m_canWrite, m_itemSize,
 							 m_blockSize, userDataSize, cacheHint,
 							 preferCompression);
@@ -286,6 +333,7 @@ protected:
 		}
 		m_size = m_fileAccessor->size();
 		m_open = true;
+		start_async_io();
 	}
 
 
@@ -295,8 +343,20 @@ protected:
 
 	template <typename BT>
 	void read_block(BT & b, stream_size_type block);
+	void write_block(const char * data, stream_size_type block, memory_size_type itemCount);
 	void get_block_check(stream_size_type block);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for asynchronous I/O, so that the file accessor may be
+	/// used directly.
+	///////////////////////////////////////////////////////////////////////////
+	void drain_async_io() {
+		if (m_asyncIO) m_asyncIO->drain();
+	}
+
+	void start_async_io();
+	void stop_async_io();
+
 	memory_size_type m_blockItems;
 	memory_size_type m_blockSize;
 	bool m_canRead;
@@ -307,6 +367,9 @@ protected:
 	tpie::unique_ptr<temp_file> m_ownedTempFile;
 	temp_file * m_tempFile;
 	stream_size_type m_size;
+	memory_size_type m_readAheadDepth;
+	tpie::unique_ptr<async_block_io> m_asyncIO;
+	stream_size_type m_lastReadBlock;
 
 private:
 	child_t & self() {return *static_cast<child_t *>(this);}
@@ -19,6 +19,8 @@
 
 #include <tpie/file_base_crtp.h>
 #include <tpie/file_accessor/file_accessor.h>
+#include <algorithm>
+#include <limits>
 
 namespace tpie {
 
@@ -38,6 +40,8 @@ file_base_crtp<child_t>::file_base_crtp(
 	m_blockSize = block_size(blockFactor);
 	m_blockItems = m_blockSize/m_itemSize;
 	m_tempFile = 0;
+	m_readAheadDepth = 0;
+	m_lastReadBlock = std::numeric_limits<stream_size_type>::max();
 }
 
 template <typename child_t>
@@ -52,10 +56,54 @@ void file_base_crtp<child_t>::read_block(BT & b, stream_size_type block) {
 		b.size = static_cast<memory_size_type>(self().size() - block * m_blockItems);
 
 	// populate buffer data
-	if (b.size > 0 &&
+	if (m_asyncIO) {
+		m_asyncIO->read(b.data, b.number, b.size);
+	} else if (b.size > 0 &&
 		m_fileAccessor->read_block(b.data, b.number, b.size) != b.size) {
 		throw io_exception("Incorrect number of items read");
 	}
+
+	if (!m_asyncIO || !m_canRead) return;
+
+	// schedule read-ahead in the direction of travel
+	const bool backwards = m_lastReadBlock != std::numeric_limits<stream_size_type>::max()
+		&& block < m_lastReadBlock;
+	m_lastReadBlock = block;
+	for (memory_size_type i = 1; i <= m_readAheadDepth; ++i) {
+		if (backwards && i > block) break;
+		stream_size_type next = backwards ? block - i : block + i;
+		stream_size_type first = next * static_cast<stream_size_type>(m_blockItems);
+		if (first >= self().size()) break;
+		memory_size_type items = static_cast<memory_size_type>(
+			std::min(static_cast<stream_size_type>(m_blockItems), self().size() - first));
+		m_asyncIO->prefetch(next, items);
+	}
+}
+
+template <typename child_t>
+void file_base_crtp<child_t>::write_block(const char * data, stream_size_type block,
+										  memory_size_type itemCount) {
+	if (m_asyncIO)
+		m_asyncIO->write(data, block, itemCount);
+	else
+		m_fileAccessor->write_block(data, block, itemCount);
+}
+
+template <typename child_t>
+void file_base_crtp<child_t>::start_async_io() {
+	m_lastReadBlock = std::numeric_limits<stream_size_type>::max();
+	if (m_readAheadDepth == 0) return;
+	m_asyncIO.reset(tpie_new<async_block_io>(m_fileAccessor, m_blockSize,
+											 m_itemSize, m_readAheadDepth));
+}
+
+template <typename child_t>
+void file_base_crtp<child_t>::stop_async_io() {
+	if (!m_asyncIO) return;
+	tpie::unique_ptr<async_block_io> asyncIO(m_asyncIO.release());
+	asyncIO->stop();
+	if (m_tempFile)
+		m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
 }
 
 template <typename child_t>
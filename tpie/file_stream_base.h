@@ -50,7 +50,7 @@ public:
 	/////////////////////////////////////////////////////////////////////////
 	inline void close() throw(stream_exception) {
 		if (m_open) flush_block();
-		tpie_delete_array(m_block.data, m_itemSize * m_blockItems);
+		tpie_delete_aligned_buffer(m_block.data, m_itemSize * m_blockItems);
 		m_block.data = 0;
 		p_t::close();
 	}
@@ -71,6 +71,7 @@ public:
 		m_nextIndex = std::numeric_limits<memory_size_type>::max();
 		m_index = std::numeric_limits<memory_size_type>::max();
 		m_size = size;
+		drain_async_io();
 		m_fileAccessor->truncate(size);
 		if (m_tempFile)
 			m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
@@ -106,6 +107,9 @@ protected:
 		swap(m_block.data,      other.m_block.data);
 		swap(m_ownedTempFile,   other.m_ownedTempFile);
 		swap(m_tempFile,        other.m_tempFile);
+		swap(m_readAheadDepth,  other.m_readAheadDepth);
+		swap(m_asyncIO,         other.m_asyncIO);
+		swap(m_lastReadBlock,   other.m_lastReadBlock);
 	}
 
 	inline void open_inner(const std::string & path,
@@ -122,7 +126,7 @@ protected:
 		m_block.size = 0;
 		m_block.number = std::numeric_limits<stream_size_type>::max();
 		m_block.dirty = false;
-		m_block.data = tpie_new_array<char>(m_blockItems * m_itemSize);
+		m_block.data = tpie_new_aligned_buffer(m_blockItems * m_itemSize);
 
 		initialize();
 		seek(0);
@@ -140,8 +144,8 @@ protected:
 		if (m_block.dirty) {
 			assert(m_canWrite);
 			update_vars();
-			m_fileAccessor->write_block(m_block.data, m_block.number, m_block.size);
-			if (m_tempFile)
+			write_block(m_block.data, m_block.number, m_block.size);
+			if (m_tempFile && !m_asyncIO)
 				m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
 		}
 		m_block.dirty = false;
@@ -21,6 +21,7 @@
 #define __TPIE_INTERNAL_PRIORITY_QUEUE_H__
 #include <tpie/array.h>
 #include <algorithm>
+#include <type_traits>
 #include <tpie/util.h>
 namespace tpie {
 ///////////////////////////////////////////////////////////////////////////////
@@ -28,13 +29,47 @@ namespace tpie {
 /// \brief Simple heap based priority queue implementation.
 ///////////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Heap policy of internal_priority_queue: every node has D children.
+///
+/// The children of node i are stored next to each other at indices
+/// D*i+1 to D*i+D, and a heap of n items has only log_D(n) levels. The items
+/// are placed so that index 1 starts a 64-byte cache line, so when the item
+/// size divides 64, the children of a node lie in as few cache lines as
+/// possible: one line when D times the item size is at most 64. A 4- or
+/// 8-ary heap is usually faster than a binary heap for items of 8 to 16
+/// bytes.
+///////////////////////////////////////////////////////////////////////////////
+template <memory_size_type D>
+struct dary_heap {
+	static_assert(D >= 2, "A heap node needs at least two children");
+	static const memory_size_type arity = D;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Heap policy of internal_priority_queue: binary heap maintained by
+/// the standard library heap algorithms.
+///////////////////////////////////////////////////////////////////////////////
+typedef dary_heap<2> binary_heap;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \class internal_priority_queue
 /// \author Lars Hvam Petersen, Jakob Truelsen
-/// \brief Standard binary internal heap.
+/// \brief Internal heap with a fixed maximum size.
+///
+/// By default this is a binary heap maintained by the standard library heap
+/// algorithms. The heap_t policy selects a \ref dary_heap with more children
+/// per node instead.
 ///////////////////////////////////////////////////////////////////////////////
-template <typename T, typename comp_t = std::less<T> >
-class internal_priority_queue: public linear_memory_base< internal_priority_queue<T, comp_t> > {
+template <typename T, typename comp_t = std::less<T>, typename heap_t = binary_heap>
+class internal_priority_queue: public linear_memory_base< internal_priority_queue<T, comp_t, heap_t> > {
+	static const memory_size_type arity = heap_t::arity;
+	typedef std::integral_constant<bool, arity == 2> is_binary;
+
+	static const memory_size_type cache_line = 64;
+	/** Extra items allocated by a d-ary heap to align index 1. */
+	static const memory_size_type align_slack =
+		(arity != 2 && cache_line % sizeof(T) == 0) ? cache_line / sizeof(T) : 0;
 public:
 	typedef memory_size_type size_type;
 
@@ -44,7 +79,9 @@ public:
 	///////////////////////////////////////////////////////////////////////////
     internal_priority_queue(size_type max_size, comp_t c=comp_t(),
 							memory_bucket_ref bucket = memory_bucket_ref())
-		: pq(max_size, bucket), sz(0), comp(c) {}
+		: pq(max_size + align_slack, bucket), sz(0), comp(c) {
+		align();
+	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Construct a priority queue with given elements.
@@ -53,7 +90,8 @@ public:
 	internal_priority_queue(size_type max_size, const IT & start, const IT & end,
 							comp_t c=comp_t(),
 							memory_bucket_ref bucket = memory_bucket_ref())
-		: pq(max_size, bucket), sz(0), comp(c) {
+		: pq(max_size + align_slack, bucket), sz(0), comp(c) {
+		align();
 		insert(start, end);
 	}
 
@@ -62,7 +100,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	template <typename IT>
 	void insert(const IT & start, const IT & end) {
-		std::copy(start, end, pq.find(sz));
+		std::copy(start, end, items() + sz);
 		sz += (end - start);
 		make_safe();
 	}
@@ -74,11 +112,11 @@ public:
     /// \param v The element that should be inserted.
 	///////////////////////////////////////////////////////////////////////////
 	void unsafe_push(const T & v) { 
-		pq[sz++] = v;
+		items()[sz++] = v;
 	}
 
 	void unsafe_push(T && v) {
-		pq[sz++] = std::move(v);
+		items()[sz++] = std::move(v);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -86,7 +124,7 @@ public:
 	/// unsafe_push.
 	///////////////////////////////////////////////////////////////////////////
 	void make_safe() {
-		std::make_heap(pq.begin(), pq.find(sz), comp);
+		make_heap(is_binary());
 	}
   
 	///////////////////////////////////////////////////////////////////////////
@@ -107,15 +145,15 @@ public:
     /// \param v The element that should be inserted.
 	///////////////////////////////////////////////////////////////////////////
     void push(const T & v) { 
-		assert(size() < pq.size());
-		pq[sz++] = v; 
-		std::push_heap(pq.begin(), pq.find(sz), comp);
+		assert(size() < pq.size() - align_slack);
+		items()[sz++] = v; 
+		push_heap(is_binary());
     }
 
 	void push(T && v) {
-		assert(size() < pq.size());
-		pq[sz++] = std::move(v);
-		std::push_heap(pq.begin(), pq.find(sz), comp);
+		assert(size() < pq.size() - align_slack);
+		items()[sz++] = std::move(v);
+		push_heap(is_binary());
     }
 
 	///////////////////////////////////////////////////////////////////////////
@@ -123,7 +161,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
     void pop() { 
 		assert(!empty());
-		std::pop_heap(pq.begin(), pq.find(sz), comp);
+		pop_heap(is_binary());
 		--sz;
     }
 
@@ -132,14 +170,14 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void pop_and_push(const T & v) {
 		assert(!empty());
-		pq[0] = v;
-		pop_and_push_heap(pq.begin(), pq.find(sz), comp);
+		items()[0] = v;
+		sift_down(is_binary());
 	}
 
 	void pop_and_push(T && v) {
 		assert(!empty());
-		pq[0] = std::move(v);
-		pop_and_push_heap(pq.begin(), pq.find(sz), comp);
+		items()[0] = std::move(v);
+		sift_down(is_binary());
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -147,9 +185,9 @@ public:
     ///
     /// \return The minimum element.
 	///////////////////////////////////////////////////////////////////////////
-    const T & top() const {return pq[0];}
+    const T & top() const {return pq[m_offset];}
 
-	T & top() {return pq[0];}
+	T & top() {return pq[m_offset];}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \copybrief linear_memory_structure_doc::memory_coefficient()
@@ -164,12 +202,16 @@ public:
 	/// \copydetails linear_memory_structure_doc::memory_overhead()
 	///////////////////////////////////////////////////////////////////////////
 	static double memory_overhead() {
-		return tpie::array<T>::memory_overhead() - sizeof(tpie::array<T>) + sizeof(internal_priority_queue);
+		return tpie::array<T>::memory_overhead() - sizeof(tpie::array<T>) + sizeof(internal_priority_queue)
+			+ align_slack * sizeof(T);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
     /// \brief Return the underlying array.
 	/// Make sure you know what you are doing.
+	///
+	/// The items of a binary heap are the first size() entries. A
+	/// \ref dary_heap keeps them at an offset for alignment instead.
     /// \return The underlying array.
 	///////////////////////////////////////////////////////////////////////////
 	tpie::array<T> & get_array() {
@@ -185,9 +227,95 @@ public:
 	/// \brief Resize priority queue to given size.
 	/// \param s New size of priority queue.
 	///////////////////////////////////////////////////////////////////////////
-	void resize(size_t s) {sz=0; pq.resize(s);}
-private:	
+	void resize(size_t s) {sz=0; pq.resize(s + align_slack); align();}
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Choose the offset of the items so that index 1 starts a cache
+	/// line, if the allocation allows it.
+	///////////////////////////////////////////////////////////////////////////
+	void align() {
+		m_offset = 0;
+		if (align_slack == 0 || pq.size() == 0) return;
+		size_t second = reinterpret_cast<size_t>(pq.get() + 1);
+		size_t gap = (cache_line - second % cache_line) % cache_line;
+		if (gap % sizeof(T) == 0) m_offset = gap / sizeof(T);
+	}
+
+	T * items() {return pq.get() + m_offset;}
+
+	void make_heap(std::true_type) {
+		std::make_heap(pq.begin(), pq.find(sz), comp);
+	}
+
+	void push_heap(std::true_type) {
+		std::push_heap(pq.begin(), pq.find(sz), comp);
+	}
+
+	void pop_heap(std::true_type) {
+		std::pop_heap(pq.begin(), pq.find(sz), comp);
+	}
+
+	void sift_down(std::true_type) {
+		pop_and_push_heap(pq.begin(), pq.find(sz), comp);
+	}
+
+	// comp is the swapped comparator used by the std heap algorithms, so
+	// comp(b, a) means that a comes before b.
+	bool before(const T & a, const T & b) {
+		return comp(b, a);
+	}
+
+	void make_heap(std::false_type) {
+		if (sz < 2) return;
+		for (size_type i = (sz - 2) / arity + 1; i-- > 0;)
+			sift_down_from(i, sz);
+	}
+
+	void push_heap(std::false_type) {
+		T * h = items();
+		size_type i = sz - 1;
+		T v = std::move(h[i]);
+		while (i > 0) {
+			size_type parent = (i - 1) / arity;
+			if (!before(v, h[parent])) break;
+			h[i] = std::move(h[parent]);
+			i = parent;
+		}
+		h[i] = std::move(v);
+	}
+
+	void pop_heap(std::false_type) {
+		// Called before sz is decremented.
+		if (sz < 2) return;
+		T * h = items();
+		h[0] = std::move(h[sz - 1]);
+		sift_down_from(0, sz - 1);
+	}
+
+	void sift_down(std::false_type) {
+		sift_down_from(0, sz);
+	}
+
+	void sift_down_from(size_type i, size_type n) {
+		T * h = items();
+		T v = std::move(h[i]);
+		for (;;) {
+			size_type first = arity * i + 1;
+			if (first >= n) break;
+			size_type last = std::min(first + arity, n);
+			size_type best = first;
+			for (size_type c = first + 1; c < last; ++c)
+				if (before(h[c], h[best])) best = c;
+			if (!before(h[best], v)) break;
+			h[i] = std::move(h[best]);
+			i = best;
+		}
+		h[i] = std::move(v);
+	}
+
 	tpie::array<T> pq; 
+	/** Index in pq of the top item. Zero for a binary heap. */
+	size_type m_offset;
     size_type sz;
 	binary_argument_swap<comp_t> comp;
 };
@@ -23,12 +23,79 @@
 
 #include <tpie/job.h>
 #include <tpie/array.h>
-#include <tpie/internal_queue.h>
 #include <tpie/exception.h>
-#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
 #include <thread>
 namespace tpie {
- 
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Value of current_worker in threads that are not job workers.
+///////////////////////////////////////////////////////////////////////////////
+const size_t no_worker = std::numeric_limits<size_t>::max();
+
+///////////////////////////////////////////////////////////////////////////////
+/// Index of the worker running in this thread.
+///////////////////////////////////////////////////////////////////////////////
+thread_local size_t current_worker = no_worker;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Where this thread starts looking for jobs to steal.
+///////////////////////////////////////////////////////////////////////////////
+thread_local size_t next_victim = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+/// A queue of jobs with its own lock. The owning worker pushes and pops at
+/// the back; other threads steal from the front, taking the oldest and
+/// typically largest jobs.
+///////////////////////////////////////////////////////////////////////////////
+struct job_deque {
+	std::mutex mutex;
+	std::deque<job *> jobs;
+	// Keep deques of different workers on different cache lines.
+	char padding[64];
+
+	void push(job * j) {
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(j);
+	}
+
+	job * pop_back() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty()) return 0;
+		job * j = jobs.back();
+		jobs.pop_back();
+		return j;
+	}
+
+	job * pop_front() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty()) return 0;
+		job * j = jobs.front();
+		jobs.pop_front();
+		return j;
+	}
+
+	template <typename F>
+	job * take_if(F pred) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::deque<job *>::iterator i = jobs.begin(); i != jobs.end(); ++i) {
+			if (pred(*i)) {
+				job * j = *i;
+				jobs.erase(i);
+				return j;
+			}
+		}
+		return 0;
+	}
+};
+
+} // unnamed namespace
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Job manager singleton.
 ///////////////////////////////////////////////////////////////////////////////
@@ -41,16 +108,25 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Default constructor.
 	///////////////////////////////////////////////////////////////////////////
-	job_manager() : m_jobs(128), m_kill_job_pool(false) {}
+	job_manager()
+		: m_pending(0)
+		, m_pushes(0)
+		, m_sleepingWorkers(0)
+		, m_sleepingJoiners(0)
+		, m_kill_job_pool(false)
+	{
+	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Initialize the thread pool.
 	///////////////////////////////////////////////////////////////////////////
 	void init_pool(size_t threads) {
+		m_deques.resize(threads);
+		for (size_t i = 0; i < threads; ++i)
+			m_deques[i].reset(tpie_new<job_deque>());
 		m_thread_pool.resize(threads);
 		for (size_t i = 0; i < threads; ++i) {
-			std::function<void()> f(worker);
-			std::thread t(f);
+			std::thread t(worker, i);
 			// thread is move-constructible
 			m_thread_pool[i].swap(t);
 		}
@@ -60,51 +136,171 @@ public:
 	/// \brief Notify all waiting workers, wait for them to quit.
 	///////////////////////////////////////////////////////////////////////////
 	void shutdown_pool() {
-		std::unique_lock<std::mutex> lock(jobs_mutex);
+		std::unique_lock<std::mutex> lock(m_mutex);
 		m_kill_job_pool = true;
-		m_has_data.notify_all();
+		m_work_available.notify_all();
 		lock.unlock();
 		for (size_t i = 0; i < m_thread_pool.size(); ++i) {
 			m_thread_pool[i].join();
 		}
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Make a job available to the workers.
+	///
+	/// A worker pushes onto its own deque; other threads use the shared
+	/// queue.
+	///////////////////////////////////////////////////////////////////////////
+	void push(job * j) {
+		if (current_worker == no_worker)
+			m_shared.push(j);
+		else
+			m_deques[current_worker]->push(j);
+		++m_pending;
+		++m_pushes;
+		if (m_sleepingWorkers.load() > 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_work_available.notify_one();
+		}
+		wake_joiners();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take a pending job, or return 0 if there is none.
+	///
+	/// Look in the deque of the calling worker first, then in the shared
+	/// queue, and finally steal from the other workers.
+	///////////////////////////////////////////////////////////////////////////
+	job * pop() {
+		if (m_pending.load() <= 0) return 0;
+		const size_t self = current_worker;
+		job * j = 0;
+		if (self != no_worker) j = m_deques[self]->pop_back();
+		if (j == 0) j = m_shared.pop_front();
+		const size_t n = m_deques.size();
+		for (size_t i = 0; j == 0 && i < n; ++i) {
+			const size_t victim = (next_victim + i) % n;
+			if (victim != self) j = m_deques[victim]->pop_front();
+		}
+		if (j == 0) return 0;
+		--m_pending;
+		// Steal from the next worker the next time around.
+		if (n > 0) next_victim = (next_victim + 1) % n;
+		return j;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take a pending job in the subtree of root, that is, root or a
+	/// job enqueued with root as an ancestor, or return 0 if there is none.
+	///////////////////////////////////////////////////////////////////////////
+	job * take_subtree(job * root) {
+		if (m_pending.load() <= 0) return 0;
+		auto inSubtree = [root] (job * j) {
+			// The ancestors of a pending job are alive, since they wait
+			// for it to be done.
+			for (; j != 0; j = j->m_parent) if (j == root) return true;
+			return false;
+		};
+		job * j = m_shared.take_if(inSubtree);
+		for (size_t i = 0; j == 0 && i < m_deques.size(); ++i)
+			j = m_deques[i]->take_if(inSubtree);
+		if (j != 0) --m_pending;
+		return j;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of jobs pushed so far.
+	///////////////////////////////////////////////////////////////////////////
+	size_t pushes() const {
+		return m_pushes.load();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Block a joining thread until more than pushesSeen jobs have
+	/// been pushed or until done() returns true.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename F>
+	void wait_join(size_t pushesSeen, F done) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		++m_sleepingJoiners;
+		while (m_pushes.load() == pushesSeen && !done()) m_job_done.wait(lock);
+		--m_sleepingJoiners;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wake threads blocked in wait_join().
+	///////////////////////////////////////////////////////////////////////////
+	void wake_joiners() {
+		if (m_sleepingJoiners.load() == 0) return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job_done.notify_all();
+	}
+
+	bool killed() const {
+		return m_kill_job_pool;
+	}
+
 private:
 
-	tpie::internal_queue<tpie::job *> m_jobs;
+	tpie::array<tpie::unique_ptr<job_deque> > m_deques;
 	tpie::array<std::thread> m_thread_pool;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief The only mutex we will ever need.
+	/// \brief Jobs enqueued by threads that are not workers.
 	///////////////////////////////////////////////////////////////////////////
-	std::mutex jobs_mutex;
+	job_deque m_shared;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of jobs pushed and not yet popped. May be briefly
+	/// negative when a job is popped before its push is counted.
+	///////////////////////////////////////////////////////////////////////////
+	std::atomic<memory_offset_type> m_pending;
+
+	std::atomic<size_t> m_pushes;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Notified when a job is added to the queue.
+	/// \brief Protects sleeping; the deques have their own locks.
 	///////////////////////////////////////////////////////////////////////////
-	std::condition_variable m_has_data;
+	std::mutex m_mutex;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Notified when a job is pushed while workers are sleeping.
+	///////////////////////////////////////////////////////////////////////////
+	std::condition_variable m_work_available;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Notified when a job is pushed or done while threads are
+	/// sleeping in job::join().
+	///////////////////////////////////////////////////////////////////////////
+	std::condition_variable m_job_done;
+
+	std::atomic<size_t> m_sleepingWorkers;
+	std::atomic<size_t> m_sleepingJoiners;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief True when the workers should quit ASAP.
 	///////////////////////////////////////////////////////////////////////////
-	bool m_kill_job_pool;
+	std::atomic<bool> m_kill_job_pool;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Worker thread entry point.
 	///////////////////////////////////////////////////////////////////////////
-	static void worker() {
-		for (;;) {
-			std::unique_lock<std::mutex> lock(the_job_manager->jobs_mutex);
-			while (the_job_manager->m_jobs.empty() && !the_job_manager->m_kill_job_pool) the_job_manager->m_has_data.wait(lock);
-			if (the_job_manager->m_kill_job_pool) break;
-			tpie::job * j = the_job_manager->m_jobs.front();
-			the_job_manager->m_jobs.pop();
-			lock.unlock();
-			j->run();
+	static void worker(size_t index) {
+		current_worker = index;
+		next_victim = index + 1;
+		job_manager & m = *the_job_manager;
+		while (!m.m_kill_job_pool) {
+			job * j = m.pop();
+			if (j != 0) {
+				j->run();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m.m_mutex);
+			++m.m_sleepingWorkers;
+			while (m.m_pending.load() <= 0 && !m.m_kill_job_pool) m.m_work_available.wait(lock);
+			--m.m_sleepingWorkers;
 		}
 	};
-
-	friend class tpie::job;
 };
 
 memory_size_type default_worker_count() {
@@ -133,35 +329,31 @@ job::job()
 }
 
 void job::join() {
-	std::unique_lock<std::mutex> lock(the_job_manager->jobs_mutex);
-	while (m_dependencies) {
-		m_done.wait(lock);
+	while (m_state.load() != job_idle) {
+		const size_t pushesSeen = the_job_manager->pushes();
+		job * j = the_job_manager->take_subtree(this);
+		if (j != 0) {
+			j->run();
+			continue;
+		}
+		the_job_manager->wait_join(pushesSeen, [this] { return m_state.load() == job_idle; });
 	}
 }
 
 bool job::is_done() {
-	std::lock_guard<std::mutex> lock(the_job_manager->jobs_mutex);
-	return !m_dependencies;
+	return m_state.load() == job_idle;
 }
 
 void job::enqueue(job * parent) {
 	if (m_state != job_idle)
 		throw tpie::exception("Bad job state");
+	if (the_job_manager->killed()) throw job_manager_exception();
 
 	m_state = job_enqueued;
-
-	std::unique_lock<std::mutex> lock(the_job_manager->jobs_mutex);
-	if (the_job_manager->m_kill_job_pool) throw job_manager_exception();
 	m_parent = parent;
 	m_dependencies = 1;
 	if (m_parent) ++m_parent->m_dependencies;
-	if (the_job_manager->m_jobs.full()) {
-		lock.unlock();
-		run();
-		return;
-	}
-	the_job_manager->m_jobs.push(this);
-	the_job_manager->m_has_data.notify_one();
+	the_job_manager->push(this);
 }
 
 void job::run() {
@@ -171,7 +363,6 @@ void job::run() {
 	m_state = job_running;
 
 	(*this)();
-	std::lock_guard<std::mutex> lock(the_job_manager->jobs_mutex);
 	done();
 }
 
@@ -179,15 +370,15 @@ void job::done() {
 	if (m_state != job_running)
 		throw tpie::exception("Bad job state");
 
-	--m_dependencies;
-	if (m_dependencies) return;
+	if (--m_dependencies) return;
 
-	m_state = job_idle;
-
-	if (m_parent) m_parent->done();
-	m_done.notify_all();
+	// Once the state is idle, a joining thread may destroy this job,
+	// so the parent must be notified through a copy of the pointer.
+	job * parent = m_parent;
 	on_done();
+	m_state = job_idle;
+	the_job_manager->wake_joiners();
+	if (parent) parent->done();
 }
 
 } // namespace tpie
-
@@ -25,11 +25,21 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <stddef.h>
-#include <condition_variable>
+#include <atomic>
 #include <tpie/types.h>
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Unit of work run by the job framework.
+///
+/// Each worker thread keeps its own deque of jobs. A job enqueued by a
+/// worker is pushed onto that worker's deque, which the worker pops from
+/// the back; idle workers steal from the front of other workers' deques.
+/// Jobs enqueued by other threads are placed in a shared queue.
+/// A thread waiting in join() runs pending jobs of the joined job's subtree
+/// until the joined job is done.
+///////////////////////////////////////////////////////////////////////////////
 class job {
 
 	enum job_state { job_idle, job_enqueued, job_running };
@@ -53,6 +63,11 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Wait for this job and its subjobs to complete.
+	///
+	/// While waiting, the calling thread runs this job and its subjobs if
+	/// they have not been started by a worker. Unrelated jobs are never run,
+	/// so join may be called while holding locks that other jobs need, and
+	/// nested joins are bounded by the depth of the job tree.
 	///////////////////////////////////////////////////////////////////////////
 	void join();
 
@@ -84,20 +99,15 @@ protected:
 
 private:
 
-	size_t m_dependencies;
+	std::atomic<size_t> m_dependencies;
 	job * m_parent;
-	job_state m_state;
-
-	///////////////////////////////////////////////////////////////////////////
-	/// \brief Notified when this job and subjobs are done.
-	///////////////////////////////////////////////////////////////////////////
-	std::condition_variable m_done;
+	std::atomic<job_state> m_state;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Called when this job or a subjob is done.
 	///
-	/// Decrement m_dependencies and call on_done() and notify
-	/// waiters, if applicable.
+	/// Decrement m_dependencies, and when it reaches zero, call on_done(),
+	/// wake waiters and notify the parent.
 	///////////////////////////////////////////////////////////////////////////
 	void done();
 
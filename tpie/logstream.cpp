@@ -18,6 +18,7 @@
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 #include <vector>
 #include <algorithm>
+#include <mutex>
 #include <tpie/logstream.h>
 #include <cstdio>
 #include <tpie/tpie_log.h>
@@ -27,6 +28,9 @@ namespace log_bits {
 
 std::vector<log_target *> log_targets;
 bool logging_disabled;
+// Guards log_targets and the targets themselves, since every thread flushes
+// its own log_stream_bufs.
+std::recursive_mutex log_targets_mutex;
 
 }
 
@@ -41,6 +45,7 @@ log_stream_buf::~log_stream_buf() {flush();}
 void log_stream_buf::flush() {
 	if (pptr() == m_buff) return;
 	if (!logging_disabled) {
+		std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 		*pptr() = 0;
 		if (log_targets.empty())
 			// As a special service if no one is listening
@@ -60,6 +65,7 @@ int log_stream_buf::overflow(int c) {
 }
 
 int log_stream_buf::sync() {
+	std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 	//Do not display the messages before there is a target
 	if (log_targets.empty()) return 0;
 	flush();
@@ -67,10 +73,12 @@ int log_stream_buf::sync() {
 }
 
 void add_log_target(log_target * t) {
+	std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 	log_targets.push_back(t);
 }
 
 void remove_log_target(log_target * t) {
+	std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 	std::vector<log_target *>::iterator i =
 		std::find(log_targets.begin(), log_targets.end(), t);
 	if (i != log_targets.end()) {
@@ -80,11 +88,13 @@ void remove_log_target(log_target * t) {
 }
 
 void begin_log_group(const std::string & name) {
+	std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 	for(size_t i = 0; i < log_targets.size(); ++i)
 		log_targets[i]->begin_group(name);
 }
 
 void end_log_group() {
+	std::lock_guard<std::recursive_mutex> lock(log_targets_mutex);
 	for(size_t i = 0; i < log_targets.size(); ++i)
 		log_targets[i]->end_group();
 }
@@ -0,0 +1,261 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_LOSER_TREE_H__
+#define __TPIE_LOSER_TREE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file loser_tree.h
+/// \brief Tournament tree for merging sorted runs.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/array.h>
+#include <tpie/util.h>
+#include <tpie/tpie_assert.h>
+#include <functional>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class loser_tree
+/// \brief Loser tree over a fixed number of runs, holding the current item of
+/// each run.
+///
+/// Internal nodes store the index of the run that lost the match played at
+/// that node, so replacing the winner costs one comparison per tree level
+/// and moves only run indices. When the same run wins twice in a row, the
+/// runner-up is located; as long as the winning run keeps producing items
+/// that do not exceed it, pop_and_push() needs only a single comparison.
+///
+/// Usage: resize() to the number of runs, unsafe_set() the first item of
+/// each non-empty run, make_safe(), and then repeatedly read top() and call
+/// pop_and_push() with the next item of top_run() or pop() when that run
+/// is exhausted.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t = std::less<T> >
+class loser_tree: public linear_memory_base<loser_tree<T, pred_t> > {
+public:
+	typedef memory_size_type size_type;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Construct a loser tree with no runs.
+	///////////////////////////////////////////////////////////////////////////
+	loser_tree(pred_t pred = pred_t(),
+			   memory_bucket_ref bucket = memory_bucket_ref())
+		: m_items(bucket)
+		, m_tree(bucket)
+		, m_active(bucket)
+		, m_runs(0)
+		, m_runnerUp(no_run)
+		, m_pred(pred)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the number of runs and mark all of them as exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void resize(size_type runs) {
+		if (m_items.size() != runs) {
+			m_items.resize(runs);
+			m_tree.resize(runs);
+		}
+		m_active.resize(runs, false);
+		m_runs = runs;
+		m_runnerUp = no_run;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of runs the tree was sized for.
+	///////////////////////////////////////////////////////////////////////////
+	size_type runs() const {return m_runs;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the current item of a run without updating the tree.
+	/// make_safe() must be called before the tree is queried.
+	///////////////////////////////////////////////////////////////////////////
+	void unsafe_set(size_type run, const T & item) {
+		m_items[run] = item;
+		m_active[run] = true;
+	}
+
+	void unsafe_set(size_type run, T && item) {
+		m_items[run] = std::move(item);
+		m_active[run] = true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play all matches after a sequence of calls to unsafe_set().
+	///////////////////////////////////////////////////////////////////////////
+	void make_safe() {
+		m_runnerUp = no_run;
+		if (m_runs == 0) return;
+		m_tree[0] = build(1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Are all runs exhausted?
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() const {
+		return m_runs == 0 || !m_active[m_tree[0]];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the least current item.
+	///////////////////////////////////////////////////////////////////////////
+	const T & top() const {return m_items[m_tree[0]];}
+
+	T & top() {return m_items[m_tree[0]];}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the run holding the least current item.
+	///////////////////////////////////////////////////////////////////////////
+	size_type top_run() const {return m_tree[0];}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Replace the least item by the next item of the same run.
+	///////////////////////////////////////////////////////////////////////////
+	void pop_and_push(const T & item) {
+		tp_assert(!empty(), "pop_and_push() on empty loser_tree");
+		m_items[m_tree[0]] = item;
+		advance();
+	}
+
+	void pop_and_push(T && item) {
+		tp_assert(!empty(), "pop_and_push() on empty loser_tree");
+		m_items[m_tree[0]] = std::move(item);
+		advance();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the least item; its run is exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		tp_assert(!empty(), "pop() on empty loser_tree");
+		m_active[m_tree[0]] = false;
+		m_runnerUp = no_run;
+		replay(m_tree[0]);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Release all runs.
+	///////////////////////////////////////////////////////////////////////////
+	void clear() {
+		resize(0);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_coefficient()
+	/// \copydetails linear_memory_structure_doc::memory_coefficient()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_coefficient() {
+		return tpie::array<T>::memory_coefficient()
+			+ tpie::array<size_type>::memory_coefficient()
+			+ tpie::array<bool>::memory_coefficient();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_overhead()
+	/// \copydetails linear_memory_structure_doc::memory_overhead()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_overhead() {
+		return tpie::array<T>::memory_overhead() - sizeof(tpie::array<T>)
+			+ tpie::array<size_type>::memory_overhead() - sizeof(tpie::array<size_type>)
+			+ tpie::array<bool>::memory_overhead() - sizeof(tpie::array<bool>)
+			+ sizeof(loser_tree);
+	}
+
+private:
+	static const size_type no_run = static_cast<size_type>(-1);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Does the current item of run a come strictly before that of b?
+	/// Exhausted runs lose against everything.
+	///////////////////////////////////////////////////////////////////////////
+	bool beats(size_type a, size_type b) {
+		if (!m_active[a]) return false;
+		if (!m_active[b]) return true;
+		return m_pred(m_items[a], m_items[b]);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the matches of the subtree rooted at node and return its
+	/// winner. Leaf i is node m_runs + i.
+	///////////////////////////////////////////////////////////////////////////
+	size_type build(size_type node) {
+		if (node >= m_runs) return node - m_runs;
+		size_type left = build(2*node);
+		size_type right = build(2*node+1);
+		if (beats(right, left)) std::swap(left, right);
+		m_tree[node] = right;
+		return left;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Replay the matches on the path from the leaf of run to the
+	/// root after its current item has changed.
+	///////////////////////////////////////////////////////////////////////////
+	void replay(size_type run) {
+		size_type winner = run;
+		for (size_type node = (m_runs + run) / 2; node > 0; node /= 2) {
+			if (beats(m_tree[node], winner)) std::swap(m_tree[node], winner);
+		}
+		m_tree[0] = winner;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Restore the tree after the winner's item was replaced.
+	///////////////////////////////////////////////////////////////////////////
+	void advance() {
+		const size_type run = m_tree[0];
+		if (m_runnerUp != no_run) {
+			// Every loser on the path is at least the runner-up, so the
+			// winner stays on top while it does not exceed the runner-up.
+			if (!beats(m_runnerUp, run)) return;
+			m_runnerUp = no_run;
+			replay(run);
+			return;
+		}
+		replay(run);
+		if (m_tree[0] == run) find_runner_up();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The second least item lost directly to the winner, so it is
+	/// the least of the losers on the winner's path.
+	///////////////////////////////////////////////////////////////////////////
+	void find_runner_up() {
+		const size_type run = m_tree[0];
+		size_type best = no_run;
+		for (size_type node = (m_runs + run) / 2; node > 0; node /= 2) {
+			if (best == no_run || beats(m_tree[node], best)) best = m_tree[node];
+		}
+		m_runnerUp = best;
+	}
+
+	tpie::array<T> m_items;
+	tpie::array<size_type> m_tree;
+	tpie::array<bool> m_active;
+	size_type m_runs;
+	size_type m_runnerUp;
+	pred_t m_pred;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_LOSER_TREE_H__
@@ -0,0 +1,231 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/mapped_stream.h>
+#include <tpie/stream_header.h>
+#include <tpie/util.h>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#undef NO_ERROR
+#else // WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif // WIN32
+
+namespace tpie {
+
+namespace {
+
+// Must agree with stream_accessor_base::boundary().
+const memory_size_type header_boundary = 4096;
+
+void throw_io_error(const std::string & what, const std::string & path) {
+	std::stringstream ss;
+#ifdef WIN32
+	ss << what << " " << path << ": error " << GetLastError();
+#else // WIN32
+	ss << what << " " << path << ": " << std::strerror(errno);
+#endif // WIN32
+	throw io_exception(ss.str());
+}
+
+} // unnamed namespace
+
+mapped_stream_base::mapped_stream_base(memory_size_type itemSize)
+	: m_mapping(0)
+	, m_mappingSize(0)
+	, m_data(0)
+	, m_size(0)
+	, m_offset(0)
+	, m_itemSize(itemSize)
+	, m_blockSize(0)
+	, m_blockItems(0)
+	, m_userDataSize(0)
+{
+}
+
+mapped_stream_base::~mapped_stream_base() {
+	close();
+}
+
+void mapped_stream_base::open(temp_file & file, cache_hint cacheHint /*= access_sequential*/) {
+	open(file.path(), cacheHint);
+}
+
+void mapped_stream_base::open(const std::string & path, cache_hint cacheHint /*= access_sequential*/) {
+	close();
+
+	stream_size_type fileSize;
+	void * mapping;
+#ifdef WIN32
+	HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+							 0, OPEN_EXISTING, 0, 0);
+	if (file == INVALID_HANDLE_VALUE) throw_io_error("Could not open", path);
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw_io_error("Could not get the size of", path);
+	}
+	fileSize = static_cast<stream_size_type>(size.QuadPart);
+	if (fileSize < sizeof(stream_header_t)) {
+		CloseHandle(file);
+		throw invalid_file_exception("Invalid file, too short to contain a header");
+	}
+	HANDLE fileMapping = CreateFileMapping(file, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(file);
+	if (fileMapping == 0) throw_io_error("Could not map", path);
+	mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(fileMapping);
+	if (mapping == 0) throw_io_error("Could not map", path);
+#else // WIN32
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1) throw_io_error("Could not open", path);
+	struct stat st;
+	if (::fstat(fd, &st) == -1) {
+		int error = errno;
+		::close(fd);
+		errno = error;
+		throw_io_error("Could not get the size of", path);
+	}
+	fileSize = static_cast<stream_size_type>(st.st_size);
+	if (fileSize < sizeof(stream_header_t)) {
+		::close(fd);
+		throw invalid_file_exception("Invalid file, too short to contain a header");
+	}
+	if (fileSize > std::numeric_limits<memory_size_type>::max()) {
+		::close(fd);
+		throw io_exception("File is larger than the address space");
+	}
+	mapping = ::mmap(0, static_cast<memory_size_type>(fileSize), PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping keeps the file referenced.
+	::close(fd);
+	if (mapping == MAP_FAILED) throw_io_error("Could not map", path);
+#endif // WIN32
+
+	m_mapping = static_cast<const char *>(mapping);
+	m_mappingSize = static_cast<memory_size_type>(fileSize);
+	m_path = path;
+
+	stream_header_t header;
+	std::memcpy(&header, m_mapping, sizeof(header));
+	try {
+		if (header.magic != stream_header_t::magicConst)
+			throw invalid_file_exception("Invalid file, header magic wrong");
+		if (header.version != stream_header_t::versionConst)
+			throw invalid_file_exception("Invalid file, header version wrong");
+		if (header.itemSize != m_itemSize)
+			throw invalid_file_exception("Invalid file, item size is wrong");
+		if (header.blockSize < header.itemSize)
+			throw invalid_file_exception("Invalid file, block size is wrong");
+		if (header.userDataSize > header.maxUserDataSize)
+			throw invalid_file_exception("Invalid file, user data size is greater than max user data size");
+		if (header.get_clean_close() == false)
+			throw invalid_file_exception("Invalid file, the file was not closed properly");
+		if (header.get_compressed())
+			throw stream_exception("Compressed streams cannot be mapped");
+
+		m_blockSize = static_cast<memory_size_type>(header.blockSize);
+		m_blockItems = m_blockSize / m_itemSize;
+		m_userDataSize = static_cast<memory_size_type>(header.userDataSize);
+		m_size = header.size;
+
+		const stream_size_type headerSize =
+			(sizeof(stream_header_t) + header.maxUserDataSize + header_boundary - 1)
+			/ header_boundary * header_boundary;
+		m_data = m_mapping + headerSize;
+		if (m_size > 0 && headerSize + (item_address(m_size - 1) - m_data) + m_itemSize > fileSize)
+			throw invalid_file_exception("Invalid file, file is shorter than its header claims");
+	} catch (...) {
+		close();
+		throw;
+	}
+
+	set_cache_hint(cacheHint);
+}
+
+void mapped_stream_base::close() {
+	if (m_mapping != 0) {
+#ifdef WIN32
+		UnmapViewOfFile(m_mapping);
+#else // WIN32
+		::munmap(const_cast<char *>(m_mapping), m_mappingSize);
+#endif // WIN32
+	}
+	m_mapping = 0;
+	m_mappingSize = 0;
+	m_data = 0;
+	m_size = 0;
+	m_offset = 0;
+	m_userDataSize = 0;
+	m_path.clear();
+}
+
+void mapped_stream_base::set_cache_hint(cache_hint cacheHint) {
+	if (m_mapping == 0) return;
+#ifdef WIN32
+	// Windows has no equivalent of madvise for file mappings.
+	unused(cacheHint);
+#else // WIN32
+	int advice;
+	switch (cacheHint) {
+		case access_sequential:
+			advice = MADV_SEQUENTIAL;
+			break;
+		case access_random:
+			advice = MADV_RANDOM;
+			break;
+		default:
+			advice = MADV_NORMAL;
+			break;
+	}
+	// The advice is only a hint; ignore failures.
+	::madvise(const_cast<char *>(m_mapping), m_mappingSize, advice);
+#endif // WIN32
+}
+
+memory_size_type mapped_stream_base::read_user_data(void * data, memory_size_type count) {
+	if (count > m_userDataSize) count = m_userDataSize;
+	if (count) std::memcpy(data, m_mapping + sizeof(stream_header_t), count);
+	return count;
+}
+
+void mapped_stream_base::seek_inner(stream_offset_type offset, file_stream_base::offset_type whence) {
+	switch (whence) {
+		case file_stream_base::beginning:
+			break;
+		case file_stream_base::end:
+			offset += m_size;
+			break;
+		case file_stream_base::current:
+			offset += m_offset;
+			break;
+	}
+	if (offset < 0 || static_cast<stream_size_type>(offset) > m_size)
+		throw io_exception("Tried to seek out of file");
+	m_offset = static_cast<stream_size_type>(offset);
+}
+
+} // namespace tpie
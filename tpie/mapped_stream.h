@@ -0,0 +1,231 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file mapped_stream.h  Read-only memory-mapped streams
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TPIE_MAPPED_STREAM_H
+#define TPIE_MAPPED_STREAM_H
+
+#include <tpie/types.h>
+#include <tpie/exception.h>
+#include <tpie/tpie_assert.h>
+#include <tpie/cache_hint.h>
+#include <tpie/array_view.h>
+#include <tpie/file_stream_base.h>
+#include <tpie/tempname.h>
+#include <string>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Type-independent part of mapped_stream: the mapping of a finished
+/// uncompressed stream and the interpretation of its header.
+///////////////////////////////////////////////////////////////////////////////
+class mapped_stream_base {
+public:
+	mapped_stream_base(memory_size_type itemSize);
+	~mapped_stream_base();
+
+	mapped_stream_base(const mapped_stream_base &) = delete;
+	mapped_stream_base & operator=(const mapped_stream_base &) = delete;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map a stream written by file_stream or uncompressed_stream.
+	///
+	/// The stream must have been closed properly and must not be compressed.
+	/// The file must not be written to while it is mapped.
+	///////////////////////////////////////////////////////////////////////////
+	void open(const std::string & path, cache_hint cacheHint=access_sequential);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map a stream stored in a temporary file.
+	///////////////////////////////////////////////////////////////////////////
+	void open(temp_file & file, cache_hint cacheHint=access_sequential);
+
+	void close();
+
+	bool is_open() const { return m_mapping != 0; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Tell the operating system how the mapping will be accessed.
+	/// Corresponds to madvise(2) on POSIX.
+	///////////////////////////////////////////////////////////////////////////
+	void set_cache_hint(cache_hint cacheHint);
+
+	stream_size_type size() const { return m_size; }
+
+	stream_size_type file_size() const { return m_size; }
+
+	stream_size_type offset() const { return m_offset; }
+
+	const std::string & path() const { return m_path; }
+
+	memory_size_type block_items() const { return m_blockItems; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check if the items of the stream are stored without gaps, that
+	/// is, if the block size is a multiple of the item size.
+	///////////////////////////////////////////////////////////////////////////
+	bool contiguous() const { return m_blockItems * m_itemSize == m_blockSize; }
+
+	memory_size_type user_data_size() const { return m_userDataSize; }
+
+	memory_size_type read_user_data(void * data, memory_size_type count);
+
+	template <typename TT>
+	void read_user_data(TT & data) {
+		if (sizeof(TT) != user_data_size()) throw stream_exception("Wrong user data size");
+		read_user_data(reinterpret_cast<void *>(&data), sizeof(TT));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The mapping does not use memory managed by TPIE; only the
+	/// stream object itself is counted.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type memory_usage() { return sizeof(mapped_stream_base); }
+
+protected:
+	const char * item_address(stream_size_type index) const {
+		if (contiguous()) return m_data + index * m_itemSize;
+		const stream_size_type block = index / m_blockItems;
+		return m_data + block * m_blockSize + (index - block * m_blockItems) * m_itemSize;
+	}
+
+	void seek_inner(stream_offset_type offset, file_stream_base::offset_type whence);
+
+	const char * m_mapping;
+	memory_size_type m_mappingSize;
+	/** Beginning of the item data, right after the stream header. */
+	const char * m_data;
+	stream_size_type m_size;
+	stream_size_type m_offset;
+	memory_size_type m_itemSize;
+	memory_size_type m_blockSize;
+	memory_size_type m_blockItems;
+	memory_size_type m_userDataSize;
+	std::string m_path;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Read-only stream accessing a finished uncompressed stream through
+/// a memory mapping of the file.
+///
+/// The interface for reading and seeking mirrors file_stream, but no block
+/// is ever copied into a buffer: read() and peek() return references into
+/// the mapping, and view() exposes a range of items as an array_view. Random
+/// seeks cost no system call, and pages are brought in by the operating
+/// system on demand.
+///
+/// References and views are valid until the stream is closed.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class mapped_stream: public mapped_stream_base {
+public:
+	typedef T item_type;
+	typedef file_stream_base::offset_type offset_type;
+
+	static const offset_type beginning = file_stream_base::beginning;
+	static const offset_type end = file_stream_base::end;
+	static const offset_type current = file_stream_base::current;
+
+	mapped_stream()
+		: mapped_stream_base(sizeof(T))
+	{
+	}
+
+	static memory_size_type memory_usage() { return sizeof(mapped_stream); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Move the offset of the stream. Unlike with file_stream, this
+	/// does not cause any I/O.
+	///////////////////////////////////////////////////////////////////////////
+	void seek(stream_offset_type offset, offset_type whence=beginning) {
+		seek_inner(offset, whence);
+	}
+
+	bool can_read() const { return m_offset < m_size; }
+
+	bool can_read_back() const { return m_offset > 0; }
+
+	const T & read() {
+		const T & res = peek();
+		++m_offset;
+		return res;
+	}
+
+	const T & read_back() {
+		if (!can_read_back()) throw end_of_stream_exception();
+		--m_offset;
+		return at(m_offset);
+	}
+
+	const T & peek() const {
+		if (!can_read()) throw end_of_stream_exception();
+		return at(m_offset);
+	}
+
+	void skip() {
+		read();
+	}
+
+	void skip_back() {
+		read_back();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Reads min(b-a, size()-offset()) items into the range [a, b).
+	/// If less than b-a items are read, throws an end_of_stream_exception.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename IT>
+	void read(IT const a, IT const b) {
+		for (IT i = a; i != b; ++i) *i = read();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Item at the given offset, independent of the stream offset.
+	///
+	/// Precondition: index < size()
+	///////////////////////////////////////////////////////////////////////////
+	const T & at(stream_size_type index) const {
+		tp_assert(index < m_size, "at: index out of bounds");
+		return *reinterpret_cast<const T *>(item_address(index));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief A view of count items starting at the given offset.
+	///
+	/// The range must lie within the stream, and unless contiguous() is
+	/// true, it must lie within a single block.
+	///////////////////////////////////////////////////////////////////////////
+	array_view<const T> view(stream_size_type offset, memory_size_type count) const {
+		if (offset > m_size || count > m_size - offset)
+			throw stream_exception("view: Range exceeds the stream");
+		if (!contiguous() && count > 0
+			&& offset / m_blockItems != (offset + count - 1) / m_blockItems)
+			throw stream_exception("view: Range spans a block boundary");
+		const T * begin = reinterpret_cast<const T *>(item_address(offset));
+		return array_view<const T>(begin, begin + count);
+	}
+};
+
+} // namespace tpie
+
+#endif // TPIE_MAPPED_STREAM_H
@@ -24,7 +24,12 @@
 #include "tpie_log.h"
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
+#include <new>
 #include "pretty_print.h"
+#ifdef WIN32
+#include <malloc.h>
+#endif
 
 namespace tpie {
 
@@ -194,6 +199,33 @@ memory_manager & get_memory_manager() {
 	return * mm;
 }
 
+char * tpie_new_aligned_buffer(size_t size) {
+	get_memory_manager().register_allocation(size);
+	void * p = 0;
+#ifdef WIN32
+	p = _aligned_malloc(std::max<size_t>(size, 1), direct_io_alignment);
+#else
+	if (posix_memalign(&p, direct_io_alignment, std::max<size_t>(size, 1)) != 0) p = 0;
+#endif
+	if (p == 0) {
+		get_memory_manager().register_deallocation(size);
+		throw std::bad_alloc();
+	}
+	__register_pointer(p, size, typeid(char));
+	return static_cast<char *>(p);
+}
+
+void tpie_delete_aligned_buffer(char * buffer, size_t size) throw() {
+	if (buffer == 0) return;
+	get_memory_manager().register_deallocation(size);
+	__unregister_pointer(buffer, size, typeid(char));
+#ifdef WIN32
+	_aligned_free(buffer);
+#else
+	std::free(buffer);
+#endif
+}
+
 size_t consecutive_memory_available(size_t granularity) {
 	std::pair<uint8_t *, size_t> r = get_memory_manager().__allocate_consecutive(0, granularity);
 	tpie_delete_array(r.first, r.second);
@@ -455,6 +455,26 @@ public:
 		
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Alignment of buffers, file offsets and sizes required for direct
+/// (unbuffered) I/O.
+///////////////////////////////////////////////////////////////////////////////
+const size_t direct_io_alignment = 4096;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Allocate a byte buffer aligned to direct_io_alignment and register
+/// its memory usage.
+/// \param size The size of the buffer in bytes.
+///////////////////////////////////////////////////////////////////////////////
+char * tpie_new_aligned_buffer(size_t size);
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Delete a buffer allocated with tpie_new_aligned_buffer.
+/// \param buffer The buffer to delete.
+/// \param size The size of the buffer as passed to tpie_new_aligned_buffer.
+///////////////////////////////////////////////////////////////////////////////
+void tpie_delete_aligned_buffer(char * buffer, size_t size) throw();
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Find the largest amount of memory that can be allocated as a single
 /// chunk.
@@ -0,0 +1,462 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file parallel_priority_queue.h External memory priority queue that
+/// merges in the background and accepts concurrent insertions.
+/// \sa \ref priority_queue.h
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_PARALLEL_PRIORITY_QUEUE_H_
+#define _TPIE_PARALLEL_PRIORITY_QUEUE_H_
+
+#include <tpie/priority_queue.h>
+#include <tpie/internal_priority_queue.h>
+#include <tpie/array_view.h>
+#include <tpie/job.h>
+#include <algorithm>
+#include <exception>
+#include <mutex>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief External memory priority queue whose merges run on a background
+/// job, and which several threads may push to at once.
+///
+/// The items are kept in three parts: a run of the least items taken from an
+/// external \ref priority_queue, an in-memory heap of pushed items that are
+/// less than the last item of that run, and the back, which is the external
+/// queue along with a buffer of pushed items not yet inserted into it.
+/// Every item in the back is at least the bound, the greatest item ever
+/// taken into the run, so the top of the queue is always in the run or the
+/// heap.
+///
+/// When the run gets short, a \ref job inserts the buffered items into the
+/// external queue and pops the next run from it. All slot and group merging
+/// of the external queue happens in that job, so pop() only waits for it if
+/// both the run and the heap are exhausted. The lock of the queue is released
+/// while waiting, so pushes continue in the meantime.
+///
+/// Any number of threads may call push() and push_batch(), and a
+/// \ref producer collects the items of one thread to push them in batches.
+/// Only one thread at a time may call top(), pop() and pop_batch().
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename Comparator = std::less<T> >
+class parallel_priority_queue {
+	typedef priority_queue<T, Comparator> back_queue_type;
+
+	enum bound_state {
+		/** The back is empty, every push goes to the heap. */
+		bound_none,
+		/** Pushes less than m_bound go to the heap. */
+		bound_value,
+		/** The run and heap are empty, every push goes to the back. */
+		bound_min
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Job inserting a buffer into the external queue and popping the
+	/// next run from it.
+	///////////////////////////////////////////////////////////////////////////
+	class refill_job : public job {
+	public:
+		refill_job() : m_queue(0), m_inCount(0), m_popCount(0), m_outCount(0) {}
+
+		virtual void operator()() override {
+			try {
+				m_queue->push_batch(array_view<const T>(m_in.get(), m_inCount));
+				m_outCount = m_queue->pop_batch(m_popCount, m_out.get());
+			} catch (...) {
+				m_exception = std::current_exception();
+			}
+		}
+
+		back_queue_type * m_queue;
+		array<T> m_in;
+		memory_size_type m_inCount;
+		array<T> m_out;
+		memory_size_type m_popCount;
+		memory_size_type m_outCount;
+		std::exception_ptr m_exception;
+	};
+
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Collects the pushes of one thread and forwards them to the queue
+	/// in batches.
+	///
+	/// Pushed items are not visible to the consumer until they are flushed,
+	/// which happens when the buffer is full, on flush() and on destruction.
+	///////////////////////////////////////////////////////////////////////////
+	class producer {
+	public:
+		producer(parallel_priority_queue & queue, memory_size_type bufferItems = 1024)
+			: m_queue(queue)
+			, m_buffer(std::max(bufferItems, static_cast<memory_size_type>(1)))
+			, m_count(0)
+		{
+		}
+
+		~producer() {
+			flush();
+		}
+
+		void push(const T & x) {
+			m_buffer[m_count++] = x;
+			if (m_count == m_buffer.size()) flush();
+		}
+
+		void flush() {
+			if (m_count == 0) return;
+			m_queue.push_batch(array_view<const T>(m_buffer.get(), m_count));
+			m_count = 0;
+		}
+
+	private:
+		parallel_priority_queue & m_queue;
+		array<T> m_buffer;
+		memory_size_type m_count;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor.
+	///
+	/// \param memory Number of bytes the queue is allowed to use in total.
+	/// \param bufferItems Size of the in-memory run, heap and insertion
+	/// buffers. If zero, a size is chosen from the memory.
+	/// \param blockFactor Block factor of the external queue.
+	///////////////////////////////////////////////////////////////////////////
+	parallel_priority_queue(memory_size_type memory,
+							memory_size_type bufferItems = 0,
+							float blockFactor = back_queue_type::default_blocksize,
+							Comparator comp = Comparator())
+		: m_comp(comp)
+		, m_bufferItems(buffer_items(memory, bufferItems))
+		, m_heap(m_bufferItems, comp)
+		, m_run(m_bufferItems)
+		, m_runBegin(0)
+		, m_runEnd(0)
+		, m_incoming(m_bufferItems)
+		, m_incomingCount(0)
+		, m_boundState(bound_none)
+		, m_size(0)
+		, m_queueItems(0)
+		, m_jobRunning(false)
+	{
+		m_job.m_in.resize(m_bufferItems);
+		m_job.m_out.resize(m_bufferItems / 2);
+		memory_size_type buffers = (4 * m_bufferItems + m_bufferItems / 2) * sizeof(T);
+		if (memory <= buffers)
+			throw exception("parallel_priority_queue: Not enough memory for the buffers");
+		m_queue.reset(tpie_new<back_queue_type>(memory - buffers, blockFactor));
+		m_job.m_queue = m_queue.get();
+	}
+
+	~parallel_priority_queue() {
+		if (m_jobRunning) m_job.join();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert an element into the priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	void push(const T & x) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		poll();
+		push_locked(lock, x);
+		maybe_start_job();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert a batch of elements into the priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	void push_batch(array_view<const T> items) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		poll();
+		for (const T & x : items) push_locked(lock, x);
+		maybe_start_job();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the least element. The queue must not be empty.
+	///
+	/// Unlike priority_queue::top() the element is returned by value, since
+	/// concurrent pushes may move it.
+	///////////////////////////////////////////////////////////////////////////
+	T top() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		poll();
+		ensure_top(lock);
+		return top_from_run() ? m_run[m_runBegin] : m_heap.top();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the least element.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		poll();
+		if (m_size == 0)
+			throw priority_queue_error("pop() invoked on empty priority queue");
+		ensure_top(lock);
+		pop_locked();
+		maybe_start_job();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove up to n elements from the top of the queue and write
+	/// them in order to out.
+	///
+	/// \return Number of elements removed.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename OutputIterator>
+	memory_size_type pop_batch(memory_size_type n, OutputIterator out) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		poll();
+		memory_size_type popped = 0;
+		while (popped < n && m_size != 0) {
+			ensure_top(lock);
+			*out = pop_locked();
+			++out;
+			++popped;
+			maybe_start_job();
+		}
+		return popped;
+	}
+
+	stream_size_type size() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_size;
+	}
+
+	bool empty() {
+		return size() == 0;
+	}
+
+private:
+	static memory_size_type buffer_items(memory_size_type memory, memory_size_type bufferItems) {
+		if (bufferItems == 0)
+			bufferItems = std::min(memory / 32 / sizeof(T), static_cast<memory_size_type>(1) << 16);
+		return std::max(bufferItems, static_cast<memory_size_type>(16));
+	}
+
+	bool back_empty() const {
+		return m_queueItems == 0 && m_incomingCount == 0
+			&& (!m_jobRunning || m_job.m_inCount == 0);
+	}
+
+	bool top_from_run() const {
+		if (m_runBegin == m_runEnd) return false;
+		return m_heap.empty() || !m_comp(m_heap.top(), m_run[m_runBegin]);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert an element while holding the lock.
+	///
+	/// The lock is released while waiting for the refill job, so other
+	/// threads may change the queue in the meantime.
+	///////////////////////////////////////////////////////////////////////////
+	void push_locked(std::unique_lock<std::mutex> & lock, const T & x) {
+		for (;;) {
+			if (m_boundState == bound_none
+				|| (m_boundState == bound_value && m_comp(x, m_bound))) {
+				if (m_heap.size() == m_bufferItems) {
+					// The heap is full; hand everything to the external queue.
+					reset(lock);
+					continue;
+				}
+				m_heap.push(x);
+				break;
+			}
+			if (m_incomingCount == m_bufferItems) {
+				if (m_jobRunning) wait_job(lock);
+				else start_job(0);
+				continue;
+			}
+			m_incoming[m_incomingCount++] = x;
+			break;
+		}
+		++m_size;
+	}
+
+	T pop_locked() {
+		T x;
+		if (top_from_run()) {
+			x = m_run[m_runBegin++];
+		} else {
+			x = m_heap.top();
+			m_heap.pop();
+		}
+		--m_size;
+		return x;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Make sure the least element is in the run or the heap.
+	///////////////////////////////////////////////////////////////////////////
+	void ensure_top(std::unique_lock<std::mutex> & lock) {
+		while (m_runBegin == m_runEnd && m_heap.empty()) {
+			if (m_size == 0)
+				throw priority_queue_error("top() invoked on empty priority queue");
+			if (!m_jobRunning) start_job(m_job.m_out.size());
+			wait_job(lock);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Start a refill job when the run is short or the insertion
+	/// buffer is half full.
+	///////////////////////////////////////////////////////////////////////////
+	void maybe_start_job() {
+		if (m_jobRunning) return;
+		bool refill = m_runEnd - m_runBegin <= m_bufferItems / 2 && !back_empty();
+		if (refill) start_job(m_job.m_out.size());
+		else if (m_incomingCount >= m_bufferItems / 2) start_job(0);
+	}
+
+	void start_job(memory_size_type popCount) {
+		tp_assert(!m_jobRunning, "Refill job already running");
+		m_incoming.swap(m_job.m_in);
+		m_job.m_inCount = m_incomingCount;
+		m_incomingCount = 0;
+		m_job.m_popCount = popCount;
+		m_job.m_outCount = 0;
+		m_jobRunning = true;
+		m_job.enqueue();
+	}
+
+	void poll() {
+		if (m_jobRunning && m_job.is_done()) integrate();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the refill job without holding the lock.
+	///
+	/// Another thread may integrate the job, and even start the next one,
+	/// while the lock is released, so callers must check the state again.
+	///////////////////////////////////////////////////////////////////////////
+	void wait_job(std::unique_lock<std::mutex> & lock) {
+		if (!m_jobRunning) return;
+		lock.unlock();
+		m_job.join();
+		lock.lock();
+		poll();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Append the run popped by the finished job and move the bound.
+	///////////////////////////////////////////////////////////////////////////
+	void integrate() {
+		m_jobRunning = false;
+		m_queueItems += m_job.m_inCount;
+		m_job.m_inCount = 0;
+		if (m_job.m_exception) {
+			std::exception_ptr e = m_job.m_exception;
+			m_job.m_exception = std::exception_ptr();
+			std::rethrow_exception(e);
+		}
+		memory_size_type n = m_job.m_outCount;
+		m_queueItems -= n;
+		if (n > 0) {
+			if (m_runBegin != 0) {
+				std::copy(m_run.get() + m_runBegin, m_run.get() + m_runEnd, m_run.get());
+				m_runEnd -= m_runBegin;
+				m_runBegin = 0;
+			}
+			std::copy(m_job.m_out.get(), m_job.m_out.get() + n, m_run.get() + m_runEnd);
+			m_runEnd += n;
+			m_bound = m_job.m_out[n - 1];
+			m_boundState = bound_value;
+			// Items buffered while the job ran are only known to be at least
+			// the old bound.
+			move_incoming_below_bound();
+		}
+		if (back_empty()) m_boundState = bound_none;
+	}
+
+	void move_incoming_below_bound() {
+		memory_size_type below = 0;
+		for (memory_size_type i = 0; i < m_incomingCount; ++i)
+			if (m_comp(m_incoming[i], m_bound)) ++below;
+		if (below == 0) return;
+		if (m_heap.size() + below > m_bufferItems) {
+			spill();
+			return;
+		}
+		memory_size_type j = 0;
+		for (memory_size_type i = 0; i < m_incomingCount; ++i) {
+			if (m_comp(m_incoming[i], m_bound)) m_heap.push(m_incoming[i]);
+			else m_incoming[j++] = m_incoming[i];
+		}
+		m_incomingCount = j;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the refill job and spill().
+	///////////////////////////////////////////////////////////////////////////
+	void reset(std::unique_lock<std::mutex> & lock) {
+		while (m_jobRunning) wait_job(lock);
+		spill();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert the run, the heap and the insertion buffer into the
+	/// external queue. The refill job must not be running.
+	///////////////////////////////////////////////////////////////////////////
+	void spill() {
+		array<T> & heap = m_heap.get_array();
+		m_queue->push_batch(array_view<const T>(heap.get(), m_heap.size()));
+		m_queue->push_batch(array_view<const T>(m_run.get() + m_runBegin, m_runEnd - m_runBegin));
+		m_queue->push_batch(array_view<const T>(m_incoming.get(), m_incomingCount));
+		m_queueItems += m_heap.size() + (m_runEnd - m_runBegin) + m_incomingCount;
+		m_heap.clear();
+		m_runBegin = m_runEnd = 0;
+		m_incomingCount = 0;
+		m_boundState = m_queueItems == 0 ? bound_none : bound_min;
+	}
+
+	Comparator m_comp;
+	memory_size_type m_bufferItems;
+	std::mutex m_mutex;
+
+	/** Pushed items less than the bound. */
+	internal_priority_queue<T, Comparator> m_heap;
+	/** Sorted items popped from the external queue. */
+	array<T> m_run;
+	memory_size_type m_runBegin;
+	memory_size_type m_runEnd;
+	/** Pushed items not less than the bound. */
+	array<T> m_incoming;
+	memory_size_type m_incomingCount;
+
+	bound_state m_boundState;
+	T m_bound;
+
+	stream_size_type m_size;
+	/** Items in the external queue, not counting the input of a running job. */
+	stream_size_type m_queueItems;
+
+	tpie::unique_ptr<back_queue_type> m_queue;
+	refill_job m_job;
+	bool m_jobRunning;
+};
+
+} // namespace tpie
+
+#endif // _TPIE_PARALLEL_PRIORITY_QUEUE_H_
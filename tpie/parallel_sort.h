@@ -29,6 +29,7 @@
 #include <cstdint>
 #include <boost/iterator/iterator_traits.hpp>
 #include <mutex>
+#include <condition_variable>
 #include <cmath>
 #include <functional>
 #include <tpie/progress_indicator_base.h>
@@ -65,6 +65,7 @@ public:
 	}
 
 	T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		step();
 		return m_queue->read();
 	}
@@ -99,9 +100,15 @@ public:
 	}
 
 	void push(const T & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		m_queue->write(item);
 	}
 
+	void push_batch(array_view<const T> items) {
+		bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(T));
+		m_queue->write(items.begin(), items.end());
+	}
+
 	void end() override {
 		forward("queue", &m_queue, 1);
 	}
@@ -144,6 +151,7 @@ public:
 			dest.push(m_queue->read());
 			step();
 		}
+		profile_items(m_queue->size(), m_queue->size() * sizeof(item_type));
 	}
 
 	void end() override {
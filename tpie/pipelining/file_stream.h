@@ -41,6 +41,21 @@ typedef tpie::flags<stream_option> stream_options;
 
 namespace bits {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Push the rest of a stream to dest in batches and step the progress
+/// of the reading node.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename dest_t>
+void read_batches(file_stream<T> & fs, dest_t & dest, node & reader) {
+	array<T> batch(batch_size);
+	while (fs.can_read()) {
+		size_t count = 0;
+		while (count < batch_size && fs.can_read()) batch[count++] = fs.read();
+		push_batch_to(dest, array_view<const T>(batch.get(), count));
+		reader.step(count);
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \class input_t
 ///
@@ -54,7 +69,7 @@ public:
 	input_t(dest_t dest, file_stream<item_type> & fs, stream_options options) : options(options), fs(fs), dest(std::move(dest)) {
 		add_push_destination(this->dest);
 		set_name("Read", PRIORITY_INSIGNIFICANT);
-		set_minimum_memory(fs.memory_usage());
+		set_minimum_memory(fs.memory_usage() + batch_size * sizeof(item_type));
 	}
 
 	virtual void propagate() override {
@@ -70,10 +85,9 @@ public:
 
 	virtual void go() override {
 		if (fs.is_open()) {
-			while (fs.can_read()) {
-				dest.push(fs.read());
-				step();
-			}
+			stream_size_type offset = fs.offset();
+			read_batches(fs, dest, *this);
+			profile_items(fs.offset() - offset, (fs.offset() - offset) * sizeof(item_type));
 		}
 	}
 
@@ -100,7 +114,7 @@ public:
 	named_input_t(dest_t dest, std::string path) : dest(std::move(dest)), path(path) {
 		add_push_destination(this->dest);
 		set_name("Read", PRIORITY_INSIGNIFICANT);
-		set_minimum_memory(file_stream<item_type>::memory_usage());
+		set_minimum_memory(file_stream<item_type>::memory_usage() + batch_size * sizeof(item_type));
 	}
 
 	virtual void propagate() override {
@@ -111,10 +125,8 @@ public:
 	}
 
 	virtual void go() override {
-		while (fs->can_read()) {
-			dest.push(fs->read());
-			step();
-		}
+		read_batches(*fs, dest, *this);
+		profile_items(fs->size(), fs->size() * sizeof(item_type));
 		fs.destruct();
 	}
 private:
@@ -146,6 +158,7 @@ public:
 	}
 
 	T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		step();
 		return fs.read();
 	}
@@ -185,6 +198,7 @@ public:
 	}
 
 	inline T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		step();
 		return fs.read_back();
 	}
@@ -225,6 +239,7 @@ public:
 	}
 
 	T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		step();
 		return fs->read();
 	}
@@ -259,8 +274,14 @@ public:
 	}
 
 	void push(const T & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		fs.write(item);
 	}
+
+	void push_batch(array_view<const T> items) {
+		bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(T));
+		fs.write(items.begin(), items.end());
+	}
 private:
 	file_stream<T> & fs;
 };
@@ -286,9 +307,15 @@ public:
 	}
 	
 	void push(const T & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		fs->write(item);
 	}
 
+	void push_batch(array_view<const T> items) {
+		bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(T));
+		fs->write(items.begin(), items.end());
+	}
+
 	void end() override {
 		fs->close();
 		fs.destruct();
@@ -317,10 +344,13 @@ public:
 
 	virtual void go() override {
 		source.begin();
+		stream_size_type items = 0;
 		while (source.can_pull()) {
 			fs.write(source.pull());
+			++items;
 		}
 		source.end();
+		profile_items(items, items * sizeof(item_type));
 	}
 	
 private:
@@ -337,6 +367,7 @@ public:
 	}
 	
 	void push(const item_type & i) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		fs.write(i);
 		dest.push(i);
 	}
@@ -24,30 +24,74 @@
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
 #include <tpie/pipelining/node_name.h>
+#include <type_traits>
 
 namespace tpie {
 namespace pipelining {
 namespace bits {
 
-template <typename F>
+///////////////////////////////////////////////////////////////////////////////
+/// When pure is true, the functor has no side effects, so a batch can be
+/// filtered in full before any of it is pushed on.
+///////////////////////////////////////////////////////////////////////////////
+template <typename F, bool pure = false>
 class filter_t {
 public:
 	template <typename dest_t>
 	class type: public node {
+	public:
+		typedef typename std::decay<typename unary_traits<F>::argument_type>::type item_type;
 	private:
 		F functor;
 		dest_t dest;
+		tpie::array<item_type> m_buffer;
 	public:
-		typedef typename std::decay<typename unary_traits<F>::argument_type>::type item_type;
 		type(dest_t dest, const F & functor):
 			functor(functor), dest(std::move(dest)) {
 			set_name(bits::extract_pipe_name(typeid(F).name()), PRIORITY_NO_NAME);
+			if (pure && std::is_trivial<item_type>::value)
+				set_minimum_memory(batch_size * sizeof(item_type));
 		}
 		
 		void push(const item_type & item) {
+			bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 			if (functor(item))
 				dest.push(item);
 		}
+
+		template <bool P = pure>
+		typename std::enable_if<P>::type push_batch(array_view<const item_type> items) {
+			bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(item_type));
+			filter_batch(items, std::is_trivial<item_type>());
+		}
+
+		void end() override {
+			m_buffer.resize(0);
+		}
+
+	private:
+		///////////////////////////////////////////////////////////////////////
+		/// Trivial items that pass the filter are copied to a buffer and
+		/// passed on as a batch.
+		///////////////////////////////////////////////////////////////////////
+		void filter_batch(array_view<const item_type> items, std::true_type) {
+			if (m_buffer.size() == 0) m_buffer.resize(batch_size);
+			size_t n = 0;
+			for (const item_type & item: items) {
+				if (!functor(item)) continue;
+				m_buffer[n++] = item;
+				if (n == batch_size) {
+					push_batch_to(dest, array_view<const item_type>(m_buffer.get(), n));
+					n = 0;
+				}
+			}
+			if (n > 0) push_batch_to(dest, array_view<const item_type>(m_buffer.get(), n));
+		}
+
+		void filter_batch(array_view<const item_type> items, std::false_type) {
+			for (const item_type & item: items)
+				if (functor(item)) dest.push(item);
+		}
 	};
 };
 
@@ -63,6 +107,19 @@ pipe_middle<tempfactory<bits::filter_t<F>, F> > filter(const F & functor) {
 	return tempfactory<bits::filter_t<F>, F >(functor);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Like filter, for a functor without side effects.
+///
+/// Batches pushed to the node are filtered in full before the kept items
+/// are pushed on as a batch, so the functor may run ahead of the nodes after
+/// it.
+/// \param functor The filter to use
+///////////////////////////////////////////////////////////////////////////////
+template <typename F>
+pipe_middle<tempfactory<bits::filter_t<F, true>, F> > pure_filter(const F & functor) {
+	return tempfactory<bits::filter_t<F, true>, F >(functor);
+}
+
 } //namespace pipelining
 } //namespace terrastream
 
@@ -54,25 +54,65 @@ struct unary_traits_imp<R(*)(A)> {
 template <typename T>
 struct unary_traits: public unary_traits_imp<decltype(&T::operator()) > {};
 
-template <typename F>
+///////////////////////////////////////////////////////////////////////////////
+/// When pure is true, the functor has no side effects, so a batch can be
+/// mapped in full before any of it is pushed on.
+///////////////////////////////////////////////////////////////////////////////
+template <typename F, bool pure = false>
 class map_t {
 public:
 	template <typename dest_t>
 	class type: public node {
 	private:
+		typedef typename std::decay<typename unary_traits<F>::return_type>::type out_type;
+
 		F functor;
 		dest_t dest;
+		tpie::array<out_type> m_buffer;
 	public:
 		typedef typename std::decay<typename unary_traits<F>::argument_type>::type item_type;
 
 		type(dest_t dest, const F & functor):
 			functor(functor), dest(std::move(dest)) {
 			set_name(bits::extract_pipe_name(typeid(F).name()), PRIORITY_NO_NAME);
+			if (pure && std::is_trivial<out_type>::value)
+				set_minimum_memory(batch_size * sizeof(out_type));
 		}
 		
 		void push(const item_type & item) {
+			bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 			dest.push(functor(item));
 		}
+
+		template <bool P = pure>
+		typename std::enable_if<P>::type push_batch(array_view<const item_type> items) {
+			bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(item_type));
+			map_batch(items, std::is_trivial<out_type>());
+		}
+
+		void end() override {
+			m_buffer.resize(0);
+		}
+
+	private:
+		///////////////////////////////////////////////////////////////////////
+		/// Trivial results are computed into a buffer by a plain loop that the
+		/// compiler may vectorize, and passed on as a batch.
+		///////////////////////////////////////////////////////////////////////
+		void map_batch(array_view<const item_type> items, std::true_type) {
+			if (m_buffer.size() == 0) m_buffer.resize(batch_size);
+			for (size_t i = 0; i < items.size(); i += batch_size) {
+				size_t n = std::min(batch_size, items.size() - i);
+				const item_type * in = &items[i];
+				out_type * out = m_buffer.get();
+				for (size_t j = 0; j < n; ++j) out[j] = functor(in[j]);
+				push_batch_to(dest, array_view<const out_type>(out, n));
+			}
+		}
+
+		void map_batch(array_view<const item_type> items, std::false_type) {
+			for (const item_type & item: items) dest.push(functor(item));
+		}
 	};
 };
 
@@ -92,6 +132,7 @@ public:
 
 		template <typename T>
 		void push(const T & item) {
+			bits::profile_scope profile(get_profile(), 1, sizeof(T));
 			dest.push(functor(item));
 		}
 	};
@@ -111,6 +152,7 @@ public:
 	}
 	
 	void push(const item_type & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		functor(item);
 	}
 };
@@ -144,6 +186,18 @@ pipe_middle<tempfactory<bits::map_t<F>, F> > map(const F & functor) {
 	return tempfactory<bits::map_t<F>, F >(functor);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Like map, for a functor without side effects.
+///
+/// Batches pushed to the node are mapped in full before the results are
+/// pushed on as a batch, so the functor may run ahead of the nodes after it.
+/// \param f The functor that should be applied to items
+///////////////////////////////////////////////////////////////////////////////
+template <typename F, typename = typename std::enable_if<bits::has_argument_type<F>::value>::type>
+pipe_middle<tempfactory<bits::map_t<F, true>, F> > pure_map(const F & functor) {
+	return tempfactory<bits::map_t<F, true>, F >(functor);
+}
+
 template <typename F, typename = typename std::enable_if<!bits::has_argument_type<F>::value>::type>
 pipe_middle<tempfactory<bits::map_temp_t<F>, F> > map(const F & functor) {
 	return tempfactory<bits::map_temp_t<F>, F >(functor);
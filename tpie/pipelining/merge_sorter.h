@@ -28,6 +28,11 @@
 #include <tpie/dummy_progress.h>
 #include <tpie/array_view.h>
 #include <tpie/parallel_sort.h>
+#include <tpie/radix_sort.h>
+#include <tpie/job.h>
+#include <exception>
+#include <numeric>
+#include <vector>
 
 namespace tpie {
 
@@ -156,6 +161,12 @@ private:
 	typedef typename specific_store_t::element_type element_type;	//Should be the same as TT
 	typedef outer_type item_type;
 	static const size_t item_size = specific_store_t::item_size;
+	typedef merger<specific_store_t, pred_t> merger_type;
+	typedef bits::store_pred<pred_t, specific_store_t> store_pred_t;
+	typedef radix_key_traits<pred_t, element_type> radix_traits;
+	// Runs are radix sorted when the predicate is a key_less, as given by
+	// sort_by_key, and scratch memory is available.
+	static const bool radix_sorted = is_key_less<pred_t>::value;
 public:
 
 	typedef std::shared_ptr<merge_sorter> ptr;
@@ -180,6 +191,8 @@ public:
 		, m_currentRunItems(m_bucket)
 		, m_maxItems(std::numeric_limits<stream_size_type>::max())
 		, pred(pred)
+		, m_replacementSelection(false)
+		, m_selecting(false)
 		, m_evacuated(false)
 		, m_finalMergeInitialized(false)
 		, m_owning_node(nullptr)
@@ -282,6 +295,22 @@ public:
 		check_not_started();
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Form runs by replacement selection.
+	///
+	/// Once the run buffer is full, it is kept as a heap, and every pushed
+	/// item writes out the smallest buffered item and takes its place. The
+	/// pushed item joins the current run unless it is smaller than the item
+	/// written, in which case it is set aside for the next run. Runs are
+	/// about twice the buffer size on random input, and input in which no
+	/// item is preceded by a buffer's worth of larger items gives a single
+	/// run, needing no merges at all.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_replacement_selection(bool enabled) {
+		m_replacementSelection = enabled;
+		check_not_started();
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Initiate phase 1: Formation of input runs.
 	///////////////////////////////////////////////////////////////////////////
@@ -294,6 +323,10 @@ public:
 		m_runFiles.resize(p.fanout*2);
 		m_currentRunItemCount = 0;
 		m_finishedRuns = 0;
+		m_runLengths[0].clear();
+		m_runLengths[1].clear();
+		m_currentRunSorted = true;
+		m_selecting = false;
 		m_state = stRunFormation;
 		m_itemCount = 0;
 	}
@@ -304,10 +337,16 @@ public:
 	inline void push(item_type && item) {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
 		if (m_currentRunItemCount >= p.runLength) {
+			if (m_replacementSelection) {
+				select_push(m_store.outer_to_store(std::move(item)));
+				++m_itemCount;
+				return;
+			}
 			sort_current_run();
 			empty_current_run();
 		}
 		m_currentRunItems[m_currentRunItemCount] = m_store.outer_to_store(std::move(item));
+		check_run_order();
 		++m_currentRunItemCount;
 		++m_itemCount;
 	}
@@ -315,19 +354,60 @@ public:
 	inline void push(const item_type & item) {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
 		if (m_currentRunItemCount >= p.runLength) {
+			if (m_replacementSelection) {
+				select_push(m_store.outer_to_store(item));
+				++m_itemCount;
+				return;
+			}
 			sort_current_run();
 			empty_current_run();
 		}
 		m_currentRunItems[m_currentRunItemCount] = m_store.outer_to_store(item);
+		check_run_order();
 		++m_currentRunItemCount;
 		++m_itemCount;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Push items to merge sorter during phase 1.
+	///
+	/// The items are appended to the current run as far as it has room, so
+	/// the run is only checked for being full once per run rather than once
+	/// per item.
+	///////////////////////////////////////////////////////////////////////////
+	inline void push_batch(array_view<const item_type> items) {
+		tp_assert(m_state == stRunFormation, "Wrong phase");
+		size_t i = 0;
+		while (i < items.size()) {
+			if (m_currentRunItemCount >= p.runLength) {
+				if (m_replacementSelection) {
+					for (; i < items.size(); ++i) push(items[i]);
+					return;
+				}
+				sort_current_run();
+				empty_current_run();
+			}
+			const memory_size_type n = std::min<memory_size_type>(items.size() - i, p.runLength - m_currentRunItemCount);
+			for (memory_size_type j = 0; j < n; ++j) {
+				m_currentRunItems[m_currentRunItemCount] = m_store.outer_to_store(items[i + j]);
+				check_run_order();
+				++m_currentRunItemCount;
+			}
+			m_itemCount += n;
+			i += n;
+		}
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief End phase 1.
 	///////////////////////////////////////////////////////////////////////////
 	inline void end() {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
+		if (m_selecting) {
+			end_selection();
+			m_state = stMerge;
+			return;
+		}
 		sort_current_run();
 
 		if (m_itemCount == 0) {
@@ -422,30 +502,175 @@ private:
 	// Phase 1 helpers.
 	///////////////////////////////////////////////////////////////////////////
 
+	// Clear m_currentRunSorted if the item just put at the end of the
+	// current run is smaller than the one before it.
+	inline void check_run_order() {
+		if (m_currentRunSorted && m_currentRunItemCount > 0
+			&& pred(specific_store_t::store_as_element(m_currentRunItems[m_currentRunItemCount]),
+					specific_store_t::store_as_element(m_currentRunItems[m_currentRunItemCount-1])))
+			m_currentRunSorted = false;
+	}
+
 	inline void sort_current_run() {
-		parallel_sort(m_currentRunItems.begin(), m_currentRunItems.begin()+m_currentRunItemCount, 
-					  bits::store_pred<pred_t, specific_store_t>(pred));
+		if (m_currentRunSorted) return;
+		sort_items(0, m_currentRunItemCount);
+		m_currentRunSorted = true;
+	}
+
+	inline void sort_items(memory_size_type from, memory_size_type to) {
+		sort_items(from, to, std::integral_constant<bool, radix_sorted>());
+	}
+
+	inline void sort_items(memory_size_type from, memory_size_type to, std::false_type) {
+		parallel_sort(m_currentRunItems.begin()+from, m_currentRunItems.begin()+to,
+					  store_pred_t(pred));
+	}
+
+	// The radix sort uses the unused end of the run buffer as scratch when
+	// it is large enough, and otherwise the phase 1 memory left over by the
+	// run buffer. Without either, the items are sorted by comparisons.
+	inline void sort_items(memory_size_type from, memory_size_type to, std::true_type) {
+		const memory_size_type n = to - from;
+		array<store_type> buffer(0, allocator<store_type>(m_bucket));
+		store_type * scratch = 0;
+		if (m_currentRunItems.size() - m_currentRunItemCount >= n) {
+			scratch = m_currentRunItems.get() + m_currentRunItemCount;
+		} else if (n * sizeof(store_type) <= spare_memory_phase_1()) {
+			buffer.resize(n);
+			scratch = buffer.get();
+		} else {
+			sort_items(from, to, std::false_type());
+			return;
+		}
+		parallel_radix_sort(m_currentRunItems.get()+from, m_currentRunItems.get()+to,
+							scratch, bits::store_key<radix_traits, pred_t, specific_store_t>(pred));
+	}
+
+	inline memory_size_type spare_memory_phase_1() const {
+		const memory_size_type used = memory_usage_phase_1(p);
+		return p.memoryPhase1 > used ? p.memoryPhase1 - used : 0;
 	}
 
+	// If the sorted buffer starts no lower than the previous run ended, it
+	// is appended to that run, so presorted input gives a single run.
 	// postcondition: m_currentRunItemCount = 0
 	inline void empty_current_run() {
+		file_stream<element_type> fs;
+		if (m_finishedRuns > 0 && m_currentRunItemCount > 0
+			&& !pred(specific_store_t::store_as_element(m_currentRunItems[0]), m_lastRunItem)) {
+			if (m_finishedRuns < 10)
+				log_debug() << "Append " << m_currentRunItemCount << " items to run file " << m_finishedRuns-1 << std::endl;
+			open_run_file_append(fs, 0, m_finishedRuns-1);
+			m_runLengths[0].back() += m_currentRunItemCount;
+		} else {
+			if (m_finishedRuns < 10)
+				log_debug() << "Write " << m_currentRunItemCount << " items to run file " << m_finishedRuns << std::endl;
+			else if (m_finishedRuns == 10)
+				log_debug() << "..." << std::endl;
+			open_run_file_write(fs, 0, m_finishedRuns);
+			m_runLengths[0].push_back(m_currentRunItemCount);
+			++m_finishedRuns;
+		}
+		for (memory_size_type i = 0; i < m_currentRunItemCount; ++i) {
+			element_type item = m_store.store_to_element(std::move(m_currentRunItems[i]));
+			if (i + 1 == m_currentRunItemCount) m_lastRunItem = item;
+			fs.write(item);
+		}
+		m_currentRunItemCount = 0;
+		m_currentRunSorted = true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Replacement selection. The buffer holds the heap of the current run
+	// in [0, m_heapSize) and the items set aside for the next run after it.
+	///////////////////////////////////////////////////////////////////////////
+
+	inline void select_push(store_type item) {
+		if (!m_selecting) {
+			log_debug() << "Start replacement selection" << std::endl;
+			m_selecting = true;
+			start_selection_run();
+		}
+		store_pred_t less(pred);
+		bool sameRun = !less(item, m_currentRunItems[0]);
+		m_runStream.write(m_store.store_to_element(std::move(m_currentRunItems[0])));
+		++m_runStreamItems;
+		if (sameRun) {
+			m_currentRunItems[0] = std::move(item);
+		} else {
+			--m_heapSize;
+			if (m_heapSize > 0) m_currentRunItems[0] = std::move(m_currentRunItems[m_heapSize]);
+			m_currentRunItems[m_heapSize] = std::move(item);
+		}
+		if (m_heapSize > 0) {
+			sift_down(0);
+		} else {
+			end_selection_run();
+			start_selection_run();
+		}
+	}
+
+	// Make a heap of the entire buffer and open the next run.
+	inline void start_selection_run() {
+		m_heapSize = m_currentRunItemCount;
+		for (memory_size_type i = m_heapSize / 2; i--;) sift_down(i);
+		open_run_file_write(m_runStream, 0, m_finishedRuns);
+		m_runStreamItems = 0;
+	}
+
+	inline void end_selection_run() {
 		if (m_finishedRuns < 10)
-			log_debug() << "Write " << m_currentRunItemCount << " items to run file " << m_finishedRuns << std::endl;
+			log_debug() << "Wrote " << m_runStreamItems << " items to run file " << m_finishedRuns << std::endl;
 		else if (m_finishedRuns == 10)
 			log_debug() << "..." << std::endl;
-		file_stream<element_type> fs;
-		open_run_file_write(fs, 0, m_finishedRuns);
-		for (memory_size_type i = 0; i < m_currentRunItemCount; ++i)
-			fs.write(m_store.store_to_element(std::move(m_currentRunItems[i])));
-		m_currentRunItemCount = 0;
+		m_runStream.close();
+		m_runLengths[0].push_back(m_runStreamItems);
 		++m_finishedRuns;
 	}
 
+	// Write the heap as the end of the current run, and the items set aside
+	// as one more run.
+	inline void end_selection() {
+		sort_items(0, m_heapSize);
+		for (memory_size_type i = 0; i < m_heapSize; ++i)
+			m_runStream.write(m_store.store_to_element(std::move(m_currentRunItems[i])));
+		m_runStreamItems += m_heapSize;
+		end_selection_run();
+		if (m_heapSize < m_currentRunItemCount) {
+			sort_items(m_heapSize, m_currentRunItemCount);
+			open_run_file_write(m_runStream, 0, m_finishedRuns);
+			for (memory_size_type i = m_heapSize; i < m_currentRunItemCount; ++i)
+				m_runStream.write(m_store.store_to_element(std::move(m_currentRunItems[i])));
+			m_runStreamItems = m_currentRunItemCount - m_heapSize;
+			end_selection_run();
+		}
+		m_currentRunItemCount = 0;
+		m_currentRunItems.resize(0);
+		m_selecting = false;
+		m_reportInternal = false;
+		log_debug() << "Got " << m_finishedRuns << " runs by replacement selection. External reporting mode." << std::endl;
+	}
+
+	inline void sift_down(memory_size_type i) {
+		store_pred_t less(pred);
+		store_type item = std::move(m_currentRunItems[i]);
+		for (;;) {
+			memory_size_type child = 2*i + 1;
+			if (child >= m_heapSize) break;
+			if (child + 1 < m_heapSize && less(m_currentRunItems[child+1], m_currentRunItems[child])) ++child;
+			if (!less(m_currentRunItems[child], item)) break;
+			m_currentRunItems[i] = std::move(m_currentRunItems[child]);
+			i = child;
+		}
+		m_currentRunItems[i] = std::move(item);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
-	/// Prepare m_merger for merging the runNumber'th to the
+	/// Prepare the merger for merging the runNumber'th to the
 	/// (runNumber+runCount)'th run in mergeLevel.
 	///////////////////////////////////////////////////////////////////////////
-	inline void initialize_merger(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount) {
+	inline void initialize_merger(merger_type & m, memory_size_type mergeLevel, memory_size_type runNumber,
+								  memory_size_type runCount) {
 		// runCount is a memory_size_type since we must be able to have that
 		// many file_streams open at the same time.
 
@@ -454,9 +679,24 @@ private:
 		for (memory_size_type i = 0; i < runCount; ++i) {
 			open_run_file_read(in[i], mergeLevel, runNumber+i);
 		}
-		stream_size_type runLength = calculate_run_length(p.runLength, p.fanout, mergeLevel);
 		// Pass file streams with correct stream offsets to the merger
-		m_merger.reset(in, runLength);
+		const std::vector<stream_size_type> & lengths = m_runLengths[mergeLevel % 2];
+		array<stream_size_type> runLengths(runCount);
+		std::copy(lengths.begin() + runNumber, lengths.begin() + runNumber + runCount, runLengths.begin());
+		m.reset(in, runLengths);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Record the length of the run merged from the runNumber'th to the
+	/// (runNumber+runCount)'th run in mergeLevel as the next run of
+	/// mergeLevel+1.
+	///////////////////////////////////////////////////////////////////////////
+	inline void add_merged_run_length(memory_size_type mergeLevel, memory_size_type runNumber,
+									  memory_size_type runCount) {
+		const std::vector<stream_size_type> & lengths = m_runLengths[mergeLevel % 2];
+		m_runLengths[(mergeLevel+1) % 2].push_back(
+			std::accumulate(lengths.begin() + runNumber, lengths.begin() + runNumber + runCount,
+							stream_size_type(0)));
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -473,6 +713,7 @@ private:
 		m_finalRunCount = runCount;
 		m_runPositions.next_level();
 		m_runPositions.final_level(p.fanout);
+		m_runLengths[(finalMergeLevel+1) % 2].clear();
 		if (runCount > p.finalFanout) {
 			log_debug() << "Run count in final level (" << runCount << ") is greater than the final fanout (" << p.finalFanout << ")\n";
 
@@ -480,7 +721,8 @@ private:
 			memory_size_type n = runCount-i;
 			log_debug() << "Merge " << n << " runs starting from #" << i << std::endl;
 			dummy_progress_indicator pi;
-			m_finalMergeSpecialRunNumber = merge_runs(finalMergeLevel, i, n, pi);
+			merge_runs(finalMergeLevel, i, n, 0, pi);
+			m_finalMergeSpecialRunNumber = 0;
 		} else {
 			log_debug() << "Run count in final level (" << runCount << ") is less or equal to the final fanout (" << p.finalFanout << ")" << std::endl;
 			m_finalMergeSpecialRunNumber = std::numeric_limits<memory_size_type>::max();
@@ -500,43 +742,136 @@ public:
 			}
 			open_run_file_read(in[p.finalFanout-1], m_finalMergeLevel+1, m_finalMergeSpecialRunNumber);
 			log_debug() << "Special large run is at offset " << in[p.finalFanout-1].offset() << " and has size " << in[p.finalFanout-1].size() << std::endl;
-			stream_size_type runLength = calculate_run_length(p.runLength, p.fanout, m_finalMergeLevel+1);
-			log_debug() << "Run length " << runLength << std::endl;
-			m_merger.reset(in, runLength);
+			const std::vector<stream_size_type> & lengths = m_runLengths[m_finalMergeLevel % 2];
+			array<stream_size_type> runLengths(p.finalFanout);
+			std::copy(lengths.begin(), lengths.begin() + p.finalFanout - 1, runLengths.begin());
+			runLengths[p.finalFanout-1] = m_runLengths[(m_finalMergeLevel+1) % 2][0];
+			log_debug() << "Special run length " << runLengths[p.finalFanout-1] << std::endl;
+			m_merger.reset(in, runLengths);
 		} else {
-			initialize_merger(m_finalMergeLevel, 0, m_finalRunCount);
+			initialize_merger(m_merger, m_finalMergeLevel, 0, m_finalRunCount);
 		}
 		m_evacuated = false;
 	}
 
 private:
-	///////////////////////////////////////////////////////////////////////////
-	/// initialize_merger helper.
-	///////////////////////////////////////////////////////////////////////////
-	static inline stream_size_type calculate_run_length(stream_size_type initialRunLength, memory_size_type fanout, memory_size_type mergeLevel) {
-		stream_size_type runLength = initialRunLength;
-		for (memory_size_type i = 0; i < mergeLevel; ++i) {
-			runLength *= fanout;
-		}
-		return runLength;
-	}
-
 	///////////////////////////////////////////////////////////////////////////
 	/// Merge the runNumber'th to the (runNumber+runCount)'th in mergeLevel
-	/// into mergeLevel+1.
-	/// \returns The run number in mergeLevel+1 that was written to.
+	/// into run nextRunNumber in mergeLevel+1.
 	///////////////////////////////////////////////////////////////////////////
 	template <typename ProgressIndicator>
-	inline memory_size_type merge_runs(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount, ProgressIndicator & pi) {
-		initialize_merger(mergeLevel, runNumber, runCount);
+	inline void merge_runs(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount,
+						   memory_size_type nextRunNumber, ProgressIndicator & pi) {
+		initialize_merger(m_merger, mergeLevel, runNumber, runCount);
+		add_merged_run_length(mergeLevel, runNumber, runCount);
 		file_stream<element_type> out;
-		memory_size_type nextRunNumber = runNumber/p.fanout;
 		open_run_file_write(out, mergeLevel+1, nextRunNumber);
 		while (m_merger.can_pull()) {
 			pi.step();
 			out.write(m_store.store_to_element(m_merger.pull()));
 		}
-		return nextRunNumber;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Job merging a group of runs into a single output run.
+	///
+	/// The streams are opened by the calling thread, since run positions
+	/// must be accessed in order.
+	///////////////////////////////////////////////////////////////////////////
+	class merge_job : public job {
+	public:
+		merge_job(pred_t pred, specific_store_t store, memory_bucket_ref bucket)
+			: m_merger(pred, store, bucket)
+			, m_store(store)
+			, m_items(0)
+		{
+		}
+
+		virtual void operator()() override {
+			try {
+				while (m_merger.can_pull()) {
+					m_out.write(m_store.store_to_element(m_merger.pull()));
+					++m_items;
+				}
+				m_out.close();
+			} catch (...) {
+				m_exception = std::current_exception();
+			}
+		}
+
+		merger_type m_merger;
+		file_stream<element_type> m_out;
+		specific_store_t m_store;
+		stream_size_type m_items;
+		std::exception_ptr m_exception;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merge the groups firstGroup to firstGroup+groups-1 of fanout runs
+	/// each in mergeLevel concurrently on the job pool.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename ProgressIndicator>
+	void merge_groups(memory_size_type mergeLevel, memory_size_type runCount, memory_size_type fanout,
+					  memory_size_type firstGroup, memory_size_type groups,
+					  ProgressIndicator & pi) {
+		if (groups == 1) {
+			memory_size_type i = firstGroup*fanout;
+			merge_runs(mergeLevel, i, std::min(runCount-i, fanout), firstGroup, pi);
+			return;
+		}
+		array<tpie::unique_ptr<merge_job> > jobs(groups);
+		for (memory_size_type g = 0; g < groups; ++g) {
+			memory_size_type i = (firstGroup+g)*fanout;
+			jobs[g].reset(tpie_new<merge_job>(pred, m_store, m_bucket));
+			initialize_merger(jobs[g]->m_merger, mergeLevel, i, std::min(runCount-i, fanout));
+			add_merged_run_length(mergeLevel, i, std::min(runCount-i, fanout));
+			open_run_file_write(jobs[g]->m_out, mergeLevel+1, firstGroup+g);
+		}
+		for (memory_size_type g = 0; g < groups; ++g) jobs[g]->enqueue();
+		// Joining runs pending merges on this thread as well.
+		for (memory_size_type g = 0; g < groups; ++g) jobs[g]->join();
+		for (memory_size_type g = 0; g < groups; ++g) {
+			if (jobs[g]->m_exception) std::rethrow_exception(jobs[g]->m_exception);
+			pi.step(jobs[g]->m_items);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Choose the fanout of an intermediate merge level.
+	///
+	/// Merging with p.fanout in every level, the runCount runs would go
+	/// through some number h of intermediate levels. Rather than filling
+	/// the first levels and leaving a small final merge, spread the fanout
+	/// evenly over the h intermediate levels and the final merge, keeping
+	/// the number of passes over the data unchanged. Smaller merges can be
+	/// run concurrently within the stream budget of a single merge.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type level_fanout(memory_size_type runCount) const {
+		// capacity = p.fanout^h, where h is the number of levels after this one.
+		memory_size_type levels = 1;
+		stream_size_type capacity = 1;
+		while (runCount > capacity * p.fanout * p.fanout) {
+			capacity *= p.fanout;
+			++levels;
+		}
+		// After this level, at most capacity*p.fanout runs may remain.
+		memory_size_type lo = static_cast<memory_size_type>((runCount + capacity * p.fanout - 1) / (capacity * p.fanout));
+		memory_size_type balanced = static_cast<memory_size_type>(
+			std::ceil(std::pow(static_cast<double>(runCount), 1.0 / (levels + 1))));
+		return clamp(2, std::max(lo, balanced), p.fanout);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The number of groups of the given fanout to merge at a time.
+	///
+	/// The merges of a batch together open no more streams, and thus use no
+	/// more memory and files, than a single merge with the fanout p.fanout.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type merge_parallelism(memory_size_type fanout, memory_size_type groups) const {
+		memory_size_type k = (p.fanout + 1) / (fanout + 1);
+		k = std::min(k, default_worker_count() + 1);
+		k = std::min(k, groups);
+		return std::max(k, static_cast<memory_size_type>(1));
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -553,19 +888,22 @@ private:
 		memory_size_type mergeLevel = 0;
 		memory_size_type runCount = m_finishedRuns;
 		while (runCount > p.fanout) {
-			log_debug() << "Merge " << runCount << " runs in merge level " << mergeLevel << '\n';
+			memory_size_type fanout = level_fanout(runCount);
+			memory_size_type newRunCount = (runCount + fanout - 1) / fanout;
+			memory_size_type parallelism = merge_parallelism(fanout, newRunCount);
+			log_debug() << "Merge " << runCount << " runs in merge level " << mergeLevel
+						<< " with fanout " << fanout << ", " << parallelism << " merges at a time\n";
 			m_runPositions.next_level();
-			memory_size_type newRunCount = 0;
-			for (memory_size_type i = 0; i < runCount; i += p.fanout) {
-				memory_size_type n = std::min(runCount-i, p.fanout);
+			m_runLengths[(mergeLevel+1) % 2].clear();
+			for (memory_size_type g = 0; g < newRunCount; g += parallelism) {
+				memory_size_type groups = std::min(parallelism, newRunCount - g);
 
-				if (newRunCount < 10)
-					log_debug() << "Merge " << n << " runs starting from #" << i << std::endl;
-				else if (newRunCount == 10)
+				if (g < 10)
+					log_debug() << "Merge groups " << g << " to " << g+groups-1 << std::endl;
+				else if (g < 10 + parallelism)
 					log_debug() << "..." << std::endl;
 
-				merge_runs(mergeLevel, i, n, pi);
-				++newRunCount;
+				merge_groups(mergeLevel, runCount, fanout, g, groups, pi);
 			}
 			++mergeLevel;
 			runCount = newRunCount;
@@ -697,6 +1035,11 @@ private:
 		if (!p.filesPhase3)
 			throw tpie::exception("memory limit for phase 3 not set");
 
+		// Internal reporting must fit in the memory we were given, even when
+		// the phase 2 and 3 limits are raised below to fit the fanout.
+		const memory_size_type reportMemory =
+			std::min(p.memoryPhase1, std::min(p.memoryPhase2, p.memoryPhase3));
+
 		// We must set aside memory for temp_files in m_runFiles.
 		// m_runFiles contains fanout*2 temp_files, so calculate fanout before run length.
 
@@ -739,10 +1082,7 @@ private:
 		}
 		p.runLength = (p.memoryPhase1 - bits::run_positions::memory_usage() - streamMemory - tempFileMemory)/item_size;
 
-		p.internalReportThreshold = (std::min(p.memoryPhase1,
-											  std::min(p.memoryPhase2,
-													   p.memoryPhase3))
-									 - tempFileMemory)/item_size;
+		p.internalReportThreshold = (reportMemory - tempFileMemory)/item_size;
 		if (p.internalReportThreshold > p.runLength)
 			p.internalReportThreshold = p.runLength;
 
@@ -881,6 +1221,16 @@ private:
 		m_runPositions.set_position(mergeLevel, runNumber, fs.get_position());
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Open the file of an existing run to append to the run, which
+	/// must be the last one written to the file.
+	///////////////////////////////////////////////////////////////////////////
+	void open_run_file_append(file_stream<element_type> & fs, memory_size_type mergeLevel, memory_size_type runNumber) {
+		memory_size_type idx = run_file_index(mergeLevel, runNumber);
+		fs.open(m_runFiles[idx], access_read_write, 0, access_sequential, compression_normal);
+		fs.seek(0, file_stream_base::end);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Open an existing run file and seek to the correct offset.
 	///////////////////////////////////////////////////////////////////////////
@@ -911,7 +1261,7 @@ private:
 	bool m_parametersSet;
 
 	specific_store_t m_store;
-	merger<specific_store_t, pred_t> m_merger;
+	merger_type m_merger;
 
 	bits::run_positions m_runPositions;
 
@@ -927,6 +1277,12 @@ private:
 	// Used to index into m_currentRunItems, so memory_size_type.
 	memory_size_type m_currentRunItemCount;
 
+	// Whether the items in the current run buffer were pushed in order.
+	bool m_currentRunSorted;
+
+	// The last item of the last run written from the run buffer.
+	element_type m_lastRunItem;
+
 	bool m_reportInternal;
 
 	// When doing internal reporting: the number of items already reported
@@ -938,6 +1294,20 @@ private:
 	stream_size_type m_maxItems;
 
 	pred_t pred;
+
+	bool m_replacementSelection;
+	// True once the buffer has filled up with replacement selection.
+	bool m_selecting;
+	// Size of the heap of the current run in m_currentRunItems.
+	memory_size_type m_heapSize;
+	// The run being written by replacement selection, and its length so far.
+	file_stream<element_type> m_runStream;
+	stream_size_type m_runStreamItems;
+	// The lengths of the runs of the merge levels being read and written,
+	// indexed by merge level modulo 2. Runs of varying length share files,
+	// so merges must know where each run ends.
+	std::vector<stream_size_type> m_runLengths[2];
+
 	bool m_evacuated;
 	bool m_finalMergeInitialized;
 	memory_size_type m_finalMergeLevel;
@@ -20,7 +20,8 @@
 #ifndef __TPIE_PIPELINING_MERGER_H__
 #define __TPIE_PIPELINING_MERGER_H__
 
-#include <tpie/internal_priority_queue.h>
+#include <tpie/loser_tree.h>
+#include <algorithm>
 #include <tpie/compressed/stream.h>
 #include <tpie/file_stream.h>
 #include <tpie/tpie_assert.h>
@@ -37,26 +38,25 @@ private:
 public:
 	inline merger(pred_t pred, specific_store_t store,
 				  memory_bucket_ref bucket = memory_bucket_ref())
-		: pq(0, predwrap(store_pred_t(pred)), bucket)
+		: tree(store_pred_t(pred), bucket)
 		, in(bucket)
-		, itemsRead(bucket)
+		, itemsLeft(bucket)
 		, m_store(store) {
 	}
 
 	inline bool can_pull() {
-		return !pq.empty();
+		return !tree.empty();
 	}
 
  	inline store_type pull() {
 		tp_assert(can_pull(), "pull() while !can_pull()");
-		store_type el = std::move(pq.top().first);
-		size_t i = pq.top().second;
-		if (in[i].can_read() && itemsRead[i] < runLength) {
-			pq.pop_and_push(
-				std::make_pair(m_store.element_to_store(in[i].read()), i));
-			++itemsRead[i];
+		store_type el = std::move(tree.top());
+		size_t i = tree.top_run();
+		if (itemsLeft[i] > 0 && in[i].can_read()) {
+			tree.pop_and_push(m_store.element_to_store(in[i].read()));
+			--itemsLeft[i];
 		} else {
-			pq.pop();
+			tree.pop();
 		}
 		if (!can_pull()) {
 			reset();
@@ -66,8 +66,8 @@ public:
 
 	inline void reset() {
 		in.resize(0);
-		pq.resize(0);
-		itemsRead.resize(0);
+		tree.clear();
+		itemsLeft.resize(0);
 	}
 
 	// Initialize merger with given sorted input runs. Each file stream is
@@ -76,57 +76,50 @@ public:
 	// occurs earlier).
 	// Precondition: !can_pull()
 	void reset(array<file_stream<element_type> > & inputs, stream_size_type runLength) {
-		this->runLength = runLength;
-		tp_assert(pq.empty(), "Reset before we are done");
+		tp_assert(tree.empty(), "Reset before we are done");
 		in.swap(inputs);
-		pq.resize(in.size());
-		for (size_t i = 0; i < in.size(); ++i) {
-			pq.unsafe_push(
-				std::make_pair(
-					m_store.element_to_store(in[i].read()), i));
-		}
-		pq.make_safe();
-		itemsRead.resize(in.size(), 1);
+		itemsLeft.resize(in.size(), runLength);
+		fill_tree();
+	}
+
+	// As above, but reading runLengths[i] items from the i'th stream, for
+	// runs of varying length that share files.
+	void reset(array<file_stream<element_type> > & inputs, const array<stream_size_type> & runLengths) {
+		tp_assert(tree.empty(), "Reset before we are done");
+		tp_assert(inputs.size() == runLengths.size(), "Wrong number of run lengths");
+		in.swap(inputs);
+		itemsLeft.resize(in.size());
+		std::copy(runLengths.begin(), runLengths.end(), itemsLeft.begin());
+		fill_tree();
 	}
 
 	inline static memory_size_type memory_usage(memory_size_type fanout) {
 		return sizeof(merger)
-			- sizeof(internal_priority_queue<std::pair<store_type, size_t>, predwrap>) // pq
-			+ static_cast<memory_size_type>(internal_priority_queue<std::pair<store_type, size_t>, predwrap>::memory_usage(fanout)) // pq
+			- sizeof(loser_tree<store_type, store_pred_t>) // tree
+			+ static_cast<memory_size_type>(loser_tree<store_type, store_pred_t>::memory_usage(fanout)) // tree
 			- sizeof(array<file_stream<element_type> >) // in
 			+ static_cast<memory_size_type>(array<file_stream<element_type> >::memory_usage(fanout)) // in
 			- fanout*sizeof(file_stream<element_type>) // in file_streams
 			+ fanout*file_stream<element_type>::memory_usage() // in file_streams
-			- sizeof(array<size_t>) // itemsRead
-			+ static_cast<memory_size_type>(array<size_t>::memory_usage(fanout)) // itemsRead
+			- sizeof(array<stream_size_type>) // itemsLeft
+			+ static_cast<memory_size_type>(array<stream_size_type>::memory_usage(fanout)) // itemsLeft
 			;
 	}
 
-	class predwrap {
-	public:
-		typedef std::pair<store_type, size_t> item_type;
-		typedef item_type first_argument_type;
-		typedef item_type second_argument_type;
-		typedef bool result_type;
-
-		predwrap(store_pred_t pred)
-			: pred(pred)
-		{
-		}
-
-		inline bool operator()(const item_type & lhs, const item_type & rhs) {
-			return pred(lhs.first, rhs.first);
+private:
+	// Read the first item of every run.
+	void fill_tree() {
+		tree.resize(in.size());
+		for (size_t i = 0; i < in.size(); ++i) {
+			tree.unsafe_set(i, m_store.element_to_store(in[i].read()));
+			--itemsLeft[i];
 		}
+		tree.make_safe();
+	}
 
-	private:
-		store_pred_t pred;
-	};
-
-private:
-	internal_priority_queue<std::pair<store_type, size_t>, predwrap> pq;
+	loser_tree<store_type, store_pred_t> tree;
 	array<file_stream<element_type> > in;
-	array<stream_size_type> itemsRead;
-	stream_size_type runLength;
+	array<stream_size_type> itemsLeft;
 	specific_store_t m_store;
 };
 
@@ -28,6 +28,8 @@
 #include <tpie/pipelining/predeclare.h>
 #include <tpie/pipelining/node_name.h>
 #include <tpie/pipelining/node_traits.h>
+#include <tpie/pipelining/profile.h>
+#include <tpie/pipelining/push_batch.h>
 #include <tpie/flags.h>
 #include <limits>
 #include <tpie/resources.h>
@@ -444,6 +446,32 @@ public:
 		m_resourceBeingAssigned = type;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get the profile record of this node, or nullptr if the
+	/// pipeline is not being profiled.
+	/// \sa bits::profile_scope
+	///////////////////////////////////////////////////////////////////////////
+	node_profile * get_profile() const {
+		return m_profile;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Count items handled by this node when the pipeline is being
+	/// profiled, e.g. the items an initiator pushes in go().
+	///////////////////////////////////////////////////////////////////////////
+	void profile_items(stream_size_type items, memory_size_type bytes) {
+		if (!m_profile) return;
+		m_profile->items += items;
+		m_profile->bytes += bytes;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Used internally. Set the profile record of this node.
+	///////////////////////////////////////////////////////////////////////////
+	void set_profile(node_profile * profile) {
+		m_profile = profile;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Get options specified for plot(), as a combination of
 	/// \c node::PLOT values.
@@ -789,6 +817,8 @@ public:
 
 	friend class bits::datastructure_runtime;
 
+	friend class bits::runtime;
+
 	friend class factory_base;
 
 	friend class bits::pipeline_base;
@@ -806,6 +836,7 @@ private:
 	progress_indicator_base * m_pi;
 	STATE m_state;
 	resource_type m_resourceBeingAssigned = NO_RESOURCE;
+	node_profile * m_profile = nullptr;
 	std::unique_ptr<progress_indicator_base> m_piProxy;
 	flags<PLOT> m_plotOptions;
 
@@ -38,10 +38,9 @@
 /// receives the items pushed to each after instance.
 ///
 /// All nodes have access to a single parallel_bits::state instance
-/// which has the mutex and the necessary condition variables.
+/// which has the rings and events used to pass items between the threads.
 ///    It also has pointers to the parallel_bits::before and
-/// parallel_bits::after instances and it holds an array of worker states (of
-/// enum type parallel_bits::worker_state).
+/// parallel_bits::after instances.
 ///    It also has a options struct which contains the user-supplied
 /// parameters to the framework (size of item buffer and number of concurrent
 /// workers).
@@ -50,36 +49,39 @@
 /// since we get deadlocks if some of the workers are allowed to wait for a
 /// ready tpie::job worker. Instead, we use std::threads directly.
 ///
-/// Parallel worker states. The main thread has a condition variable
-/// (producerCond) which is signalled every time a worker changes its own
-/// state. Each worker thread has a condition variable (workerCond[]) which is
-/// signalled when the main thread changes the worker's state.
+/// Each worker has two single producer, single consumer rings of item
+/// buffers (parallel_bits::batch_ring): an input ring written by the main
+/// thread and an output ring read by the main thread. Handing a buffer over
+/// is a single atomic store, and no lock is shared between the workers.
 ///
-/// Initializing: Before the input/output buffers are initialized.
-/// -> Idle (worker thread)
+/// The producer sends each input buffer to the next worker, round-robin,
+/// that has fewer than state_base::inputSlots input buffers pending. The
+/// worker pushes the items through its pipeline and sends the output
+/// buffers back; the last output buffer of an input buffer is marked, so the
+/// producer knows when the input buffer is done. To maintain order, the
+/// producer keeps a queue of the workers in the order it sent them input,
+/// and only consumes output from the front worker.
 ///
-/// Idle: Input/output buffers are empty.
-/// -> Processing (main thread)
+/// A thread only parks on its event (parallel_bits::event_count) when its
+/// rings give it nothing to do: the main thread (producerEvent) when there
+/// is no output to consume and no worker can take more input, a worker
+/// (workerEvents[]) when its input ring is empty or its output ring is full.
 ///
-/// Processing: Input buffer is full; output buffer is empty.
-/// -> Partial output (worker thread; signals main)
-/// -> Outputting (worker thread)
-///
-/// Partial output: Output buffer is full; input buffer is non-empty.
-/// -> Processing (main thread)
-///
-/// Outputting: Output buffer is full; input buffer is empty.
-/// -> Idle (main thread)
+/// parallel_input() reads a file in the workers instead: the producer only
+/// sends each worker a description of a range of items (parallel_bits::
+/// file_chunk), and the first node of each worker pipeline reads that range
+/// from the worker's own file_stream.
 ///
 /// TODO at some future point: Optimize code for the case where the buffer size
 /// is one.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <tpie/pipelining/parallel/options.h>
-#include <tpie/pipelining/parallel/worker_state.h>
+#include <tpie/pipelining/parallel/ring.h>
 #include <tpie/pipelining/parallel/aligned_array.h>
 #include <tpie/pipelining/parallel/base.h>
 #include <tpie/pipelining/parallel/factory.h>
 #include <tpie/pipelining/parallel/pipes.h>
+#include <tpie/pipelining/parallel/input.h>
 
 #endif // __TPIE_PIPELINING_PARALLEL_H__
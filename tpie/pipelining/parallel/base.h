@@ -26,7 +26,7 @@
 #include <memory>
 #include <tpie/pipelining/maintain_order_type.h>
 #include <tpie/pipelining/parallel/options.h>
-#include <tpie/pipelining/parallel/worker_state.h>
+#include <tpie/pipelining/parallel/ring.h>
 #include <tpie/pipelining/parallel/aligned_array.h>
 
 namespace tpie {
@@ -205,41 +205,54 @@ public:
 /// This class is instantiated once and kept in a std::shared_ptr, and it is
 /// not copy constructible.
 ///
-/// Unless noted otherwise, a thread must own the state mutex to access other
-/// parts of this instance.
+/// Items are passed between the threads in batch_rings: each worker has an
+/// input ring written by the producer and an output ring read by the
+/// producer, so no lock is shared between the workers. A thread only parks
+/// on its event_count when its rings give it nothing to do.
 ///////////////////////////////////////////////////////////////////////////////
 class state_base {
 public:
-	typedef std::mutex mutex_t;
-	typedef std::condition_variable cond_t;
-	typedef std::unique_lock<std::mutex> lock_t;
+	/** Number of input buffers each worker may have queued or in progress. */
+	static const memory_size_type inputSlots = 2;
 
-	const options opts;
+	/** Number of output buffers each worker may fill before the producer has
+	 * consumed them. */
+	static const memory_size_type outputSlots = 2;
 
-	/** Single mutex. */
-	mutex_t mutex;
+	const options opts;
 
-	/** Condition variable.
+	/** Event the producer waits on.
 	 *
-	 * Who waits: The producer, with the single mutex (waits until at least one
-	 * worker has state = IDLE or state = OUTPUTTING).
+	 * Who waits: The producer, for output from the workers and for workers
+	 * to start and stop.
 	 *
-	 * Who signals: The par_after, when a worker is OUTPUTTING. */
-	cond_t producerCond;
+	 * Who notifies: after, when it publishes an output buffer, and before,
+	 * when the worker thread starts and stops. */
+	event_count producerEvent;
 
-	/** Condition variable, one per worker.
+	/** Event, one per worker.
 	 *
-	 * Who waits: The worker's par_before when waiting for input (wait for
-	 * state = PROCESSING), the worker's par_after when waiting for output to
-	 * be read (wait for state = IDLE). Waits with the single mutex.
+	 * Who waits: The worker's before when waiting for input, and the
+	 * worker's after when waiting for a free output buffer.
 	 *
-	 * Who signals: par_producer, when input has been written (sets state to PROCESSING).
-	 * par_consumer, when output has been read (sets state to IDLE).
-	 */
-	cond_t * workerCond;
+	 * Who notifies: The producer, when it publishes input, consumes output
+	 * or stops the workers. */
+	array<event_count> workerEvents;
+
+	/** Number of output buffers the workers have published and the producer
+	 * has not yet consumed, so the producer need not scan every worker's
+	 * output ring to see if there is output. */
+	std::atomic<memory_size_type> outputsReady;
+
+	/** Number of worker threads that have started and not yet stopped. */
+	std::atomic<size_t> runningWorkers;
 
-	/** Shared state, must have mutex to write. */
-	size_t runningWorkers;
+	/** Set by the producer when all input has been processed. */
+	std::atomic<bool> stopping;
+
+	/** Set by the producer when all workers have stopped. From then on,
+	 * after sends items directly to the consumer in the main thread. */
+	bool finished;
 
 	/// Must not be used concurrently.
 	void set_input_ptr(size_t idx, node * v) {
@@ -255,8 +268,6 @@ public:
 	/// \brief  Get the specified before instance.
 	///
 	/// Enables easy construction of the pipeline graph at runtime.
-	///
-	/// Shared state, must have mutex to use.
 	///////////////////////////////////////////////////////////////////////////
 	node & input(size_t idx) { return *m_inputs[idx]; }
 
@@ -267,96 +278,26 @@ public:
 	/// First, it enables easy construction of the pipeline graph at runtime.
 	/// Second, it is used by before to send batch signals to
 	/// after.
-	///
-	/// Shared state, must have mutex to use.
 	///////////////////////////////////////////////////////////////////////////
 	after_base & output(size_t idx) { return *m_outputs[idx]; }
 
-	/// Shared state, must have mutex to use.
-	worker_state get_state(size_t idx) {
-		return m_states[idx];
-	}
-
-	/// Shared state, must have mutex to use.
-	void transition_state(size_t idx, worker_state from, worker_state to) {
-		if (m_states[idx] != from) {
-			std::stringstream ss;
-			ss << idx << " Invalid state transition " << from << " -> " << to << "; current state is " << m_states[idx];
-			log_error() << ss.str() << std::endl;
-			throw exception(ss.str());
-		}
-		m_states[idx] = to;
-	}
-
 protected:
 	std::vector<node *> m_inputs;
 	std::vector<after_base *> m_outputs;
-	std::vector<worker_state> m_states;
 
 	state_base(const options opts)
 		: opts(opts)
+		, workerEvents(opts.numJobs)
+		, outputsReady(0)
 		, runningWorkers(0)
+		, stopping(false)
+		, finished(false)
 		, m_inputs(opts.numJobs, 0)
 		, m_outputs(opts.numJobs, 0)
-		, m_states(opts.numJobs, INITIALIZING)
 	{
-		workerCond = new cond_t[opts.numJobs];
 	}
 
 	virtual ~state_base() {
-		delete[] workerCond;
-	}
-};
-
-///////////////////////////////////////////////////////////////////////////////
-/// \brief Instantiated in each thread.
-///////////////////////////////////////////////////////////////////////////////
-template <typename T>
-class parallel_input_buffer {
-	memory_size_type m_inputSize;
-	array<T> m_inputBuffer;
-
-public:
-	array_view<T> get_input() {
-		return array_view<T>(&m_inputBuffer[0], m_inputSize);
-	}
-
-	void set_input(array_view<T> input) {
-		if (input.size() > m_inputBuffer.size())
-			throw tpie::exception(m_inputBuffer.size() ? "Input too large" : "Input buffer not initialized");
-
-		memory_size_type items =
-			std::copy(input.begin(), input.end(), m_inputBuffer.begin())
-			-m_inputBuffer.begin();
-
-		m_inputSize = items;
-	}
-
-	parallel_input_buffer(const options & opts)
-		: m_inputSize(0)
-		, m_inputBuffer(opts.bufSize)
-	{
-	}
-};
-
-///////////////////////////////////////////////////////////////////////////////
-/// \brief Instantiated in each thread.
-///////////////////////////////////////////////////////////////////////////////
-template <typename T>
-class parallel_output_buffer {
-	memory_size_type m_outputSize;
-	array<T> m_outputBuffer;
-	friend class after<T>;
-
-public:
-	array_view<T> get_output() {
-		return array_view<T>(&m_outputBuffer[0], m_outputSize);
-	}
-
-	parallel_output_buffer(const options & opts)
-		: m_outputSize(0)
-		, m_outputBuffer(opts.bufSize)
-	{
 	}
 };
 
@@ -378,18 +319,15 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief State subclass containing the item type specific state, i.e. the
-/// input/output buffers and the concrete pipes.
+/// input/output rings and the concrete pipes.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T1, typename T2>
 class state : public state_base {
 public:
 	typedef std::shared_ptr<state> ptr;
-	typedef state_base::mutex_t mutex_t;
-	typedef state_base::cond_t cond_t;
-	typedef state_base::lock_t lock_t;
 
-	array<parallel_input_buffer<T1> *> m_inputBuffers;
-	array<parallel_output_buffer<T2> *> m_outputBuffers;
+	array<batch_ring<T1> *> m_inputRings;
+	array<batch_ring<T2> *> m_outputRings;
 
 	consumer<T2> * m_cons;
 
@@ -398,8 +336,8 @@ public:
 	template <typename fact_t>
 	state(const options opts, fact_t && fact)
 		: state_base(opts)
-		, m_inputBuffers(opts.numJobs)
-		, m_outputBuffers(opts.numJobs)
+		, m_inputRings(opts.numJobs)
+		, m_outputRings(opts.numJobs)
 		, m_cons(0)
 	{
 		typedef threads_impl<T1, T2, fact_t> pipes_impl_t;
@@ -421,12 +359,16 @@ public:
 template <typename T>
 class after : public after_base {
 protected:
+	typedef batch_ring<T> ring_t;
+	typedef typename ring_t::batch batch_t;
+
 	state_base & st;
 	size_t parId;
-	std::unique_ptr<parallel_output_buffer<T> > m_buffer;
-	array<parallel_output_buffer<T> *> & m_outputBuffers;
-	typedef state_base::lock_t lock_t;
+	std::unique_ptr<ring_t> m_ring;
+	array<ring_t *> & m_outputRings;
 	consumer<T> * const * m_cons;
+	/** Output buffer being filled, or 0 if none. */
+	batch_t * m_batch;
 
 public:
 	typedef T item_type;
@@ -436,8 +378,9 @@ public:
 				   size_t parId)
 		: st(state)
 		, parId(parId)
-		, m_outputBuffers(state.m_outputBuffers)
+		, m_outputRings(state.m_outputRings)
 		, m_cons(state.get_consumer_ptr_ptr())
+		, m_batch(0)
 	{
 		state.set_output_ptr(parId, this);
 		set_name("Parallel after", PRIORITY_INSIGNIFICANT);
@@ -454,8 +397,10 @@ public:
 		: after_base(std::move(other))
 		, st(other.st)
 		, parId(std::move(other.parId))
-		, m_outputBuffers(other.m_outputBuffers)
-		, m_cons(std::move(other.m_cons)) {
+		, m_outputRings(other.m_outputRings)
+		, m_cons(std::move(other.m_cons))
+		, m_batch(0)
+	{
 		st.set_output_ptr(parId, this);
 		if (m_cons == 0) throw tpie::exception("Unexpected nullptr in move");
 		if (*m_cons != 0) throw tpie::exception("Expected nullptr in move");
@@ -465,10 +410,12 @@ public:
 	/// \brief Push to thread-local buffer; flush it when full.
 	///////////////////////////////////////////////////////////////////////////
 	void push(const T & item) {
-		if (m_buffer->m_outputSize >= m_buffer->m_outputBuffer.size())
+		if (m_batch != 0 && m_batch->size == m_batch->items.size())
 			flush_buffer_impl(false);
+		if (m_batch == 0)
+			acquire_batch();
 
-		m_buffer->m_outputBuffer[m_buffer->m_outputSize++] = item;
+		m_batch->items[m_batch->size++] = item;
 	}
 
 	virtual void end() override {
@@ -479,12 +426,13 @@ public:
 	/// \brief  Invoked by before::worker (in worker thread context).
 	///////////////////////////////////////////////////////////////////////////
 	virtual void worker_initialize() override {
-		m_buffer.reset(new parallel_output_buffer<T>(st.opts));
-		m_outputBuffers[parId] = m_buffer.get();
+		m_ring.reset(new ring_t(state_base::outputSlots, st.opts.bufSize));
+		m_outputRings[parId] = m_ring.get();
+		m_batch = 0;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Invoked by before::push_all when all input items have been
+	/// \brief  Invoked by before::worker when all input items have been
 	/// pushed.
 	///////////////////////////////////////////////////////////////////////////
 	virtual void flush_buffer() override {
@@ -492,63 +440,50 @@ public:
 	}
 
 private:
-	bool is_done() const {
-		switch (st.get_state(parId)) {
-			case INITIALIZING:
-				throw tpie::exception("INITIALIZING not expected in after::is_done");
-			case IDLE:
-				return true;
-			case PROCESSING:
-				// The main thread may transition us from Outputting to Idle to
-				// Processing without us noticing, or it may transition us from
-				// Partial_Output to Processing. In either case, we are done
-				// flushing the buffer.
-				return true;
-			case PARTIAL_OUTPUT:
-			case OUTPUTTING:
-				return false;
-			case DONE:
-				return true;
-		}
-		throw tpie::exception("Unknown state");
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get a free output buffer, waiting for the producer to consume
+	/// one if the ring is full.
+	///////////////////////////////////////////////////////////////////////////
+	void acquire_batch() {
+		ring_t & ring = *m_ring;
+		if (!st.finished)
+			st.workerEvents[parId].wait([&ring]() { return ring.write_slot() != 0; });
+		m_batch = ring.write_slot();
+		m_batch->size = 0;
+		m_batch->last = false;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Send a signal to the main thread that the output buffer must
-	/// be emptied.
+	/// \brief  Hand the output buffer over to the producer.
 	///
 	/// If this is in response to a full output buffer before the input buffer
-	/// has been processed, `complete == false`. In this case, we transition
-	/// to PARTIAL_OUTPUT and the main thread will transition us to PROCESSING
-	/// after consuming our output buffer.
+	/// has been processed, `complete == false`.
 	///
 	/// If this is in response to an empty input buffer, `complete == true`,
-	/// and we transition to OUTPUTTING and the main thread will transition us
-	/// to IDLE.
+	/// and the buffer is marked as the last output of the input buffer. This
+	/// is how the producer learns that the worker is done with its input, so
+	/// the buffer is sent even if it is empty.
+	///
+	/// When the producer has finished, we are called from the main thread
+	/// during end(), and send the items directly to the consumer.
 	///
 	/// \param  complete  Whether the entire input has been processed.
 	///////////////////////////////////////////////////////////////////////////
 	void flush_buffer_impl(bool complete) {
-		// At this point, we could check if the output buffer is empty and
-		// short-circuit when it is without acquiring the lock; however, we
-		// must do a full PROCESSING -> OUTPUTTING -> IDLE transition in this
-		// case to let the main thread know that we are done processing the
-		// input.
-
-		lock_t lock(st.mutex);
-		if (st.get_state(parId) == DONE) {
+		if (st.finished) {
+			if (m_batch == 0) return;
 			if (*m_cons == 0) throw tpie::exception("Unexpected nullptr in flush_buffer");
-			array_view<T> out = m_buffer->get_output();
-			(*m_cons)->consume(out);
-		} else {
-			st.transition_state(parId, PROCESSING, complete ? OUTPUTTING : PARTIAL_OUTPUT);
-			// notify producer that output is ready
-			st.producerCond.notify_one();
-			while (!is_done()) {
-				st.workerCond[parId].wait(lock);
-			}
+			(*m_cons)->consume(m_batch->get());
+			m_batch->size = 0;
+			return;
 		}
-		m_buffer->m_outputSize = 0;
+		if (m_batch == 0) acquire_batch();
+		m_batch->last = complete;
+		m_ring->publish();
+		++st.outputsReady;
+		m_batch = 0;
+		// notify producer that output is ready
+		st.producerEvent.notify();
 	}
 };
 
@@ -560,10 +495,13 @@ private:
 template <typename T>
 class before : public node {
 protected:
+	typedef batch_ring<T> ring_t;
+	typedef typename ring_t::batch batch_t;
+
 	state_base & st;
 	size_t parId;
-	std::unique_ptr<parallel_input_buffer<T> > m_buffer;
-	array<parallel_input_buffer<T> *> & m_inputBuffers;
+	std::unique_ptr<ring_t> m_ring;
+	array<ring_t *> & m_inputRings;
 	std::thread m_worker;
 
 	///////////////////////////////////////////////////////////////////////////
@@ -575,7 +513,7 @@ protected:
 	before(state<T, Output> & st, size_t parId)
 		: st(st)
 		, parId(parId)
-		, m_inputBuffers(st.m_inputBuffers)
+		, m_inputRings(st.m_inputRings)
 	{
 		set_name("Parallel before", PRIORITY_INSIGNIFICANT);
 		set_plot_options(PLOT_PARALLEL | PLOT_SIMPLIFIED_HIDE);
@@ -585,12 +523,13 @@ protected:
 	before(const before & other)
 		: st(other.st)
 		, parId(other.parId)
-		, m_inputBuffers(other.m_inputBuffers)
+		, m_inputRings(other.m_inputRings)
 	{
 	}
 
 	~before() {
-		m_worker.join();
+		// The worker is not started if the pipeline fails before begin().
+		if (m_worker.joinable()) m_worker.join();
 	}
 
 public:
@@ -603,46 +542,22 @@ public:
 	}
 
 private:
-	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if we are ready to process a batch of input.
-	///////////////////////////////////////////////////////////////////////////
-	bool ready() {
-		switch (st.get_state(parId)) {
-			case INITIALIZING:
-				throw tpie::exception("INITIALIZING not expected in before::ready");
-			case IDLE:
-				return false;
-			case PROCESSING:
-				return true;
-			case PARTIAL_OUTPUT:
-				throw tpie::exception("State 'partial_output' was not expected in before::ready");
-			case OUTPUTTING:
-				throw tpie::exception("State 'outputting' was not expected in before::ready");
-			case DONE:
-				return false;
-		}
-		throw tpie::exception("Unknown state");
-	}
-
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Class providing RAII-style bookkeeping of number of workers.
 	///////////////////////////////////////////////////////////////////////////
 	class running_signal {
-		typedef state_base::cond_t cond_t;
-		memory_size_type & sig;
-		cond_t & producerCond;
+		state_base & st;
 	public:
-		running_signal(memory_size_type & sig, cond_t & producerCond)
-			: sig(sig)
-			, producerCond(producerCond)
+		running_signal(state_base & st)
+			: st(st)
 		{
-			++sig;
-			producerCond.notify_one();
+			++st.runningWorkers;
+			st.producerEvent.notify();
 		}
 
 		~running_signal() {
-			--sig;
-			producerCond.notify_one();
+			--st.runningWorkers;
+			st.producerEvent.notify();
 		}
 	};
 
@@ -654,30 +569,30 @@ private:
 	/// \brief  Worker thread entry point.
 	///////////////////////////////////////////////////////////////////////////
 	void worker() {
-		state_base::lock_t lock(st.mutex);
-
-		m_buffer.reset(new parallel_input_buffer<T>(st.opts));
-		m_inputBuffers[parId] = m_buffer.get();
+		m_ring.reset(new ring_t(state_base::inputSlots, st.opts.inputBufSize));
+		m_inputRings[parId] = m_ring.get();
 
 		// virtual invocation
 		st.output(parId).worker_initialize();
 
-		st.transition_state(parId, INITIALIZING, IDLE);
-		running_signal _(st.runningWorkers, st.producerCond);
+		running_signal _(st);
+		ring_t & ring = *m_ring;
+		event_count & event = st.workerEvents[parId];
+		state_base & s = st;
 		while (true) {
-			// wait for transition IDLE -> PROCESSING
-			while (!ready()) {
-				if (st.get_state(parId) == DONE) {
-					return;
-				}
-				st.workerCond[parId].wait(lock);
-			}
-			lock.unlock();
+			event.wait([&ring, &s]() { return ring.read_slot() != 0 || s.stopping; });
+			batch_t * input = ring.read_slot();
+			if (input == 0) return;
 
 			// virtual invocation
-			push_all(m_buffer->get_input());
+			push_all(input->get());
+
+			// Give the input buffer back before the last output buffer is
+			// sent, so the producer may reuse it as soon as it sees the output.
+			ring.release();
 
-			lock.lock();
+			// virtual invocation
+			st.output(parId).flush_buffer();
 		}
 	}
 };
@@ -704,18 +619,11 @@ public:
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Push all items from buffer and flush output buffer afterwards.
-	///
-	/// If pipeline is one-to-one, that is, one item output for each item
-	/// input, then the flush at the end is not needed.
+	/// \brief Push all items from buffer. The worker flushes the output
+	/// buffer afterwards.
 	///////////////////////////////////////////////////////////////////////////
-	virtual void push_all(array_view<item_type> items) {
-		for (size_t i = 0; i < items.size(); ++i) {
-			dest.push(items[i]);
-		}
-
-		// virtual invocation
-		this->st.output(this->parId).flush_buffer();
+	virtual void push_all(array_view<item_type> items) override {
+		push_batch_to(dest, array_view<const item_type>(items));
 	}
 };
 
@@ -747,9 +655,7 @@ public:
 	/// \brief Push all items from output buffer to the rest of the pipeline.
 	///////////////////////////////////////////////////////////////////////////
 	virtual void consume(array_view<item_type> a) override {
-		for (size_t i = 0; i < a.size(); ++i) {
-			dest.push(a[i]);
-		}
+		push_batch_to(dest, array_view<const item_type>(a));
 	}
 };
 
@@ -769,97 +675,103 @@ private:
 	stateptr st;
 	array<T1> inputBuffer;
 	size_t written;
-	size_t readyIdx;
 	std::shared_ptr<consumer<T2> > cons;
 	internal_queue<memory_size_type> m_outputOrder;
 	stream_size_type m_steps;
+	/** Number of input buffers sent to each worker whose last output buffer
+	 * has not been consumed. */
+	array<memory_size_type> m_pending;
+	memory_size_type m_totalPending;
+	/** Worker to try first when sending the next input buffer. */
+	size_t m_nextWorker;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread.
+	/// \brief  Find a worker with room for another input buffer.
 	///
-	/// A worker may wait for output to be fetched, or it may wait for input to
-	/// be sent. If there is a worker waiting, this function returns true and
-	/// sets the index of the waiting worker in this->readyIdx.
-	///////////////////////////////////////////////////////////////////////////
-	bool has_ready_pipe() {
-		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case PROCESSING:
-					break;
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					// If we have to maintain order of items, the only
-					// outputting worker we consider to be waiting is the
-					// "front worker".
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
-						break;
-					// fallthrough
-				case IDLE:
-					readyIdx = i;
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_ready_pipe().");
+	/// Since a worker gives its input buffer back before it sends the last
+	/// output buffer, a worker has room in its input ring when fewer than
+	/// inputSlots of its input buffers are pending. The workers are tried
+	/// round-robin, so the search usually stops at the first one.
+	///////////////////////////////////////////////////////////////////////////
+	bool find_free_worker(size_t & idx) {
+		const size_t n = st->opts.numJobs;
+		for (size_t k = 0; k < n; ++k) {
+			size_t i = (m_nextWorker + k) % n;
+			if (m_pending[i] < state_base::inputSlots) {
+				idx = i;
+				m_nextWorker = (i + 1) % n;
+				return true;
 			}
 		}
 		return false;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread to process its
-	/// output.
-	///
-	/// This is used in end() instead of has_ready_pipe, since we do not care
-	/// about workers waiting for input when we don't have any input to send.
+	/// \brief  Check if there is an output buffer we may consume.
 	///
-	/// Like has_ready_pipe, this function sets this->readyIdx if and only if
-	/// it returns true.
+	/// If we have to maintain order of items, only the output of the worker
+	/// that got the oldest pending input buffer is considered.
 	///////////////////////////////////////////////////////////////////////////
-	bool has_outputting_pipe() {
-		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case IDLE:
-				case PROCESSING:
-					break;
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
-						break;
-					readyIdx = i;
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_outputting_pipe().");
+	bool has_output() {
+		if (st->opts.maintainOrder)
+			return !m_outputOrder.empty()
+				&& st->m_outputRings[m_outputOrder.front()]->read_slot() != 0;
+		return st->outputsReady.load() != 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Consume one output buffer of the given worker.
+	/// \returns  false if the worker has not sent an output buffer.
+	///////////////////////////////////////////////////////////////////////////
+	bool consume_batch(size_t idx) {
+		batch_ring<T2> & ring = *st->m_outputRings[idx];
+		typename batch_ring<T2>::batch * output = ring.read_slot();
+		if (output == 0) return false;
+		const bool last = output->last;
+
+		// Receive buffer (virtual invocation)
+		cons->consume(output->get());
+		ring.release();
+		--st->outputsReady;
+		st->workerEvents[idx].notify();
+
+		if (last) {
+			--m_pending[idx];
+			--m_totalPending;
+			if (st->opts.maintainOrder) {
+				if (m_outputOrder.front() != idx) {
+					log_error() << "Producer: Expected " << idx << " in front; got "
+						<< m_outputOrder.front() << std::endl;
+					throw tpie::exception("Producer got output from the wrong worker");
+				}
+				m_outputOrder.pop();
 			}
 		}
-		return false;
+		return true;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread to process its
-	/// output.
-	///
-	/// This is used in end() when we are waiting for workers to finish up.
-	/// When no worker is outputting and no worker is processing, all items
-	/// have been processed.
-	///
-	/// Does not modify this->readyIdx.
+	/// \brief  Consume all the output buffers that the workers have sent.
 	///////////////////////////////////////////////////////////////////////////
-	bool has_processing_pipe() {
-		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case IDLE:
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					break;
-				case PROCESSING:
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_processing_pipe().");
-			}
+	void consume_output() {
+		if (st->opts.maintainOrder) {
+			while (!m_outputOrder.empty() && consume_batch(m_outputOrder.front())) {}
+			return;
+		}
+		for (size_t i = 0; i < st->opts.numJobs && st->outputsReady.load() != 0; ++i) {
+			while (m_pending[i] > 0 && consume_batch(i)) {}
 		}
-		return false;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wait until a worker sends output and consume it.
+	///////////////////////////////////////////////////////////////////////////
+	void wait_for_output() {
+		{
+			bits::profile_blocked blocked(this->get_profile());
+			st->producerEvent.wait([this]() { return has_output(); });
+		}
+		consume_output();
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -891,6 +803,8 @@ public:
 		, written(0)
 		, cons(new consumer_t(std::move(cons)))
 		, m_steps(0)
+		, m_totalPending(0)
+		, m_nextWorker(0)
 	{
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
 			this->add_push_destination(st->input(i));
@@ -899,23 +813,25 @@ public:
 		this->set_plot_options(PLOT_PARALLEL | PLOT_SIMPLIFIED_HIDE);
 
 		memory_size_type usage =
-			st->opts.numJobs * st->opts.bufSize * (sizeof(T1) + sizeof(T2)) // workers
-			+ st->opts.bufSize * sizeof(item_type) // our buffer
+			st->opts.numJobs
+			* (state_base::inputSlots * st->opts.inputBufSize * sizeof(T1)
+			   + state_base::outputSlots * st->opts.bufSize * sizeof(T2)) // workers
+			+ st->opts.inputBufSize * sizeof(item_type) // our buffer
 			;
 		this->set_minimum_memory(usage);
 
 		if (st->opts.maintainOrder) {
-			m_outputOrder.resize(st->opts.numJobs);
+			m_outputOrder.resize(st->opts.numJobs * state_base::inputSlots);
 		}
 	}
 
 	virtual void begin() override {
-		inputBuffer.resize(st->opts.bufSize);
+		inputBuffer.resize(st->opts.inputBufSize);
+		m_pending.resize(st->opts.numJobs, 0);
 
-		state_base::lock_t lock(st->mutex);
-		while (st->runningWorkers != st->opts.numJobs) {
-			st->producerCond.wait(lock);
-		}
+		state_t & s = *st;
+		bits::profile_blocked blocked(this->get_profile());
+		st->producerEvent.wait([&s]() { return s.runningWorkers == s.opts.numJobs; });
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -924,126 +840,84 @@ public:
 	/// Since the parallel producer and parallel consumer run single-threaded
 	/// in the main thread, producer::push is our only opportunity to have the
 	/// consumer call push on its destination. Thus, when we accumulate an
-	/// input buffer, before sending it off to a worker, we might want to have
-	/// the consumer consume an output buffer to free up a parallel worker.
+	/// input buffer, before sending it off to a worker, we consume the output
+	/// buffers the workers have sent in the meantime.
 	///////////////////////////////////////////////////////////////////////////
 	void push(item_type item) {
+		bits::profile_scope profile(this->get_profile(), 1, sizeof(item_type));
 		inputBuffer[written++] = item;
-		if (written < st->opts.bufSize) {
+		if (written < st->opts.inputBufSize) {
 			// Wait for more items before doing anything expensive such as
-			// locking.
+			// touching the rings.
 			return;
 		}
-		state_base::lock_t lock(st->mutex);
 
 		flush_steps();
 
-		empty_input_buffer(lock);
+		empty_input_buffer();
 	}
 
-private:
-	void empty_input_buffer(state_base::lock_t & lock) {
-		while (written > 0) {
-			while (!has_ready_pipe()) {
-				st->producerCond.wait(lock);
-			}
-			switch (st->get_state(readyIdx)) {
-				case INITIALIZING:
-					throw tpie::exception("State 'INITIALIZING' not expected at this point");
-				case IDLE:
-				{
-					// Send buffer to ready worker
-					item_type * first = &inputBuffer[0];
-					item_type * last = first + written;
-					parallel_input_buffer<T1> & dest = *st->m_inputBuffers[readyIdx];
-					dest.set_input(array_view<T1>(first, last));
-					st->transition_state(readyIdx, IDLE, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
-					written = 0;
-					if (st->opts.maintainOrder)
-						m_outputOrder.push(readyIdx);
-					break;
-				}
-				case PROCESSING:
-					throw tpie::exception("State 'processing' not expected at this point");
-				case PARTIAL_OUTPUT:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-					st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
-					break;
-				case OUTPUTTING:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-
-					st->transition_state(readyIdx, OUTPUTTING, IDLE);
-					st->workerCond[readyIdx].notify_one();
-					if (st->opts.maintainOrder) {
-						if (m_outputOrder.front() != readyIdx) {
-							log_error() << "Producer: Expected " << readyIdx << " in front; got "
-								<< m_outputOrder.front() << std::endl;
-							throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-						}
-						m_outputOrder.pop();
-					}
-					break;
-				case DONE:
-					throw tpie::exception("State 'DONE' not expected at this point");
-			}
+	void push_batch(array_view<const item_type> items) {
+		bits::profile_scope profile(this->get_profile(), items.size(), items.size() * sizeof(item_type));
+		for (const item_type & item: items) {
+			inputBuffer[written++] = item;
+			if (written < st->opts.inputBufSize) continue;
+			flush_steps();
+			empty_input_buffer();
 		}
 	}
 
+private:
+	void empty_input_buffer() {
+		consume_output();
+		if (written == 0) return;
+
+		size_t idx;
+		while (!find_free_worker(idx)) wait_for_output();
+
+		// Send buffer to the worker
+		batch_ring<T1> & ring = *st->m_inputRings[idx];
+		typename batch_ring<T1>::batch * input = ring.write_slot();
+		if (input == 0) throw tpie::exception("Input ring of a free worker is full");
+		std::copy(inputBuffer.begin(), inputBuffer.begin() + written, input->items.begin());
+		input->size = written;
+		ring.publish();
+		st->workerEvents[idx].notify();
+		written = 0;
+
+		++m_pending[idx];
+		++m_totalPending;
+		if (st->opts.maintainOrder)
+			m_outputOrder.push(idx);
+	}
+
 public:
 	virtual void end() override {
-		state_base::lock_t lock(st->mutex);
-
 		flush_steps();
 
-		empty_input_buffer(lock);
+		empty_input_buffer();
 
 		inputBuffer.resize(0);
 
 		st->set_consumer_ptr(cons.get());
 
-		bool done = false;
-		while (!done) {
-			while (!has_outputting_pipe()) {
-				if (!has_processing_pipe()) {
-					done = true;
-					break;
-				}
-				// All items pushed; wait for processors to complete
-				st->producerCond.wait(lock);
-			}
-			if (done) break;
-
-			// virtual invocation
-			cons->consume(st->m_outputBuffers[readyIdx]->get_output());
+		// All items pushed; wait for processors to complete
+		consume_output();
+		while (m_totalPending > 0) wait_for_output();
 
-			if (st->get_state(readyIdx) == PARTIAL_OUTPUT) {
-				st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-				st->workerCond[readyIdx].notify_one();
-				continue;
-			}
-			st->transition_state(readyIdx, OUTPUTTING, IDLE);
-			if (st->opts.maintainOrder) {
-				if (m_outputOrder.front() != readyIdx) {
-					log_error() << "Producer: Expected " << readyIdx << " in front; got "
-						<< m_outputOrder.front() << std::endl;
-					throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-				}
-				m_outputOrder.pop();
-			}
-		}
 		// Notify all workers that all processing is done
+		st->stopping = true;
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			st->transition_state(i, IDLE, DONE);
-			st->workerCond[i].notify_one();
+			st->workerEvents[i].notify();
 		}
-		while (st->runningWorkers > 0) {
-			st->producerCond.wait(lock);
+		state_t & s = *st;
+		{
+			bits::profile_blocked blocked(this->get_profile());
+			st->producerEvent.wait([&s]() { return s.runningWorkers == 0; });
 		}
 		// All workers terminated
+		st->finished = true;
+		m_pending.resize(0);
 
 		flush_steps();
 	}
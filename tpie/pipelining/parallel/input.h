@@ -0,0 +1,294 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_PARALLEL_INPUT_H__
+#define __TPIE_PIPELINING_PARALLEL_INPUT_H__
+
+#include <tpie/array.h>
+#include <tpie/file_stream.h>
+#include <tpie/job.h>
+#include <tpie/maybe.h>
+#include <tpie/pipelining/node.h>
+#include <tpie/pipelining/pipe_base.h>
+#include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/pair_factory.h>
+#include <tpie/pipelining/parallel/factory.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace parallel_bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  A range of items of a file, read by a single worker.
+///////////////////////////////////////////////////////////////////////////////
+struct file_chunk {
+	/** Position of the first item, or stream_position() to seek to begin. */
+	stream_position position;
+	/** Offset of the first item. */
+	stream_size_type begin;
+	/** Offset past the last item. */
+	stream_size_type end;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Splits a file into chunks and sends them to the workers.
+///
+/// Runs in the main thread. Only the chunk descriptions pass through the
+/// producer; the items are read by the workers.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, typename T>
+class chunk_source_t : public node {
+public:
+	typedef file_chunk item_type;
+
+	chunk_source_t(dest_t dest, std::string path,
+				   std::vector<stream_position> boundaries,
+				   memory_size_type chunkItems)
+		: dest(std::move(dest))
+		, path(std::move(path))
+		, boundaries(std::move(boundaries))
+		, chunkItems(chunkItems)
+		, items(0)
+	{
+		add_push_destination(this->dest);
+		set_name("Parallel read", PRIORITY_INSIGNIFICANT);
+		set_minimum_memory(file_stream<T>::memory_usage());
+		set_minimum_resource_usage(FILES, 1);
+	}
+
+	virtual void propagate() override {
+		{
+			file_stream<T> fs;
+			fs.open(path, access_read);
+			items = fs.size();
+			// A compressed stream cannot seek to an arbitrary item, and the
+			// worker reading the chunk would fail outside the main thread.
+			if (boundaries.empty() && fs.is_compressed())
+				throw tpie::exception("parallel_input: Reading a compressed stream "
+									  "requires chunk boundaries");
+		}
+		if (chunkItems == 0)
+			chunkItems = std::max(file_stream<T>::block_size(1.0) / sizeof(T),
+								  static_cast<memory_size_type>(1));
+		for (size_t i = 0; i < boundaries.size(); ++i) {
+			const stream_size_type offset = boundaries[i].offset();
+			if ((i == 0 && offset != 0)
+				|| (i > 0 && offset <= boundaries[i-1].offset())
+				|| offset >= items)
+				throw tpie::exception("parallel_input: Chunk boundaries must start at "
+									  "offset 0 and be increasing offsets in the file");
+		}
+		forward("items", chunk_count());
+		forward("parallel_input_items", items);
+		set_steps(items);
+	}
+
+	virtual void go() override {
+		file_chunk c;
+		if (boundaries.empty()) {
+			for (stream_size_type b = 0; b < items; b += chunkItems) {
+				c.begin = b;
+				c.end = std::min(b + chunkItems, items);
+				dest.push(c);
+				step(c.end - c.begin);
+			}
+			return;
+		}
+		for (size_t i = 0; i < boundaries.size(); ++i) {
+			c.position = boundaries[i];
+			c.begin = boundaries[i].offset();
+			c.end = (i + 1 < boundaries.size()) ? boundaries[i+1].offset() : items;
+			dest.push(c);
+			step(c.end - c.begin);
+		}
+	}
+
+private:
+	stream_size_type chunk_count() const {
+		if (!boundaries.empty()) return boundaries.size();
+		return (items + chunkItems - 1) / chunkItems;
+	}
+
+	dest_t dest;
+	std::string path;
+	std::vector<stream_position> boundaries;
+	memory_size_type chunkItems;
+	stream_size_type items;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Reads the items of the chunks it is pushed from its own stream.
+///
+/// Runs in a worker thread, as the first node of the worker pipeline.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, typename T>
+class chunk_reader_t : public node {
+public:
+	typedef file_chunk item_type;
+
+	chunk_reader_t(dest_t dest, std::string path)
+		: dest(std::move(dest))
+		, path(std::move(path))
+	{
+		add_push_destination(this->dest);
+		set_name("Read chunk", PRIORITY_INSIGNIFICANT);
+		set_minimum_memory(file_stream<T>::memory_usage() + bits::batch_size * sizeof(T));
+		set_minimum_resource_usage(FILES, 1);
+	}
+
+	virtual void propagate() override {
+		// Like parallel(), every worker is told the total number of items.
+		forward("items", fetch<stream_size_type>("parallel_input_items"));
+	}
+
+	virtual void begin() override {
+		fs.construct();
+		fs->open(path, access_read);
+		batch.resize(bits::batch_size);
+	}
+
+	void push(const file_chunk & c) {
+		if (c.position == stream_position())
+			fs->seek(c.begin);
+		else
+			fs->set_position(c.position);
+		stream_size_type i = c.begin;
+		while (i < c.end) {
+			size_t count = 0;
+			for (; count < bits::batch_size && i < c.end; ++count, ++i)
+				batch[count] = fs->read();
+			push_batch_to(dest, array_view<const T>(batch.get(), count));
+		}
+	}
+
+	virtual void end() override {
+		batch.resize(0);
+		fs.destruct();
+	}
+
+private:
+	dest_t dest;
+	std::string path;
+	maybe<file_stream<T> > fs;
+	array<T> batch;
+};
+
+template <typename T, typename fact_t>
+struct parallel_input_types {
+	typedef tfactory<chunk_source_t, Args<T>, std::string,
+					 std::vector<stream_position>, memory_size_type> source_factory;
+	typedef tfactory<chunk_reader_t, Args<T>, std::string> reader_factory;
+	typedef factory<bits::pair_factory<reader_factory, fact_t> > parallel_factory;
+	typedef pipe_begin<bits::pair_factory<source_factory, parallel_factory> > type;
+};
+
+template <typename T, typename fact_t>
+typename parallel_input_types<T, fact_t>::type
+parallel_input_impl(const std::string & path,
+					std::vector<stream_position> && boundaries,
+					memory_size_type chunkItems,
+					pipe_middle<fact_t> && fact,
+					maintain_order_type maintainOrder,
+					size_t numJobs,
+					size_t bufSize) {
+	typedef parallel_input_types<T, fact_t> types;
+	options opts;
+	opts.maintainOrder = maintainOrder == maintain_order;
+	opts.numJobs = numJobs;
+	opts.bufSize = bufSize;
+	// Each chunk is sent to a worker on its own.
+	opts.inputBufSize = 1;
+	pipe_middle<typename types::reader_factory> reader(path);
+	pipe_middle<typename types::parallel_factory> workers(
+		typename types::parallel_factory(
+			std::move((std::move(reader) | std::move(fact)).factory), std::move(opts)));
+	return pipe_begin<typename types::source_factory>(path, std::move(boundaries), chunkItems)
+		| std::move(workers);
+}
+
+} // namespace parallel_bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Reads a file in multiple threads and runs a pipeline on the items
+/// in each thread.
+///
+/// The file is split into chunks of consecutive items, and each worker
+/// thread reads the chunks it is given from its own stream, so the items are
+/// not copied by a central producer. As with parallel(), the output of the
+/// workers is pushed to the rest of the pipeline in the main thread, and
+/// maintain_order keeps the output in the order of the chunks.
+///
+/// The file must be an uncompressed stream, since compressed streams cannot
+/// seek to an arbitrary item, and a compressed file makes the pipeline throw
+/// a tpie::exception before it runs. Use the overload taking chunk
+/// boundaries for compressed streams.
+///
+/// \tparam T  The item type of the file.
+/// \param path  The path of the file.
+/// \param fact  The pipeline run on the items in each worker.
+/// \param maintainOrder  Whether to output items in the order of the file.
+/// \param numJobs  The number of threads to utilize for parallel execution.
+/// \param chunkItems  Number of items read at a time by a worker, or 0 to
+/// read a block at a time.
+/// \param bufSize  The number of items in the buffers sent from the workers.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename fact_t>
+typename parallel_bits::parallel_input_types<T, fact_t>::type
+parallel_input(const std::string & path, pipe_middle<fact_t> && fact,
+			   maintain_order_type maintainOrder = arbitrary_order,
+			   size_t numJobs = default_worker_count(),
+			   memory_size_type chunkItems = 0, size_t bufSize = 2048) {
+	return parallel_bits::parallel_input_impl<T>(path, std::vector<stream_position>(),
+		chunkItems, std::move(fact), maintainOrder, numJobs, bufSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Reads a file in multiple threads, split at the given positions,
+/// and runs a pipeline on the items in each thread.
+///
+/// Each chunk starts at one of the positions and ends at the next one or at
+/// the end of the file. Since the positions are used with set_position(),
+/// this works for compressed streams, where the positions may be recorded
+/// with file_stream::get_position() while the file is written.
+///
+/// \param boundaries  Positions of the first item of each chunk, ordered by
+/// offset, the first one being the beginning of the file.
+/// \sa parallel_input
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename fact_t>
+typename parallel_bits::parallel_input_types<T, fact_t>::type
+parallel_input(const std::string & path, std::vector<stream_position> boundaries,
+			   pipe_middle<fact_t> && fact,
+			   maintain_order_type maintainOrder = arbitrary_order,
+			   size_t numJobs = default_worker_count(), size_t bufSize = 2048) {
+	return parallel_bits::parallel_input_impl<T>(path, std::move(boundaries), 0,
+		std::move(fact), maintainOrder, numJobs, bufSize);
+}
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PARALLEL_INPUT_H__
@@ -34,7 +34,10 @@ namespace parallel_bits {
 struct options {
 	bool maintainOrder;
 	size_t numJobs;
+	/** Number of items in the buffers sent from the workers. */
 	size_t bufSize;
+	/** Number of items in the buffers sent to the workers. */
+	size_t inputBufSize;
 };
 
 } // namespace parallel_bits
@@ -51,6 +51,7 @@ parallel(pipe_middle<fact_t> && fact, maintain_order_type maintainOrder, size_t
 	}
 	opts.numJobs = numJobs;
 	opts.bufSize = bufSize;
+	opts.inputBufSize = bufSize;
 	return pipe_middle<parallel_bits::factory<fact_t> >
 		(parallel_bits::factory<fact_t>
 		 (std::move(fact.factory), std::move(opts)));
@@ -0,0 +1,210 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_PARALLEL_RING_H__
+#define __TPIE_PIPELINING_PARALLEL_RING_H__
+
+#include <tpie/array.h>
+#include <tpie/array_view.h>
+#include <tpie/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace parallel_bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Lets a thread sleep until a condition published by another thread
+/// becomes true, without locking in the common case.
+///
+/// The waiting thread spins on the condition for a while before it parks on
+/// a condition variable. A notifying thread only takes the mutex when some
+/// thread is parked, so notify() is a single atomic load when no one waits.
+///
+/// The condition must be made true by a sequentially consistent store before
+/// notify() is called, and be read by sequentially consistent loads.
+///////////////////////////////////////////////////////////////////////////////
+class event_count {
+public:
+	event_count()
+		: m_waiters(0)
+		, m_epoch(0)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Return when pred() is true.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename Pred>
+	void wait(Pred pred) {
+		for (size_t i = 0; i < spin_count; ++i) {
+			if (pred()) return;
+			std::this_thread::yield();
+		}
+		while (true) {
+			// Register as a waiter before checking the condition, so a
+			// notify() after the check sees us.
+			++m_waiters;
+			const size_t epoch = m_epoch.load();
+			if (pred()) {
+				--m_waiters;
+				return;
+			}
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (m_epoch.load() == epoch) m_cond.wait(lock);
+			}
+			--m_waiters;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wake the waiting threads so they check their condition again.
+	///////////////////////////////////////////////////////////////////////////
+	void notify() {
+		if (m_waiters.load() == 0) return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_epoch;
+		}
+		m_cond.notify_all();
+	}
+
+private:
+	static const size_t spin_count = 64;
+
+	std::atomic<size_t> m_waiters;
+	std::atomic<size_t> m_epoch;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Single producer, single consumer ring of item buffers.
+///
+/// The producer fills the buffer returned by write_slot() and hands it over
+/// with publish(); the consumer reads the buffer returned by read_slot() and
+/// gives it back with release(). Each side keeps a copy of the index of the
+/// other side and only reloads it when the ring looks full or empty, so the
+/// two indices are shared between the threads once per buffer, not per item.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class batch_ring {
+public:
+	struct batch {
+		array<T> items;
+		/** Number of items written to the buffer. */
+		memory_size_type size;
+		/** Whether this is the last output buffer of an input buffer. */
+		bool last;
+
+		array_view<T> get() {
+			return array_view<T>(items.get(), size);
+		}
+	};
+
+	batch_ring(memory_size_type slots, memory_size_type bufSize)
+		: m_slots(slots)
+		, m_head(0)
+		, m_cachedTail(0)
+		, m_tail(0)
+		, m_cachedHead(0)
+	{
+		for (memory_size_type i = 0; i < slots; ++i) {
+			m_slots[i].items.resize(bufSize);
+			m_slots[i].size = 0;
+			m_slots[i].last = false;
+		}
+	}
+
+	static memory_size_type memory_usage(memory_size_type slots, memory_size_type bufSize) {
+		return sizeof(batch_ring) + slots * (sizeof(batch) + bufSize * sizeof(T));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Producer: Return the next free buffer, or 0 if the ring is full.
+	///////////////////////////////////////////////////////////////////////////
+	batch * write_slot() {
+		const memory_size_type tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_cachedHead == m_slots.size()) {
+			m_cachedHead = m_head.load();
+			if (tail - m_cachedHead == m_slots.size()) return 0;
+		}
+		return &m_slots[tail % m_slots.size()];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Producer: Hand the buffer returned by write_slot() over to the
+	/// consumer.
+	///////////////////////////////////////////////////////////////////////////
+	void publish() {
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Consumer: Return the oldest published buffer, or 0 if the ring
+	/// is empty.
+	///////////////////////////////////////////////////////////////////////////
+	batch * read_slot() {
+		const memory_size_type head = m_head.load(std::memory_order_relaxed);
+		if (head == m_cachedTail) {
+			m_cachedTail = m_tail.load();
+			if (head == m_cachedTail) return 0;
+		}
+		return &m_slots[head % m_slots.size()];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Consumer: Give the buffer returned by read_slot() back to the
+	/// producer.
+	///////////////////////////////////////////////////////////////////////////
+	void release() {
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1);
+	}
+
+private:
+	static const size_t cache_line = 64;
+
+	array<batch> m_slots;
+
+	// Consumer side
+	char m_padding1[cache_line];
+	std::atomic<memory_size_type> m_head;
+	memory_size_type m_cachedTail;
+
+	// Producer side
+	char m_padding2[cache_line];
+	std::atomic<memory_size_type> m_tail;
+	memory_size_type m_cachedHead;
+	char m_padding3[cache_line];
+};
+
+} // namespace parallel_bits
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PARALLEL_RING_H__
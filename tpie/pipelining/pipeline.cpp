@@ -22,6 +22,8 @@
 #include <tpie/pipelining/node.h>
 #include <unordered_map>
 #include <iostream>
+#include <iomanip>
+#include <map>
 #include <tpie/pipelining/runtime.h>
 
 namespace {
@@ -52,7 +54,64 @@ namespace bits {
 
 typedef std::unordered_map<const node *, size_t> nodes_t;
 
-void pipeline_base_base::plot_impl(std::ostream & out, bool full) {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Label each plotted node with its profile and fill it with a shade
+/// of red according to its share of the largest exclusive time.
+///
+/// The times of nodes hidden in the simplified plot are added to the node
+/// representing them. Hidden nodes usually run in other phases than their
+/// representative, so for items and memory the largest value is shown.
+///////////////////////////////////////////////////////////////////////////////
+void plot_profile(std::ostream & out, node_map::ptr nodeMap,
+				  const std::unordered_map<node_map::id_t, node_map::id_t> & repr,
+				  const pipeline_profile & profile) {
+	std::map<node_map::id_t, node_profile> shown;
+	for (const node_profile & n: profile.nodes) {
+		node_map::id_t id = n.id;
+		while (repr.count(id)) id = repr.at(id);
+		if (nodeMap->get(id) == nullptr) continue;
+		auto i = shown.find(id);
+		if (i == shown.end()) {
+			shown.insert(std::make_pair(id, n));
+			continue;
+		}
+		node_profile & s = i->second;
+		s.items = std::max(s.items, n.items);
+		s.bytes = std::max(s.bytes, n.bytes);
+		s.inclusiveTime += n.inclusiveTime;
+		s.exclusiveTime += n.exclusiveTime;
+		s.blockedTime += n.blockedTime;
+		s.memoryAssigned = std::max(s.memoryAssigned, n.memoryAssigned);
+		s.memoryUsed = std::max(s.memoryUsed, n.memoryUsed);
+	}
+
+	double maxTime = 0;
+	for (const auto & p: shown) maxTime = std::max(maxTime, p.second.exclusiveTime);
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(3);
+	for (const auto & p: shown) {
+		const node_profile & n = p.second;
+		double share = maxTime > 0 ? n.exclusiveTime / maxTime : 0;
+		out << '"' << name(nodeMap, p.first) << "\" [label=\"" << name(nodeMap, p.first)
+			<< "\\n" << n.items << " items, " << n.bytes << " bytes"
+			<< "\\n" << n.exclusiveTime << " s (" << n.inclusiveTime << " s incl.)";
+		if (n.blockedTime > 0)
+			out << "\\n" << n.blockedTime << " s blocked";
+		out << "\\n" << n.memoryUsed << " / " << n.memoryAssigned << " bytes memory"
+			<< "\", style=filled, fillcolor=\"0.000 " << share << " 1.000\"];\n";
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+} // default namespace
+
+void pipeline_base_base::plot_impl(std::ostream & out, bool full,
+									const pipeline_profile * profile) {
 	typedef tpie::pipelining::bits::node_map::id_t id_t;
 
 	node_map::ptr nodeMap = m_nodeMap->find_authority();
@@ -81,6 +140,8 @@ void pipeline_base_base::plot_impl(std::ostream & out, bool full) {
 			out << '"' << name(nodeMap, i->first) << "\";\n";
 	}
 
+	if (profile) plot_profile(out, nodeMap, repr, *profile);
+
 	for (node_map::relmapit i = relations.begin(); i != relations.end(); ++i) {
 		id_t s = i->first;
 		id_t t = i->second.first;
@@ -115,6 +176,8 @@ void pipeline_base::operator()(stream_size_type items, progress_indicator_base &
 							   const char * file, const char * function) {
 	node_map::ptr map = m_nodeMap->find_authority();
 	runtime rt(map);
+	rt.set_concurrent_phases(m_concurrentPhases);
+	rt.set_profile(m_profiling ? &m_profile : nullptr);
 	rt.go(items, pi, initialFiles, initialMemory, file, function);
 
 	/*
@@ -23,6 +23,7 @@
 #include <tpie/types.h>
 #include <iostream>
 #include <tpie/pipelining/tokens.h>
+#include <tpie/pipelining/profile.h>
 #include <tpie/progress_indicator_null.h>
 #include <tpie/file_manager.h>
 
@@ -92,8 +93,8 @@ public:
 protected:
 	node_map::ptr m_nodeMap;	
 
-private:
-	void plot_impl(std::ostream & out, bool full);	
+	void plot_impl(std::ostream & out, bool full,
+				   const pipeline_profile * profile = nullptr);
 };
 	
 
@@ -124,9 +125,41 @@ public:
 		return m_memory;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set whether independent phases may run concurrently.
+	/// \sa pipeline::set_concurrent_phases
+	///////////////////////////////////////////////////////////////////////////
+	void set_concurrent_phases(bool enabled) {
+		m_concurrentPhases = enabled;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set whether running the pipeline records a profile.
+	/// \sa pipeline::set_profiling
+	///////////////////////////////////////////////////////////////////////////
+	void set_profiling(bool enabled) {
+		m_profiling = enabled;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get the profile recorded by the last run.
+	///////////////////////////////////////////////////////////////////////////
+	const pipeline_profile & get_profile() const {
+		return m_profile;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Generate a GraphViz plot of the pipeline annotated with the
+	/// profile recorded by the last run.
+	///////////////////////////////////////////////////////////////////////////
+	void plot_profile(std::ostream & out) {plot_impl(out, false, &m_profile);}
+
 	void order_before(pipeline_base & other);
 protected:
 	double m_memory;
+	bool m_concurrentPhases = false;
+	bool m_profiling = false;
+	pipeline_profile m_profile;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -238,6 +271,45 @@ public:
 		return p->memory();
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Run phases that do not depend on each other concurrently.
+	///
+	/// Off by default. When enabled, phases with no dependency between them,
+	/// such as the merge phases of two sorts fed by a fork, are started at
+	/// the same time on the job pool, and the memory and files given to the
+	/// pipeline are divided between them. The nodes of such phases must not
+	/// share state that is not thread safe.
+	///////////////////////////////////////////////////////////////////////////
+	void set_concurrent_phases(bool enabled) {
+		p->set_concurrent_phases(enabled);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Record a profile of every node when the pipeline is run.
+	///
+	/// Off by default. The profile of the last run holds the items, bytes,
+	/// inclusive and exclusive time, blocked time and memory of each node;
+	/// see pipelining/profile.h for what is measured.
+	///////////////////////////////////////////////////////////////////////////
+	void set_profiling(bool enabled) {
+		p->set_profiling(enabled);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get the profile recorded by the last run.
+	///////////////////////////////////////////////////////////////////////////
+	const pipeline_profile & get_profile() const {
+		return p->get_profile();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Generate a GraphViz plot annotated with the profile recorded
+	/// by the last run.
+	///////////////////////////////////////////////////////////////////////////
+	void plot_profile(std::ostream & os = std::cout) {
+		p->plot_profile(os);
+	}
+
 	bits::node_map::ptr get_node_map() const {
 		return p->get_node_map();
 	}
@@ -0,0 +1,108 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/pipelining/profile.h>
+#include <iostream>
+
+namespace {
+
+// The innermost profile_scope of each thread.
+thread_local tpie::pipelining::bits::profile_scope * current_scope = nullptr;
+
+void write_json_string(std::ostream & out, const std::string & s) {
+	out << '"';
+	for (char c: s) {
+		switch (c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					const char * hex = "0123456789abcdef";
+					out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+				} else {
+					out << c;
+				}
+		}
+	}
+	out << '"';
+}
+
+} // default namespace
+
+namespace tpie {
+
+namespace pipelining {
+
+const node_profile * pipeline_profile::find(stream_size_type id) const {
+	for (const node_profile & n: nodes)
+		if (n.id == id) return &n;
+	return nullptr;
+}
+
+void pipeline_profile::write_json(std::ostream & out) const {
+	out << "{\"phases\": [";
+	for (size_t i = 0; i < phaseTimes.size(); ++i) {
+		if (i) out << ", ";
+		out << phaseTimes[i];
+	}
+	out << "], \"nodes\": [";
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const node_profile & n = nodes[i];
+		if (i) out << ", ";
+		out << "{\"id\": " << n.id << ", \"name\": ";
+		write_json_string(out, n.name);
+		out << ", \"phase\": " << n.phase
+			<< ", \"items\": " << n.items
+			<< ", \"bytes\": " << n.bytes
+			<< ", \"inclusive_time\": " << n.inclusiveTime
+			<< ", \"exclusive_time\": " << n.exclusiveTime
+			<< ", \"blocked_time\": " << n.blockedTime
+			<< ", \"memory_assigned\": " << n.memoryAssigned
+			<< ", \"memory_used\": " << n.memoryUsed
+			<< '}';
+	}
+	out << "]}";
+}
+
+namespace bits {
+
+void profile_scope::enter(stream_size_type items, memory_size_type bytes) {
+	m_profile->items += items;
+	m_profile->bytes += bytes;
+	m_parent = current_scope;
+	m_childTime = 0;
+	current_scope = this;
+	m_start = ptime::now();
+}
+
+void profile_scope::leave() {
+	double time = ptime::seconds(m_start, ptime::now());
+	m_profile->inclusiveTime += time;
+	m_profile->exclusiveTime += time - m_childTime;
+	if (m_parent) m_parent->m_childTime += time;
+	current_scope = m_parent;
+}
+
+} // namespace bits
+
+} // namespace pipelining
+
+} // namespace tpie
@@ -0,0 +1,154 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file pipelining/profile.h  Per-node profiling of pipelines.
+///
+/// When profiling is enabled with pipeline::set_profiling, the runtime gives
+/// every node a node_profile record. The runtime itself times the calls it
+/// makes to the nodes (begin, go and end) and samples their memory usage.
+/// Pushes and pulls are direct calls between nodes that the runtime does not
+/// see, so nodes that move items put a profile_scope at the top of push and
+/// pull, and initiators count the items they push with node::profile_items.
+/// Time spent in nodes without a profile_scope is counted as exclusive time
+/// of the closest profiled caller.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_PIPELINING_PROFILE_H__
+#define __TPIE_PIPELINING_PROFILE_H__
+
+#include <tpie/types.h>
+#include <tpie/stats.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace tpie {
+
+namespace pipelining {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Profiling information recorded for one node.
+///
+/// Times are wall clock seconds measured by the thread running the node.
+///////////////////////////////////////////////////////////////////////////////
+struct node_profile {
+	std::string name;
+	stream_size_type id = 0;
+	/// Index of the phase the node ran in.
+	size_t phase = 0;
+	/// Items pushed to or pulled from the node.
+	stream_size_type items = 0;
+	/// Size of the items pushed to or pulled from the node.
+	stream_size_type bytes = 0;
+	/// Time spent in the node including the nodes it called.
+	double inclusiveTime = 0;
+	/// Time spent in the node excluding the profiled nodes it called.
+	double exclusiveTime = 0;
+	/// Time spent waiting for other threads, e.g. parallel workers.
+	double blockedTime = 0;
+	/// Memory assigned to the node by the runtime.
+	memory_size_type memoryAssigned = 0;
+	/// Largest memory usage seen after begin and before end.
+	memory_size_type memoryUsed = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Profiling information recorded for one run of a pipeline.
+///////////////////////////////////////////////////////////////////////////////
+struct pipeline_profile {
+	std::vector<node_profile> nodes;
+	/// Wall clock seconds spent in each phase, indexed by phase.
+	std::vector<double> phaseTimes;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get the record of the node with the given id, or nullptr.
+	///////////////////////////////////////////////////////////////////////////
+	const node_profile * find(stream_size_type id) const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Write the profile as a JSON object.
+	///////////////////////////////////////////////////////////////////////////
+	void write_json(std::ostream & out) const;
+};
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Count an item and time the enclosing block for a node profile.
+///
+/// Does nothing if the profile is nullptr, that is, when the pipeline is not
+/// being profiled. The time of a scope is subtracted from the exclusive time
+/// of the enclosing scope on the same thread.
+///////////////////////////////////////////////////////////////////////////////
+class profile_scope {
+public:
+	profile_scope(node_profile * profile, stream_size_type items = 0, memory_size_type bytes = 0)
+		: m_profile(profile)
+	{
+		if (m_profile) enter(items, bytes);
+	}
+
+	~profile_scope() {
+		if (m_profile) leave();
+	}
+
+	profile_scope(const profile_scope &) = delete;
+	profile_scope & operator=(const profile_scope &) = delete;
+
+private:
+	void enter(stream_size_type items, memory_size_type bytes);
+	void leave();
+
+	node_profile * m_profile;
+	profile_scope * m_parent;
+	double m_childTime;
+	ptime m_start;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Count the time of the enclosing block as blocked time of a node.
+///////////////////////////////////////////////////////////////////////////////
+class profile_blocked {
+public:
+	profile_blocked(node_profile * profile)
+		: m_profile(profile)
+	{
+		if (m_profile) m_start = ptime::now();
+	}
+
+	~profile_blocked() {
+		if (m_profile) m_profile->blockedTime += ptime::seconds(m_start, ptime::now());
+	}
+
+	profile_blocked(const profile_blocked &) = delete;
+	profile_blocked & operator=(const profile_blocked &) = delete;
+
+private:
+	node_profile * m_profile;
+	ptime m_start;
+};
+
+} // namespace bits
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PROFILE_H__
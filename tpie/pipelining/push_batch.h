@@ -0,0 +1,95 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file pipelining/push_batch.h  Pushing batches of items between nodes.
+///
+/// Besides push(item), a node may implement
+/// \code
+/// void push_batch(array_view<const item_type> items);
+/// \endcode
+/// which must have the same effect as pushing the items one at a time.
+/// map and filter only have it when made with pure_map and pure_filter,
+/// since they run the functor on a whole batch before pushing any of it on.
+/// Nodes that produce many items at once call push_batch_to, which calls
+/// push_batch on the destination if it has one and push for each item
+/// otherwise. This lets a batch pass through several nodes with one call
+/// per node instead of one call per item.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_PIPELINING_PUSH_BATCH_H__
+#define __TPIE_PIPELINING_PUSH_BATCH_H__
+
+#include <tpie/array_view.h>
+#include <type_traits>
+#include <utility>
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Number of items nodes put in the batches they produce.
+///////////////////////////////////////////////////////////////////////////////
+const size_t batch_size = 1024;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Check whether dest_t has push_batch(array_view<const T>).
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, typename T>
+struct has_push_batch {
+	template <typename C>
+	static std::true_type test(decltype(std::declval<C &>().push_batch(std::declval<array_view<const T> >())) *);
+
+	template <typename>
+	static std::false_type test(...);
+
+	static const bool value = decltype(test<dest_t>(nullptr))::value;
+};
+
+template <typename dest_t, typename T>
+void push_batch_to(dest_t & dest, array_view<const T> items, std::true_type) {
+	dest.push_batch(items);
+}
+
+template <typename dest_t, typename T>
+void push_batch_to(dest_t & dest, array_view<const T> items, std::false_type) {
+	for (const T & item: items) dest.push(item);
+}
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Push a batch of items to a node.
+///
+/// Calls dest.push_batch(items) if the node has push_batch, and otherwise
+/// calls dest.push for each item.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, typename T>
+void push_batch_to(dest_t & dest, array_view<const T> items) {
+	bits::push_batch_to(dest, items, std::integral_constant<bool, bits::has_push_batch<dest_t, T>::value>());
+}
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PUSH_BATCH_H__
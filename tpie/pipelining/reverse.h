@@ -57,6 +57,7 @@ public:
 	/// \brief Pushes an item to the node
 	///////////////////////////////////////////////////////////////////////////////
 	void push(const item_type & t) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		m_stack->push(t);
 	}
 
@@ -94,6 +95,7 @@ public:
 	/// \brief Pushes an item to the node
 	///////////////////////////////////////////////////////////////////////////////
 	void push(const item_type & t) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		m_stack->push(t);
 	}
 private:
@@ -128,10 +130,12 @@ public:
 	}
 
 	void go() override {
+		stream_size_type items = m_stack->size();
 		while (!m_stack->empty()) {
 			dest.push(m_stack->pop());
 			step();
 		}
+		profile_items(items, items * sizeof(item_type));
 	}
 
 	void end() override {
@@ -168,10 +172,12 @@ public:
 	}
 
 	virtual void go() override {
+		stream_size_type items = m_stack->size();
 		while (!m_stack->empty()) {
 			dest.push(m_stack->pop());
 			step();
 		}
+		profile_items(items, items * sizeof(item_type));
 	}
 
 	virtual void end() override {
@@ -214,6 +220,7 @@ public:
 	/// \brief Pulls an item from the node
 	///////////////////////////////////////////////////////////////////////////////
 	T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		return m_stack->pop();
 	}
 
@@ -256,6 +263,7 @@ public:
 	/// \brief Pull an item from the node
 	///////////////////////////////////////////////////////////////////////////////
 	T pull() {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		T r = m_stack->top();
 		m_stack->pop();
 		return r;
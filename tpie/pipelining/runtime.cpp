@@ -20,10 +20,12 @@
 #include <tpie/fractional_progress.h>
 #include <tpie/progress_indicator_null.h>
 #include <tpie/disjoint_sets.h>
+#include <tpie/job.h>
 #include <tpie/pipelining/tokens.h>
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/runtime.h>
 #include <boost/functional/hash.hpp>
+#include <exception>
 
 namespace tpie {
 
@@ -996,28 +998,86 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 class begin_end {
 public:
-	begin_end(graph<node *> & actorGraph) {
+	///////////////////////////////////////////////////////////////////////////
+	/// \param time  If not nullptr, the time from begin() to end() is added
+	/// to it when profiling.
+	///////////////////////////////////////////////////////////////////////////
+	begin_end(graph<node *> & actorGraph, double * time = nullptr)
+		: m_time(time)
+	{
 		actorGraph.topological_order(m_topologicalOrder);
 	}
 
 	void begin() {
+		if (m_time) m_start = ptime::now();
 		for (size_t i = m_topologicalOrder.size(); i--;) {
-			m_topologicalOrder[i]->set_state(node::STATE_IN_BEGIN);
-			m_topologicalOrder[i]->begin();
-			m_topologicalOrder[i]->set_state(node::STATE_AFTER_BEGIN);
+			node * n = m_topologicalOrder[i];
+			n->set_state(node::STATE_IN_BEGIN);
+			{
+				profile_scope profile(n->get_profile());
+				n->begin();
+			}
+			n->set_state(node::STATE_AFTER_BEGIN);
+			if (n->get_profile()) {
+				n->get_profile()->memoryAssigned = n->get_available_memory();
+				sample_memory(n);
+			}
 		}
 	}
 
 	void end() {
 		for (size_t i = 0; i < m_topologicalOrder.size(); ++i) {
-			m_topologicalOrder[i]->set_state(node::STATE_IN_END);
-			m_topologicalOrder[i]->end();
-			m_topologicalOrder[i]->set_state(node::STATE_AFTER_END);
+			node * n = m_topologicalOrder[i];
+			if (n->get_profile()) sample_memory(n);
+			n->set_state(node::STATE_IN_END);
+			{
+				profile_scope profile(n->get_profile());
+				n->end();
+			}
+			n->set_state(node::STATE_AFTER_END);
 		}
+		if (m_time) *m_time += ptime::seconds(m_start, ptime::now());
 	}
 
 private:
+	static void sample_memory(node * n) {
+		node_profile & p = *n->get_profile();
+		p.memoryUsed = std::max(p.memoryUsed, n->get_used_memory());
+	}
+
 	std::vector<node *> m_topologicalOrder;
+	double * m_time;
+	ptime m_start;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Job calling go() on the initiators of a phase that runs concurrently with
+/// other phases. Exceptions are kept until the job has been joined.
+///////////////////////////////////////////////////////////////////////////////
+class phase_job : public job {
+public:
+	phase_job(runtime & rt, const std::vector<node *> & phase)
+		: m_runtime(rt)
+		, m_phase(phase)
+	{
+	}
+
+	virtual void operator()() override {
+		try {
+			m_runtime.go_initiators(m_phase);
+		} catch (...) {
+			m_exception = std::current_exception();
+		}
+	}
+
+	std::exception_ptr get_exception() const {
+		return m_exception;
+	}
+
+private:
+	runtime & m_runtime;
+	const std::vector<node *> & m_phase;
+	std::exception_ptr m_exception;
 };
 
 datastructure_runtime::datastructure_runtime(const std::vector<std::vector<node *> > & phases, node_map & nodeMap)
@@ -1124,6 +1184,7 @@ struct gocontext {
 	std::unordered_set<node_map::id_t> evacuateWhenDone;
 	std::vector<graph<node *> > itemFlow;
 	std::vector<graph<node *> > actor;
+	std::vector<size_t> groups;
 	datastructure_runtime drt;
 	progress_indicators pi;
 	size_t i;
@@ -1135,6 +1196,8 @@ struct gocontext {
 
 runtime::runtime(node_map::ptr nodeMap)
 	: m_nodeMap(*nodeMap)
+	, m_concurrentPhases(false)
+	, m_profile(nullptr)
 {
 }
 
@@ -1142,6 +1205,26 @@ size_t runtime::get_node_count() {
 	return m_nodeMap.size();
 }
 
+void runtime::set_concurrent_phases(bool enabled) {
+	m_concurrentPhases = enabled;
+}
+
+void runtime::set_profile(pipeline_profile * profile) {
+	m_profile = profile;
+}
+
+namespace {
+
+template <typename T>
+void apply_order(std::vector<T> & v, const std::vector<size_t> & order) {
+	std::vector<T> result;
+	result.reserve(order.size());
+	for (size_t i : order) result.push_back(std::move(v[i]));
+	v.swap(result);
+}
+
+} // default namespace
+
 
 void gocontextdel::operator()(void * p) {delete static_cast<gocontext*>(p);}
 	
@@ -1184,14 +1267,28 @@ gocontext_ptr runtime::go_init(stream_size_type items,
 	// and call node::prepare in item source to item sink order
 	prepare_all(itemFlow);
 
+	// Group phases that run concurrently, now that the minimum memory
+	// and files of the nodes are known
+	std::vector<size_t> order;
+	std::vector<size_t> groups;
+	get_concurrent_phases(phases, files, memory, order, groups);
+	if (m_concurrentPhases) {
+		apply_order(phases, order);
+		apply_order(itemFlow, order);
+		apply_order(actor, order);
+		get_evacuations(phases, groups, evacuateWhenDone);
+	}
+
 	// build the datastructure runtime
 	datastructure_runtime drt(phases, m_nodeMap); 
 
 	// Gather node file requirements and assign files to each phase
-	assign_files(phases, files);
+	assign_files(phases, groups, files);
 
 	// Gather node memory requirements and assign memory to each phase
-	assign_memory(phases, memory, drt);
+	assign_memory(phases, groups, memory, drt);
+
+	init_profile(phases);
 
 	// Exception guarantees are the following:
 	//   Progress indicators:
@@ -1217,6 +1314,7 @@ gocontext_ptr runtime::go_init(stream_size_type items,
 				std::move(evacuateWhenDone),
 				std::move(itemFlow),
 				std::move(actor),
+				std::move(groups),
 				std::move(drt),
 				std::move(pi),
 				0,
@@ -1238,16 +1336,27 @@ void runtime::go_until(gocontext * gc, node * node) {
 		// Run each phase:
 		// Evacuate previous if necessary
 		auto & phase = gc->phases[gc->i];
-		log_debug() << "Running pipe phase " << get_phase_name(phase) << std::endl;
 		
-		if (gc->i > 0) evacuate_all(gc->phases[gc->i-1], gc->evacuateWhenDone);
+		if (gc->i > 0) {
+			for (size_t j = gc->groups[gc->i-1]; j < gc->i; ++j)
+				evacuate_all(gc->phases[j], gc->evacuateWhenDone);
+		}
+
+		size_t last = gc->i;
+		while (last + 1 < gc->phases.size() && gc->groups[last+1] == gc->i) ++last;
+		if (last != gc->i) {
+			go_concurrent(gc, last);
+			continue;
+		}
+
+		log_debug() << "Running pipe phase " << get_phase_name(phase) << std::endl;
 			
 		// call propagate in item source to item sink order
 		propagate_all(gc->itemFlow[gc->i]);
 		// reassign files to all nodes in the phase
-		reassign_files(gc->phases, gc->i, gc->files);
+		reassign_files(gc->phases, gc->groups, gc->i, gc->files);
 		// reassign memory to all nodes in the phase
-		reassign_memory(gc->phases, gc->i, gc->memory, gc->drt);
+		reassign_memory(gc->phases, gc->groups, gc->i, gc->memory, gc->drt);
 
 		bool emptyFace = true;
 		for (auto n: phase)
@@ -1260,7 +1369,8 @@ void runtime::go_until(gocontext * gc, node * node) {
 		// set progress indicators on each node
 		set_progress_indicators(phase, gc->phaseProgress.get());
 		// call begin in leaf to root actor order
-		begin_end beginEnd(gc->actor[gc->i]);
+		begin_end beginEnd(gc->actor[gc->i],
+						   m_profile ? &m_profile->phaseTimes[gc->i] : nullptr);
 		beginEnd.begin();
 		
 		// call go on initiators
@@ -1283,6 +1393,74 @@ void runtime::go_until(gocontext * gc, node * node) {
 	gc->i++;
 }
 		
+void runtime::go_concurrent(gocontext * gc, size_t last) {
+	const size_t first = gc->i;
+	for (size_t i = first; i <= last; ++i)
+		log_debug() << "Running pipe phase " << get_phase_name(gc->phases[i])
+					<< " concurrently" << std::endl;
+
+	// call propagate in item source to item sink order
+	for (size_t i = first; i <= last; ++i)
+		propagate_all(gc->itemFlow[i]);
+	// reassign files and memory to all nodes in the group
+	reassign_files(gc->phases, gc->groups, first, gc->files);
+	reassign_memory(gc->phases, gc->groups, first, gc->memory, gc->drt);
+
+	// Progress indicators are not thread safe, so only the first phase,
+	// which is run by this thread, reports progress as it goes. The
+	// indicators of the other phases are done when their jobs are joined.
+	std::vector<phase_progress_indicator> phaseProgress;
+	std::vector<progress_indicator_null> nullProgress(last - first);
+	for (size_t i = last + 1; i-- > first;) {
+		bool emptyFace = true;
+		for (auto n: gc->phases[i])
+			if (is_initiator(n) && !n->is_go_free())
+				emptyFace = false;
+		phaseProgress.push_back(phase_progress_indicator(gc->pi, i, gc->phases[i], emptyFace));
+		if (i == first)
+			set_progress_indicators(gc->phases[i], phaseProgress.back().get());
+		else
+			set_progress_indicators(gc->phases[i], nullProgress[i - first - 1]);
+	}
+
+	// call begin in leaf to root actor order
+	std::vector<begin_end> beginEnds;
+	for (size_t i = first; i <= last; ++i) {
+		beginEnds.emplace_back(gc->actor[i],
+							   m_profile ? &m_profile->phaseTimes[i] : nullptr);
+		beginEnds.back().begin();
+	}
+
+	// call go on initiators
+	std::vector<std::unique_ptr<phase_job> > jobs;
+	for (size_t i = first + 1; i <= last; ++i) {
+		jobs.emplace_back(new phase_job(*this, gc->phases[i]));
+		jobs.back()->enqueue();
+	}
+	std::exception_ptr error;
+	try {
+		go_initiators(gc->phases[first]);
+	} catch (...) {
+		error = std::current_exception();
+	}
+	for (auto & j: jobs) {
+		j->join();
+		if (!error) error = j->get_exception();
+	}
+	if (error) std::rethrow_exception(error);
+
+	// call end in root to leaf actor order
+	for (size_t i = first; i <= last; ++i) {
+		beginEnds[i - first].end();
+		gc->drt.free_datastructures(i);
+	}
+
+	// call pi.done in the reverse order of pi.init
+	while (!phaseProgress.empty()) phaseProgress.pop_back();
+
+	gc->i = last;
+}
+
 void runtime::go(stream_size_type items,
 				 progress_indicator_base & progress,
 				 memory_size_type filesAvailable,
@@ -1293,6 +1471,12 @@ void runtime::go(stream_size_type items,
 	// Check that each phase has at least one initiator
 	ensure_initiators(gc->phases);
 	go_until(gc.get(), nullptr);
+	// The profile records belong to the caller, so do not keep pointers
+	// to them in the nodes
+	if (m_profile) {
+		for (auto & phase: gc->phases)
+			for (node * n: phase) n->set_profile(nullptr);
+	}
 }
 
 void runtime::get_item_sources(std::vector<node *> & itemSources) {
@@ -1610,6 +1794,116 @@ void runtime::get_phases(const std::map<node *, size_t> & phaseMap,
 	}
 }
 
+void runtime::get_concurrent_phases(const std::vector<std::vector<node *> > & phases,
+									memory_size_type files,
+									memory_size_type memory,
+									std::vector<size_t> & order,
+									std::vector<size_t> & groups)
+{
+	const size_t N = phases.size();
+	order.clear();
+	groups.clear();
+	if (!m_concurrentPhases) {
+		for (size_t i = 0; i < N; ++i) {
+			order.push_back(i);
+			groups.push_back(i);
+		}
+		return;
+	}
+
+	std::unordered_map<node_map::id_t, size_t> phaseOf;
+	for (size_t i = 0; i < N; ++i)
+		for (node * n : phases[i])
+			phaseOf[n->get_id()] = i;
+
+	// The phases each phase depends on, and the phases that must run alone:
+	// a memory share dependency on a node that cannot be evacuated must be
+	// on the phase right before, and datastructures are assigned memory per
+	// phase.
+	std::vector<std::set<size_t> > dependencies(N);
+	std::vector<bool> alone(N, false);
+	const node_map::relmap_t & relations = m_nodeMap.find_authority()->get_relations();
+	for (node_map::relmapit i = relations.begin(); i != relations.end(); ++i) {
+		bits::node_relation rel = i->second.second;
+		if (rel != depends && rel != no_forward_depends && rel != memory_share_depends)
+			continue;
+		size_t toPhase = phaseOf[i->first];
+		size_t fromPhase = phaseOf[i->second.first];
+		if (fromPhase == toPhase) continue;
+		dependencies[toPhase].insert(fromPhase);
+		if (rel == memory_share_depends && !m_nodeMap.get(i->second.first)->can_evacuate())
+			alone[fromPhase] = alone[toPhase] = true;
+	}
+	for (size_t i = 0; i < N; ++i)
+		for (node * n : phases[i])
+			if (!n->get_datastructures().empty())
+				alone[i] = true;
+
+	// This thread and each job worker runs a phase of the group.
+	const size_t maxGroupSize = default_worker_count() + 1;
+
+	const size_t NIL = N;
+	std::vector<size_t> groupOf(N, NIL);
+	for (size_t i = 0; i < N; ++i) {
+		if (groupOf[i] != NIL) continue;
+		const size_t first = order.size();
+		groupOf[i] = first;
+		order.push_back(i);
+		groups.push_back(first);
+		if (alone[i]) continue;
+
+		std::vector<node *> nodes = phases[i];
+		// Since phases are in topological order, a later phase does not
+		// depend on any phase skipped here.
+		for (size_t j = i + 1; j < N && order.size() - first < maxGroupSize; ++j) {
+			if (groupOf[j] != NIL || alone[j]) continue;
+			bool ready = true;
+			for (size_t d : dependencies[j])
+				if (groupOf[d] == NIL || groupOf[d] == first) ready = false;
+			if (!ready) continue;
+
+			std::vector<node *> groupNodes = nodes;
+			groupNodes.insert(groupNodes.end(), phases[j].begin(), phases[j].end());
+			memory_runtime mrt(groupNodes);
+			file_runtime frt(groupNodes);
+			if (mrt.sum_minimum_usage() > memory || frt.sum_minimum_usage() > files)
+				continue;
+
+			nodes.swap(groupNodes);
+			groupOf[j] = first;
+			order.push_back(j);
+			groups.push_back(first);
+		}
+	}
+}
+
+void runtime::get_evacuations(const std::vector<std::vector<node *> > & phases,
+							  const std::vector<size_t> & groups,
+							  std::unordered_set<node_map::id_t> & evacuateWhenDone)
+{
+	evacuateWhenDone.clear();
+	std::unordered_set<node_map::id_t> previousNodes;
+	std::unordered_set<node_map::id_t> groupNodes;
+	bits::node_map::ptr nodeMap = m_nodeMap.find_authority();
+	for (size_t i = 0; i < phases.size(); ++i) {
+		if (groups[i] == i) {
+			previousNodes.swap(groupNodes);
+			groupNodes.clear();
+		}
+		for (const auto node : phases[i]) {
+			const auto range = nodeMap->get_relations().equal_range(node->get_id());
+			for (auto it = range.first ; it != range.second ; ++it) {
+				if (it->second.second != memory_share_depends) continue;
+				if (previousNodes.count(it->second.first) != 0) continue;
+				evacuateWhenDone.emplace(it->second.first);
+			}
+		}
+		for (const auto node : phases[i]) {
+			groupNodes.emplace(node->get_id());
+		}
+	}
+}
+
 void runtime::get_item_flow_graphs(std::vector<std::vector<node *> > & phases,
 								   std::vector<graph<node *> > & itemFlow)
 {
@@ -1713,11 +2007,39 @@ void runtime::go_initiators(const std::vector<node *> & phase) {
 		if (is_initiator(phase[i])) initiators.push_back(phase[i]);
 	for (size_t i = 0; i < initiators.size(); ++i) {
 		initiators[i]->set_state(node::STATE_IN_GO);
-		initiators[i]->go();
+		{
+			profile_scope profile(initiators[i]->get_profile());
+			initiators[i]->go();
+		}
 		initiators[i]->set_state(node::STATE_AFTER_BEGIN);
 	}
 }
 
+void runtime::init_profile(const std::vector<std::vector<node *> > & phases) {
+	if (m_profile) {
+		size_t nodes = 0;
+		for (auto & phase: phases) nodes += phase.size();
+		m_profile->nodes.clear();
+		// The nodes point into the vector, so it must not reallocate
+		m_profile->nodes.reserve(nodes);
+		m_profile->phaseTimes.assign(phases.size(), 0.0);
+	}
+	for (size_t i = 0; i < phases.size(); ++i) {
+		for (node * n: phases[i]) {
+			if (!m_profile) {
+				n->set_profile(nullptr);
+				continue;
+			}
+			m_profile->nodes.emplace_back();
+			node_profile & p = m_profile->nodes.back();
+			p.name = n->get_name();
+			p.id = n->get_id();
+			p.phase = i;
+			n->set_profile(&p);
+		}
+	}
+}
+
 /*static*/
 void runtime::set_resource_being_assigned(const std::vector<node *> & nodes,
 										  resource_type type) {
@@ -1725,34 +2047,41 @@ void runtime::set_resource_being_assigned(const std::vector<node *> & nodes,
 		n->set_resource_being_assigned(type);
 }
 
+/*static*/
+std::vector<node *> runtime::group_nodes(const std::vector<std::vector<node *> > & phases,
+										 const std::vector<size_t> & groups,
+										 size_t phase) {
+	std::vector<node *> nodes;
+	for (size_t i = phase; i < phases.size() && groups[i] == phase; ++i)
+		nodes.insert(nodes.end(), phases[i].begin(), phases[i].end());
+	return nodes;
+}
+
 /*static*/
 void runtime::assign_files(const std::vector<std::vector<node *> > & phases,
-							memory_size_type files) {
+						   const std::vector<size_t> & groups,
+						   memory_size_type files) {
 	for (size_t phase = 0; phase < phases.size(); ++phase) {
-		file_runtime frt(phases[phase]);
-
-		double c = get_files_factor(files, frt);
-#ifndef TPIE_NDEBUG
-		frt.print_usage(c, log_debug());
-#endif // TPIE_NDEBUG
-		set_resource_being_assigned(phases[phase], FILES);
-		frt.assign_usage(c);
-		set_resource_being_assigned(phases[phase], NO_RESOURCE);
+		// The phases of a group are assigned files along with the first one
+		if (groups[phase] != phase) continue;
+		reassign_files(phases, groups, phase, files);
 	}
 }
 
 /*static*/
 void runtime::reassign_files(const std::vector<std::vector<node *> > & phases,
-							  size_t phase,
-							  memory_size_type files) {
-	file_runtime frt(phases[phase]);
+							 const std::vector<size_t> & groups,
+							 size_t phase,
+							 memory_size_type files) {
+	std::vector<node *> nodes = group_nodes(phases, groups, phase);
+	file_runtime frt(nodes);
 	double c = get_files_factor(files, frt);
 #ifndef TPIE_NDEBUG
 	frt.print_usage(c, log_debug());
 #endif // TPIE_NDEBUG
-	set_resource_being_assigned(phases[phase], FILES);
+	set_resource_being_assigned(nodes, FILES);
 	frt.assign_usage(c);
-	set_resource_being_assigned(phases[phase], NO_RESOURCE);
+	set_resource_being_assigned(nodes, NO_RESOURCE);
 }
 
 /*static*/
@@ -1803,42 +2132,44 @@ double runtime::get_files_factor(memory_size_type files, const file_runtime & fr
 
 /*static*/
 void runtime::assign_memory(const std::vector<std::vector<node *> > & phases,
+							const std::vector<size_t> & groups,
 							memory_size_type memory,
 							datastructure_runtime & drt) {
+	// The phases of a group are assigned memory along with the first one.
+	// They use no datastructures, so the datastructures in memory are the
+	// same for all of them.
 	for (size_t phase = 0; phase < phases.size(); ++phase) {
-		memory_runtime mrt(phases[phase]);
+		if (groups[phase] != phase) continue;
+		std::vector<node *> nodes = group_nodes(phases, groups, phase);
+		memory_runtime mrt(nodes);
 
 		double c = get_memory_factor(memory, phase, mrt, drt, false);
-		drt.minimize_factor(c, phase);
+		for (size_t i = phase; i < phases.size() && groups[i] == phase; ++i)
+			drt.minimize_factor(c, i);
 	}
 
 	for (size_t phase = 0; phase < phases.size(); ++phase) {
-		memory_runtime mrt(phases[phase]);
-
-		double c = get_memory_factor(memory, phase, mrt, drt, true);
-#ifndef TPIE_NDEBUG
-		mrt.print_usage(c, log_debug());
-#endif // TPIE_NDEBUG
-		set_resource_being_assigned(phases[phase], MEMORY);
-		mrt.assign_usage(c);
-		set_resource_being_assigned(phases[phase], NO_RESOURCE);
+		if (groups[phase] != phase) continue;
+		reassign_memory(phases, groups, phase, memory, drt);
 	}
 	drt.assign_memory();
 }
 
 /*static*/
 void runtime::reassign_memory(const std::vector<std::vector<node *> > & phases,
+							  const std::vector<size_t> & groups,
 							  size_t phase,
 							  memory_size_type memory,
 							  const datastructure_runtime & drt) {
-	memory_runtime mrt(phases[phase]);
+	std::vector<node *> nodes = group_nodes(phases, groups, phase);
+	memory_runtime mrt(nodes);
 	double c = get_memory_factor(memory, phase, mrt, drt, true);
 #ifndef TPIE_NDEBUG
 	mrt.print_usage(c, log_debug());
 #endif // TPIE_NDEBUG
-	set_resource_being_assigned(phases[phase], MEMORY);
+	set_resource_being_assigned(nodes, MEMORY);
 	mrt.assign_usage(c);
-	set_resource_being_assigned(phases[phase], NO_RESOURCE);
+	set_resource_being_assigned(nodes, NO_RESOURCE);
 }
 
 /*static*/
@@ -50,6 +50,8 @@ typedef std::unique_ptr<gocontext, gocontextdel> gocontext_ptr;
 ///////////////////////////////////////////////////////////////////////////////
 class runtime {
 	node_map & m_nodeMap;
+	bool m_concurrentPhases;
+	pipeline_profile * m_profile;
 
 public:
 	///////////////////////////////////////////////////////////////////////////
@@ -66,6 +68,20 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	size_t get_node_count();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Set whether phases that do not depend on each other may run
+	/// concurrently. Off by default.
+	///
+	/// See get_concurrent_phases for which phases are run together.
+	///////////////////////////////////////////////////////////////////////////
+	void set_concurrent_phases(bool enabled);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Record a profile of every node in the given profile when the
+	/// pipeline is run, or disable profiling if nullptr. Off by default.
+	///////////////////////////////////////////////////////////////////////////
+	void set_profile(pipeline_profile * profile);
+
 	gocontext_ptr go_init(stream_size_type items,
 						 progress_indicator_base & progress,
 						 memory_size_type files,
@@ -88,6 +104,10 @@ public:
 	/// appropriate. We call propagate in item source to item sink order;
 	/// we call begin in leaf to root actor order; we call end in root to leaf
 	/// actor order.
+	///
+	/// If concurrent phases are enabled, the initiators of a group of
+	/// phases from get_concurrent_phases are run at the same time on the
+	/// job pool, while propagate, begin and end are called in this thread.
 	///////////////////////////////////////////////////////////////////////////
 	void go(stream_size_type items,
 			progress_indicator_base & progress,
@@ -150,6 +170,36 @@ public:
 					std::unordered_set<node_map::id_t> & evacuateWhenDone,
 					std::vector<std::vector<node *> > & phases);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Order the phases in groups that can run concurrently.
+	///
+	/// order[k] is the index in phases of the kth phase to run, and groups[k]
+	/// is the position in order of the first phase of its group; the phases
+	/// of a group are consecutive.
+	///
+	/// A group is started by the first phase not yet ordered, and a later
+	/// phase joins it if all the phases it depends on are in earlier groups
+	/// and the minimum memory and files of the group fit in the given
+	/// amounts. Phases that use datastructures or share memory with a
+	/// phase that cannot be evacuated always run alone. If concurrent
+	/// phases are disabled, every phase is its own group.
+	///////////////////////////////////////////////////////////////////////////
+	void get_concurrent_phases(const std::vector<std::vector<node *> > & phases,
+							   memory_size_type files,
+							   memory_size_type memory,
+							   std::vector<size_t> & order,
+							   std::vector<size_t> & groups);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Compute evacuateWhenDone for grouped phases.
+	///
+	/// Like get_phases, but a memory share dependency only has to be
+	/// evacuated if it is not on a phase of the previous group.
+	///////////////////////////////////////////////////////////////////////////
+	void get_evacuations(const std::vector<std::vector<node *> > & phases,
+						 const std::vector<size_t> & groups,
+						 std::unordered_set<node_map::id_t> & evacuateWhenDone);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
@@ -217,6 +267,26 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void go_initiators(const std::vector<node *> & phase);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Give every node its record in m_profile, or clear the
+	/// profile pointers of the nodes if m_profile is nullptr.
+	///////////////////////////////////////////////////////////////////////////
+	void init_profile(const std::vector<std::vector<node *> > & phases);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Internal method used by go_until(): run the phases from
+	/// gc->i to last concurrently.
+	///////////////////////////////////////////////////////////////////////////
+	void go_concurrent(gocontext * gc, size_t last);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get the nodes of the group of phases starting at the given
+	/// phase.
+	///////////////////////////////////////////////////////////////////////////
+	static std::vector<node *> group_nodes(const std::vector<std::vector<node *> > & phases,
+										   const std::vector<size_t> & groups,
+										   size_t phase);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
@@ -225,16 +295,20 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
+	///
+	/// The phases of a group divide the files between them.
 	///////////////////////////////////////////////////////////////////////////
 	static void assign_files(const std::vector<std::vector<node *> > & phases,
-							  memory_size_type files);
+							 const std::vector<size_t> & groups,
+							 memory_size_type files);
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
 	static void reassign_files(const std::vector<std::vector<node *> > & phases,
-								memory_size_type phase,
-								memory_size_type files);
+							   const std::vector<size_t> & groups,
+							   memory_size_type phase,
+							   memory_size_type files);
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by assign_memory().
@@ -244,14 +318,18 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
+	///
+	/// The phases of a group divide the memory between them.
 	///////////////////////////////////////////////////////////////////////////
 	static void assign_memory(const std::vector<std::vector<node *> > & phases,
+							  const std::vector<size_t> & groups,
 							  memory_size_type memory, datastructure_runtime & drt);
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
 	static void reassign_memory(const std::vector<std::vector<node *> > & phases,
+								const std::vector<size_t> & groups,
 								memory_size_type phase,
 								memory_size_type memory, const datastructure_runtime & drt);
 
@@ -133,6 +133,7 @@ public:
 	}
 
 	item_type pull() {
+		bits::profile_scope profile(this->get_profile(), 1, sizeof(item_type));
 		this->step();
 		return this->m_sorter->pull();
 	}
@@ -190,11 +191,14 @@ public:
 	}
 	
 	virtual void go() override {
+		stream_size_type items = 0;
 		while (this->m_sorter->can_pull()) {
 			item_type && y=this->m_sorter->pull();
 			dest.push(std::move(y));
 			this->step();
+			++items;
 		}
+		this->profile_items(items, items * sizeof(item_type));
 	}
 
 	void end() override {
@@ -345,13 +349,20 @@ public:
 	}
 
 	void push(item_type && item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		m_sorter->push(std::move(item));
 	}
 
 	void push(const item_type & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(item_type));
 		m_sorter->push(item);
 	}
 
+	void push_batch(array_view<const item_type> items) {
+		bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(item_type));
+		m_sorter->push_batch(items);
+	}
+
 	void begin() override {
 		m_sorter->begin();
 		m_sorter->set_owner(this);
@@ -515,6 +526,19 @@ sort(const pred_t & p) {
 	return pipe_middle<fact>(fact(p, default_store())).name("Sort");
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Pipelining sorter ordering items by an unsigned integer key.
+///
+/// Runs are formed by a radix sort on the key instead of by comparisons,
+/// with scratch space from the phase 1 memory not used by the run buffer.
+/// Runs that do not leave room for the scratch are sorted by comparisons.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_t>
+inline pipe_middle<bits::sort_factory<key_less<key_t>, default_store> >
+sort_by_key(const key_t & key) {
+	return sort(key_less<key_t>(key));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief A pipelining node that sorts large elements indirectly by using 
 /// a storeand a given predicate.
@@ -47,10 +47,12 @@ public:
 	}
 
 	void go() override {
-		for (auto & i: input) {
-			dest.push(i);
-			step();
+		for (size_t i = 0; i < input.size(); i += batch_size) {
+			size_t n = std::min(batch_size, input.size() - i);
+			push_batch_to(dest, array_view<const T>(input.data() + i, n));
+			step(n);
 		}
+		profile_items(input.size(), input.size() * sizeof(T));
 	}
 private:
 	dest_t dest;
@@ -87,8 +89,14 @@ public:
 	output_vector_t(std::vector<T, A> & output) : output(output) {}
 
 	void push(const T & item) {
+		bits::profile_scope profile(get_profile(), 1, sizeof(T));
 		output.push_back(item);
 	}
+
+	void push_batch(array_view<const T> items) {
+		bits::profile_scope profile(get_profile(), items.size(), items.size() * sizeof(T));
+		output.insert(output.end(), items.begin(), items.end());
+	}
 private:
 	std::vector<item_type, A> & output;
 };
@@ -20,6 +20,7 @@
 #ifndef __TPIE_PIPELINING_STORE_H__
 #define __TPIE_PIPELINING_STORE_H__
 #include <tpie/memory.h>
+#include <utility>
 namespace tpie {
 
 namespace bits {
@@ -50,6 +51,25 @@ public:
 			specific_store_t::store_as_element(rhs));
 	}
 };
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Radix key of a stored item, as given by radix_traits on the
+/// element it holds.
+///////////////////////////////////////////////////////////////////////////////
+template <typename radix_traits, typename pred_t, typename specific_store_t>
+class store_key {
+private:
+	typedef typename specific_store_t::store_type store_type;
+	typedef typename specific_store_t::element_type element_type;
+	pred_t pred;
+public:
+	store_key(pred_t pred): pred(pred) {}
+
+	auto operator()(const store_type & item) const
+		-> decltype(radix_traits::key(std::declval<const pred_t &>(), std::declval<const element_type &>())) {
+		return radix_traits::key(pred, specific_store_t::store_as_element(item));
+	}
+};
 } //namespace bits
 
 /**
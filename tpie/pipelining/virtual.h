@@ -87,6 +87,7 @@ class virtsrc : public node {
 public:
 	virtual const node_token & get_token() = 0;
 	virtual void push(input_type v) = 0;
+	virtual void push_batch(array_view<const Input> items) = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -115,8 +116,14 @@ public:
 	}
 
 	void push(input_type v) {
+		bits::profile_scope profile(this->get_profile(), 1, sizeof(item_type));
 		dest.push(v);
 	}
+
+	void push_batch(array_view<const item_type> items) {
+		bits::profile_scope profile(this->get_profile(), items.size(), items.size() * sizeof(item_type));
+		push_batch_to(dest, items);
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -159,6 +166,10 @@ public:
 		m_virtdest->push(v);
 	}
 
+	void push_batch(array_view<const Output> items) {
+		m_virtdest->push_batch(items);
+	}
+
 	void set_destination(virtsrc<Output> * dest) {
 		if (m_virtdest != 0) {
 			throw tpie::exception("Virtual destination set twice");
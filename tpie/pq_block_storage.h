@@ -0,0 +1,508 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file pq_block_storage.h Block storage for the slots and group buffers of
+/// the external priority queue.
+/// \sa \ref priority_queue.h
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_PQ_BLOCK_STORAGE_H_
+#define _TPIE_PQ_BLOCK_STORAGE_H_
+
+#include <tpie/tpie_assert.h>
+#include <tpie/array.h>
+#include <tpie/tempname.h>
+#include <tpie/stats.h>
+#include <tpie/file_stream.h>
+#include <tpie/file_accessor/file_accessor.h>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+namespace tpie {
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Keeps a number of FIFO sequences of items in fixed size blocks of
+/// a single temporary file.
+///
+/// Every block starts with the position of the next block of its sequence,
+/// so the only per sequence state in memory is the position of the first
+/// and last block. Blocks that have been read past are reused before the
+/// file is extended. The positions of up to free_cache_size free blocks are
+/// kept in memory. When more blocks are freed, the cached positions are
+/// written to the freed block, which joins a free list threaded through such
+/// blocks, so the free list costs one block transfer per free_cache_size
+/// blocks.
+///
+/// Items are copied to and from the blocks as raw bytes, so T must be
+/// trivially copy constructible and destructible.
+///
+/// Items are appended to a sequence with a \ref writer and consumed from
+/// the front with a \ref reader. At most one reader or writer may be open on
+/// a sequence at a time.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class pq_block_storage {
+	// std::pair is not trivially copyable because of its assignment, but it
+	// is copied as raw bytes as safely as any trivially copyable type.
+	static_assert(std::is_trivially_copy_constructible<T>::value
+				  && std::is_trivially_destructible<T>::value,
+				  "pq_block_storage stores items as raw bytes");
+public:
+	typedef memory_size_type sequence_type;
+
+private:
+	static const stream_size_type no_block = std::numeric_limits<stream_size_type>::max();
+
+	/** Number of free block positions kept in memory. */
+	static const memory_size_type free_cache_size = 64;
+
+	static const memory_size_type header_size =
+		(sizeof(stream_size_type) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+	struct sequence {
+		sequence() : head(no_block), headSkip(0), tail(no_block), tailItems(0) {}
+
+		/** Position of the first block, or no_block if empty. */
+		stream_size_type head;
+		/** Number of items consumed from the first block. */
+		memory_size_type headSkip;
+		/** Position of the last block. */
+		stream_size_type tail;
+		/** Number of items in the last block. */
+		memory_size_type tailItems;
+	};
+
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Reads the items of a sequence from the front.
+	///
+	/// Items are inspected with peek() and consumed with advance(). When the
+	/// reader is closed, the sequence starts at the first item that was not
+	/// consumed.
+	///////////////////////////////////////////////////////////////////////////
+	class reader {
+	public:
+		reader(pq_block_storage & storage)
+			: m_storage(storage)
+			, m_block(tpie_new_aligned_buffer(storage.m_blockSize))
+			, m_open(false)
+			, m_consume(true)
+			, m_sequence(0)
+			, m_position(no_block)
+			, m_next(no_block)
+			, m_index(0)
+			, m_items(0)
+		{
+		}
+
+		~reader() {
+			close();
+			tpie_delete_aligned_buffer(m_block, m_storage.m_blockSize);
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Start reading the given sequence.
+		///
+		/// \param s The sequence to read.
+		/// \param consume Whether advance() should remove the items from the
+		/// sequence. If false, the sequence is left unchanged.
+		///////////////////////////////////////////////////////////////////////
+		void open(sequence_type s, bool consume = true) {
+			close();
+			m_open = true;
+			m_consume = consume;
+			m_sequence = s;
+			m_position = no_block;
+			m_index = m_items = 0;
+			const sequence & seq = m_storage.m_sequences[s];
+			if (seq.head == no_block) return;
+			load(seq.head);
+			m_index = seq.headSkip;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Return the first item that has not been consumed. The
+		/// sequence must not be exhausted.
+		///////////////////////////////////////////////////////////////////////
+		const T & peek() {
+			if (m_index == m_items) {
+				stream_size_type next = m_next;
+				if (m_consume) {
+					m_storage.free_block(m_position);
+					sequence & seq = m_storage.m_sequences[m_sequence];
+					seq.head = next;
+					seq.headSkip = 0;
+				}
+				load(next);
+			}
+			return items()[m_index];
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Consume the item returned by peek().
+		///////////////////////////////////////////////////////////////////////
+		void advance() {
+			++m_index;
+			if (!m_consume || m_index != m_items) return;
+			sequence & seq = m_storage.m_sequences[m_sequence];
+			if (m_position != seq.tail) return;
+			// The sequence is exhausted.
+			m_storage.free_block(m_position);
+			seq = sequence();
+			m_position = no_block;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Consume and return the next item.
+		///////////////////////////////////////////////////////////////////////
+		const T & read() {
+			const T & item = peek();
+			advance();
+			return item;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Stop reading, recording the number of items consumed.
+		///////////////////////////////////////////////////////////////////////
+		void close() {
+			if (!m_open) return;
+			m_open = false;
+			if (!m_consume || m_position == no_block) return;
+			sequence & seq = m_storage.m_sequences[m_sequence];
+			seq.head = m_position;
+			seq.headSkip = m_index;
+		}
+
+	private:
+		T * items() {
+			return reinterpret_cast<T *>(m_block + header_size);
+		}
+
+		void load(stream_size_type position) {
+			tp_assert(position != no_block, "Read past the end of a sequence");
+			const sequence & seq = m_storage.m_sequences[m_sequence];
+			m_position = position;
+			m_items = (position == seq.tail) ? seq.tailItems : m_storage.m_blockItems;
+			m_index = 0;
+			m_storage.read_block(position, m_block, m_items);
+			m_next = *reinterpret_cast<stream_size_type *>(m_block);
+			if (m_next != no_block) m_storage.will_read_block(m_sequence, m_next);
+		}
+
+		reader(const reader &);
+		reader & operator=(const reader &);
+
+		pq_block_storage & m_storage;
+		char * m_block;
+		bool m_open;
+		bool m_consume;
+		sequence_type m_sequence;
+		stream_size_type m_position;
+		stream_size_type m_next;
+		memory_size_type m_index;
+		memory_size_type m_items;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Appends items to the end of a sequence.
+	///////////////////////////////////////////////////////////////////////////
+	class writer {
+	public:
+		writer(pq_block_storage & storage)
+			: m_storage(storage)
+			, m_block(tpie_new_aligned_buffer(storage.m_blockSize))
+			, m_open(false)
+			, m_dirty(false)
+			, m_sequence(0)
+			, m_position(no_block)
+			, m_index(0)
+		{
+		}
+
+		~writer() {
+			close();
+			tpie_delete_aligned_buffer(m_block, m_storage.m_blockSize);
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Start appending to the given sequence.
+		///////////////////////////////////////////////////////////////////////
+		void open(sequence_type s) {
+			close();
+			m_open = true;
+			m_dirty = false;
+			m_sequence = s;
+			m_position = no_block;
+			m_index = 0;
+			const sequence & seq = m_storage.m_sequences[s];
+			if (seq.tail != no_block && seq.tailItems < m_storage.m_blockItems) {
+				// Continue filling the last block.
+				m_position = seq.tail;
+				m_index = seq.tailItems;
+				m_storage.read_block(m_position, m_block, m_index);
+			}
+		}
+
+		void write(const T & item) {
+			if (m_position == no_block || m_index == m_storage.m_blockItems)
+				new_block();
+			items()[m_index++] = item;
+			m_dirty = true;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Write the last block to the file.
+		///////////////////////////////////////////////////////////////////////
+		void close() {
+			if (!m_open) return;
+			m_open = false;
+			if (m_dirty) flush();
+		}
+
+	private:
+		T * items() {
+			return reinterpret_cast<T *>(m_block + header_size);
+		}
+
+		stream_size_type & next() {
+			return *reinterpret_cast<stream_size_type *>(m_block);
+		}
+
+		void flush() {
+			m_storage.write_block(m_position, m_block, m_index);
+			m_storage.m_sequences[m_sequence].tailItems = m_index;
+			m_dirty = false;
+		}
+
+		void new_block() {
+			stream_size_type position = m_storage.alloc_block();
+			sequence & seq = m_storage.m_sequences[m_sequence];
+			if (m_position != no_block) {
+				next() = position;
+				flush();
+			} else if (seq.tail != no_block) {
+				m_storage.set_next(seq.tail, position);
+			} else {
+				seq.head = position;
+				seq.headSkip = 0;
+			}
+			seq.tail = position;
+			seq.tailItems = 0;
+			m_position = position;
+			m_index = 0;
+			next() = no_block;
+		}
+
+		writer(const writer &);
+		writer & operator=(const writer &);
+
+		pq_block_storage & m_storage;
+		char * m_block;
+		bool m_open;
+		bool m_dirty;
+		sequence_type m_sequence;
+		stream_size_type m_position;
+		memory_size_type m_index;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor.
+	///
+	/// \param sequences Number of sequences.
+	/// \param blockFactor Size of the blocks relative to the default block
+	/// size of streams.
+	///////////////////////////////////////////////////////////////////////////
+	pq_block_storage(memory_size_type sequences, double blockFactor)
+		: m_sequences(sequences, sequence())
+		, m_blockSize(block_size(blockFactor))
+		, m_blockItems((m_blockSize - header_size) / sizeof(T))
+		, m_end(0)
+		, m_free(no_block)
+		, m_freeCapacity(std::min(memory_size_type(free_cache_size),
+								  (m_blockSize - free_header_size) / sizeof(stream_size_type)))
+		, m_freeCount(0)
+		, m_freeBlock(0)
+		, m_freeBlockSize(0)
+	{
+		m_accessor.set_direct_io(tempname::get_direct_io());
+		m_accessor.open_rw_new(m_file.path());
+		m_freeBlockSize = free_block_transfer_size();
+		m_freeBlock = tpie_new_aligned_buffer(m_freeBlockSize);
+	}
+
+	~pq_block_storage() {
+		tpie_delete_aligned_buffer(m_freeBlock, m_freeBlockSize);
+		m_accessor.close_i();
+		increment_temp_file_usage(-static_cast<stream_offset_type>(m_end));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by one open reader or writer.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type memory_usage(double blockFactor) {
+		return block_size(blockFactor) + std::max(sizeof(reader), sizeof(writer));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used per sequence.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type sequence_memory_usage() {
+		return sizeof(sequence);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove all items of a sequence.
+	///////////////////////////////////////////////////////////////////////////
+	void clear(sequence_type s) {
+		sequence & seq = m_sequences[s];
+		stream_size_type position = seq.head;
+		while (position != no_block) {
+			stream_size_type next = no_block;
+			if (position != seq.tail)
+				m_accessor.read_at_i(&next, sizeof(next), position);
+			free_block(position);
+			position = next;
+		}
+		seq = sequence();
+	}
+
+private:
+	/** Size of the next position and count in a block of the free list. */
+	static const memory_size_type free_header_size = 2 * sizeof(stream_size_type);
+
+	static memory_size_type block_size(double blockFactor) {
+		memory_size_type size = std::max(file_stream<T>::block_size(blockFactor), header_size + sizeof(T));
+		// Room for at least one cached position in a block of the free list.
+		size = std::max(size, free_header_size + sizeof(stream_size_type));
+		// With direct I/O for temporary files, blocks are whole direct I/O
+		// units, so that they can bypass the page cache.
+		if (!tempname::get_direct_io()) return size;
+		return (size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Bytes to transfer for a block holding the given number of
+	/// items; with direct I/O, rounded up to whole direct I/O units.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type transfer_size(memory_size_type items) const {
+		memory_size_type size = header_size + items * sizeof(T);
+		if (!m_accessor.direct_io_active()) return size;
+		return (size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Bytes to transfer for a block of the free list holding
+	/// m_freeCapacity positions.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type free_block_transfer_size() const {
+		memory_size_type size = free_header_size + m_freeCapacity * sizeof(stream_size_type);
+		if (!m_accessor.direct_io_active()) return size;
+		return (size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Let the file system read ahead the block at the given position
+	/// of a sequence, since readers go on to it once the current block is
+	/// consumed.
+	///////////////////////////////////////////////////////////////////////////
+	void will_read_block(sequence_type s, stream_size_type position) {
+		const sequence & seq = m_sequences[s];
+		memory_size_type items = (position == seq.tail) ? seq.tailItems : m_blockItems;
+		m_accessor.will_read_at_i(position, transfer_size(items));
+	}
+
+	void read_block(stream_size_type position, char * block, memory_size_type items) {
+		m_accessor.read_at_i(block, transfer_size(items), position);
+	}
+
+	void write_block(stream_size_type position, const char * block, memory_size_type items) {
+		m_accessor.write_at_i(block, transfer_size(items), position);
+	}
+
+	void set_next(stream_size_type position, stream_size_type next) {
+		m_accessor.write_at_i(&next, sizeof(next), position);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The cached free block positions, which follow the header of
+	/// the free list block buffer.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type * free_cache() {
+		return reinterpret_cast<stream_size_type *>(m_freeBlock + free_header_size);
+	}
+
+	stream_size_type alloc_block() {
+		if (m_freeCount > 0) return free_cache()[--m_freeCount];
+		if (m_free == no_block) {
+			stream_size_type position = m_end;
+			m_end += m_blockSize;
+			increment_temp_file_usage(static_cast<stream_offset_type>(m_blockSize));
+			return position;
+		}
+		// Take the positions stored in the first block of the free list,
+		// and then the block itself.
+		stream_size_type position = m_free;
+		m_accessor.read_at_i(m_freeBlock, m_freeBlockSize, position);
+		const stream_size_type * header = reinterpret_cast<const stream_size_type *>(m_freeBlock);
+		m_free = header[0];
+		m_freeCount = static_cast<memory_size_type>(header[1]);
+		return position;
+	}
+
+	void free_block(stream_size_type position) {
+		if (m_freeCount < m_freeCapacity) {
+			free_cache()[m_freeCount++] = position;
+			return;
+		}
+		// Store the cached positions in the freed block.
+		stream_size_type * header = reinterpret_cast<stream_size_type *>(m_freeBlock);
+		header[0] = m_free;
+		header[1] = m_freeCount;
+		m_accessor.write_at_i(m_freeBlock, m_freeBlockSize, position);
+		m_free = position;
+		m_freeCount = 0;
+	}
+
+	array<sequence> m_sequences;
+	memory_size_type m_blockSize;
+	memory_size_type m_blockItems;
+	/** End of the file. */
+	stream_size_type m_end;
+	/** First block of the free list. */
+	stream_size_type m_free;
+	/** Number of positions that fit in the free cache. */
+	memory_size_type m_freeCapacity;
+	/** Number of positions in the free cache. */
+	memory_size_type m_freeCount;
+	/** Buffer holding the free cache, laid out as a block of the free list. */
+	char * m_freeBlock;
+	memory_size_type m_freeBlockSize;
+	temp_file m_file;
+	file_accessor::raw_file_accessor m_accessor;
+};
+
+} // namespace bits
+
+} // namespace tpie
+
+#endif // _TPIE_PQ_BLOCK_STORAGE_H_
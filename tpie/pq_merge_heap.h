@@ -28,6 +28,7 @@
 #include "tpie_log.h"
 #include <cassert>
 #include <tpie/memory.h>
+#include <tpie/loser_tree.h>
 
 namespace tpie{
 
@@ -35,7 +36,9 @@ namespace tpie{
 /// \class pq_merge_heap
 /// \author Lars Hvam Petersen
 ///
-/// pq_merge_heap
+/// Merge heap over the slots of a priority queue group. The first item of
+/// every run is pushed before the first query; the items are then kept in a
+/// \ref loser_tree, so each pop_and_push() costs one comparison per level.
 ///////////////////////////////////////////////////////////////////////////////
 template<typename T, typename Comparator = std::less<T> >
 class pq_merge_heap {
@@ -69,10 +72,10 @@ class pq_merge_heap {
 
 		///////////////////////////////////////////////////////////////////////
 		/// \brief Remove the top element from the priority queue and insert
-		/// another.
+		/// another from the same run.
 		///
 		/// \param x The item.
-		/// \param run Where it comes from.
+		/// \param run Where it comes from; must equal top_run().
 		///////////////////////////////////////////////////////////////////////
 		void pop_and_push(const T& x, run_type run);
 
@@ -105,16 +108,14 @@ class pq_merge_heap {
 		bool empty() const;
 
 	private:
-		void fixDown();
-		void validate();
-		void dump();
+		void refresh() const;
 
 		memory_size_type m_size;
-		Comparator comp_;
+		memory_size_type m_pushed;
+		mutable bool m_dirty;
 
-		T* heap;
-		run_type* runs;
-		memory_size_type maxsize;
+		mutable loser_tree<T, Comparator> m_tree;
+		tpie::array<run_type> runs;
 };
 
 #include "pq_merge_heap.inl"
@@ -52,6 +52,18 @@ public:
     ///////////////////////////////////////////////////////////////////////////
     void push(const T& x);
 
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Insert a range of elements into the priority queue.
+    ///
+    /// Large batches are appended and heapified in linear time. If the batch
+    /// fills the queue, the heap order is only restored when it is needed, so
+    /// a full queue can go straight to sorted_array().
+    ///
+    /// \param first Start of the range.
+    /// \param last End of the range; at most maxsize-size() elements.
+    ///////////////////////////////////////////////////////////////////////////
+    void push_batch(const T * first, const T * last);
+
     ///////////////////////////////////////////////////////////////////////////
     /// \brief Remove the top element from the priority queue.
     ///////////////////////////////////////////////////////////////////////////
@@ -111,9 +123,12 @@ public:
     void sorted_pop();
 
 private:
+    void restore_heap();
+
     Comparator comp;
 	internal_priority_queue<T, Comparator> h;
     memory_size_type maxsize;
+    bool unordered;
     //T dummy;
 };
 	
@@ -20,7 +20,7 @@
 
 template<typename T, typename Comparator>
 pq_overflow_heap<T, Comparator>::pq_overflow_heap(memory_size_type m, Comparator c):
-  comp(c), h(m, comp), maxsize(m) {}
+  comp(c), h(m, comp), maxsize(m), unordered(false) {}
 
 template<typename T, typename Comparator>
 inline void pq_overflow_heap<T, Comparator>::push(const T& x) {
@@ -30,18 +30,42 @@ inline void pq_overflow_heap<T, Comparator>::push(const T& x) {
 		exit(-1);
 	}
 #endif
+	restore_heap();
 	h.push(x);
 }
 
+template<typename T, typename Comparator>
+inline void pq_overflow_heap<T, Comparator>::push_batch(const T * first, const T * last) {
+	assert(static_cast<memory_size_type>(last - first) <= maxsize - h.size());
+	if(static_cast<memory_size_type>(last - first) * 2 < h.size()) {
+		// Few elements compared to the heap; sift each of them up.
+		restore_heap();
+		for(; first != last; ++first) h.push(*first);
+		return;
+	}
+	for(; first != last; ++first) h.unsafe_push(*first);
+	if(full()) unordered = true;
+	else h.make_safe();
+}
+
+template<typename T, typename Comparator>
+inline void pq_overflow_heap<T, Comparator>::restore_heap() {
+	if(!unordered) return;
+	h.make_safe();
+	unordered = false;
+}
+
 template<typename T, typename Comparator>
 inline void pq_overflow_heap<T, Comparator>::pop() {
 	assert(!empty());
+	restore_heap();
 	h.pop();
 }
 
 template<typename T, typename Comparator>
 inline const T& pq_overflow_heap<T, Comparator>::top() {
 	assert(!empty());
+	restore_heap();
 	return h.top();
 }
 
@@ -70,6 +94,7 @@ inline memory_size_type pq_overflow_heap<T, Comparator>::sorted_size() const{
 template<typename T, typename Comparator>
 inline void pq_overflow_heap<T, Comparator>::sorted_pop() {
 	h.clear();
+	unordered = false;
 }
 
 template<typename T, typename Comparator>
@@ -37,10 +37,13 @@
 #include <string>
 #include <cstring> // for memcpy
 #include <sstream>
+#include <algorithm>
 #include "pq_merge_heap.h"
+#include <tpie/pq_block_storage.h>
 #include <tpie/err.h>
 #include <tpie/stream.h>
 #include <tpie/array.h>
+#include <tpie/array_view.h>
 #include <boost/filesystem.hpp>
 
 namespace tpie {
@@ -78,6 +81,8 @@ template<typename T, typename Comparator = std::less<T>, typename OPQType = pq_o
 class priority_queue {
 	typedef memory_size_type group_type;
 	typedef memory_size_type slot_type;
+	typedef bits::pq_block_storage<T> storage_type;
+	typedef typename storage_type::sequence_type sequence_type;
 public:
 	static constexpr float default_blocksize = 0.0625; 
 	
@@ -119,6 +124,19 @@ public:
     /////////////////////////////////////////////////////////
     void push(const T& x);
 
+    /////////////////////////////////////////////////////////
+    ///
+    /// Insert a batch of elements into the priority queue
+    ///
+    /// The elements are moved into the insertion buffer in
+    /// bulk, and every time the buffer fills up it is sorted
+    /// and written to a slot as in push().
+    ///
+    /// \param items The items
+    ///
+    /////////////////////////////////////////////////////////
+    void push_batch(array_view<const T> items);
+
     /////////////////////////////////////////////////////////
     ///
     /// Remove the top element from the priority queue
@@ -126,6 +144,24 @@ public:
     /////////////////////////////////////////////////////////
     void pop();
 
+    /////////////////////////////////////////////////////////
+    ///
+    /// Remove up to n elements from the top of the priority
+    /// queue and write them in order to out
+    ///
+    /// Runs of elements in the deletion buffer that precede
+    /// the top of the insertion buffer are copied out in one
+    /// step.
+    ///
+    /// \param n Maximum number of elements to remove
+    /// \param out Output iterator receiving the elements
+    ///
+    /// \return Number of elements removed
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename OutputIterator>
+    memory_size_type pop_batch(memory_size_type n, OutputIterator out);
+
     /////////////////////////////////////////////////////////
     ///
     /// See what's on the top of the priority queue
@@ -188,9 +224,9 @@ private:
 	/** Merge buffer of size 2*m. */
 	tpie::array<T> mergebuffer;
 
-	/** 3*(#slots) integers. Slot i contains its elements in cyclic ascending order,
+	/** 3*(#slots) integers. Slot i contains its elements in ascending order,
 	 * starting at index slot_state[3*i]. Slot i contains slot_state[3*i+1] elements.
-	 * Its data is in data file index slot_state[3*i+2]. */
+	 * Its data is in storage sequence slot_state[3*i+2]. */
 	tpie::array<memory_size_type> slot_state;
 
 	/** 2*(#groups) integers. Group buffer i has its elements in cyclic ascending order,
@@ -225,18 +261,20 @@ private:
     void             group_size_set(group_type group, memory_size_type n);
     memory_size_type group_size(group_type group) const;
 
-    array<temp_file> datafiles;
-    array<temp_file> groupdatafiles;
+	/** Slots and group buffers 1 through k-1, each stored as a sequence of
+	 * blocks in a single temporary file. */
+	tpie::unique_ptr<storage_type> storage;
 
-    temp_file & slot_data(slot_type slotid);
+    sequence_type slot_data(slot_type slotid);
     void slot_data_set(slot_type slotid, memory_size_type n);
-    temp_file & group_data(group_type groupid);
+    sequence_type group_data(group_type groupid);
     memory_size_type slot_max_size(slot_type slotid);
     void write_slot(slot_type slotid, T* arr, memory_size_type len);
     slot_type free_slot(group_type group);
     void empty_group(group_type group);
     void fill_buffer();
     void fill_group_buffer(group_type group);
+    void empty_overflow_heap();
     void compact(slot_type slot);
     void validate();
     void remove_group_buffer(group_type group);
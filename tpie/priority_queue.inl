@@ -77,25 +77,27 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail, str
 	{
 		//Calculate M
 		setting_m = mm_avail/sizeof(T);
-		//Get stream memory usage
-		memory_size_type usage = file_stream<T>::memory_usage(block_factor);
-		TP_LOG_DEBUG("Memory used by file_stream: " << usage << "b\n");
+		//Get memory usage of a reader or writer of the block storage
+		memory_size_type usage = storage_type::memory_usage(block_factor);
+		TP_LOG_DEBUG("Memory used by storage stream: " << usage << "b\n");
 
 		memory_size_type alloc_overhead = 0;
 
 
 		//Compute overhead of the parameters
 		const memory_size_type fanout_overhead = 2*sizeof(stream_size_type)// group state
-			+ (usage+sizeof(file_stream<T>*)+alloc_overhead) //temporary streams
+			+ storage_type::sequence_memory_usage() // group sequence
+			+ (usage+sizeof(void*)+alloc_overhead) //temporary streams
 			+ (sizeof(T)+sizeof(group_type)); //mergeheap
-		const memory_size_type sq_fanout_overhead = 3*sizeof(stream_size_type); //slot_state
+		const memory_size_type sq_fanout_overhead = 3*sizeof(stream_size_type) //slot_state
+			+ storage_type::sequence_memory_usage(); //slot sequence
 		const memory_size_type heap_m_overhead = sizeof(T) //opg
 			+ sizeof(T) //gbuffer0
 			+ sizeof(T) //extra buffer for remove_group_buffer
 			+ 2*sizeof(T); //mergebuffer
 		const memory_size_type buffer_m_overhead = sizeof(T) + 2*sizeof(T); //buffer
 		const memory_size_type extra_overhead =
-			  2*(usage+sizeof(file_stream<T>*)+alloc_overhead) //temporary streams
+			  2*(usage+sizeof(void*)+alloc_overhead) //temporary streams
 			+ 2*(sizeof(T)+sizeof(group_type)); //mergeheap
 		const memory_size_type additional_overhead = 16*1024; //Just leave a bit unused
 		TP_LOG_DEBUG("fanout_overhead     " << fanout_overhead     << ",\n" <<
@@ -142,10 +144,7 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail, str
 			const stream_size_type denominator = 2*sq_fanout_overhead;
 			setting_k = static_cast<memory_size_type>(nominator/denominator); //Set fanout
 
-			// Don't open too many files
-			setting_k = std::min(get_file_manager().available(), setting_k);
-
-			// Performance degrades with more than around 250 open files
+			// Performance degrades with a fanout of more than around 250
 			setting_k = std::min(static_cast<memory_size_type>(250), setting_k);
 		}
 
@@ -166,9 +165,9 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail, str
 
 		// this is assumed in empty_group.
 		if (2*setting_m*sizeof(T) <
-			sizeof(file_stream<T>) +
+			sizeof(typename storage_type::writer) +
 			setting_k * (sizeof(T) + sizeof(size_type) +
-						 sizeof(file_stream<T>))) {
+						 sizeof(typename storage_type::reader))) {
 			throw exception("Priority queue: Not enough memory for empty_group. "
 							"Increase allowed memory.");
 		}
@@ -218,18 +217,15 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail, str
 		group_state[i] = 0;
 	}
 
-	std::stringstream ss;
-	ss << tempname::tpie_name("pq_data");
-	datafiles.resize(setting_k*setting_k);
-	groupdatafiles.resize(setting_k);
+	// one sequence per slot followed by one per group buffer
+	storage.reset(tpie_new<storage_type>(setting_k*setting_k+setting_k, block_factor));
 	TP_LOG_DEBUG("memory after alloc: " 
 				 << get_memory_manager().available() << "b" << "\n");
 }
 
 template <typename T, typename Comparator, typename OPQType>
 priority_queue<T, Comparator, OPQType>::~priority_queue() { // destructor
-	datafiles.resize(0); // unlink slots
-	groupdatafiles.resize(0); // unlink groups 
+	storage.reset(); // unlink slots and groups
 
 	buffer.resize(0);
 	gbuffer0.resize(0);
@@ -238,76 +234,8 @@ priority_queue<T, Comparator, OPQType>::~priority_queue() { // destructor
 
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::push(const T& x) {
-
 	if(opq->full()) {
-		// When the overflow priority queue (aka. insertion buffer) is full,
-		// insert its contents into a new slot in group 0.
-		//
-		// To maintain the heap invariant
-		//     deletion buffer <= group buffer 0 <= group 0 slots
-		// we bubble lesser elements from insertion buffer down into
-		// deletion buffer and group buffer 0.
-
-		slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
-		                               // by merging it into a slot in group i+1)
-
-		assert(opq->sorted_size() == setting_m);
-		T* arr = opq->sorted_array();
-
-		// Bubble lesser elements down into deletion buffer
-		if(buffer_size > 0) {
-
-			// fetch insertion buffer
-			memcpy(&mergebuffer[0], &arr[0], sizeof(T)*opq->sorted_size());
-
-			// fetch deletion buffer
-			memcpy(&mergebuffer[opq->sorted_size()], &buffer[buffer_start], sizeof(T)*buffer_size);
-
-			// sort buffer elements
-			std::sort(mergebuffer.get(), mergebuffer.get()+(buffer_size+opq->sorted_size()), comp_);
-
-			// smaller elements go in deletion buffer
-			memcpy(buffer.get()+buffer_start, mergebuffer.get(), sizeof(T)*buffer_size);
-
-			// larger elements go in insertion buffer
-			memcpy(&arr[0], mergebuffer.get()+buffer_size, sizeof(T)*opq->sorted_size());
-		}
-
-		// Bubble lesser elements down into group buffer 0
-		if(group_size(0)> 0) {
-
-			// Merge insertion buffer and group buffer 0
-			assert(group_size(0)+opq->sorted_size() <= setting_m*2);
-			memory_size_type j = 0;
-
-			// fetch gbuffer0
-			for(stream_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
-				mergebuffer[j] = gbuffer0[static_cast<memory_size_type>(i%setting_m)];
-				++j;
-			}
-
-			// fetch insertion buffer
-			memcpy(&mergebuffer[j], &arr[0], sizeof(T)*opq->sorted_size());
-
-			// sort
-			std::sort(mergebuffer.get(), mergebuffer.get()+(group_size(0)+opq->sorted_size()), comp_);
-
-			// smaller elements go in gbuffer0
-			memcpy(gbuffer0.get(), mergebuffer.get(), static_cast<size_t>(sizeof(T)*group_size(0)));
-			group_start_set(0,0);
-
-			// larger elements go in insertion buffer (actually a free group 0 slot)
-			memcpy(&arr[0], &mergebuffer[group_size(0)], sizeof(T)*opq->sorted_size());
-		}
-
-		// move insertion buffer (which has elements larger than all of
-		// gbuffer0 and deletion buffer) into a free group 0 slot
-
-		write_slot(slot, arr, opq->sorted_size());
-		opq->sorted_pop();
-
-		// insertion buffer is now empty
-
+		empty_overflow_heap();
 	}
 
 	// insertion buffer is non-full. insert element.
@@ -318,6 +246,26 @@ void priority_queue<T, Comparator, OPQType>::push(const T& x) {
 #endif
 }
 
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::push_batch(array_view<const T> items) {
+	if(items.empty()) return;
+	const T * first = &*items.begin();
+	const T * last = first + items.size();
+	while(first != last) {
+		if(opq->full()) {
+			empty_overflow_heap();
+		}
+		memory_size_type room = static_cast<memory_size_type>(opq->sorted_size() - opq->size());
+		memory_size_type n = std::min(room, static_cast<memory_size_type>(last - first));
+		opq->push_batch(first, first + n);
+		first += n;
+		m_size += n;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+}
+
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::pop() {
 	if(empty()) {
@@ -372,6 +320,46 @@ const T& priority_queue<T, Comparator, OPQType>::top() {
 	return min;
 }
 
+template <typename T, typename Comparator, typename OPQType> template <typename OutputIterator>
+memory_size_type priority_queue<T, Comparator, OPQType>::pop_batch(memory_size_type n, OutputIterator out) {
+	memory_size_type popped = 0;
+	while(popped < n && !empty()) {
+		// Freshen deletion buffer (if empty) and min_in_buffer
+		top();
+		if(!min_in_buffer) {
+			// Top element in insertion buffer
+			*out = opq->top();
+			++out;
+			opq->pop();
+			++popped;
+			--m_size;
+			continue;
+		}
+
+		// Take every element of the deletion buffer that top() would
+		// return before the top of the insertion buffer.
+		memory_size_type count = std::min(n - popped, buffer_size);
+		if(opq->size() != 0) {
+			const T & opqTop = opq->top();
+			const T * begin = buffer.get() + buffer_start;
+			count = static_cast<memory_size_type>(
+				std::lower_bound(begin, begin + count, opqTop, comp_) - begin);
+		}
+		out = std::copy(buffer.get() + buffer_start, buffer.get() + buffer_start + count, out);
+		buffer_start += count;
+		buffer_size -= count;
+		if(buffer_size == 0) {
+			buffer_start = 0;
+		}
+		popped += count;
+		m_size -= count;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+	return popped;
+}
+
 template <typename T, typename Comparator, typename OPQType>
 stream_size_type priority_queue<T, Comparator, OPQType>::size() const {
 	return m_size;
@@ -443,13 +431,11 @@ void priority_queue<T, Comparator, OPQType>::dump() {
 			TP_LOG_DEBUG("\n");
 		} else {
 			// output group buffer contents
-			file_stream<T> instream(block_factor);
-			instream.open(group_data(i));
+			typename storage_type::reader instream(*storage);
+			instream.open(group_data(i), false);
 			memory_size_type k = 0;
-			if(group_size(i) > 0) {
-				for(k = 0; k < setting_m; k++) {
-					TP_LOG_DEBUG(instream.read() << " ");
-				}
+			for(k = 0; k < group_size(i); k++) {
+				TP_LOG_DEBUG(instream.read() << " ");
 			}
 			for(memory_size_type l = k; l < setting_m; l++) {
 				TP_LOG_DEBUG("() ");
@@ -463,13 +449,14 @@ void priority_queue<T, Comparator, OPQType>::dump() {
 					<< slot_size(j)
 					<< " start: " << slot_start(j) << "):");
 
-			file_stream<T> instream(block_factor);
-			instream.open(slot_data(j));
+			typename storage_type::reader instream(*storage);
+			instream.open(slot_data(j), false);
 			stream_size_type k;
-			for(k = 0; k < slot_start(j)+slot_size(j); k++) {
-				TP_LOG_DEBUG((k>=slot_start(j)?"":"(") <<
-						instream.read() <<
-						(k>=slot_start(j)?"":")") << " ");
+			for(k = 0; k < slot_start(j); k++) {
+				TP_LOG_DEBUG("(?) ");
+			}
+			for(; k < slot_start(j)+slot_size(j); k++) {
+				TP_LOG_DEBUG(instream.read() << " ");
 			}
 			for(stream_size_type l = k; l < slot_max_size(j); l++) {
 				TP_LOG_DEBUG("() ");
@@ -485,6 +472,79 @@ void priority_queue<T, Comparator, OPQType>::dump() {
 // Private
 /////////////////////////////
 
+// Write the full insertion buffer to a free slot in group 0.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::empty_overflow_heap() {
+	// When the overflow priority queue (aka. insertion buffer) is full,
+	// insert its contents into a new slot in group 0.
+	//
+	// To maintain the heap invariant
+	//     deletion buffer <= group buffer 0 <= group 0 slots
+	// we bubble lesser elements from insertion buffer down into
+	// deletion buffer and group buffer 0.
+
+	slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
+	                               // by merging it into a slot in group i+1)
+
+	assert(opq->sorted_size() == setting_m);
+	T* arr = opq->sorted_array();
+
+	// Bubble lesser elements down into deletion buffer
+	if(buffer_size > 0) {
+
+		// fetch insertion buffer
+		memcpy(&mergebuffer[0], &arr[0], sizeof(T)*opq->sorted_size());
+
+		// fetch deletion buffer
+		memcpy(&mergebuffer[opq->sorted_size()], &buffer[buffer_start], sizeof(T)*buffer_size);
+
+		// sort buffer elements
+		std::sort(mergebuffer.get(), mergebuffer.get()+(buffer_size+opq->sorted_size()), comp_);
+
+		// smaller elements go in deletion buffer
+		memcpy(buffer.get()+buffer_start, mergebuffer.get(), sizeof(T)*buffer_size);
+
+		// larger elements go in insertion buffer
+		memcpy(&arr[0], mergebuffer.get()+buffer_size, sizeof(T)*opq->sorted_size());
+	}
+
+	// Bubble lesser elements down into group buffer 0
+	if(group_size(0)> 0) {
+
+		// Merge insertion buffer and group buffer 0
+		assert(group_size(0)+opq->sorted_size() <= setting_m*2);
+		memory_size_type j = 0;
+
+		// fetch gbuffer0
+		for(stream_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
+			mergebuffer[j] = gbuffer0[static_cast<memory_size_type>(i%setting_m)];
+			++j;
+		}
+
+		// fetch insertion buffer
+		memcpy(&mergebuffer[j], &arr[0], sizeof(T)*opq->sorted_size());
+
+		// sort
+		std::sort(mergebuffer.get(), mergebuffer.get()+(group_size(0)+opq->sorted_size()), comp_);
+
+		// smaller elements go in gbuffer0
+		memcpy(gbuffer0.get(), mergebuffer.get(), static_cast<size_t>(sizeof(T)*group_size(0)));
+		group_start_set(0,0);
+
+		// larger elements go in insertion buffer (actually a free group 0 slot)
+		memcpy(&arr[0], &mergebuffer[group_size(0)], sizeof(T)*opq->sorted_size());
+	}
+
+	// move insertion buffer (which has elements larger than all of
+	// gbuffer0 and deletion buffer) into a free group 0 slot
+
+	write_slot(slot, arr, opq->sorted_size());
+	opq->sorted_pop();
+
+	// insertion buffer is now empty
+
+}
+
 // Find a free slot in given group.
 // If the group is full, call empty_group,
 // which calls remove_group_buffer, which calls free_slot(0)
@@ -552,15 +612,14 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 	{
 	pq_merge_heap<T, Comparator> heap(current_r);
 
-	tpie::array<tpie::unique_ptr<file_stream<T> > > data(current_r);
+	tpie::array<tpie::unique_ptr<typename storage_type::reader> > data(current_r);
 	for(memory_size_type i = 0; i<current_r; i++) {
-		data[i].reset(tpie_new<file_stream<T> >(block_factor));
+		data[i].reset(tpie_new<typename storage_type::reader>(*storage));
 		if(i == 0 && group_size(i)>0) {
 			heap.push(gbuffer0[group_start(0)], 0);
 		} else if(group_size(i)>0) {
 			data[i]->open(group_data(i));
-			data[i]->seek(group_start(i));
-			heap.push(data[i]->read(), i);
+			heap.push(data[i]->peek(), i);
 		} else if(i > 0) {
 			// dummy, well :o/
 		}
@@ -568,11 +627,11 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 
 	while(!heap.empty() && buffer_size!=setting_mmark) {
 		group_type current_group = heap.top_run();
-		if(current_group!= 0 && data[current_group]->offset() == setting_m) {
-			data[current_group]->seek(0);
-		}
 		buffer[(buffer_size+buffer_start)%setting_m] = heap.top();
 		buffer_size++;
+		if(current_group != 0) {
+			data[current_group]->advance();
+		}
 
 		assert(group_size(current_group) >= 1);
 		group_size_set(current_group, group_size(current_group)-1);
@@ -583,7 +642,7 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 			if(current_group == 0) {
 				heap.pop_and_push(gbuffer0[group_start(0)], 0);
 			} else {
-				heap.pop_and_push(data[current_group]->read(), current_group);
+				heap.pop_and_push(data[current_group]->peek(), current_group);
 			}
 		}
 	}
@@ -616,10 +675,9 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 
 		//group output stream, not used if group==0 in this case 
 		//the in-memory gbuffer0 is used
-		file_stream<T> out(block_factor);
-		out.open(group_data(group));
+		typename storage_type::writer out(*storage);
 		if(group > 0) {
-			out.seek((group_start(group)+group_size(group))%setting_m);
+			out.open(group_data(group));
 		}
 
 		//merge heap for the setting_k slots
@@ -627,21 +685,18 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 
 		//Create streams for the non-empty slots and initialize
 		//internal heap with one element per slot
-		tpie::array<tpie::unique_ptr<file_stream<T> > > data(setting_k);
+		tpie::array<tpie::unique_ptr<typename storage_type::reader> > data(setting_k);
 		for(memory_size_type i = 0; i<setting_k; i++) {
 
-			data[i].reset(tpie_new<file_stream<T> >(block_factor));
+			data[i].reset(tpie_new<typename storage_type::reader>(*storage));
 
 			if(slot_size(group*setting_k+i)>0) {
-				//slot is non-empry, opening stream
+				//slot is non-empry, opening stream at the start of the slot
 				slot_type slotid = group*setting_k+i;
 				data[i]->open(slot_data(slotid));
 
-				//seek to start of slot
-				data[i]->seek(slot_start(slotid));
-
 				//push first item of slot on the stream
-				heap.push(data[i]->read(), slotid);
+				heap.push(data[i]->peek(), slotid);
 			}
 		}
 
@@ -655,10 +710,6 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 				gbuffer0[(group_start(0)+group_size(0))%setting_m] = heap.top();
 			} else {
 				//write to disk for group >0
-				if(out.offset() == setting_m) {
-					out.seek(0);
-				}
-
 				out.write(heap.top());
 			}
 
@@ -666,6 +717,7 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 			group_size_set(group, group_size(group) + 1);
 
 			//decrease slot size and increase starting index
+			data[current_slot-group*setting_k]->advance();
 			slot_start_set(current_slot, slot_start(current_slot)+1);
 			slot_size_set(current_slot, slot_size(current_slot)-1);
 
@@ -673,10 +725,12 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 			if(slot_size(current_slot) == 0) {
 				heap.pop();
 			} else {
-				heap.pop_and_push(data[current_slot-group*setting_k]->read(), current_slot);
+				heap.pop_and_push(data[current_slot-group*setting_k]->peek(), current_slot);
 			}
 		}
 
+		out.close();
+
 	}
 
 	//restore mergebuffer
@@ -689,9 +743,9 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 
 // Memory usage:
 // Deallocates mergebuffer : -2*setting_m
-// Opens newstream         : sizeof(file_stream<T>)
+// Opens newstream         : sizeof(writer)
 // PQ merge heap           : setting_k * (sizeof T + sizeof size_type)
-// Opens old streams       : setting_k * sizeof(file_stream<T>)
+// Opens old streams       : setting_k * sizeof(reader)
 // Reallocates mergebuffer : +2*setting_m
 // (no net heap usage since 2*setting_m > temporary heap usage)
 template <typename T, typename Comparator, typename OPQType>
@@ -724,36 +778,38 @@ void priority_queue<T, Comparator, OPQType>::empty_group(group_type group) {
 #endif
 	{
 
-		file_stream<T> newstream(block_factor);
+		typename storage_type::writer newstream(*storage);
 		newstream.open(slot_data(newslot));
 		pq_merge_heap<T, Comparator> heap(setting_k);
 
 		// Open streams to slots in group `group', push top element to merge heap
-		tpie::array<tpie::unique_ptr<file_stream<T> > > data(setting_k);
+		tpie::array<tpie::unique_ptr<typename storage_type::reader> > data(setting_k);
 		for(memory_size_type i = 0; i<setting_k; i++) {
-			data[i].reset(tpie_new<file_stream<T> >(block_factor));
+			data[i].reset(tpie_new<typename storage_type::reader>(*storage));
 			data[i]->open(slot_data(group*setting_k+i));
 			if(slot_size(group*setting_k+i) == 0) {
 				ret = true;
 				break;
 			}
 			assert(slot_size(group*setting_k+i)>0);
-			data[i]->seek(slot_start(group*setting_k+i));
-			heap.push(data[i]->read(), group*setting_k+i);
+			heap.push(data[i]->peek(), group*setting_k+i);
 		}
 
 		while(!heap.empty() && !ret) {
 			slot_type current_slot = heap.top_run();
 			newstream.write(heap.top());
+			data[current_slot-group*setting_k]->advance();
 			slot_size_set(newslot,slot_size(newslot)+1);
 			slot_start_set(current_slot, slot_start(current_slot)+1);
 			slot_size_set(current_slot, slot_size(current_slot)-1);
 			if(slot_size(current_slot) == 0) {
 				heap.pop();
 			} else {
-				heap.pop_and_push(data[current_slot-group*setting_k]->read(), current_slot);
+				heap.pop_and_push(data[current_slot-group*setting_k]->peek(), current_slot);
 			}
 		}
+
+		newstream.close();
 	}
 
 #ifndef TPIE_NDEBUG
@@ -807,19 +863,12 @@ void priority_queue<T, Comparator, OPQType>::validate() {
 		}
 	}
 	// todo: validate gbuffer0
-	for(stream_size_type i = 1; i < setting_k; i++) { // groups, nb: cyclic
+	for(stream_size_type i = 1; i < setting_k; i++) { // groups
 		if(group_size(i) > 0) {
-			file_stream<T> stream;
-			stream.open(group_data(i));
-			stream.seek(group_start(i));
-			if(stream.offset() == setting_m) {
-				stream.seek(0);
-			}
+			typename storage_type::reader stream(*storage);
+			stream.open(group_data(i), false);
 			T last = stream.read();
 			for(stream_size_type j = 1; j < group_size(i); j++) {
-				if(stream.offset() == setting_m) {
-					stream.seek(0);
-				}
 				T read = stream.read();
 				if(comp_(read, last)) { // compare
 					dump();
@@ -827,15 +876,14 @@ void priority_queue<T, Comparator, OPQType>::validate() {
 									", read: " << read << ")");
 					exit(-1);
 				} 
+				last = read;
 			}
-			delete stream;
 		}
 	}
 	for(stream_size_type i = 0; i < setting_k*setting_k; i++) { // slots
 		if(slot_size(i) > 0){
-			file_stream<T> stream;
-			stream.open(slot_data(i));
-			stream.seek(slot_start(i));
+			typename storage_type::reader stream(*storage);
+			stream.open(slot_data(i), false);
 			T last = stream.read();
 			for(stream_size_type j = 1; j < slot_size(i); j++) {
 				T read = stream.read();
@@ -853,12 +901,8 @@ void priority_queue<T, Comparator, OPQType>::validate() {
 		T buf_max = buffer[buffer_start+buffer_size-1];
 		for(stream_size_type i = 1; i < setting_k; i++) { // todo: gbuffer0
 			if(group_size(i) > 0) {
-				file_stream<T> stream;
-				stream.open(group_data(i));
-				stream.seek(group_start(i));
-				if(stream->offset() == setting_m) {
-					stream.seek(0);
-				}
+				typename storage_type::reader stream(*storage);
+				stream.open(group_data(i), false);
 				T first = stream.read();
 				if(comp_(first, buf_max)) { // compare
 					dump();
@@ -873,17 +917,18 @@ void priority_queue<T, Comparator, OPQType>::validate() {
 	// todo: gbuffer0
 	for(stream_size_type i = 1; i < setting_k; i++) { // group buffers --> slots
 		if(group_size(i) > 0) {
-			file_stream<T> stream;
-			stream.open(group_data(i));
-			stream.seek((group_start(i)+group_size(i)-1)%setting_m);
+			typename storage_type::reader stream(*storage);
+			stream.open(group_data(i), false);
 			T item_group = stream.read();
+			for(stream_size_type j = 1; j < group_size(i); j++) {
+				item_group = stream.read();
+			}
 			//cout << "item_group: " << item_group << "\n";
 
 			for(stream_size_type j = i*setting_k; j<i*setting_k+setting_k;j++) {
 				if(slot_size(j) > 0) {
-					file_stream<T> stream;
-					stream.open(slot_data(j));
-					stream.seek(slot_start(j));
+					typename storage_type::reader stream(*storage);
+					stream.open(slot_data(j), false);
 					T item_slot = stream.read();
 					
 					if(comp_(item_slot, item_group)) { // compare
@@ -925,20 +970,12 @@ void priority_queue<T, Comparator, OPQType>::remove_group_buffer(group_type grou
 
 	assert(group < setting_k);
 	array<T> arr(static_cast<size_t>(group_size(group)));
-	file_stream<T> data(block_factor);
-	data.open(group_data(group));
-	data.seek(group_start(group));
-	memory_size_type size = group_size(group);
-	if(group_start(group) + group_size(group) <= static_cast<stream_size_type>(setting_m)) {
-		data.read(arr.begin(), arr.find(size));
-	} else {
-		// two reads
-		memory_size_type first_read = setting_m - group_start(group);
-		memory_size_type second_read = size - first_read;
-
-		data.read(arr.begin(), arr.find(first_read));
-		data.seek(0);
-		data.read(arr.find(first_read), arr.find(first_read+second_read));
+	{
+		typename storage_type::reader data(*storage);
+		data.open(group_data(group));
+		for(memory_size_type i = 0; i < group_size(group); i++) {
+			arr[i] = data.read();
+		}
 	}
 	assert(group_size(group) > 0);
 
@@ -1006,8 +1043,9 @@ memory_size_type priority_queue<T, Comparator, OPQType>::group_size(group_type g
 }
 
 template <typename T, typename Comparator, typename OPQType>
-temp_file & priority_queue<T, Comparator, OPQType>::slot_data(slot_type slotid) {
-	return datafiles[slot_state[slotid*3+2]];
+typename priority_queue<T, Comparator, OPQType>::sequence_type
+priority_queue<T, Comparator, OPQType>::slot_data(slot_type slotid) {
+	return slot_state[slotid*3+2];
 }
 
 template <typename T, typename Comparator, typename OPQType>
@@ -1016,8 +1054,9 @@ void priority_queue<T, Comparator, OPQType>::slot_data_set(slot_type slotid, mem
 }
 
 template <typename T, typename Comparator, typename OPQType>
-temp_file & priority_queue<T, Comparator, OPQType>::group_data(group_type groupid) {
-	return groupdatafiles[groupid];
+typename priority_queue<T, Comparator, OPQType>::sequence_type
+priority_queue<T, Comparator, OPQType>::group_data(group_type groupid) {
+	return setting_k*setting_k+groupid;
 }
 
 template <typename T, typename Comparator, typename OPQType>
@@ -1031,9 +1070,12 @@ memory_size_type priority_queue<T, Comparator, OPQType>::slot_max_size(slot_type
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::write_slot(slot_type slotid, T* arr, memory_size_type len) {
 	assert(len > 0);
-	file_stream<T> data(block_factor);
+	typename storage_type::writer data(*storage);
 	data.open(slot_data(slotid));
-	data.write(arr+0, arr+len);
+	for(memory_size_type i = 0; i < len; i++) {
+		data.write(arr[i]);
+	}
+	data.close();
 	slot_start_set(slotid, 0);
 	slot_size_set(slotid, len);
 	if(current_r == 0 && slotid < setting_k) {
@@ -0,0 +1,218 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file radix_heap.h  Internal priority queue for monotone integer keys.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_RADIX_HEAP_H__
+#define __TPIE_RADIX_HEAP_H__
+
+#include <tpie/tpie_assert.h>
+#include <tpie/array.h>
+#include <tpie/util.h>
+#include <tpie/radix_sort.h>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Radix heap: internal priority queue for integer keys where no key
+/// pushed is less than the last key returned by top().
+///
+/// This is the access pattern of Dijkstra's algorithm and of time forward
+/// processing. The key of an item is given by radix_key_traits for pred_t,
+/// so the heap works for std::less and std::greater on integers and for
+/// key_less on any item type with an integer key.
+///
+/// Items are kept in one bucket per bit of the key: bucket b > 0 holds the
+/// items whose key first differs from the last key in bit b-1, and bucket 0
+/// the items equal to it. When bucket 0 is empty, the lowest nonempty bucket
+/// is split on its least key, so every item moves to a lower bucket at most
+/// once per bit and push and pop take amortized O(1) key operations.
+///
+/// The buckets are linked lists through a fixed array of max_size items.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t = std::less<T> >
+class radix_heap: public linear_memory_base< radix_heap<T, pred_t> > {
+	typedef radix_key_traits<pred_t, T> traits;
+	static_assert(traits::enabled, "radix_heap requires radix_key_traits for the predicate");
+public:
+	typedef memory_size_type size_type;
+	typedef typename std::decay<decltype(traits::key(std::declval<const pred_t &>(),
+													 std::declval<const T &>()))>::type key_type;
+	static_assert(std::is_unsigned<key_type>::value, "radix_heap keys must be unsigned integers");
+
+private:
+	static const size_type bucket_count = 8 * sizeof(key_type) + 1;
+	static const size_type none = std::numeric_limits<size_type>::max();
+
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Construct a radix heap.
+	/// \param max_size Maximum size of the heap.
+	///////////////////////////////////////////////////////////////////////////
+	radix_heap(size_type max_size, pred_t pred = pred_t(),
+			   memory_bucket_ref bucket = memory_bucket_ref())
+		: m_pred(pred)
+		, m_items(max_size, bucket)
+		, m_next(max_size, bucket)
+	{
+		clear();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert an element. Its key must not be less than the key of
+	/// the last element returned by top().
+	///////////////////////////////////////////////////////////////////////////
+	void push(const T & v) {
+		assert(m_free != none);
+		key_type k = key(v);
+		tp_assert(!(k < m_last), "radix_heap: key less than the last top");
+		size_type slot = m_free;
+		m_free = m_next[slot];
+		m_items[slot] = v;
+		link(slot, bucket_of(k));
+		++m_size;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the minimum element.
+	///////////////////////////////////////////////////////////////////////////
+	const T & top() {
+		assert(!empty());
+		refill();
+		return m_items[m_head[0]];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the minimum element.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		assert(!empty());
+		refill();
+		size_type slot = m_head[0];
+		m_head[0] = m_next[slot];
+		m_next[slot] = m_free;
+		m_free = slot;
+		--m_size;
+	}
+
+	bool empty() const {return m_size == 0;}
+
+	size_type size() const {return m_size;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove all elements, and allow any key to be pushed again.
+	///////////////////////////////////////////////////////////////////////////
+	void clear() {
+		for (size_type i = 0; i < m_next.size(); ++i) m_next[i] = i + 1;
+		if (m_next.size() > 0) m_next[m_next.size() - 1] = none;
+		m_free = m_next.size() > 0 ? 0 : none;
+		std::fill(m_head, m_head + bucket_count, none);
+		m_size = 0;
+		m_last = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_coefficient()
+	/// \copydetails linear_memory_structure_doc::memory_coefficient()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_coefficient() {
+		return tpie::array<T>::memory_coefficient()
+			+ tpie::array<size_type>::memory_coefficient();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_overhead()
+	/// \copydetails linear_memory_structure_doc::memory_overhead()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_overhead() {
+		return tpie::array<T>::memory_overhead() - sizeof(tpie::array<T>)
+			+ tpie::array<size_type>::memory_overhead() - sizeof(tpie::array<size_type>)
+			+ sizeof(radix_heap);
+	}
+
+private:
+	key_type key(const T & v) const {
+		return static_cast<key_type>(traits::key(m_pred, v));
+	}
+
+	// Number of the highest bit in which k differs from the last key, plus
+	// one, or zero if k equals the last key.
+	size_type bucket_of(key_type k) const {
+		key_type x = static_cast<key_type>(k ^ m_last);
+		size_type b = 0;
+		while (x != 0) {
+			++b;
+			x = static_cast<key_type>(x >> 1);
+		}
+		return b;
+	}
+
+	void link(size_type slot, size_type b) {
+		m_next[slot] = m_head[b];
+		m_head[b] = slot;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief If bucket 0 is empty, split the lowest nonempty bucket on its
+	/// least key.
+	///////////////////////////////////////////////////////////////////////////
+	void refill() {
+		if (m_head[0] != none) return;
+		size_type b = 1;
+		while (m_head[b] == none) ++b;
+		size_type slot = m_head[b];
+		key_type least = key(m_items[slot]);
+		for (slot = m_next[slot]; slot != none; slot = m_next[slot])
+			least = std::min(least, key(m_items[slot]));
+		m_last = least;
+		slot = m_head[b];
+		m_head[b] = none;
+		while (slot != none) {
+			size_type next = m_next[slot];
+			link(slot, bucket_of(key(m_items[slot])));
+			slot = next;
+		}
+	}
+
+	pred_t m_pred;
+	tpie::array<T> m_items;
+	/** Next item in the same bucket, or in the free list. */
+	tpie::array<size_type> m_next;
+	size_type m_head[bucket_count];
+	size_type m_free;
+	size_type m_size;
+	key_type m_last;
+};
+
+template <typename T, typename pred_t>
+const typename radix_heap<T, pred_t>::size_type radix_heap<T, pred_t>::bucket_count;
+
+template <typename T, typename pred_t>
+const typename radix_heap<T, pred_t>::size_type radix_heap<T, pred_t>::none;
+
+} // namespace tpie
+
+#endif // __TPIE_RADIX_HEAP_H__
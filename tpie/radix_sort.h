@@ -0,0 +1,290 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2017, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_RADIX_SORT_H__
+#define __TPIE_RADIX_SORT_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file radix_sort.h
+/// \brief Radix sort on unsigned integer keys.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/array.h>
+#include <tpie/job.h>
+#include <tpie/util.h>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace tpie {
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief LSD radix sort of src[0, n) on the low `digits` bytes of the key.
+///
+/// Passes alternate between src and dst, and the result is left in out,
+/// which must be either src or dst.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename key_t>
+void radix_sort_low_digits(T * src, T * dst, size_t n, key_t & key, size_t digits, T * out) {
+	typedef typename std::decay<decltype(key(*src))>::type key_type;
+	const size_t maxDigits = sizeof(key_type);
+
+	if (n > 1 && digits > 0) {
+		memory_size_type counts[maxDigits][256] = {};
+		for (T * i = src; i != src + n; ++i) {
+			key_type k = key(*i);
+			for (size_t d = 0; d < digits; ++d)
+				++counts[d][(k >> (8*d)) & 0xFF];
+		}
+
+		const key_type first = key(*src);
+		for (size_t d = 0; d < digits; ++d) {
+			memory_size_type * count = counts[d];
+			if (count[(first >> (8*d)) & 0xFF] == n) continue;
+
+			memory_size_type offset = 0;
+			for (size_t b = 0; b < 256; ++b) {
+				memory_size_type c = count[b];
+				count[b] = offset;
+				offset += c;
+			}
+			for (T * i = src; i != src + n; ++i)
+				dst[count[(key(*i) >> (8*d)) & 0xFF]++] = std::move(*i);
+			std::swap(src, dst);
+		}
+	}
+
+	if (src != out) std::move(src, src + n, out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sorts a group of MSD buckets of parallel_radix_sort.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename key_t>
+class radix_bucket_job : public job {
+public:
+	radix_bucket_job(T * src, T * dst, const memory_size_type * bounds,
+					 size_t buckets, key_t key, size_t digits)
+		: m_src(src)
+		, m_dst(dst)
+		, m_bounds(bounds)
+		, m_buckets(buckets)
+		, m_key(key)
+		, m_digits(digits)
+	{
+	}
+
+	virtual void operator()() override {
+		try {
+			for (size_t b = 0; b < m_buckets; ++b) {
+				memory_size_type from = m_bounds[b];
+				memory_size_type to = m_bounds[b+1];
+				radix_sort_low_digits(m_src + from, m_dst + from, to - from,
+									  m_key, m_digits, m_dst + from);
+			}
+		} catch (...) {
+			m_exception = std::current_exception();
+		}
+	}
+
+	std::exception_ptr m_exception;
+
+private:
+	T * m_src;
+	T * m_dst;
+	const memory_size_type * m_bounds;
+	size_t m_buckets;
+	key_t m_key;
+	size_t m_digits;
+};
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Stably sort [begin, end) by an unsigned integer key.
+///
+/// Items are distributed on one byte of the key at a time, starting with the
+/// least significant byte, alternating between the input range and scratch.
+/// The histograms of all bytes are computed in a single pass up front, and a
+/// byte on which every item agrees is skipped, so keys that only use their
+/// low bytes cost a pass per byte actually used.
+///
+/// \param begin  First item to sort.
+/// \param end  One past the last item to sort.
+/// \param scratch  Buffer with room for end - begin items.
+/// \param key  Functor mapping an item to an unsigned integer key.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename key_t>
+void radix_sort(T * begin, T * end, T * scratch, key_t key) {
+	typedef typename std::decay<decltype(key(*begin))>::type key_type;
+	static_assert(std::is_unsigned<key_type>::value,
+				  "radix_sort requires an unsigned integer key");
+	bits::radix_sort_low_digits(begin, scratch, end - begin, key, sizeof(key_type), begin);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Stably sort [begin, end) by an unsigned integer key using the job
+/// framework.
+///
+/// The items are first distributed into 256 buckets on the most significant
+/// byte in which the keys differ. The buckets are then sorted independently
+/// by radix_sort on the remaining low bytes, in groups of buckets on the job
+/// pool. Buckets are small enough to stay in cache for much longer than the
+/// whole range would in a plain LSD sort. Small ranges are sorted directly
+/// with radix_sort.
+///
+/// \param begin  First item to sort.
+/// \param end  One past the last item to sort.
+/// \param scratch  Buffer with room for end - begin items.
+/// \param key  Functor mapping an item to an unsigned integer key.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename key_t>
+void parallel_radix_sort(T * begin, T * end, T * scratch, key_t key) {
+	typedef typename std::decay<decltype(key(*begin))>::type key_type;
+	static_assert(std::is_unsigned<key_type>::value,
+				  "parallel_radix_sort requires an unsigned integer key");
+	typedef bits::radix_bucket_job<T, key_t> job_t;
+
+	const memory_size_type n = end - begin;
+	if (n < 65536) {
+		radix_sort(begin, end, scratch, key);
+		return;
+	}
+
+	const key_type first = key(*begin);
+	key_type differ = 0;
+	for (T * i = begin; i != end; ++i) differ |= key(*i) ^ first;
+	if (differ == 0) return;
+	size_t top = sizeof(key_type) - 1;
+	while (((differ >> (8*top)) & 0xFF) == 0) --top;
+
+	memory_size_type bounds[257] = {};
+	for (T * i = begin; i != end; ++i) ++bounds[((key(*i) >> (8*top)) & 0xFF) + 1];
+	for (size_t b = 0; b < 256; ++b) bounds[b+1] += bounds[b];
+	{
+		memory_size_type next[256];
+		std::copy(bounds, bounds + 256, next);
+		for (T * i = begin; i != end; ++i)
+			scratch[next[(key(*i) >> (8*top)) & 0xFF]++] = std::move(*i);
+	}
+
+	// Group consecutive buckets into a few jobs per worker.
+	const memory_size_type target = n / (4 * (default_worker_count() + 1)) + 1;
+	array<tpie::unique_ptr<job_t> > jobs(256);
+	size_t jobCount = 0;
+	for (size_t b = 0; b < 256;) {
+		size_t e = b + 1;
+		while (e < 256 && bounds[e+1] - bounds[b] <= target) ++e;
+		jobs[jobCount++].reset(tpie_new<job_t>(scratch, begin, bounds + b, e - b, key, top));
+		b = e;
+	}
+	for (size_t j = 0; j < jobCount; ++j) jobs[j]->enqueue();
+	for (size_t j = 0; j < jobCount; ++j) jobs[j]->join();
+	for (size_t j = 0; j < jobCount; ++j)
+		if (jobs[j]->m_exception) std::rethrow_exception(jobs[j]->m_exception);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Predicate ordering items by an unsigned integer key.
+///
+/// Sorters that support radix sorting recognize this predicate through
+/// is_key_less and sort on the key directly. Other predicates, including
+/// std::less on integers, are sorted by comparisons.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_t>
+struct key_less {
+	key_less(key_t key = key_t()): key(key) {}
+
+	template <typename T>
+	bool operator()(const T & a, const T & b) const {
+		return key(a) < key(b);
+	}
+
+	key_t key;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Tells whether pred_t is a key_less, that is, whether the user
+/// asked for a radix sort by giving a key extractor.
+///////////////////////////////////////////////////////////////////////////////
+template <typename pred_t>
+struct is_key_less : std::false_type {};
+
+template <typename key_t>
+struct is_key_less<key_less<key_t> > : std::true_type {};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Tells whether items of type T ordered by pred_t can be radix
+/// sorted, and how to compute their key.
+///
+/// When enabled, key(pred, item) returns an unsigned integer such that
+/// pred(a, b) holds exactly when key(pred, a) < key(pred, b). The trait is
+/// enabled for key_less, and for std::less and std::greater on integers.
+/// Specialize it to radix sort on other predicates.
+///////////////////////////////////////////////////////////////////////////////
+template <typename pred_t, typename T, typename Enable = void>
+struct radix_key_traits {
+	static const bool enabled = false;
+};
+
+template <typename key_t, typename T>
+struct radix_key_traits<key_less<key_t>, T> {
+	static const bool enabled = true;
+
+	static auto key(const key_less<key_t> & pred, const T & item) -> decltype(pred.key(item)) {
+		return pred.key(item);
+	}
+};
+
+template <typename T>
+struct radix_key_traits<std::less<T>, T,
+						typename std::enable_if<std::is_integral<T>::value
+												&& !std::is_same<T, bool>::value>::type> {
+	static const bool enabled = true;
+	typedef typename std::make_unsigned<T>::type key_type;
+
+	// Flipping the sign bit maps signed integers to unsigned in order.
+	static key_type key(const std::less<T> &, const T & item) {
+		const key_type sign = std::is_signed<T>::value
+			? static_cast<key_type>(key_type(1) << (8*sizeof(T) - 1)) : key_type(0);
+		return static_cast<key_type>(static_cast<key_type>(item) ^ sign);
+	}
+};
+
+template <typename T>
+struct radix_key_traits<std::greater<T>, T,
+						typename std::enable_if<std::is_integral<T>::value
+												&& !std::is_same<T, bool>::value>::type> {
+	static const bool enabled = true;
+	typedef typename std::make_unsigned<T>::type key_type;
+
+	static key_type key(const std::greater<T> &, const T & item) {
+		return static_cast<key_type>(~radix_key_traits<std::less<T>, T>::key(std::less<T>(), item));
+	}
+};
+
+} // namespace tpie
+
+#endif // __TPIE_RADIX_SORT_H__
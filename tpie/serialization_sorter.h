@@ -20,15 +20,26 @@
 #ifndef TPIE_SERIALIZATION_SORTER_H
 #define TPIE_SERIALIZATION_SORTER_H
 
-#include <queue>
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <vector>
 
 #include <tpie/array.h>
 #include <tpie/array_view.h>
+#include <tpie/job.h>
+#include <tpie/loser_tree.h>
 #include <tpie/tempname.h>
 #include <tpie/tpie_log.h>
 #include <tpie/stats.h>
 #include <tpie/parallel_sort.h>
+#include <tpie/radix_sort.h>
 
 #include <tpie/serialization2.h>
 #include <tpie/serialization_stream.h>
@@ -54,6 +65,8 @@ struct sort_parameters {
 	memory_size_type memoryPhase3;
 	/** Minimum size of serialized items. */
 	memory_size_type minimumItemSize;
+	/** Key ranges of the final merge; 0 to choose from the phase 3 memory. */
+	memory_size_type finalMergePartitions;
 	/** Directory in which temporary files are stored. */
 	std::string tempDir;
 
@@ -66,6 +79,7 @@ struct sort_parameters {
 			<< "Phase 3 files:               " << filesPhase3 << '\n'
 			<< "Phase 3 memory:              " << memoryPhase3 << '\n'
 			<< "Minimum item size:           " << minimumItemSize << '\n'
+			<< "Final merge partitions:      " << finalMergePartitions << '\n'
 			<< "Temporary directory:         " << tempDir << '\n';
 	}
 };
@@ -87,6 +101,24 @@ void unset_owner(memory_bucket_ref /*b*/, T & /*item*/) {}
 
 template <typename T, typename pred_t>
 class internal_sort {
+public:
+	typedef std::function<uint64_t(const T &)> key_prefix_t;
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Key prefix of an item along with its position in the buffer.
+	///////////////////////////////////////////////////////////////////////////
+	struct prefix_entry {
+		uint64_t prefix;
+		memory_size_type index;
+	};
+
+	struct prefix_key {
+		uint64_t operator()(const prefix_entry & e) const {
+			return e.prefix;
+		}
+	};
+
 	array<T> m_buffer;
 	memory_size_type m_items;
 	memory_size_type m_memForItems;
@@ -97,6 +129,8 @@ class internal_sort {
 
 	bool m_full;
 
+	key_prefix_t m_keyPrefix;
+
 	memory_bucket_ref m_buffer_bucket;
 	memory_bucket_ref m_item_bucket;
 
@@ -114,12 +148,31 @@ public:
 	{
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort by a 64-bit key prefix before consulting the predicate.
+	///
+	/// See serialization_sorter::set_key_prefix. Must be called before
+	/// begin().
+	///////////////////////////////////////////////////////////////////////////
+	void set_key_prefix(key_prefix_t keyPrefix) {
+		m_keyPrefix = keyPrefix;
+	}
+
 	void begin(memory_size_type memAvail) {
-		m_buffer.resize(memAvail / sizeof(T) / 2);
+		// With a key prefix, sort() needs two prefix entries per item,
+		// which are taken from the items' half of the memory.
+		memory_size_type keyMemory = 0;
+		if (m_keyPrefix) {
+			memory_size_type n = memAvail / 2 / (sizeof(T) + 2*sizeof(prefix_entry));
+			m_buffer.resize(n);
+			keyMemory = 2 * n * sizeof(prefix_entry);
+		} else {
+			m_buffer.resize(memAvail / sizeof(T) / 2);
+		}
 		m_items = 0;
 		m_largestItem = sizeof(T);
 		m_full = false;
-		m_memForItems = memAvail - m_buffer_bucket->count;
+		m_memForItems = memAvail - m_buffer_bucket->count - keyMemory;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -190,7 +243,10 @@ public:
 	}
 
 	void sort() {
-		parallel_sort(m_buffer.get(), m_buffer.get() + m_items, m_pred);
+		if (m_keyPrefix)
+			prefix_sort();
+		else
+			parallel_sort(m_buffer.get(), m_buffer.get() + m_items, m_pred);
 	}
 
 	const T * begin() const {
@@ -220,6 +276,123 @@ public:
 		m_items = 0;
 		m_full = false;
 	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Exchange items, buffers and memory buckets with another sorter.
+	///////////////////////////////////////////////////////////////////////////
+	void swap(internal_sort & other) {
+		m_buffer.swap(other.m_buffer);
+		std::swap(m_items, other.m_items);
+		std::swap(m_memForItems, other.m_memForItems);
+		std::swap(m_largestItem, other.m_largestItem);
+		std::swap(m_full, other.m_full);
+		std::swap(m_keyPrefix, other.m_keyPrefix);
+		std::swap(m_buffer_bucket, other.m_buffer_bucket);
+		std::swap(m_item_bucket, other.m_item_bucket);
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort the buffer by key prefix, then by predicate.
+	///
+	/// The (prefix, index) pairs are radix sorted, runs of equal prefixes are
+	/// ordered with the predicate, and the items are then moved to their
+	/// final positions by following the cycles of the permutation, so each
+	/// item is moved once.
+	///////////////////////////////////////////////////////////////////////////
+	void prefix_sort() {
+		const memory_size_type n = m_items;
+		array<prefix_entry> entries(n, m_buffer_bucket);
+		{
+			array<prefix_entry> scratch(n, m_buffer_bucket);
+			for (memory_size_type i = 0; i < n; ++i) {
+				entries[i].prefix = m_keyPrefix(m_buffer[i]);
+				entries[i].index = i;
+			}
+			parallel_radix_sort(entries.get(), entries.get() + n, scratch.get(), prefix_key());
+		}
+
+		for (memory_size_type i = 0; i < n;) {
+			memory_size_type j = i + 1;
+			while (j < n && entries[j].prefix == entries[i].prefix) ++j;
+			if (j - i > 1) {
+				std::sort(entries.get() + i, entries.get() + j,
+						  [this](const prefix_entry & a, const prefix_entry & b) {
+							  return m_pred(m_buffer[a.index], m_buffer[b.index]);
+						  });
+			}
+			i = j;
+		}
+
+		// Position i receives the item at entries[i].index. Visited
+		// positions are marked by pointing them at themselves.
+		for (memory_size_type i = 0; i < n; ++i) {
+			if (entries[i].index == i) continue;
+			T item = std::move(m_buffer[i]);
+			memory_size_type dst = i;
+			memory_size_type src = entries[i].index;
+			while (src != i) {
+				m_buffer[dst] = std::move(m_buffer[src]);
+				entries[dst].index = dst;
+				dst = src;
+				src = entries[dst].index;
+			}
+			m_buffer[dst] = std::move(item);
+			entries[dst].index = dst;
+		}
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Writer of a single sorted run.
+///
+/// Besides serializing the items, the writer remembers the offsets of about
+/// samplesPerRun items spread evenly over the run. The final merge uses them
+/// to split the runs into key ranges that are merged concurrently.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class run_writer {
+	serialization_writer m_writer;
+	std::vector<stream_size_type> m_samples;
+	stream_size_type m_sampleInterval;
+	stream_size_type m_nextSample;
+
+public:
+	static const memory_size_type samplesPerRun = 64;
+
+	run_writer()
+		: m_sampleInterval(1)
+		, m_nextSample(0)
+	{
+	}
+
+	void open(const std::string & path, stream_size_type expectedSize) {
+		m_writer.open(path);
+		m_samples.clear();
+		m_sampleInterval = expectedSize / samplesPerRun + 1;
+		m_nextSample = 0;
+	}
+
+	void write(const T & v) {
+		stream_size_type offset = m_writer.offset();
+		if (offset >= m_nextSample) {
+			m_samples.push_back(offset);
+			m_nextSample = offset + m_sampleInterval;
+		}
+		m_writer.serialize(v);
+	}
+
+	void close() {
+		m_writer.close();
+	}
+
+	stream_size_type file_size() {
+		return m_writer.file_size();
+	}
+
+	std::vector<stream_size_type> & samples() {
+		return m_samples;
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -240,22 +413,25 @@ public:
 /// We let remainingRuns := b - a, and nextLevelRuns := c - b.
 ///
 /// The tuple (remainingRuns, nextLevelRuns) has the following transitions:
-/// On open_new_writer(): (x, y) -> (x, 1+y),
-/// On open_readers(fanout): (fanout+x, y) -> (fanout+x, y),
-/// On open_readers(fanout): (0, fanout+y) -> (fanout+y, 0),
-/// On close_readers_and_delete(): (fanout+x, y) -> (x, y).
+/// On new_run() and open_new_writer(): (x, y) -> (x, 1+y),
+/// On take_runs(fanout): (fanout+x, y) -> (x, y),
+/// On take_runs(fanout): (0, fanout+y) -> (y, 0).
+///
+/// take_runs() only hands out the physical indices of the runs; the caller
+/// reads them and calls delete_run() when they are no longer needed. Every
+/// run file handed out by new_run() is deleted by reset() at the latest.
 ///
 /// ## Merge sorter usage
 ///
 /// During run formation (the first phase of merge sort), we repeatedly call
 /// open_new_writer() and close_writer() to write out runs to the disk.
 ///
-/// After run formation, we call open_readers(fanout) to advance into the first
+/// After run formation, we call take_runs(fanout) to advance into the first
 /// level of the merge heap (so one can think of run formation as a "zeroth
-/// level" in the merge heap).
+/// level" in the merge heap), and new_run() for the output of each merge.
 ///
 /// As a slight optimization, when remaining_runs() == 1, one may call
-/// move_last_reader_to_next_level() to move the remaining run into the next
+/// move_last_run_to_next_level() to move the remaining run into the next
 /// merge level without scanning through and copying the single remaining run.
 ///
 /// See serialization_sorter::merge_runs() for the logic involving
@@ -263,6 +439,13 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
 class file_handler {
+	struct run_info {
+		run_info() : fileSize(0) {}
+
+		stream_size_type fileSize;
+		std::vector<stream_size_type> samples;
+	};
+
 	// Physical index of the run file with logical index 0.
 	size_t m_fileOffset;
 	// Physical index of the run file that begins the next run.
@@ -271,22 +454,14 @@ class file_handler {
 	size_t m_nextFileOffset;
 
 	bool m_writerOpen;
-	size_t m_readersOpen;
+	run_writer<T> m_writer;
+	size_t m_writerRun;
 
-	serialization_writer m_writer;
-	stream_size_type m_currentWriterByteSize;
-
-	array<serialization_reader> m_readers;
+	// Run files that may exist on disk, by physical index.
+	std::map<size_t, run_info> m_runs;
 
 	std::string m_tempDir;
 
-	std::string run_file(size_t physicalIndex) {
-		if (m_tempDir.size() == 0) throw exception("run_file: temp dir is the empty string");
-		std::stringstream ss;
-		ss << m_tempDir << '/' << physicalIndex << ".tpie";
-		return ss.str();
-	}
-
 public:
 	file_handler()
 		: m_fileOffset(0)
@@ -294,10 +469,7 @@ public:
 		, m_nextFileOffset(0)
 
 		, m_writerOpen(false)
-		, m_readersOpen(0)
-
-		, m_writer()
-		, m_currentWriterByteSize(0)
+		, m_writerRun(0)
 	{
 	}
 
@@ -311,24 +483,61 @@ public:
 		m_tempDir = tempDir;
 	}
 
-	void open_new_writer() {
+	std::string run_file(size_t physicalIndex) const {
+		if (m_tempDir.size() == 0) throw exception("run_file: temp dir is the empty string");
+		std::stringstream ss;
+		ss << m_tempDir << '/' << physicalIndex << ".tpie";
+		return ss.str();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Allocate the physical index of a new run in the next level.
+	///////////////////////////////////////////////////////////////////////////
+	size_t new_run() {
+		size_t idx = m_nextFileOffset++;
+		m_runs[idx];
+		return idx;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Record the size and samples of a run written by a run_writer.
+	///////////////////////////////////////////////////////////////////////////
+	void run_written(size_t idx, stream_size_type fileSize, std::vector<stream_size_type> & samples) {
+		run_info & run = m_runs[idx];
+		run.fileSize = fileSize;
+		run.samples.swap(samples);
+		increase_usage(idx, fileSize);
+	}
+
+	void open_new_writer(stream_size_type expectedSize) {
 		if (m_writerOpen) throw exception("open_new_writer: Writer already open");
-		m_writer.open(run_file(m_nextFileOffset++));
-		m_currentWriterByteSize = m_writer.file_size();
+		m_writerRun = new_run();
+		m_writer.open(run_file(m_writerRun), expectedSize);
 		m_writerOpen = true;
 	}
 
 	void write(const T & v) {
 		if (!m_writerOpen) throw exception("write: No writer open");
-		m_writer.serialize(v);
+		m_writer.write(v);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Flush and close the run file of the open writer.
+	///
+	/// Unlike the rest of file_handler, this may be called from a job while
+	/// the owning thread does not use the file_handler; close_writer() must
+	/// still be called afterwards.
+	///////////////////////////////////////////////////////////////////////////
+	void flush_writer() {
+		if (!m_writerOpen) throw exception("flush_writer: No writer open");
+		m_writer.close();
 	}
 
 	void close_writer() {
 		if (!m_writerOpen) throw exception("close_writer: No writer open");
-		m_writer.close();
-		stream_size_type sz = m_writer.file_size();
-		increase_usage(m_nextFileOffset-1, static_cast<stream_offset_type>(sz));
 		m_writerOpen = false;
+		m_writer.close();
+		run_written(m_writerRun, m_writer.file_size(), m_writer.samples());
 	}
 
 	size_t remaining_runs() {
@@ -339,77 +548,62 @@ public:
 		return m_nextFileOffset - m_nextLevelFileOffset;
 	}
 
-	bool readers_open() {
-		return m_readersOpen > 0;
+	stream_size_type next_level_size() {
+		stream_size_type size = 0;
+		for (size_t i = m_nextLevelFileOffset; i < m_nextFileOffset; ++i) {
+			typename std::map<size_t, run_info>::iterator r = m_runs.find(i);
+			if (r != m_runs.end()) size += r->second.fileSize;
+		}
+		return size;
 	}
 
-	void open_readers(size_t fanout) {
-		if (m_readersOpen != 0) throw exception("open_readers: readers already open");
-		if (fanout == 0) throw exception("open_readers: fanout == 0");
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take the next fanout runs of the current level for merging.
+	///
+	/// \returns The physical index of the first run taken.
+	///////////////////////////////////////////////////////////////////////////
+	size_t take_runs(size_t fanout) {
+		if (fanout == 0) throw exception("take_runs: fanout == 0");
 		if (remaining_runs() == 0) {
 			if (m_writerOpen) throw exception("Writer open while moving to next merge level");
 			m_nextLevelFileOffset = m_nextFileOffset;
 		}
-		if (fanout > remaining_runs()) throw exception("open_readers: fanout out of bounds");
+		if (fanout > remaining_runs()) throw exception("take_runs: fanout out of bounds");
 
-		if (m_readers.size() < fanout) m_readers.resize(fanout);
-		for (size_t i = 0; i < fanout; ++i) {
-			m_readers[i].open(run_file(m_fileOffset + i));
-		}
-		m_readersOpen = fanout;
+		size_t first = m_fileOffset;
+		m_fileOffset += fanout;
+		return first;
 	}
 
-	bool can_read(size_t idx) {
-		if (m_readersOpen == 0) throw exception("can_read: no readers open");
-		if (m_readersOpen < idx) throw exception("can_read: index out of bounds");
-		return m_readers[idx].can_read();
+	void move_last_run_to_next_level() {
+		if (remaining_runs() != 1)
+			throw exception("move_last_run_to_next_level: remaining_runs != 1");
+		m_nextLevelFileOffset = m_fileOffset;
 	}
 
-	T read(size_t idx) {
-		if (m_readersOpen == 0) throw exception("read: no readers open");
-		if (m_readersOpen < idx) throw exception("read: index out of bounds");
-		T res;
-		m_readers[idx].unserialize(res);
-		return res;
+	stream_size_type file_size(size_t idx) {
+		return m_runs[idx].fileSize;
 	}
 
-	void close_readers_and_delete() {
-		if (m_readersOpen == 0) throw exception("close_readers_and_delete: no readers open");
-
-		for (size_t i = 0; i < m_readersOpen; ++i) {
-			decrease_usage(m_fileOffset + i, m_readers[i].file_size());
-			m_readers[i].close();
-			boost::filesystem::remove(run_file(m_fileOffset + i));
-		}
-		m_fileOffset += m_readersOpen;
-		m_readersOpen = 0;
+	const std::vector<stream_size_type> & samples(size_t idx) {
+		return m_runs[idx].samples;
 	}
 
-	void move_last_reader_to_next_level() {
-		if (remaining_runs() != 1)
-			throw exception("move_last_reader_to_next_level: remaining_runs != 1");
-		m_nextLevelFileOffset = m_fileOffset;
+	void delete_run(size_t idx) {
+		typename std::map<size_t, run_info>::iterator i = m_runs.find(idx);
+		if (i == m_runs.end()) return;
+		decrease_usage(idx, i->second.fileSize);
+		boost::filesystem::remove(run_file(idx));
+		m_runs.erase(i);
 	}
 
 	void reset() {
-		if (m_readersOpen > 0) {
-			log_debug() << "reset: Close readers" << std::endl;
-			close_readers_and_delete();
-		}
-		m_readers.resize(0);
 		if (m_writerOpen) {
 			log_debug() << "reset: Close writer" << std::endl;
 			close_writer();
 		}
-		log_debug() << "Remove " << m_fileOffset << " through " << m_nextFileOffset << std::endl;
-		for (size_t i = m_fileOffset; i < m_nextFileOffset; ++i) {
-			std::string runFile = run_file(i);
-			serialization_reader rd;
-			rd.open(runFile);
-			decrease_usage(i, rd.file_size());
-			rd.close();
-			boost::filesystem::remove(runFile);
-		}
+		log_debug() << "Remove " << m_runs.size() << " run files" << std::endl;
+		while (!m_runs.empty()) delete_run(m_runs.begin()->first);
 		m_fileOffset = m_nextLevelFileOffset = m_nextFileOffset = 0;
 	}
 
@@ -425,78 +619,233 @@ private:
 	}
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Merge the items of several run files, or of a byte range of each.
+///////////////////////////////////////////////////////////////////////////////
 template <typename T, typename pred_t>
 class merger {
-	class mergepred_t {
-		pred_t m_pred;
+	array<serialization_reader> m_readers;
+	array<stream_size_type> m_ends;
+	loser_tree<T, pred_t> m_tree;
 
-	public:
-		typedef std::pair<T, size_t> item_type;
+public:
+	merger(const pred_t & pred)
+		: m_tree(pred)
+	{
+	}
 
-		mergepred_t(const pred_t & pred) : m_pred(pred) {}
+	// Prepare for merging fanout runs, which must then be opened.
+	void init(size_t fanout) {
+		m_readers.resize(fanout);
+		m_ends.resize(fanout);
+		m_tree.resize(fanout);
+	}
 
-		// Used with std::priority_queue, so invert the original relation.
-		bool operator()(const item_type & a, const item_type & b) const {
-			return m_pred(b.first, a.first);
+	// Read the items of the given run file from offset begin up to end.
+	void open(size_t idx, const std::string & path,
+			  stream_size_type begin = 0,
+			  stream_size_type end = std::numeric_limits<stream_size_type>::max()) {
+		m_readers[idx].open(path);
+		if (begin != 0) m_readers[idx].seek(begin);
+		m_ends[idx] = end;
+	}
+
+	// Read the first item of every run; call after opening all of them.
+	void make_safe() {
+		for (size_t i = 0; i < m_readers.size(); ++i) {
+			if (can_read(i)) m_tree.unsafe_set(i, read(i));
 		}
-	};
+		m_tree.make_safe();
+	}
+
+	bool empty() const {
+		return m_tree.empty();
+	}
 
-	typedef typename mergepred_t::item_type item_type;
+	const T & top() const {
+		return m_tree.top();
+	}
 
-	file_handler<T> & files;
-	pred_t pred;
-	std::vector<serialization_reader> rd;
-	typedef std::priority_queue<item_type, std::vector<item_type>, mergepred_t> priority_queue_type;
-	priority_queue_type pq;
+	void pop() {
+		size_t idx = m_tree.top_run();
+		if (can_read(idx)) {
+			m_tree.pop_and_push(read(idx));
+		} else {
+			m_tree.pop();
+		}
+	}
 
+	void free() {
+		for (size_t i = 0; i < m_readers.size(); ++i) m_readers[i].close();
+		m_readers.resize(0);
+		m_ends.resize(0);
+		m_tree.clear();
+	}
+
+private:
+	bool can_read(size_t idx) {
+		return m_readers[idx].can_read() && m_readers[idx].offset() < m_ends[idx];
+	}
+
+	T read(size_t idx) {
+		T res;
+		m_readers[idx].unserialize(res);
+		return res;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Job merging the opened inputs of its merger into a new run file.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t>
+class merge_job : public job {
 public:
-	merger(file_handler<T> & files, const pred_t & pred)
-		: files(files)
-		, pred(pred)
-		, pq(mergepred_t(pred))
+	merge_job(const pred_t & pred)
+		: m_merger(pred)
+		, m_run(0)
+		, m_expectedSize(0)
 	{
 	}
 
-	// Assume files.open_readers(fanout) has just been called
-	void init(size_t fanout) {
-		rd.resize(fanout);
-		for (size_t i = 0; i < fanout; ++i)
-			push_from(i);
+	virtual void operator()() override {
+		try {
+			m_merger.make_safe();
+			m_out.open(m_path, m_expectedSize);
+			while (!m_merger.empty()) {
+				m_out.write(m_merger.top());
+				m_merger.pop();
+			}
+			m_out.close();
+			m_merger.free();
+		} catch (...) {
+			m_exception = std::current_exception();
+		}
 	}
 
-	bool empty() const {
-		return pq.empty();
+	merger<T, pred_t> m_merger;
+	run_writer<T> m_out;
+	size_t m_run;
+	std::string m_path;
+	stream_size_type m_expectedSize;
+	std::exception_ptr m_exception;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  A key range of the final merge.
+///
+/// As a job, it merges the start of the range into memory until the range is
+/// exhausted or the buffered items reach m_limit bytes, counting both the
+/// capacity of the item buffer and the serialized size of the items. pull()
+/// then takes the buffered items, followed by the rest of the range from the
+/// merger.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t>
+class range_job : public job {
+public:
+	typedef std::vector<T, allocator<T> > buffer_type;
+
+	range_job(const pred_t & pred)
+		: m_merger(pred)
+		, m_limit(0)
+		, m_next(0)
+	{
 	}
 
-	const T & top() const {
-		return pq.top().first;
+	virtual void operator()() override {
+		try {
+			m_merger.make_safe();
+			memory_size_type serializedBytes = 0;
+			while (!m_merger.empty()) {
+				if (m_items.size() == m_items.capacity()) {
+					// Grow the buffer ourselves so that its capacity stays
+					// within the limit.
+					memory_size_type capacity = std::max<memory_size_type>(16, 2 * m_items.capacity());
+					memory_size_type room = m_limit > serializedBytes ? m_limit - serializedBytes : 0;
+					capacity = std::min<memory_size_type>(capacity, room / sizeof(T));
+					if (capacity <= m_items.size()) break;
+					m_items.reserve(capacity);
+				}
+				serializedBytes += serialized_size(m_merger.top());
+				m_items.push_back(m_merger.top());
+				m_merger.pop();
+				if (serializedBytes + m_items.capacity() * sizeof(T) >= m_limit) break;
+			}
+		} catch (...) {
+			m_exception = std::current_exception();
+		}
 	}
 
-	void pop() {
-		size_t idx = pq.top().second;
-		pq.pop();
-		push_from(idx);
+	bool empty() const {
+		return m_next == m_items.size() && m_merger.empty();
+	}
+
+	T pop() {
+		if (m_next < m_items.size()) return std::move(m_items[m_next++]);
+		T item = m_merger.top();
+		m_merger.pop();
+		return item;
 	}
 
-	// files.close_readers_and_delete() should be called after this
 	void free() {
-		{
-			priority_queue_type tmp(pred);
-			std::swap(pq, tmp);
-		}
-		rd.resize(0);
+		m_merger.free();
+		buffer_type().swap(m_items);
+		m_next = 0;
 	}
 
-private:
-	void push_from(size_t idx) {
-		if (files.can_read(idx)) {
-			pq.push(std::make_pair(files.read(idx), idx));
+	merger<T, pred_t> m_merger;
+	buffer_type m_items;
+	memory_size_type m_limit;
+	size_t m_next;
+	std::exception_ptr m_exception;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Job writing a sorted buffer to the open writer of a file_handler.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t>
+class run_job : public job {
+public:
+	run_job(file_handler<T> & files)
+		: m_files(files)
+		, m_sorter(0)
+	{
+	}
+
+	virtual void operator()() override {
+		try {
+			for (const T * item = m_sorter->begin(); item != m_sorter->end(); ++item) {
+				m_files.write(*item);
+			}
+			m_files.flush_writer();
+		} catch (...) {
+			m_exception = std::current_exception();
 		}
 	}
+
+	file_handler<T> & m_files;
+	const internal_sort<T, pred_t> * m_sorter;
+	std::exception_ptr m_exception;
 };
 
 } // namespace serialization_bits
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Key prefix of a string for serialization_sorter::set_key_prefix.
+///
+/// The first eight bytes of the string as a big-endian integer, padded with
+/// zero bytes, which is consistent with std::less<std::string>.
+///////////////////////////////////////////////////////////////////////////////
+struct string_key_prefix {
+	uint64_t operator()(const std::string & s) const {
+		uint64_t prefix = 0;
+		for (size_t i = 0; i < 8; ++i) {
+			prefix <<= 8;
+			if (i < s.size()) prefix |= static_cast<unsigned char>(s[i]);
+		}
+		return prefix;
+	}
+};
+
 template <typename T, typename pred_t = std::less<T> >
 class serialization_sorter {
 public:
@@ -509,19 +858,49 @@ private:
 	memory_bucket_ref m_buffer_bucket;
 	std::unique_ptr<memory_bucket> m_item_bucket_ptr;
 	memory_bucket_ref m_item_bucket;
+	std::unique_ptr<memory_bucket> m_spare_buffer_bucket_ptr;
+	memory_bucket_ref m_spare_buffer_bucket;
+	std::unique_ptr<memory_bucket> m_spare_item_bucket_ptr;
+	memory_bucket_ref m_spare_item_bucket;
 	pipelining::node * m_owning_node;
 
+	typedef serialization_bits::merge_job<T, pred_t> merge_job_t;
+	typedef serialization_bits::range_job<T, pred_t> range_job_t;
+
 	sorter_state m_state;
+	pred_t m_pred;
 	serialization_bits::internal_sort<T, pred_t> m_sorter;
+	// Once the first run is written, runs are formed in m_sorter and
+	// m_spareSorter in turn, and each run is written by m_runJob while
+	// the next one is being filled.
+	serialization_bits::internal_sort<T, pred_t> m_spareSorter;
+	bool m_doubleBuffered;
 	serialization_bits::sort_parameters m_params;
 	bool m_parametersSet;
 	serialization_bits::file_handler<T> m_files;
-	serialization_bits::merger<T, pred_t> m_merger;
+	serialization_bits::run_job<T, pred_t> m_runJob;
+	bool m_runJobPending;
 
 	stream_size_type m_items;
+	memory_size_type m_largestItem;
 	bool m_reportInternal;
 	const T * m_nextInternalItem;
 
+	// The final merge is split into m_finalPartitions key ranges, which
+	// pull() merges in order. While m_range is pulled, m_nextRange merges the
+	// start of the next range into memory, up to m_prefetchBytes.
+	memory_size_type m_finalPartitions;
+	memory_size_type m_prefetchBytes;
+	bool m_finalStarted;
+	size_t m_finalFirstRun;
+	size_t m_finalRuns;
+	std::vector<stream_size_type> m_bounds;
+	size_t m_partitions;
+	size_t m_nextPartition;
+	tpie::unique_ptr<range_job_t> m_range;
+	tpie::unique_ptr<range_job_t> m_nextRange;
+	bool m_prefetching;
+
 	static const memory_size_type defaultFiles = 253; // Default number of files available, when not using set_available_files
 	static const memory_size_type minimumFilesPhase1 = 1;
 	static const memory_size_type maximumFilesPhase1 = 1;
@@ -538,15 +917,32 @@ public:
 		, m_buffer_bucket(memory_bucket_ref(m_buffer_bucket_ptr.get()))
 		, m_item_bucket_ptr(new memory_bucket())
 		, m_item_bucket(memory_bucket_ref(m_item_bucket_ptr.get()))
+		, m_spare_buffer_bucket_ptr(new memory_bucket())
+		, m_spare_buffer_bucket(memory_bucket_ref(m_spare_buffer_bucket_ptr.get()))
+		, m_spare_item_bucket_ptr(new memory_bucket())
+		, m_spare_item_bucket(memory_bucket_ref(m_spare_item_bucket_ptr.get()))
 		, m_owning_node(nullptr)
 		, m_state(state_initial)
+		, m_pred(pred)
 		, m_sorter(m_buffer_bucket, m_item_bucket, pred)
+		, m_spareSorter(m_spare_buffer_bucket, m_spare_item_bucket, pred)
+		, m_doubleBuffered(false)
 		, m_parametersSet(false)
 		, m_files()
-		, m_merger(m_files, pred)
+		, m_runJob(m_files)
+		, m_runJobPending(false)
 		, m_items(0)
+		, m_largestItem(0)
 		, m_reportInternal(false)
 		, m_nextInternalItem(0)
+		, m_finalPartitions(1)
+		, m_prefetchBytes(0)
+		, m_finalStarted(false)
+		, m_finalFirstRun(0)
+		, m_finalRuns(0)
+		, m_partitions(0)
+		, m_nextPartition(0)
+		, m_prefetching(false)
 	{
 		m_params.filesPhase1 = 0;
 		m_params.filesPhase2 = 0;
@@ -555,6 +951,13 @@ public:
 		m_params.memoryPhase2 = 0;
 		m_params.memoryPhase3 = 0;
 		m_params.minimumItemSize = minimumItemSize;
+		m_params.finalMergePartitions = 0;
+	}
+
+	~serialization_sorter() {
+		// Jobs must not outlive the run files they use.
+		m_runJob.join();
+		if (m_prefetching) m_nextRange->join();
 	}
 
 private:
@@ -618,6 +1021,39 @@ public:
 		check_not_started();
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the number of key ranges the final merge is split into.
+	///
+	/// The ranges are pulled in order. While one range is pulled, a job
+	/// merges the start of the next one into the phase 3 memory left over by
+	/// the two mergers, so the final merge writes no temporary files. If the
+	/// phase 3 memory or files do not allow a second merger, the final merge
+	/// is not split. The default, 0, picks ranges small enough to be merged
+	/// ahead entirely, and 1 disables the split.
+	///////////////////////////////////////////////////////////////////////////
+	void set_final_merge_partitions(memory_size_type p) {
+		m_params.finalMergePartitions = p;
+		check_not_started();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Form runs by sorting on a binary key prefix.
+	///
+	/// keyPrefix maps an item to an unsigned 64-bit integer such that
+	/// keyPrefix(a) < keyPrefix(b) implies pred(a, b) for all items a and b.
+	/// Runs are then formed by radix sorting the prefixes, consulting the
+	/// predicate only for items with equal prefixes, and moving every item
+	/// once. This pays off when the predicate is expensive, for instance on
+	/// strings, and most prefixes are distinct. The prefixes take 32 bytes
+	/// per buffered item out of the phase 1 memory.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename F>
+	void set_key_prefix(F keyPrefix) {
+		check_not_started();
+		m_sorter.set_key_prefix(keyPrefix);
+		m_spareSorter.set_key_prefix(keyPrefix);
+	}
+
 	void set_available_memory(memory_size_type m) {
 		set_phase_1_memory(m);
 		set_phase_2_memory(m);
@@ -648,19 +1084,25 @@ public:
 			throw tpie::exception("Bad state in actualy_memory_phase_3");
 		if (m_reportInternal)
 			return m_sorter.memory_usage();
-		else
-			return m_files.next_level_runs() * (m_sorter.get_largest_item_size() + serialization_reader::memory_usage());
+		memory_size_type perPartition = m_files.next_level_runs() * (largest_item_size() + serialization_reader::memory_usage());
+		if (m_finalPartitions <= 1)
+			return perPartition;
+		return 2 * perPartition + m_prefetchBytes;
 	}
 
 	void set_owner(pipelining::node * n) {
 		if (m_owning_node != nullptr) {
 			m_buffer_bucket_ptr = std::move(m_owning_node->bucket(0));
 			m_item_bucket_ptr = std::move(m_owning_node->bucket(1));
+			m_spare_buffer_bucket_ptr = std::move(m_owning_node->bucket(2));
+			m_spare_item_bucket_ptr = std::move(m_owning_node->bucket(3));
 		}
 
 		if (n != nullptr) {
 			n->bucket(0) = std::move(m_buffer_bucket_ptr);
 			n->bucket(1) = std::move(m_item_bucket_ptr);
+			n->bucket(2) = std::move(m_spare_buffer_bucket_ptr);
+			n->bucket(3) = std::move(m_spare_item_bucket_ptr);
 		}
 
 		m_owning_node = n;
@@ -775,6 +1217,7 @@ public:
 
 		if (m_sorter.push(item)) return;
 		end_run();
+		if (!m_doubleBuffered) start_double_buffering();
 		if (!m_sorter.push(item)) {
 			throw exception("Couldn't fit a single item in buffer");
 		}
@@ -818,9 +1261,12 @@ public:
 		} else {
 
 			end_run();
+			finish_run_job();
 			log_debug() << "Got " << m_files.next_level_runs() << " runs. "
 				<< "External reporting mode." << std::endl;
 			m_sorter.free();
+			m_spareSorter.free();
+			m_doubleBuffered = false;
 			m_reportInternal = false;
 		}
 
@@ -864,7 +1310,7 @@ public:
 			throw tpie::exception("Bad state in end");
 		if (m_reportInternal) return true;
 
-		memory_size_type largestItem = m_sorter.get_largest_item_size();
+		memory_size_type largestItem = largest_item_size();
 		memory_size_type fanoutMemory = m_params.memoryPhase2 - serialization_writer::memory_usage();
 		memory_size_type perFanout = largestItem + serialization_reader::memory_usage();
 		memory_size_type fanout = std::min(m_params.filesPhase2 - 1, fanoutMemory / perFanout);
@@ -886,7 +1332,7 @@ public:
 			return;
 		}
 
-		memory_size_type largestItem = m_sorter.get_largest_item_size();
+		memory_size_type largestItem = largest_item_size();
 		if (largestItem == 0) {
 			log_warning() << "Largest item is 0 bytes; doing nothing." << std::endl;
 			m_state = state_3;
@@ -932,24 +1378,47 @@ public:
 		while (m_files.next_level_runs() > finalFanout) {
 			if (m_files.remaining_runs() != 0)
 				throw exception("m_files.remaining_runs() != 0");
-			log_debug() << "Runs in current level: " << m_files.next_level_runs() << '\n';
-			for (size_t remainingRuns = m_files.next_level_runs(); remainingRuns > 0;) {
-				size_t f = std::min(fanout, remainingRuns);
-				merge_runs(f);
+			size_t runCount = m_files.next_level_runs();
+			memory_size_type levelFanout = level_fanout(runCount, fanout, finalFanout);
+			size_t merges = (runCount + levelFanout - 1) / levelFanout;
+			memory_size_type parallelism = merge_parallelism(levelFanout, merges, perFanout);
+			log_debug() << "Runs in current level: " << runCount
+				<< ", fanout " << levelFanout << ", "
+				<< parallelism << " merges at a time" << '\n';
+			for (size_t remainingRuns = runCount; remainingRuns > 0;) {
+				size_t f = std::min(levelFanout * parallelism, remainingRuns);
+				merge_runs(levelFanout, f);
 				remainingRuns -= f;
 				if (remainingRuns != m_files.remaining_runs())
 					throw exception("remainingRuns != m_files.remaining_runs()");
 			}
 		}
 
+		m_finalPartitions = final_partitions(perFanout);
+		log_debug() << "Final merge of " << m_files.next_level_runs() << " runs in "
+			<< m_finalPartitions << " partitions" << std::endl;
+
 		m_state = state_3;
 	}
 
 private:
+	memory_size_type largest_item_size() {
+		return std::max(m_largestItem, m_sorter.get_largest_item_size());
+	}
+
 	void end_run() {
+		finish_run_job();
 		m_sorter.sort();
 		if (m_sorter.begin() == m_sorter.end()) return;
-		m_files.open_new_writer();
+		m_largestItem = std::max(m_largestItem, m_sorter.get_largest_item_size());
+		m_files.open_new_writer(m_sorter.current_serialized_size());
+		if (m_doubleBuffered) {
+			m_sorter.swap(m_spareSorter);
+			m_runJob.m_sorter = &m_spareSorter;
+			m_runJob.enqueue();
+			m_runJobPending = true;
+			return;
+		}
 		for (const T * item = m_sorter.begin(); item != m_sorter.end(); ++item) {
 			m_files.write(*item);
 		}
@@ -957,33 +1426,294 @@ private:
 		m_sorter.reset();
 	}
 
-	void initialize_merger(size_t fanout) {
-		if (fanout == 0) throw exception("initialize_merger: fanout == 0");
-		m_files.open_readers(fanout);
-		m_merger.init(fanout);
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the run being written in the background, if any.
+	///////////////////////////////////////////////////////////////////////////
+	void finish_run_job() {
+		if (!m_runJobPending) return;
+		m_runJob.join();
+		m_runJobPending = false;
+		std::exception_ptr e = m_runJob.m_exception;
+		m_runJob.m_exception = std::exception_ptr();
+		if (e) std::rethrow_exception(e);
+		m_files.close_writer();
+		m_spareSorter.reset();
 	}
 
-	void free_merger_and_files() {
-		m_merger.free();
-		m_files.close_readers_and_delete();
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Split the run formation memory between two buffers, so a run
+	/// can be written while the next one is filled.
+	///
+	/// Only done once a run has been written, so inputs that fit in memory
+	/// are still reported internally.
+	///////////////////////////////////////////////////////////////////////////
+	void start_double_buffering() {
+		memory_size_type memAvail = m_params.memoryPhase1 - serialization_writer::memory_usage();
+		// Each buffer should hold at least a block of serialized items.
+		if (memAvail / 2 < serialization_writer::memory_usage()) return;
+		log_debug() << "Double buffering run formation with "
+			<< memAvail / 2 << " bytes per buffer" << std::endl;
+		m_sorter.begin(memAvail / 2);
+		m_spareSorter.begin(memAvail / 2);
+		m_doubleBuffered = true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The fanout to merge the given number of runs with.
+	///
+	/// Picks the smallest fanout that needs no more merge levels than
+	/// merging with the maximal fanout would, which leaves room for merging
+	/// several groups at a time.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type level_fanout(size_t runCount, memory_size_type fanout, memory_size_type finalFanout) {
+		// After this level and levels-1 more, at most finalFanout runs remain.
+		memory_size_type levels = 1;
+		stream_size_type capacity = finalFanout;
+		while (runCount > capacity * fanout) {
+			capacity *= fanout;
+			++levels;
+		}
+		memory_size_type lo = static_cast<memory_size_type>((runCount + capacity - 1) / capacity);
+		memory_size_type balanced = static_cast<memory_size_type>(std::ceil(
+			std::pow(static_cast<double>(runCount) / finalFanout, 1.0 / levels)));
+		return clamp(2, std::max(lo, balanced), fanout);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The number of merges with the given fanout to run at a time
+	/// within the phase 2 memory and file limits.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type merge_parallelism(memory_size_type fanout, size_t merges, memory_size_type perFanout) {
+		memory_size_type perMerge = fanout * perFanout + serialization_writer::memory_usage();
+		memory_size_type k = m_params.memoryPhase2 / perMerge;
+		k = std::min(k, m_params.filesPhase2 / (fanout + 1));
+		k = std::min(k, default_worker_count() + 1);
+		k = std::min(k, static_cast<memory_size_type>(merges));
+		return std::max(k, static_cast<memory_size_type>(1));
 	}
 
-	void merge_runs(size_t fanout) {
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The number of key ranges to split the final merge into, and
+	/// the memory for merging the next range ahead.
+	///
+	/// Splitting needs a second merger within the phase 3 memory and file
+	/// limits, and at least a block of memory left over for the items merged
+	/// ahead.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type final_partitions(memory_size_type perFanout) {
+		m_prefetchBytes = 0;
+		memory_size_type runs = m_files.next_level_runs();
+		memory_size_type p = m_params.finalMergePartitions;
+		if (p == 0 && default_worker_count() == 0) return 1;
+		if (p == 1 || runs <= 1) return 1;
+		memory_size_type mergers = 2 * runs * perFanout;
+		if (m_params.memoryPhase3 < mergers + serialization_writer::memory_usage()
+			|| m_params.filesPhase3 < 2 * runs)
+			return 1;
+		m_prefetchBytes = m_params.memoryPhase3 - mergers;
+		if (p == 0) {
+			// Ranges of about half the memory for the items merged ahead,
+			// which also hold the unserialized items. Finer ranges than the
+			// samples of a run cannot be told apart.
+			stream_size_type bytes = m_files.next_level_size();
+			const stream_size_type samples = serialization_bits::run_writer<T>::samplesPerRun;
+			p = static_cast<memory_size_type>(std::min(2 * bytes / m_prefetchBytes + 2, samples));
+		}
+		return p;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Merge the next runs of the current level in groups of fanout,
+	/// running the merges concurrently.
+	///////////////////////////////////////////////////////////////////////////
+	void merge_runs(size_t fanout, size_t runs) {
 		if (fanout == 0) throw exception("merge_runs: fanout == 0");
 
-		if (fanout == 1 && m_files.remaining_runs() == 1) {
-			m_files.move_last_reader_to_next_level();
-			return;
+		size_t merges = (runs + fanout - 1) / fanout;
+		array<tpie::unique_ptr<merge_job_t> > jobs(merges);
+		array<size_t> firstRun(merges);
+		array<size_t> runCount(merges);
+		size_t started = 0;
+		for (size_t m = 0; m < merges; ++m) {
+			size_t f = std::min(fanout, runs - m * fanout);
+			if (f == 1 && m_files.remaining_runs() == 1) {
+				m_files.move_last_run_to_next_level();
+				continue;
+			}
+			merge_job_t * j = tpie_new<merge_job_t>(m_pred);
+			jobs[started].reset(j);
+			firstRun[started] = m_files.take_runs(f);
+			runCount[started] = f;
+			j->m_merger.init(f);
+			for (size_t i = 0; i < f; ++i) {
+				j->m_merger.open(i, m_files.run_file(firstRun[started] + i));
+				j->m_expectedSize += m_files.file_size(firstRun[started] + i);
+			}
+			j->m_run = m_files.new_run();
+			j->m_path = m_files.run_file(j->m_run);
+			++started;
 		}
 
-		initialize_merger(fanout);
-		m_files.open_new_writer();
-		while (!m_merger.empty()) {
-			m_files.write(m_merger.top());
-			m_merger.pop();
+		if (started == 1) {
+			(*jobs[0])();
+		} else {
+			for (size_t m = 0; m < started; ++m) jobs[m]->enqueue();
+			for (size_t m = 0; m < started; ++m) jobs[m]->join();
 		}
-		free_merger_and_files();
-		m_files.close_writer();
+
+		for (size_t m = 0; m < started; ++m) {
+			if (jobs[m]->m_exception) std::rethrow_exception(jobs[m]->m_exception);
+		}
+		for (size_t m = 0; m < started; ++m) {
+			m_files.run_written(jobs[m]->m_run, jobs[m]->m_out.file_size(), jobs[m]->m_out.samples());
+			for (size_t i = 0; i < runCount[m]; ++i) m_files.delete_run(firstRun[m] + i);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Split the runs of the final merge into key ranges.
+	///
+	/// The splitters are chosen among sampled items of the runs, so the
+	/// ranges hold roughly the same number of bytes. On return,
+	/// bounds[r*(k+1)+i] is the offset in run r of the first item of range i,
+	/// where k is the returned number of ranges.
+	///////////////////////////////////////////////////////////////////////////
+	size_t partition_runs(std::vector<stream_size_type> & bounds) {
+		const size_t runs = m_finalRuns;
+		std::vector<T> keys;
+		std::vector<stream_size_type> offsets;
+		std::vector<size_t> firstKey(runs + 1, 0);
+		serialization_reader rd;
+		if (m_finalPartitions > 1) {
+			size_t samples = 0;
+			for (size_t r = 0; r < runs; ++r)
+				samples += m_files.samples(m_finalFirstRun + r).size();
+			// Keep about as many sampled items in memory as the merges do.
+			size_t stride = samples / (runs * m_finalPartitions) + 1;
+			for (size_t r = 0; r < runs; ++r) {
+				const std::vector<stream_size_type> & s = m_files.samples(m_finalFirstRun + r);
+				rd.open(m_files.run_file(m_finalFirstRun + r));
+				for (size_t i = 0; i < s.size(); i += stride) {
+					rd.seek(s[i]);
+					keys.push_back(T());
+					rd.unserialize(keys.back());
+					offsets.push_back(s[i]);
+				}
+				rd.close();
+				firstKey[r + 1] = keys.size();
+			}
+		}
+
+		std::vector<T> splitters;
+		if (!keys.empty()) {
+			std::vector<size_t> order(keys.size());
+			std::iota(order.begin(), order.end(), static_cast<size_t>(0));
+			std::sort(order.begin(), order.end(),
+					  [this, &keys](size_t a, size_t b) { return m_pred(keys[a], keys[b]); });
+			for (size_t p = 1; p < m_finalPartitions; ++p) {
+				const T & k = keys[order[p * order.size() / m_finalPartitions]];
+				if (splitters.empty() || m_pred(splitters.back(), k)) splitters.push_back(k);
+			}
+		}
+
+		const size_t partitions = splitters.size() + 1;
+		bounds.resize(runs * (partitions + 1));
+		for (size_t r = 0; r < runs; ++r) {
+			stream_size_type * b = &bounds[r * (partitions + 1)];
+			b[0] = 0;
+			b[partitions] = std::numeric_limits<stream_size_type>::max();
+			if (partitions == 1) continue;
+			rd.open(m_files.run_file(m_finalFirstRun + r));
+			for (size_t p = 1; p < partitions; ++p) {
+				// Every item before the last sampled item that precedes the
+				// splitter belongs to an earlier range. The sampled items of
+				// a run are sorted, so it is found by binary search.
+				size_t i = std::lower_bound(keys.begin() + firstKey[r], keys.begin() + firstKey[r + 1],
+											splitters[p - 1], m_pred) - keys.begin();
+				stream_size_type offset = b[p - 1];
+				if (i > firstKey[r]) offset = std::max(offset, offsets[i - 1]);
+				b[p] = lower_bound_offset(rd, offset, splitters[p - 1]);
+			}
+			rd.close();
+		}
+		return partitions;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The offset of the first item not less than the splitter,
+	/// scanning from an offset where all earlier items are less.
+	///
+	/// The scan starts at the preceding loaded sample, so it reads at most the
+	/// items between two loaded samples of the run.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type lower_bound_offset(serialization_reader & rd, stream_size_type offset, const T & splitter) {
+		rd.seek(offset);
+		T item;
+		while (rd.can_read()) {
+			offset = rd.offset();
+			rd.unserialize(item);
+			if (!m_pred(item, splitter)) return offset;
+		}
+		return rd.offset();
+	}
+
+	void open_partition(serialization_bits::merger<T, pred_t> & m, size_t p) {
+		m.init(m_finalRuns);
+		for (size_t r = 0; r < m_finalRuns; ++r) {
+			const stream_size_type * b = &m_bounds[r * (m_partitions + 1)];
+			m.open(r, m_files.run_file(m_finalFirstRun + r), b[p], b[p + 1]);
+		}
+	}
+
+	void start_final_merge() {
+		if (m_files.next_level_runs() == 0)
+			throw exception("pull: next_level_runs == 0");
+		m_finalRuns = m_files.next_level_runs();
+		m_finalFirstRun = m_files.take_runs(m_finalRuns);
+		m_finalStarted = true;
+
+		m_partitions = partition_runs(m_bounds);
+		log_debug() << "Final merge split into " << m_partitions << " key ranges" << std::endl;
+
+		m_range.reset(tpie_new<range_job_t>(m_pred));
+		if (m_partitions > 1) m_nextRange.reset(tpie_new<range_job_t>(m_pred));
+		open_partition(m_range->m_merger, 0);
+		m_range->m_merger.make_safe();
+		m_nextPartition = 1;
+		prefetch_next_partition();
+		if (m_range->empty()) next_partition();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Start merging the next key range ahead, if any.
+	///////////////////////////////////////////////////////////////////////////
+	void prefetch_next_partition() {
+		if (m_nextPartition == m_partitions) return;
+		open_partition(m_nextRange->m_merger, m_nextPartition++);
+		m_nextRange->m_limit = m_prefetchBytes;
+		m_nextRange->enqueue();
+		m_prefetching = true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Continue the final merge with the next nonempty key range.
+	///////////////////////////////////////////////////////////////////////////
+	void next_partition() {
+		m_range->free();
+		while (m_prefetching) {
+			m_nextRange->join();
+			m_prefetching = false;
+			std::exception_ptr e = m_nextRange->m_exception;
+			m_nextRange->m_exception = std::exception_ptr();
+			if (e) std::rethrow_exception(e);
+			std::swap(m_range, m_nextRange);
+			prefetch_next_partition();
+			if (!m_range->empty()) return;
+			m_range->free();
+		}
+		m_range.reset();
+		m_nextRange.reset();
+		m_files.reset();
 	}
 
 public:
@@ -1000,27 +1730,19 @@ public:
 			return item;
 		}
 
-		if (!m_files.readers_open()) {
-			if (m_files.next_level_runs() == 0)
-				throw exception("pull: next_level_runs == 0");
-			initialize_merger(m_files.next_level_runs());
-		}
+		if (!m_finalStarted) start_final_merge();
 
-		T item = m_merger.top();
-		m_merger.pop();
+		T item = m_range->pop();
 
-		if (m_merger.empty()) {
-			free_merger_and_files();
-			m_files.reset();
-		}
+		if (m_range->empty()) next_partition();
 
 		return item;
 	}
 
 	bool can_pull() {
 		if (m_reportInternal) return m_nextInternalItem != 0;
-		if (!m_files.readers_open()) return m_files.next_level_runs() > 0;
-		return !m_merger.empty();
+		if (!m_finalStarted) return m_files.next_level_runs() > 0;
+		return m_range.get() != 0 && !m_range->empty();
 	}
 };
 
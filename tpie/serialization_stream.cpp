@@ -53,8 +53,7 @@ public:
 	}
 
 	void read() {
-		m_fileAccessor.seek_i(0);
-		m_fileAccessor.read_i(&m_header, sizeof(m_header));
+		m_fileAccessor.read_at_i(&m_header, sizeof(m_header), 0);
 	}
 
 	void write(bool cleanClose) {
@@ -66,8 +65,7 @@ public:
 		std::copy(headerData, sizeof(m_header) + headerData,
 				  headerArea.begin());
 
-		m_fileAccessor.seek_i(0);
-		m_fileAccessor.write_i(&headerArea[0], headerArea.size());
+		m_fileAccessor.write_at_i(&headerArea[0], headerArea.size(), 0);
 	}
 
 	void verify() {
@@ -199,8 +197,7 @@ void serialization_writer_base::open(temp_file & tempFile, bool reverse) {
 void serialization_writer_base::write_block(const char * const s, const memory_size_type n) {
 	assert(n <= block_size());
 	stream_size_type offset = m_blocksWritten * block_size();
-	m_fileAccessor.seek_i(bits::serialization_header::header_size() + offset);
-	m_fileAccessor.write_i(s, n);
+	m_fileAccessor.write_at_i(s, n, bits::serialization_header::header_size() + offset);
 	++m_blocksWritten;
 	m_size = offset + n;
 	if (m_tempFile)
@@ -257,6 +254,11 @@ void serialization_writer::close() {
 	p_t::close(false);
 }
 
+stream_size_type serialization_writer::offset() {
+	// All blocks but the one being filled are full.
+	return p_t::file_size() - bits::serialization_header::header_size() + m_index;
+}
+
 serialization_reverse_writer::serialization_reverse_writer()
 	: m_index(0)
 {
@@ -328,9 +330,8 @@ void serialization_reader_base::read_block(const stream_size_type blk) {
 	if (to <= from) throw end_of_stream_exception();
 	m_index = 0;
 	m_blockSize = to-from;
-	m_fileAccessor.seek_i(bits::serialization_header::header_size()
-						  + from);
-	m_fileAccessor.read_i(m_block.get(), m_blockSize);
+	m_fileAccessor.read_at_i(m_block.get(), m_blockSize,
+							 bits::serialization_header::header_size() + from);
 }
 
 void serialization_reader_base::close() {
@@ -380,6 +381,27 @@ stream_size_type serialization_reader::offset() {
 	return m_blockNumber * block_size() + m_index;
 }
 
+void serialization_reader::seek(stream_size_type offset) {
+	if (offset > m_size) throw stream_exception("Seek beyond end of serialization stream");
+	if (offset == 0 && m_size == 0) {
+		m_blockNumber = 0;
+		m_index = m_blockSize = 0;
+		return;
+	}
+	stream_size_type blk = offset / block_size();
+	memory_size_type idx = static_cast<memory_size_type>(offset % block_size());
+	if (blk * block_size() >= m_size) {
+		// The end of a stream whose last block is full.
+		--blk;
+		idx = block_size();
+	}
+	if (blk != m_blockNumber || m_blockSize == 0) {
+		m_blockNumber = blk;
+		read_block(blk);
+	}
+	m_index = idx;
+}
+
 void serialization_reverse_reader::next_block() /*override*/ {
 	if (m_blockNumber == 0)
 		throw end_of_stream_exception();
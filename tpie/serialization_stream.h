@@ -126,6 +126,14 @@ public:
 
 	void close();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written, not including the header.
+	///
+	/// The offset of the next item, which a serialization_reader of the same
+	/// file can seek() to.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type offset();
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Serialize a serializable item and write it to the stream.
 	///
@@ -378,6 +386,12 @@ public:
 	/// For progress reporting.
 	///////////////////////////////////////////////////////////////////////////
 	stream_size_type offset();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Continue reading at the given offset, which must be the start
+	/// of an item as reported by serialization_writer::offset() or offset().
+	///////////////////////////////////////////////////////////////////////////
+	void seek(stream_size_type offset);
 };
 
 class serialization_reverse_reader : public bits::serialization_reader_base {
@@ -27,6 +27,7 @@ namespace {
 	std::atomic<tpie::stream_size_type> temp_file_usage;
 	std::atomic<tpie::stream_size_type> bytes_read;
 	std::atomic<tpie::stream_size_type> bytes_written;
+	std::atomic<tpie::stream_size_type> bytes_direct_io;
 	std::atomic<tpie::stream_size_type> user[20];
 } // unnamed namespace
 
@@ -63,6 +64,14 @@ namespace tpie {
 		bytes_written.fetch_add(delta);
 	}
 
+	stream_size_type get_bytes_direct_io() {
+		return bytes_direct_io.load();
+	}
+
+	void increment_bytes_direct_io(stream_size_type delta) {
+		bytes_direct_io.fetch_add(delta);
+	}
+
 	stream_size_type get_user(size_t i) {
 		return (i < sizeof(user)) ? user[i].load() : 0;
 	}
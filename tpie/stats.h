@@ -61,6 +61,18 @@ namespace tpie {
 	///////////////////////////////////////////////////////////////////////////
 	void increment_bytes_written(stream_size_type delta);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the number of bytes read or written with direct I/O,
+	/// bypassing the page cache, since program start.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_direct_io();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Inform the stats module that an additional delta bytes have
+	/// been read or written with direct I/O.
+	///////////////////////////////////////////////////////////////////////////
+	void increment_bytes_direct_io(stream_size_type delta);
+
 	stream_size_type get_user(size_t i);
 	void increment_user(size_t i, stream_size_type delta);
 
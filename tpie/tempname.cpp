@@ -35,6 +35,7 @@
 #include <tpie/err.h>
 #include <tpie/file_accessor/file_accessor.h>
 #include <stack>
+#include <mutex>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -48,8 +49,11 @@ namespace {
 std::string default_path;
 std::string default_base_name = "TPIE";
 std::string default_extension;
+bool direct_io = false;
 std::stack<std::string> subdirs;
 memory_size_type file_index = 0;
+// Temporary names may be generated by concurrently running pipeline phases.
+std::mutex gen_temp_mutex;
 
 }
 
@@ -114,6 +118,7 @@ void create_subdir() {
 }
 
 std::string gen_temp(const std::string& post_base, const std::string& dir, const std::string& suffix) {
+	std::lock_guard<std::mutex> lock(gen_temp_mutex);
 	if (!dir.empty()) {
 		boost::filesystem::path p;
 		for (int i=0; i < 42; ++i) {
@@ -279,6 +284,14 @@ const std::string& tempname::get_default_extension() {
 	return default_extension;
 }
 
+void tempname::set_direct_io(bool directIO) {
+	direct_io = directIO;
+}
+
+bool tempname::get_direct_io() {
+	return direct_io;
+}
+
 namespace tpie {
 namespace bits {
 
@@ -133,6 +133,24 @@ namespace tpie {
 		///////////////////////////////////////////////////////////////////////
 		static const std::string& get_default_extension();
 
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Set whether streams on temporary files bypass the operating
+		/// system page cache for aligned block reads and writes.
+		///
+		/// Direct I/O is off by default. When enabled, the memory used by
+		/// temporary file I/O is the block buffers accounted for by the
+		/// memory manager rather than the page cache. Files on file systems
+		/// without direct I/O support fall back to buffered I/O.
+		/// The setting applies to streams opened after the call.
+		///////////////////////////////////////////////////////////////////////
+		static void set_direct_io(bool directIO);
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Get whether streams on temporary files use direct I/O.
+		/// \sa set_direct_io
+		///////////////////////////////////////////////////////////////////////
+		static bool get_direct_io();
+
 
 		///////////////////////////////////////////////////////////////////////
 		/// Return The actual path used for temporary files taking environment
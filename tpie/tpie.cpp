@@ -35,7 +35,7 @@ static tpie::memory_size_type the_block_size=0;
 
 namespace tpie {
 
-void tpie_init(flags<subsystem> subsystems) {
+void tpie_init(flags<subsystem> subsystems, memory_size_type compressorThreads) {
 	if (subsystems & FILE_MANAGER)
 	 	init_file_manager();
 
@@ -61,7 +61,7 @@ void tpie_init(flags<subsystem> subsystems) {
 
 	if (subsystems & STREAMS) {
 		init_stream_buffer_pool();
-		init_compressor();
+		init_compressor(compressorThreads);
 	}
 
 	if (subsystems & HASH)
@@ -68,8 +68,12 @@ TPIE_DECLARE_OPERATORS_FOR_FLAGS(subsystem)
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Initialize the given subsystems of TPIE.
 /// \param subsystems Logical OR of \ref subsystem entries.
+/// \param compressorThreads Number of compressor worker threads to start
+/// when initializing STREAMS, or 0 to use
+/// \ref default_compressor_thread_count.
 ///////////////////////////////////////////////////////////////////////////////
-void tpie_init(flags<subsystem> subsystems=ALL);
+void tpie_init(flags<subsystem> subsystems=ALL,
+			   memory_size_type compressorThreads=0);
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Deinitialize the given subsystems of TPIE.
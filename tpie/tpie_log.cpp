@@ -128,7 +128,7 @@ namespace log_bits {
 bool log_selector::s_init;
 log_level log_selector::s_level;
 
-std::vector<std::shared_ptr<logstream> > log_instances;
+thread_local std::vector<std::shared_ptr<logstream> > log_instances;
 
 } // namespace log_bits
 
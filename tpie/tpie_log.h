@@ -121,7 +121,8 @@ void finish_default_log();
 
 namespace log_bits {
 
-extern std::vector<std::shared_ptr<logstream> > log_instances;
+// Each thread buffers its log messages in its own logstreams.
+extern thread_local std::vector<std::shared_ptr<logstream> > log_instances;
 
 void initiate_log_level(log_level level);
 
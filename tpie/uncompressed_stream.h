@@ -151,14 +151,17 @@ public:
 	/// \param blockFactor The block factor you pass to open.
 	/// \param includeDefaultFileAccessor Unless you are supplying your own
 	/// file accessor to open, leave this to be true.
+	/// \param readAheadDepth The depth you pass to set_read_ahead.
 	/// \returns The amount of memory maximally used by the count file_streams.
 	///////////////////////////////////////////////////////////////////////////
 	inline static memory_size_type memory_usage(
 		float blockFactor=1.0,
-		bool includeDefaultFileAccessor=true) throw() {
+		bool includeDefaultFileAccessor=true,
+		memory_size_type readAheadDepth=0) throw() {
 		// TODO
 		memory_size_type x = sizeof(uncompressed_stream);
 		x += block_memory_usage(blockFactor); // allocated in constructor
+		x += read_ahead_memory_usage(blockFactor, readAheadDepth);
 		if (includeDefaultFileAccessor)
 			x += default_file_accessor::memory_usage();
 		return x;